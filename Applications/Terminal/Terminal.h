@@ -42,6 +42,8 @@ typedef struct {
 - (void)ts_gotoX:(int)x Y:(int)y;
 - (void)ts_putChar:(screen_char_t)ch count:(int)c atX:(int)x Y:(int)y;
 - (void)ts_putChar:(screen_char_t)ch count:(int)c offset:(int)ofs;
+/* Puts `c' different characters starting at x:y. The run must fit in the row. */
+- (void)ts_putChars:(const screen_char_t *)chars count:(int)c atX:(int)x Y:(int)y;
 
 /* The portions scrolled/shifted from remain unchanged. However, it's
 assumed that they will be cleared or overwritten before the redraw is
@@ -64,6 +66,7 @@ complete. (TODO check this) */
 
 - initWithTerminalScreen:(id<TerminalScreen>)ats width:(int)w height:(int)h;
 - (void)processByte:(unsigned char)c;
+- (void)processBytes:(const unsigned char *)bytes length:(int)len;
 - (void)setTerminalScreenWidth:(int)w height:(int)h cursorY:(int)cursor_y;
 - (void)handleKeyEvent:(NSEvent *)e;
 - (void)sendString:(NSString *)str;
@@ -81,6 +81,8 @@
 
   iconv_t iconv_state;
   iconv_t iconv_input_state;
+  BOOL iconv_ascii; /* iconv_state maps printable ASCII to itself */
+  BOOL iconv_utf8;  /* iconv_state converts from UTF-8 */
 
   BOOL alternateAsMeta;
   BOOL sendDoubleEscape;
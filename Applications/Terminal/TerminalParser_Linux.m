@@ -21,6 +21,8 @@
 #include <AppKit/NSGraphics.h>
 
 #include <netinet/in.h>
+#include <stdint.h>
+#include <strings.h>
 
 /* TODO */
 #include <AppKit/NSEvent.h>
@@ -39,6 +41,30 @@ static const unichar *_set_translate(int charset)
   return translate_maps[charset];
 }
 
+/* Decodes complete 2 and 3 byte UTF-8 sequence. Returns its length or 0 if
+   it's invalid, incomplete or contains 0x9b byte (which processByte: takes
+   as CSI even inside a sequence). */
+static inline int decode_utf8(const unsigned char *s, int len, unichar *ch)
+{
+  if (s[0] >= 0xc2 && s[0] < 0xe0) {
+    if (len < 2 || (s[1] & 0xc0) != 0x80 || s[1] == 0x9b)
+      return 0;
+    *ch = ((s[0] & 0x1f) << 6) | (s[1] & 0x3f);
+    return 2;
+  }
+  if (s[0] >= 0xe0 && s[0] < 0xf0) {
+    if (len < 3 || (s[1] & 0xc0) != 0x80 || (s[2] & 0xc0) != 0x80 || s[1] == 0x9b ||
+        s[2] == 0x9b)
+      return 0;
+    if ((s[0] == 0xe0 && s[1] < 0xa0) || /* overlong */
+        (s[0] == 0xed && s[1] >= 0xa0))  /* surrogate */
+      return 0;
+    *ch = ((s[0] & 0x0f) << 12) | ((s[1] & 0x3f) << 6) | (s[2] & 0x3f);
+    return 3;
+  }
+  return 0;
+}
+
 @interface TerminalParser_Linux (private)
 
 #define csi_J(foo, vpar) [self _csi_J:vpar]
@@ -1209,6 +1235,102 @@ static unsigned char color_table[] = {0, 4, 2, 6, 1, 5, 3, 7, 8, 12, 10, 14, 9,
   }
 }
 
+/*
+  Fast path for plain text. Puts run of printable characters which need no
+  escape sequence, charset or cursor state processing straight into the
+  screen - one ts_putChars:count:atX:Y: call per row. Returns number of
+  bytes consumed; 0 means the first byte must go through processByte:.
+*/
+- (int)_putText:(const unsigned char *)bytes length:(int)len
+{
+  screen_char_t cells[256];
+  int cells_size = sizeof(cells) / sizeof(cells[0]);
+  unsigned char attr;
+  BOOL useIconv, decodeUTF8;
+  int consumed = 0;
+
+  if (vc_state != ESnormal || utf_count || input_buf_len || decim || toggle_meta ||
+      [ts useMultiCellGlyphs]) {
+    return 0;
+  }
+
+  // Same choice processByte: makes for every byte
+  useIconv = (iconv_state && translate == translate_maps[0]);
+  if (useIconv && !iconv_ascii) {
+    return 0;
+  }
+  decodeUTF8 = utf || (useIconv && iconv_utf8);
+
+  attr = (intensity) | (underline << 2) | (reverse << 3) | (blink << 4);
+
+  while (consumed < len) {
+    unsigned char c;
+    unichar code;
+    int room, n = 0, l;
+    BOOL stop = NO;
+
+    if (x >= width) {
+      if (!decawm)
+        break;
+      cr();
+      lf();
+    }
+
+    room = width - x;
+    if (room > cells_size)
+      room = cells_size;
+
+    while (n < room && consumed < len) {
+      c = bytes[consumed];
+      if (c >= 0x20 && c < 0x7f) {
+        code = useIconv ? c : translate[c];
+        consumed++;
+      } else if (c > 0x7f && decodeUTF8 && (l = decode_utf8(&bytes[consumed], len - consumed, &code))) {
+        consumed += l;
+      } else {
+        stop = YES;
+        break;
+      }
+      cells[n].ch = code;
+      cells[n].color = color;
+      cells[n].attr = attr;
+      n++;
+    }
+
+    if (n) {
+      [ts ts_putChars:cells count:n atX:x Y:y];
+      x += n;
+      [ts ts_gotoX:x Y:y];
+    }
+    if (stop)
+      break;
+  }
+
+  return consumed;
+}
+
+- (void)processBytes:(const unsigned char *)bytes length:(int)len
+{
+  SEL processByteSel = @selector(processByte:);
+  void (*processByteImp)(id, SEL, unsigned char);
+  int i = 0, n;
+
+  processByteImp = (void (*)(id, SEL, unsigned char))[self methodForSelector:processByteSel];
+
+  while (i < len) {
+    unsigned char c = bytes[i];
+
+    // Don't bother with fast path inside of escape sequences and for control
+    // characters
+    if (vc_state == ESnormal && ((c >= 0x20 && c < 0x7f) || c >= 0xc2) &&
+        (n = [self _putText:&bytes[i] length:len - i])) {
+      i += n;
+    } else {
+      processByteImp(self, processByteSel, bytes[i++]);
+    }
+  }
+}
+
 /*
   Translates '\n' to '\r' when sending.
 */
@@ -1454,16 +1576,48 @@ static unsigned char color_table[] = {0, 4, 2, 6, 1, 5, 3, 7, 8, 12, 10, 14, 9,
   }
 }
 
+// Find out if processBytes:length: may skip iconv() for the charset
+- (void)_checkIconvCharset:(const char *)iconv_charset
+{
+  char in[0x7f - 0x20];
+  uint32_t out[0x7f - 0x20];
+  char *inp = in, *outp = (char *)out;
+  size_t in_size = sizeof(in), out_size = sizeof(out);
+  int i, count = sizeof(in);
+
+  for (i = 0; i < count; i++) {
+    in[i] = 0x20 + i;
+  }
+  if (iconv(iconv_state, &inp, &in_size, &outp, &out_size) != (size_t)-1 && in_size == 0 &&
+      out_size == 0) {
+    iconv_ascii = YES;
+    for (i = 0; i < count; i++) {
+      if (ntohl(out[i]) != 0x20 + i) {
+        iconv_ascii = NO;
+        break;
+      }
+    }
+  }
+  iconv(iconv_state, NULL, NULL, NULL, NULL);
+
+  iconv_utf8 = (strcasecmp(iconv_charset, "UTF-8") == 0 || strcasecmp(iconv_charset, "UTF8") == 0);
+}
+
 - (void)setCharset:(NSString *)charsetName
 {
   const char *iconv_charset = [charsetName cString];
 
+  iconv_ascii = NO;
+  iconv_utf8 = NO;
+
   if (strcmp(iconv_charset, "ISO-8859-1")) {
     iconv_state = iconv_open("UCS-4", iconv_charset);
     if (iconv_state == (iconv_t)-1) {
       iconv_state = NULL;
       NSLog(@"Warning: unable to create iconv handle for conversion from '%s'!", iconv_charset);
       NSLog(@"Falling back to ISO-8859-1 (Latin1).");
+    } else {
+      [self _checkIconvCharset:iconv_charset];
     }
 
     iconv_input_state = iconv_open(iconv_charset, "UCS-4");
@@ -73,30 +73,46 @@ struct selection_range {
   BOOL shouldScrollBottomOnInput; /* preference */
 
   // Scrollback
-  screen_char_t *scrollback; /* scrollback buffer content storage */
+  screen_char_t *scrollback; /* scrollback buffer content storage: ring of lines */
+  int sb_top;                /* ring index of the oldest line (line -alloc_sb_depth) */
   int curr_sb_position;      /* 0 = bottom; negative value = posision */
   int max_sb_depth;          /* maximum scrollback size in lines */
   int curr_sb_depth;         /* current scrollback size in lines */
   int alloc_sb_depth;        /* current number of lines which have allocated memory for */
 
-  /* Scrolling by compositing takes a long while, so we break out of such
-     loops fairly often to process other events */
+  /* Scrolling by compositing takes a long while. Its time is a part of
+     input parsing time which is limited by readData. */
   int num_scrolls;
   /* To avoid doing lots of scrolling compositing, we combine multiple
      full-screen scrolls. pending_scroll is the combined pending line delta */
   int pending_scroll;
 
+  /* Input is parsed while parsing and redraw of the result fit into frame
+     time. Heavy output is parsed in larger batches, small writes (echo of
+     typed characters) are shown immediately. */
+  double draw_time;     /* average time of drawRect: */
+  double pending_since; /* time of oldest input which is not on screen yet */
+  BOOL isFlooded;       /* last readData was stopped by time limit */
+  struct {
+    unsigned long reads, bytes, scrolls, redraws, updates;
+    double parse_total, parse_max;
+    double draw_total, draw_max;
+    double latency_total, latency_max;
+  } stats;
+
   // ---
   // Screen - visible part of terminal contents
   // ---
   screen_char_t *screen;
   int screen_width;   // window width in characters (screen_char_t)
   int screen_height;  // window height in lines
+  screen_char_t *drawn; // last rendered contents of visible cells
 
   int cursor_x, cursor_y;
   int current_x, current_y;
 
   int draw_all; /* 0=only lazy, 1=don't know, do all, 2=do all */
+  BOOL canDrawGlyphRuns; /* fonts are monospaced: show cells with one DPSshow() */
   BOOL shouldDrawCursor;
 
   BOOL shouldIgnoreResize;
@@ -186,6 +202,7 @@ struct selection_range {
 - (BOOL)isUserProgramRunning;
 
 + (void)registerPasteboardTypes;
++ (void)renderingBenchmark;
 
 @end
 
@@ -207,6 +224,9 @@ struct selection_range {
 
 - (void)closeProgram;
 
+// Input processing and redraw timings of this window
+- (NSDictionary *)latencyStatistics;
+
 // Next 3 methods return PID of program
 - (int)runProgram:(NSString *)path withArguments:(NSArray *)args initialInput:(NSString *)d;
 - (int)runProgram:(NSString *)path
@@ -22,6 +22,7 @@
 #include <stdlib.h>
 #include <termio.h>
 #include <sys/time.h>
+#include <time.h>
 #include <sys/types.h>
 #include <unistd.h>
 #include <fcntl.h>
@@ -38,6 +39,23 @@
 #pragma mark - Definitions
 
 #define SCROLLBACK_CHANGE_STEP 1  // number of screens
+#define READ_BUFFER_SIZE 16384    // bytes read from pty at once
+#define FRAME_TIME (1.0 / 60)     // target interval of screen updates (seconds)
+#define FLOOD_FRAMES 4            // frames of input parsed at once on heavy output
+#define INTERACTIVE_SIZE 256      // input up to this size is displayed immediately
+
+/* What was rendered last time at visible cell x:y. Cells with attr 0x80
+   are unknown and always redrawn. */
+#define DRAWN(x, y) (drawn[(y) * screen_width + (x)])
+#define IS_DRAWN(d, c) ((d)->ch == (c)->ch && (d)->color == (c)->color && (d)->attr == ((c)->attr & 0x7f))
+
+static inline double monotonic_time(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
 
 /* TODO */
 @interface NSView (unlockfocus)
@@ -69,6 +87,27 @@ NSString *TerminalViewSizeDidChangeNotification = @"TerminalViewSizeDidChange";
 
 @implementation TerminalView (scrolling)
 
+/* Keep `drawn' in sync with rows of pixels moved by DPScomposite() */
+- (void)_moveDrawnRows:(int)src to:(int)dst count:(int)n
+{
+  if (!drawn || n <= 0) {
+    return;
+  }
+  memmove(&DRAWN(0, dst), &DRAWN(0, src), sizeof(screen_char_t) * screen_width * n);
+}
+
+- (void)_invalidateDrawn
+{
+  int i;
+
+  if (!drawn) {
+    return;
+  }
+  for (i = 0; i < screen_width * screen_height; i++) {
+    drawn[i].attr = 0x80;
+  }
+}
+
 /* handle accumulated pending scrolls with a single composite */
 - (void)_handlePendingScroll:(BOOL)lockFocus
 {
@@ -112,6 +151,11 @@ NSString *TerminalViewSizeDidChangeNotification = @"TerminalViewSizeDidChange";
   if (lockFocus) {
     [self unlockFocusNeedsFlush:NO];
   }
+  if (y0 > dy) {  // source is above destination: rows moved down
+    [self _moveDrawnRows:0 to:pending_scroll count:screen_height - pending_scroll];
+  } else {
+    [self _moveDrawnRows:pending_scroll to:0 count:screen_height - pending_scroll];
+  }
 
   num_scrolls++;
   pending_scroll = 0;
@@ -235,6 +279,13 @@ NSString *TerminalViewSizeDidChangeNotification = @"TerminalViewSizeDidChange";
 
 #define SCREEN(x, y) (screen[(y) * screen_width + (x)])
 
+/* Scrollback is a ring of alloc_sb_depth lines. Line -1 is the most recent
+   one, line -alloc_sb_depth is the oldest and lives at ring index sb_top. */
+#define SB_LINE(y) (&scrollback[(((y) + sb_top + alloc_sb_depth) % alloc_sb_depth) * screen_width])
+/* Character at negative offset `i' (-1 is the last character of line -1) */
+#define SB_LINES_BACK(i) ((screen_width - 1 - (i)) / screen_width)
+#define SB_CHAR(i) (SB_LINE(-SB_LINES_BACK(i))[(i) + SB_LINES_BACK(i) * screen_width])
+
 static int total_draw = 0;
 
 
@@ -394,6 +445,7 @@ static void set_foreground(NSGraphicsContext *gc, unsigned char color, unsigned
   NSFont *f, *current_font = nil;
 
   int encoding;
+  double start_time = monotonic_time(), t;
 
   NSDebugLLog(@"draw", @"drawRect: (%g %g)+(%g %g) %i\n", r.origin.x, r.origin.y, r.size.width,
               r.size.height, draw_all);
@@ -468,6 +520,22 @@ static void set_foreground(NSGraphicsContext *gc, unsigned char color, unsigned
 
 #define R(scr_x, scr_y, fx, fy) DPSrectfill(cur, scr_x, scr_y, fx, fy)
 
+    /* glyph run: cells from run_x shown with a single DPSshow() */
+    char run_buf[256];
+    int run_len, run_glyphs_len;
+    float run_x = 0;
+    unsigned char run_attr = 0, run_color = 0;
+
+#define FLUSH_RUN()                                  \
+  do {                                               \
+    if (run_glyphs_len) {                            \
+      run_buf[run_glyphs_len] = 0;                   \
+      DPSmoveto(cur, run_x + fx0, scr_y + fy0);      \
+      DPSshow(cur, run_buf);                         \
+    }                                                \
+    run_len = run_glyphs_len = 0;                    \
+  } while (0)
+
     /* Legend:
        last_color - last used color in loop
        last_attr  - last used attributes in loop
@@ -490,7 +558,7 @@ static void set_foreground(NSGraphicsContext *gc, unsigned char color, unsigned
       if (ry >= 0) {
         ch = &SCREEN(x0, ry);
       } else {
-        ch = &scrollback[x0 + (alloc_sb_depth + ry) * screen_width];
+        ch = &SB_LINE(ry)[x0];
       }
 
       scr_y = (screen_height - 1 - iy) * fy + border_y;
@@ -498,6 +566,11 @@ static void set_foreground(NSGraphicsContext *gc, unsigned char color, unsigned
       /* ~400 cycles/cell on average */
       start_x = -1;
       for (ix = x0; ix < x1; ix++, ch++) {
+        /* Cell was rewritten with the same contents: it's not dirty for
+           both passes */
+        if (!draw_all && (ch->attr & 0x80) && drawn && IS_DRAWN(&DRAWN(ix, iy), ch)) {
+          ch->attr &= 0x7f;
+        }
         /* no need to draw && not dirty */
         if (!draw_all && !(ch->attr & 0x80)) {
           if (start_x != -1) {
@@ -597,28 +670,46 @@ static void set_foreground(NSGraphicsContext *gc, unsigned char color, unsigned
     //------------------- CHARACTERS ------------------------------------------------
     last_color = -1;
     last_attr = 0;
-    /* Now draw any dirty characters */
+    /* Now draw any dirty characters. ASCII glyphs of neighbour cells with
+       the same attributes are collected into run_buf and shown at once. */
     for (iy = y0; iy < y1; iy++) {
       ry = iy + curr_sb_position;
       if (ry >= 0) {
         ch = &SCREEN(x0, ry);
       } else {
-        ch = &scrollback[x0 + (alloc_sb_depth + ry) * screen_width];
+        ch = &SB_LINE(ry)[x0];
       }
 
       scr_y = (screen_height - 1 - iy) * fy + border_y;
+      run_len = run_glyphs_len = 0;
 
       for (ix = x0; ix < x1; ix++, ch++) {
+        BOOL is_glyph, is_blank;
+
         /* no need to draw && not dirty */
         if (!draw_all && !(ch->attr & 0x80)) {
+          FLUSH_RUN();
           continue;
         }
 
         // Clear dirty bit
         ch->attr &= 0x7f;
+        if (drawn) {
+          DRAWN(ix, iy) = *ch;
+        }
 
         scr_x = ix * fx + border_x;
 
+        is_blank = (ch->ch == 0 || ch->ch == 32);
+        is_glyph = (!is_blank && ch->ch != MULTI_CELL_GLYPH);
+
+        /* Colors below are set for the run: draw it before they change */
+        if (run_len &&
+            (ch->attr != run_attr || ch->color != run_color ||
+             !(is_blank || (is_glyph && ch->ch < 0x80)))) {
+          FLUSH_RUN();
+        }
+
         //--- FOREGROUND
         /* ~1700 cycles/change */
         if ((ch->attr & 0x02) || (ch->ch != 0 && ch->ch != 32)) {
@@ -688,7 +779,7 @@ static void set_foreground(NSGraphicsContext *gc, unsigned char color, unsigned
         }
 
         //--- FONTS & ENCODING
-        if (ch->ch != 0 && ch->ch != 32 && ch->ch != MULTI_CELL_GLYPH) {
+        if (is_glyph) {
           total_draw++;
           if ((ch->attr & 3) == 2) {
             encoding = boldFont_encoding;
@@ -706,56 +797,76 @@ static void set_foreground(NSGraphicsContext *gc, unsigned char color, unsigned
             current_font = f;
           }
 
-          /* we short-circuit utf8 for performance with back-art */
-          /* TODO: short-circuit latin1 too? */
-          if (encoding == NSUTF8StringEncoding) {
-            unichar uch = ch->ch;
-            if (uch >= 0x800) {
-              buf[2] = (uch & 0x3f) | 0x80;
-              uch >>= 6;
-              buf[1] = (uch & 0x3f) | 0x80;
-              uch >>= 6;
-              buf[0] = (uch & 0x0f) | 0xe0;
-              buf[3] = 0;
-            } else if (uch >= 0x80) {
-              buf[1] = (uch & 0x3f) | 0x80;
-              uch >>= 6;
-              buf[0] = (uch & 0x1f) | 0xc0;
-              buf[2] = 0;
-            } else {
-              buf[0] = uch;
-              buf[1] = 0;
+          if (ch->ch < 0x80 && canDrawGlyphRuns) {
+            /* ASCII is the same in all encodings we use */
+            if (!run_len) {
+              run_x = scr_x;
+              run_attr = ch->attr;
+              run_color = ch->color;
+            }
+            run_buf[run_len++] = ch->ch;
+            run_glyphs_len = run_len;
+            if (run_len == sizeof(run_buf) - 1) {
+              FLUSH_RUN();
             }
           } else {
-            unichar uch = ch->ch;
-            if (uch <= 0x80) {
-              buf[0] = uch;
-              buf[1] = 0;
+            /* we short-circuit utf8 for performance with back-art */
+            /* TODO: short-circuit latin1 too? */
+            if (encoding == NSUTF8StringEncoding) {
+              unichar uch = ch->ch;
+              if (uch >= 0x800) {
+                buf[2] = (uch & 0x3f) | 0x80;
+                uch >>= 6;
+                buf[1] = (uch & 0x3f) | 0x80;
+                uch >>= 6;
+                buf[0] = (uch & 0x0f) | 0xe0;
+                buf[3] = 0;
+              } else if (uch >= 0x80) {
+                buf[1] = (uch & 0x3f) | 0x80;
+                uch >>= 6;
+                buf[0] = (uch & 0x1f) | 0xc0;
+                buf[2] = 0;
+              } else {
+                buf[0] = uch;
+                buf[1] = 0;
+              }
             } else {
-              unsigned char *pbuf = (unsigned char *)buf;
-              unsigned int dlen = sizeof(buf) - 1;
-              GSFromUnicode(&pbuf, &dlen, &uch, 1, encoding, NULL, GSUniTerminate);
+              unichar uch = ch->ch;
+              if (uch <= 0x80) {
+                buf[0] = uch;
+                buf[1] = 0;
+              } else {
+                unsigned char *pbuf = (unsigned char *)buf;
+                unsigned int dlen = sizeof(buf) - 1;
+                GSFromUnicode(&pbuf, &dlen, &uch, 1, encoding, NULL, GSUniTerminate);
+              }
             }
+            /* ~580 cycles */
+            DPSmoveto(cur, scr_x + fx0, scr_y + fy0);
+            /* baseline here for mc-case 0.65 */
+            /* ~3800 cycles */
+            DPSshow(cur, buf);
+
+            /* ~95 cycles to ARTGState -DPSshow:... */
+            /* ~343 cycles to isEmpty */
+            /* ~593 cycles to currentpoint */
+            /* ~688 cycles to transform */
+            /* ~1152 cycles to FTFont -drawString:... */
+            /* ~1375 cycles to -drawString:... setup */
+            /* ~1968 cycles cmap lookup */
+            /* ~2718 cycles sbit lookup */
+            /* ~~2750 cycles blit setup */
+            /* ~3140 cycles blit loop, empty call */
+            /* ~3140 cycles blit loop, setup */
+            /* ~3325 cycles blit loop, no write */
+            /* ~3800 cycles total */
+          }
+        } else if (is_blank && run_len) {
+          /* blanks between glyphs: trailing ones are not shown */
+          run_buf[run_len++] = ' ';
+          if (run_len == sizeof(run_buf) - 1) {
+            FLUSH_RUN();
           }
-          /* ~580 cycles */
-          DPSmoveto(cur, scr_x + fx0, scr_y + fy0);
-          /* baseline here for mc-case 0.65 */
-          /* ~3800 cycles */
-          DPSshow(cur, buf);
-
-          /* ~95 cycles to ARTGState -DPSshow:... */
-          /* ~343 cycles to isEmpty */
-          /* ~593 cycles to currentpoint */
-          /* ~688 cycles to transform */
-          /* ~1152 cycles to FTFont -drawString:... */
-          /* ~1375 cycles to -drawString:... setup */
-          /* ~1968 cycles cmap lookup */
-          /* ~2718 cycles sbit lookup */
-          /* ~~2750 cycles blit setup */
-          /* ~3140 cycles blit loop, empty call */
-          /* ~3140 cycles blit loop, setup */
-          /* ~3325 cycles blit loop, no write */
-          /* ~3800 cycles total */
         }
 
         //--- UNDERLINE
@@ -763,6 +874,7 @@ static void set_foreground(NSGraphicsContext *gc, unsigned char color, unsigned
           DPSrectfill(cur, scr_x, scr_y, fx, 1);
         }
       }
+      FLUSH_RUN();
     }
   }
 
@@ -774,6 +886,11 @@ static void set_foreground(NSGraphicsContext *gc, unsigned char color, unsigned
     x = cursor_x * fx + border_x;
     y = (screen_height - 1 - cursor_y + curr_sb_position) * fy + border_y;
 
+    /* Cell under the cursor doesn't look like its contents anymore */
+    if (drawn && cursor_y - curr_sb_position < screen_height) {
+      DRAWN(cursor_x, cursor_y - curr_sb_position).attr = 0x80;
+    }
+
     switch (cursorStyle) {
       case CURSOR_BLOCK_INVERT:  // 0
         DPScompositerect(cur, x, y, fx, fy, NSCompositeSourceIn);
@@ -793,7 +910,25 @@ static void set_foreground(NSGraphicsContext *gc, unsigned char color, unsigned
 
   NSDebugLLog(@"draw", @"total_draw=%i", total_draw);
 
+#undef FLUSH_RUN
   draw_all = 1;
+
+  t = monotonic_time();
+  if (pending_since) {
+    stats.latency_total += t - pending_since;
+    if (t - pending_since > stats.latency_max) {
+      stats.latency_max = t - pending_since;
+    }
+    stats.updates++;
+    pending_since = 0;
+  }
+  t -= start_time;
+  draw_time = draw_time * 0.75 + t * 0.25;
+  stats.draw_total += t;
+  if (t > stats.draw_max) {
+    stats.draw_max = t;
+  }
+  stats.redraws++;
 }
 
 - (BOOL)isOpaque
@@ -876,6 +1011,30 @@ static void set_foreground(NSGraphicsContext *gc, unsigned char color, unsigned
   ADD_DIRTY(0, 0, screen_width, screen_height); /* TODO */
 }
 
+- (void)ts_putChars:(const screen_char_t *)chars count:(int)c atX:(int)x Y:(int)y
+{
+  int i;
+  screen_char_t *s;
+
+  NSDebugLLog(@"ts", @"putChars: count: %i at: %i:%i", c, x, y);
+
+  if (y < 0 || y >= screen_height || x < 0) {
+    return;
+  }
+  if (x + c > screen_width) {
+    c = screen_width - x;
+  }
+  if (c <= 0) {
+    return;
+  }
+  s = &SCREEN(x, y);
+  for (i = 0; i < c; i++) {
+    s[i] = chars[i];
+    s[i].attr |= 0x80;
+  }
+  ADD_DIRTY(x, y, c, 1);
+}
+
 - (void)addDataToWriteBuffer:(const char *)data length:(int)len
 {
   if (!len) {
@@ -956,34 +1115,31 @@ static void set_foreground(NSGraphicsContext *gc, unsigned char color, unsigned
   NSDebugLLog(@"ts", @"scrollUp: %i:%i  rows: %i  save: %i", top, bottom, rows, save);
 
   if (save && (top == 0) && (bottom == screen_height)) { /* TODO? */
-    int num;
+    int num, i;
 
     if ((curr_sb_depth + rows) > alloc_sb_depth) {
       [self resizeScrollbackBuffer:YES];
     }
 
-    if (rows < alloc_sb_depth) {
-      memmove(scrollback, &scrollback[screen_width * rows],
-              sizeof(screen_char_t) * screen_width * (alloc_sb_depth - rows));
-      num = rows;
-    } else {
-      num = alloc_sb_depth;
-    }
+    num = (rows < alloc_sb_depth) ? rows : alloc_sb_depth;
 
-    if (num < screen_height) {
-      memmove(&scrollback[screen_width * (alloc_sb_depth - num)], screen,
-              num * screen_width * sizeof(screen_char_t));
-    } else {
-      memmove(&scrollback[screen_width * (alloc_sb_depth - num)], screen,
-              screen_height * screen_width * sizeof(screen_char_t));
-      /* TODO: should this use video_erase_char? */
-      memset(&scrollback[screen_width * (alloc_sb_depth - num + screen_height)], 0,
-             screen_width * (num - screen_height) * sizeof(screen_char_t));
+    /* Overwrite the oldest lines of the ring with the last `num' of the
+       scrolled out lines. Lines below the screen are blank. */
+    for (i = rows - num; i < rows; i++) {
+      screen_char_t *line = &scrollback[sb_top * screen_width];
+
+      if (i < screen_height) {
+        memcpy(line, &SCREEN(0, i), screen_width * sizeof(screen_char_t));
+      } else {
+        /* TODO: should this use video_erase_char? */
+        memset(line, 0, screen_width * sizeof(screen_char_t));
+      }
+      sb_top = (sb_top + 1) % alloc_sb_depth;
     }
 
     curr_sb_depth += num;
-    if (curr_sb_depth > max_sb_depth) {
-      curr_sb_depth = max_sb_depth;
+    if (curr_sb_depth > alloc_sb_depth) {
+      curr_sb_depth = alloc_sb_depth;
     }
   }
 
@@ -1031,6 +1187,7 @@ static void set_foreground(NSGraphicsContext *gc, unsigned char color, unsigned
       DPScomposite(GSCurrentContext(), border_x + x0, border_y + y0, w, h, [self gState],
                    border_x + dx, border_y + dy, NSCompositeCopy);
       [self unlockFocusNeedsFlush:NO];
+      [self _moveDrawnRows:top + rows to:top count:bottom - top - rows];
       num_scrolls++;
     }
   }
@@ -1078,6 +1235,7 @@ static void set_foreground(NSGraphicsContext *gc, unsigned char color, unsigned
       DPScomposite(GSCurrentContext(), border_x + x0, border_y + y0, w, h, [self gState],
                    border_x + dx, border_y + dy, NSCompositeCopy);
       [self unlockFocusNeedsFlush:NO];
+      [self _moveDrawnRows:top to:top + rows count:bottom - top - rows];
       num_scrolls++;
     }
   }
@@ -1136,6 +1294,9 @@ static void set_foreground(NSGraphicsContext *gc, unsigned char color, unsigned
     DPScomposite(GSCurrentContext(), border_x + cx0, border_y + y0, w, h, [self gState],
                  border_x + dx, border_y + dy, NSCompositeCopy);
     [self unlockFocusNeedsFlush:NO];
+    if (drawn) {
+      memmove(&DRAWN(x1, row), &DRAWN(x0, row), sizeof(screen_char_t) * c);
+    }
     num_scrolls++;
   }
   ADD_DIRTY(0, row, screen_width, 1);
@@ -1267,7 +1428,6 @@ static void set_foreground(NSGraphicsContext *gc, unsigned char color, unsigned
 
 - (NSString *)_selectionAsString
 {
-  int ofs = alloc_sb_depth * screen_width;
   NSMutableString *mstr;
   NSString *tmp;
   unichar buf[32];
@@ -1285,7 +1445,7 @@ static void set_foreground(NSGraphicsContext *gc, unsigned char color, unsigned
     ws_len = 0;
     while (1) {
       if (i < 0)
-        ch = scrollback[ofs + i].ch;
+        ch = SB_CHAR(i).ch;
       else
         ch = screen[i].ch;
 
@@ -1346,7 +1506,7 @@ static void set_foreground(NSGraphicsContext *gc, unsigned char color, unsigned
 
 - (void)_setSelection:(struct selection_range)s
 {
-  int i, j, ofs2;
+  int i, j;
 
   if (s.location < -curr_sb_depth * screen_width) {
     s.length += curr_sb_depth * screen_width + s.location;
@@ -1361,15 +1521,13 @@ static void set_foreground(NSGraphicsContext *gc, unsigned char color, unsigned
   if (s.length == selection.length && s.location == selection.location)
     return;
 
-  ofs2 = alloc_sb_depth * screen_width;
-
   j = selection.location + selection.length;
   if (j > s.location)
     j = s.location;
 
   for (i = selection.location; i < j && i < 0; i++) {
-    scrollback[ofs2 + i].attr &= 0xbf;
-    scrollback[ofs2 + i].attr |= 0x80;
+    SB_CHAR(i).attr &= 0xbf;
+    SB_CHAR(i).attr |= 0x80;
   }
   for (; i < j; i++) {
     screen[i].attr &= 0xbf;
@@ -1381,8 +1539,8 @@ static void set_foreground(NSGraphicsContext *gc, unsigned char color, unsigned
     i = selection.location;
   j = selection.location + selection.length;
   for (; i < j && i < 0; i++) {
-    scrollback[ofs2 + i].attr &= 0xbf;
-    scrollback[ofs2 + i].attr |= 0x80;
+    SB_CHAR(i).attr &= 0xbf;
+    SB_CHAR(i).attr |= 0x80;
   }
   for (; i < j; i++) {
     screen[i].attr &= 0xbf;
@@ -1392,8 +1550,8 @@ static void set_foreground(NSGraphicsContext *gc, unsigned char color, unsigned
   i = s.location;
   j = s.location + s.length;
   for (; i < j && i < 0; i++) {
-    if (!(scrollback[ofs2 + i].attr & 0x40))
-      scrollback[ofs2 + i].attr |= 0xc0;
+    if (!(SB_CHAR(i).attr & 0x40))
+      SB_CHAR(i).attr |= 0xc0;
   }
   for (; i < j; i++) {
     if (!(screen[i].attr & 0x40))
@@ -1568,13 +1726,12 @@ static void set_foreground(NSGraphicsContext *gc, unsigned char color, unsigned
   }
 
   if (g == 2) { /* select words */
-    int ofs = alloc_sb_depth * screen_width;
     unichar ch, ch2;
     NSCharacterSet *cs;
     int i, j;
 
     if (pos < 0)
-      ch = scrollback[ofs + pos].ch;
+      ch = SB_CHAR(pos).ch;
     else
       ch = screen[pos].ch;
     if (ch == 0)
@@ -1603,7 +1760,7 @@ static void set_foreground(NSGraphicsContext *gc, unsigned char color, unsigned
     j *= screen_width;
     for (i = pos - 1; i >= j; i--) {
       if (i < 0)
-        ch2 = scrollback[ofs + i].ch;
+        ch2 = SB_CHAR(i).ch;
       else
         ch2 = screen[i].ch;
       if (ch2 == 0)
@@ -1618,7 +1775,7 @@ static void set_foreground(NSGraphicsContext *gc, unsigned char color, unsigned
     j += screen_width;
     for (i = pos + 1; i < j; i++) {
       if (i < 0)
-        ch2 = scrollback[ofs + i].ch;
+        ch2 = SB_CHAR(i).ch;
       else
         ch2 = screen[i].ch;
       if (ch2 == 0)
@@ -1734,8 +1891,21 @@ static void set_foreground(NSGraphicsContext *gc, unsigned char color, unsigned
 
 - (void)readData
 {
-  char buf[256];
+  unsigned char buf[READ_BUFFER_SIZE];
   int size, total, i;
+  double start_time, t, time_limit;
+
+  start_time = t = monotonic_time();
+  /* Don't get stuck processing input forever; give other terminal windows
+     and the user a chance to do things. Parsing stops when it and the
+     following redraw would not fit into a frame. If input didn't stop
+     during previous call, a few frames are parsed at once: screen is
+     updated less often and more time is left for parsing. */
+  time_limit = (isFlooded ? FLOOD_FRAMES * FRAME_TIME : FRAME_TIME) - draw_time;
+  if (time_limit < FRAME_TIME / 4) {
+    time_limit = FRAME_TIME / 4;
+  }
+  isFlooded = NO;
 
   total = 0;
   num_scrolls = 0;
@@ -1799,28 +1969,32 @@ static void set_foreground(NSGraphicsContext *gc, unsigned char color, unsigned
       break;
     }
 
-    for (i = 0; i < size; i++) {
-      [terminalParser processByte:buf[i]];
-      // Line Feed, Vertical Tabulation, Form Feed, Carriage Return
-      if (isActivityMonitorEnabled &&
-          (buf[i] == 10 || buf[i] == 11 || buf[i] == 12 || buf[i] == 13)) {
-        // fprintf(stderr, "%i\n", buf[i]);
-        shouldUpdateTitlebar = YES;
+    [terminalParser processBytes:buf length:size];
+    // Line Feed, Vertical Tabulation, Form Feed, Carriage Return
+    if (isActivityMonitorEnabled && !shouldUpdateTitlebar) {
+      for (i = 0; i < size; i++) {
+        if (buf[i] == 10 || buf[i] == 11 || buf[i] == 12 || buf[i] == 13) {
+          shouldUpdateTitlebar = YES;
+          break;
+        }
       }
     }
     total += size;
-    /*
-      Don't get stuck processing input forever; give other terminal windows
-      and the user a chance to do things. The numbers affect latency versus
-      throughput. High numbers means more input is processed before the
-      screen is updated, leading to higher throughput but also to more
-      'jerky' updates. Low numbers would give smoother updating and less
-      latency, but throughput goes down.
-
-      TODO: tweak more? seems pretty good now
-    */
-    if (total >= 8192 || (num_scrolls + abs(pending_scroll)) > 10)
+
+    t = monotonic_time();
+    if (t - start_time >= time_limit) {
+      isFlooded = YES;
       break;
+    }
+  }
+
+  t -= start_time;
+  stats.reads++;
+  stats.bytes += total;
+  stats.scrolls += num_scrolls;
+  stats.parse_total += t;
+  if (t > stats.parse_max) {
+    stats.parse_max = t;
   }
 
   if (shouldUpdateTitlebar != NO) {
@@ -1861,9 +2035,38 @@ static void set_foreground(NSGraphicsContext *gc, unsigned char color, unsigned
     }
 
     [self _updateScroller];
+
+    if (!pending_since) {
+      pending_since = start_time;
+    }
+    // Echo of typed character: don't wait for other run loop events
+    if (!isFlooded && total <= INTERACTIVE_SIZE && master_fd != -1) {
+      [self displayIfNeeded];
+    }
   }
 }
 
+- (NSDictionary *)latencyStatistics
+{
+  unsigned long reads = stats.reads ? stats.reads : 1;
+  unsigned long redraws = stats.redraws ? stats.redraws : 1;
+  unsigned long updates = stats.updates ? stats.updates : 1;
+
+  // Times are in milliseconds
+  return @{
+    @"ReadCycles" : @(stats.reads),
+    @"BytesRead" : @(stats.bytes),
+    @"Scrolls" : @(stats.scrolls),
+    @"Redraws" : @(stats.redraws),
+    @"ParseTimeAverage" : @(stats.parse_total * 1000 / reads),
+    @"ParseTimeMax" : @(stats.parse_max * 1000),
+    @"DrawTimeAverage" : @(stats.draw_total * 1000 / redraws),
+    @"DrawTimeMax" : @(stats.draw_max * 1000),
+    @"LatencyAverage" : @(stats.latency_total * 1000 / updates),
+    @"LatencyMax" : @(stats.latency_max * 1000)
+  };
+}
+
 - (void)writeData
 {
   NSLog(@"Will write data");
@@ -1914,6 +2117,7 @@ static void set_foreground(NSGraphicsContext *gc, unsigned char color, unsigned
   if (master_fd == -1)
     return;
   NSDebugLLog(@"pty", @"closing master fd=%i\n", master_fd);
+  NSDebugLLog(@"latency", @"%@", [self latencyStatistics]);
 
   [[NSRunLoop currentRunLoop] removeEvent:(void *)(intptr_t)master_fd
                                      type:ET_RDESC
@@ -2178,91 +2382,81 @@ static int handled_mask = (NSDragOperationCopy | NSDragOperationPrivate | NSDrag
 //
 // General idea:
 // - initially allocate memory for SCROLLBACK_CHANGE_STEP terminal screens
-// - realloc scrollback buffer by SCROLLBACK_CHANGE_STEP screens until max_sb_depth will be reached
+// - grow scrollback buffer twice (but not less than SCROLLBACK_CHANGE_STEP screens)
+//   until max_sb_depth will be reached
 // - on window resize or preference change buffer size should be recalculated
 //
-// Grow/shrink minimum step is 1 screen.
+// Buffer is a ring of lines (see SB_LINE()): growing reallocs it and moves
+// only the wrapped around part of used lines to the end of new buffer.
+//
 // Depth (_depth in var names) is a number of lines.
 // Size (_size in var names) is a number of characters.
 //
-// Changes: scrollback, alloc_sb_depth. May change curr_sb_depth on buffer shrinking.
+// Changes: scrollback, sb_top, alloc_sb_depth. May change curr_sb_depth on buffer shrinking.
 - (BOOL)changeScrollBackBufferDepth:(int)lines
 {
   screen_char_t *new_scrollback;
-  int char_size = sizeof(screen_char_t);
+  size_t line_size = sizeof(screen_char_t) * screen_width;
   int new_sb_depth;  // lines
-  int new_sb_size;   // characters
 
   // There's nothing to do here
-  if (alloc_sb_depth == lines || lines == 0) {
+  if (alloc_sb_depth == lines || lines <= 0) {
     return YES;
   }
 
   // Check `lines` value for limits
-  if (lines < alloc_sb_depth) {
-    new_sb_depth = lines;
-  } else if ((lines * screen_width) >= SCROLLBACK_MAX) {
+  new_sb_depth = lines;
+  if (new_sb_depth > SCROLLBACK_MAX / screen_width) {
     new_sb_depth = SCROLLBACK_MAX / screen_width;
-  } else {
-    new_sb_depth = alloc_sb_depth + (screen_height * SCROLLBACK_CHANGE_STEP);
   }
-
   if (new_sb_depth > max_sb_depth) {
     new_sb_depth = max_sb_depth;
   }
-
-  new_sb_size = char_size * screen_width * new_sb_depth;
+  if (new_sb_depth == alloc_sb_depth) {
+    return YES;
+  }
 
   // Memory operations
   if (scrollback == NULL || alloc_sb_depth == 0) {  // Initialize
-    new_scrollback = malloc(new_sb_size);
+    new_scrollback = malloc(line_size * new_sb_depth);
     if (new_scrollback == NULL) {
       NSLog(@"EROOR: failed to allocate scrollback buffer of depth %d (error: %s)", new_sb_depth,
             strerror(errno));
       return NO;
     }
-  } else {  // Grow or shrink
-    int used_sb_size = char_size * curr_sb_depth * screen_width;
-    int used_sb_start = (char_size * alloc_sb_depth * screen_width) - used_sb_size;
-    screen_char_t *used_sb_copy = malloc(used_sb_size);
-
-    // Save scrollback contents
-    memcpy(used_sb_copy, &scrollback[used_sb_start], used_sb_size);
-
-    // fprintf(stderr, "==========================================> used_sb_copy: \n");
-    // for (int i = 0; i < (curr_sb_depth * screen_width); i++) {
-    //   fprintf(stderr, "%c", used_sb_copy[i].ch);
-    // }
-    // fprintf(stderr, "<==========================================\n");
+    sb_top = 0;
+  } else if (new_sb_depth > alloc_sb_depth) {  // Grow
+    // Used lines which are wrapped around the end of the ring
+    int wrapped = curr_sb_depth - sb_top;
 
-    new_scrollback = realloc(scrollback, new_sb_size);
+    new_scrollback = realloc(scrollback, line_size * new_sb_depth);
     if (new_scrollback == NULL) {
       NSLog(@"ERROR: failed to re-allocate scrollback buffer to %d lines (error: %s)\n",
             new_sb_depth, strerror(errno));
-      free(used_sb_copy);
       return NO;
     }
-    memset(new_scrollback, 0, new_sb_size);
-
-    // Restore scrollback contents
-    int new_sb_offset;
-    int used_sb_offset;
-    
-    if (used_sb_size > new_sb_size) { // Shrink
-      new_sb_offset = 0;
-      used_sb_offset = (used_sb_size / char_size) - (new_sb_size / char_size);
-      used_sb_size = new_sb_size;
-    } else { // Grow
-      new_sb_offset = (new_sb_size / char_size) - (used_sb_size / char_size);
-      used_sb_offset = 0;
+    // Oldest line stays at sb_top: it's the first line of the gap between
+    // most recent and moved lines.
+    if (wrapped > 0) {
+      memmove((char *)new_scrollback + line_size * (new_sb_depth - wrapped),
+              (char *)new_scrollback + line_size * (alloc_sb_depth - wrapped),
+              line_size * wrapped);
     }
+  } else {  // Shrink: keep most recent lines
+    int keep = (curr_sb_depth < new_sb_depth) ? curr_sb_depth : new_sb_depth;
+    int y;
 
-    // fprintf(stderr, "new_sb_size: %i, used_sb_size: %i, new chars: %lu, used chars: %lu\n",
-    //         new_sb_size, used_sb_size, new_sb_size/sizeof(screen_char_t),
-    //         used_sb_size/sizeof(screen_char_t));
-
-    memcpy(&new_scrollback[new_sb_offset], &used_sb_copy[used_sb_offset], used_sb_size);
-    free(used_sb_copy);
+    new_scrollback = malloc(line_size * new_sb_depth);
+    if (new_scrollback == NULL) {
+      NSLog(@"ERROR: failed to re-allocate scrollback buffer to %d lines (error: %s)\n",
+            new_sb_depth, strerror(errno));
+      return NO;
+    }
+    for (y = -keep; y < 0; y++) {
+      memcpy((char *)new_scrollback + line_size * (new_sb_depth + y), SB_LINE(y), line_size);
+    }
+    free(scrollback);
+    sb_top = 0;
   }
 
   // Debugging info
@@ -2297,6 +2491,12 @@ static int handled_mask = (NSDragOperationCopy | NSDragOperationPrivate | NSDrag
     return NO;
   }
 
+  // Grow geometrically: with a large scrollback a step of one screen means
+  // thousands of reallocations.
+  if (shouldGrow && alloc_sb_depth > change_size) {
+    change_size = alloc_sb_depth;
+  }
+
   new_sb_depth = alloc_sb_depth + (shouldGrow ? change_size : -change_size);
 
   if (new_sb_depth > max_sb_depth) {
@@ -2328,6 +2528,8 @@ static int handled_mask = (NSDragOperationCopy | NSDragOperationPrivate | NSDrag
 
   screen = malloc(sizeof(screen_char_t) * screen_width * screen_height);
   memset(screen, 0, sizeof(screen_char_t) * screen_width * screen_height);
+  drawn = malloc(sizeof(screen_char_t) * screen_width * screen_height);
+  [self _invalidateDrawn];
   draw_all = 2;
 
   shouldScrollBottomOnInput = [defaults scrollBottomOnInput];
@@ -2380,8 +2582,10 @@ static int handled_mask = (NSDragOperationCopy | NSDragOperationPrivate | NSDrag
 
   free(screen);
   free(scrollback);
+  free(drawn);
   screen = NULL;
   scrollback = NULL;
+  drawn = NULL;
 
   DESTROY(additionalWordCharacters);
   DESTROY(font);
@@ -2508,7 +2712,7 @@ static int handled_mask = (NSDragOperationCopy | NSDragOperationPrivate | NSDrag
     // fprintf(stderr, "* iy=%i ny=%i\n", iy, ny);
 
     if (iy < 0) {
-      src = &scrollback[screen_width * (alloc_sb_depth + iy)];
+      src = SB_LINE(iy);
     } else {
       src = &screen[screen_width * iy];
     }
@@ -2545,6 +2749,11 @@ static int handled_mask = (NSDragOperationCopy | NSDragOperationPrivate | NSDrag
   free(scrollback);
   screen = nscreen;
   scrollback = new_sb_buffer;
+  sb_top = 0;
+
+  free(drawn);
+  drawn = malloc(sizeof(screen_char_t) * screen_width * screen_height);
+  [self _invalidateDrawn];
 
   if (cursor_x > screen_width) {
     cursor_x = screen_width - 1;
@@ -2600,48 +2809,24 @@ static int handled_mask = (NSDragOperationCopy | NSDragOperationPrivate | NSDrag
 // - (NSString *)stringForRange:(struct selection_range)range
 - (NSString *)stringRepresentation
 {
-  int ofs = alloc_sb_depth * screen_width;
   NSMutableString *mstr = [[NSMutableString alloc] init];
   NSString *tmp;
-  unichar buf[32];
-  unichar ch;
-  int start_index, end_index;
-  int len;
-
-  if (curr_sb_depth > 0) {
-    start_index = -(curr_sb_depth * screen_width);
-  } else {
-    start_index = 0;
-  }
-  end_index = screen_width * screen_height;
-  // j = abs(curr_sb_depth * sx) + range.length;
-  // range.length = scrollbuffer size + visible area size in terms of chars
-  len = 0;
-  for (int i = start_index; i < end_index; i++) {
-    if (i < 0) {
-      ch = scrollback[ofs + i].ch;
-    } else {
-      ch = screen[i].ch;
-    }
-    if (i >= end_index) {
-      break;
-    }
-
-    buf[len++] = ch;
-
-    if (len == 32) {
-      tmp = [[NSString alloc] initWithCharacters:buf length:32];
-      [mstr appendString:tmp];
-      DESTROY(tmp);
-      len = 0;
+  unichar *buf;
+  screen_char_t *line;
+  int y, x;
+
+  // range = scrollbuffer size + visible area size in terms of chars
+  buf = malloc(screen_width * sizeof(unichar));
+  for (y = -curr_sb_depth; y < screen_height; y++) {
+    line = (y < 0) ? SB_LINE(y) : &SCREEN(0, y);
+    for (x = 0; x < screen_width; x++) {
+      buf[x] = line[x].ch;
     }
-  }
-
-  if (len) {
-    tmp = [[NSString alloc] initWithCharacters:buf length:len];
+    tmp = [[NSString alloc] initWithCharacters:buf length:screen_width];
     [mstr appendString:tmp];
     DESTROY(tmp);
   }
+  free(buf);
 
   NSLog(@"TerminalView stringRepresentation length: %lu", [mstr length]);
 
@@ -2711,6 +2896,7 @@ static int handled_mask = (NSDragOperationCopy | NSDragOperationPrivate | NSDrag
   NSDebugLLog(@"term", @"Bounding (%g %g)+(%g %g)", -fx0, -fy0, fx, fy);
   NSDebugLLog(@"term", @"Normal font encoding %i", font_encoding);
 
+  [self _updateCanDrawGlyphRuns];
   draw_all = 2;
 }
 
@@ -2722,9 +2908,26 @@ static int handled_mask = (NSDragOperationCopy | NSDragOperationPrivate | NSDrag
 
   NSDebugLLog(@"term", @"Bold font encoding %i", boldFont_encoding);
 
+  [self _updateCanDrawGlyphRuns];
   draw_all = 2;
 }
 
+/* Glyph advancement must be equal to cell width to show several cells
+   with one DPSshow(). */
+- (void)_updateCanDrawGlyphRuns
+{
+  canDrawGlyphRuns = NO;
+
+  if (!font || ![font isFixedPitch] || fabs([font advancementForGlyph:'M'].width - fx) > 0.01) {
+    return;
+  }
+  if (boldFont &&
+      (![boldFont isFixedPitch] || fabs([boldFont advancementForGlyph:'M'].width - fx) > 0.01)) {
+    return;
+  }
+  canDrawGlyphRuns = YES;
+}
+
 - (int)scrollBufferLength
 {
   return curr_sb_depth;
@@ -2748,8 +2951,13 @@ static int handled_mask = (NSDragOperationCopy | NSDragOperationPrivate | NSDrag
     return YES;
   }
 
-  [self changeScrollBackBufferDepth:lines];
-  
+  // Buffer grows on demand: shrink it or allocate the first chunk only
+  if (alloc_sb_depth == 0) {
+    [self resizeScrollbackBuffer:YES];
+  } else if (lines < alloc_sb_depth) {
+    [self changeScrollBackBufferDepth:lines];
+  }
+
   return YES;
 }
 
@@ -2980,4 +3188,87 @@ static int handled_mask = (NSDragOperationCopy | NSDragOperationPrivate | NSDrag
   fprintf(stderr, "%8.4f  %8.5f/redraw   total_draw=%i\n", t2, t2 / i, total_draw);
 }
 
+// Fill screen with text of `ls -l`: few colors, long blank tails.
+// Worst case: every cell has its own colors and attributes.
+- (void)_fillBenchmarkScreen:(BOOL)worstCase
+{
+  const char *line = "-rw-r--r--  1 user users   48211 Oct 17 10:12 TerminalView.m";
+  int len = strlen(line);
+  screen_char_t *ch;
+  int x, y;
+
+  for (y = 0; y < screen_height; y++) {
+    for (x = 0; x < screen_width; x++) {
+      ch = &SCREEN(x, y);
+      if (worstCase) {
+        ch->ch = '!' + (x + y) % 94;
+        ch->color = (x * 7 + y) & 0xff;
+        ch->attr = ((x + y) % 3) | ((x % 5 == 0) ? 0x04 : 0) | ((y % 4 == 0) ? 0x08 : 0) | 0x80;
+      } else {
+        ch->ch = x < len ? line[x] : 0;
+        ch->color = (y % 8 == 0 && x > 45 && x < len) ? 0xf4 : 0xff;
+        ch->attr = 0x01 | 0x80;
+      }
+    }
+  }
+}
+
+- (double)_benchmarkRedraws:(int)count
+                     inRect:(NSRect)r
+                  drawAllOf:(int)all
+                changeRow:(BOOL)change
+{
+  double t;
+  int i, x;
+
+  t = [NSDate timeIntervalSinceReferenceDate];
+  for (i = 0; i < count; i++) {
+    if (change) {
+      for (x = 0; x < screen_width; x++) {
+        SCREEN(x, i % screen_height).ch = '!' + (x + i) % 94;
+        SCREEN(x, i % screen_height).attr |= 0x80;
+      }
+    }
+    draw_all = all;
+    [self drawRect:r];
+  }
+  t = [NSDate timeIntervalSinceReferenceDate] - t;
+
+  return count / t;
+}
+
+// Rendering performance without terminal window: draws 200x60 screen into
+// offscreen image. Run with `Terminal -RenderBenchmark YES`.
++ (void)renderingBenchmark
+{
+  TerminalView *view;
+  NSImage *image;
+  NSRect r;
+  int i;
+
+  view = [[TerminalView alloc] initWithPreferences:[Defaults shared]];
+  r = NSMakeRect(0, 0, 200 * view->fx + view->border_x + 0.5, 60 * view->fy + view->border_y + 0.5);
+  [view setFrame:r];
+  image = [[NSImage alloc] initWithSize:r.size];
+
+  fprintf(stderr, "screen %ix%i, glyph runs %s\n", view->screen_width, view->screen_height,
+          view->canDrawGlyphRuns ? "on" : "off");
+  fprintf(stderr, "%-10s %12s %12s %12s\n", "screen", "full fps", "1 row fps", "idle fps");
+
+  [image lockFocus];
+  for (i = 0; i < 2; i++) {
+    double full, row, idle;
+
+    [view _fillBenchmarkScreen:(i == 1)];
+    full = [view _benchmarkRedraws:50 inRect:r drawAllOf:2 changeRow:NO];
+    row = [view _benchmarkRedraws:200 inRect:r drawAllOf:0 changeRow:YES];
+    idle = [view _benchmarkRedraws:200 inRect:r drawAllOf:0 changeRow:NO];
+    fprintf(stderr, "%-10s %12.1f %12.1f %12.1f\n", i ? "all-colors" : "typical", full, row, idle);
+  }
+  [image unlockFocus];
+
+  [image release];
+  [view release];
+}
+
 @end
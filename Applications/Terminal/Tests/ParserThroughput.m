@@ -0,0 +1,284 @@
+/*
+  Parser throughput: feeds recorded pty streams to TerminalParser_Linux
+  byte by byte (processByte:) and in read sized chunks (processBytes:length:),
+  reports MB/s of both and checks they leave the same screen contents.
+
+  Record streams with script(1), e.g.:
+    script -q -c "make" build.log
+    script -q -c "ls -lR /usr" ls-lR.log
+    script -q -c "vim TerminalView.m" vim.log
+
+  Usage: ParserThroughput [-c charset] [-w width] [-h height] file...
+*/
+
+#import <Foundation/Foundation.h>
+
+#import "../Terminal.h"
+#import "../TerminalParser_Linux.h"
+
+// Stand-in for Defaults: parser asks it for initial settings
+@interface NullPreferences : NSObject
+{
+  NSString *characterSet;
+}
+- initWithCharacterSet:(NSString *)charset;
+@end
+
+@implementation NullPreferences
+- initWithCharacterSet:(NSString *)charset
+{
+  self = [super init];
+  characterSet = [charset copy];
+  return self;
+}
+- (void)dealloc
+{
+  [characterSet release];
+  [super dealloc];
+}
+- (NSString *)characterSet
+{
+  return characterSet;
+}
+- (BOOL)doubleEscape
+{
+  return NO;
+}
+- (BOOL)alternateAsMeta
+{
+  return NO;
+}
+@end
+
+// TerminalView without view: keeps screen contents only
+@interface NullScreen : NSObject <TerminalScreen>
+{
+  NullPreferences *preferences;
+@public
+  screen_char_t *screen;
+  int width, height;
+  int cursor_x, cursor_y;
+}
+- initWithWidth:(int)w height:(int)h charset:(NSString *)charset;
+@end
+
+#define SCREEN(x, y) (screen[(y) * width + (x)])
+
+@implementation NullScreen
+
+- initWithWidth:(int)w height:(int)h charset:(NSString *)charset
+{
+  self = [super init];
+  width = w;
+  height = h;
+  screen = calloc(w * h, sizeof(screen_char_t));
+  preferences = [[NullPreferences alloc] initWithCharacterSet:charset];
+  return self;
+}
+
+- (void)dealloc
+{
+  free(screen);
+  [preferences release];
+  [super dealloc];
+}
+
+- (void)ts_sendCString:(const char *)str
+{
+}
+- (void)ts_sendCString:(const char *)msg length:(int)len
+{
+}
+
+- (void)ts_gotoX:(int)x Y:(int)y
+{
+  cursor_x = x;
+  cursor_y = y;
+}
+
+- (void)ts_putChar:(screen_char_t)ch count:(int)c atX:(int)x Y:(int)y
+{
+  if (y < 0 || y >= height)
+    return;
+  if (x + c > width)
+    c = width - x;
+  if (x < 0) {
+    c += x;
+    x = 0;
+  }
+  for (; c > 0; c--)
+    SCREEN(x++, y) = ch;
+}
+
+- (void)ts_putChar:(screen_char_t)ch count:(int)c offset:(int)ofs
+{
+  if (ofs + c > width * height)
+    c = width * height - ofs;
+  if (ofs < 0) {
+    c += ofs;
+    ofs = 0;
+  }
+  for (; c > 0; c--)
+    screen[ofs++] = ch;
+}
+
+- (void)ts_putChars:(const screen_char_t *)chars count:(int)c atX:(int)x Y:(int)y
+{
+  if (y < 0 || y >= height || x < 0)
+    return;
+  if (x + c > width)
+    c = width - x;
+  if (c > 0)
+    memcpy(&SCREEN(x, y), chars, c * sizeof(screen_char_t));
+}
+
+- (void)ts_scrollUpTop:(int)top bottom:(int)bottom rows:(int)nr save:(BOOL)save
+{
+  if ((top + nr) >= bottom)
+    nr = bottom - top - 1;
+  if (bottom > height || top >= bottom || nr < 1)
+    return;
+  memmove(&SCREEN(0, top), &SCREEN(0, top + nr), (bottom - top - nr) * width * sizeof(screen_char_t));
+}
+
+- (void)ts_scrollDownTop:(int)top bottom:(int)bottom rows:(int)nr
+{
+  if ((top + nr) >= bottom)
+    nr = bottom - top - 1;
+  if (bottom > height || top >= bottom || nr < 1)
+    return;
+  memmove(&SCREEN(0, top + nr), &SCREEN(0, top), (bottom - top - nr) * width * sizeof(screen_char_t));
+}
+
+- (void)ts_shiftRow:(int)y at:(int)x0 delta:(int)d
+{
+  int x1 = x0 + d, c = width - x0;
+
+  if (y < 0 || y >= height || x0 < 0 || x0 >= width)
+    return;
+  if (x1 < 0) {
+    x0 -= x1;
+    c += x1;
+    x1 = 0;
+  }
+  if (x1 + c > width)
+    c = width - x1;
+  if (c > 0)
+    memmove(&SCREEN(x1, y), &SCREEN(x0, y), c * sizeof(screen_char_t));
+}
+
+- (screen_char_t)ts_getCharAtX:(int)x Y:(int)y
+{
+  return SCREEN(x, y);
+}
+
+- (void)ts_setTitle:(NSString *)new_title type:(int)title_type
+{
+}
+
+- (id)preferences
+{
+  return preferences;
+}
+
+- (BOOL)useMultiCellGlyphs
+{
+  return NO;
+}
+
+- (int)relativeWidthOfCharacter:(unichar)ch
+{
+  return 1;
+}
+
+@end
+
+#define CHUNK_SIZE 16384 // TerminalView reads that much at once
+
+static double runParser(NSData *stream, NullScreen *ts, BOOL bulk)
+{
+  TerminalParser_Linux *parser;
+  const unsigned char *bytes = [stream bytes];
+  NSUInteger length = [stream length];
+  NSUInteger i, n;
+  NSDate *start;
+  double time;
+
+  parser = [[TerminalParser_Linux alloc] initWithTerminalScreen:ts
+                                                          width:ts->width
+                                                         height:ts->height];
+  start = [NSDate date];
+  if (bulk) {
+    for (i = 0; i < length; i += n) {
+      n = (length - i < CHUNK_SIZE) ? length - i : CHUNK_SIZE;
+      [parser processBytes:&bytes[i] length:n];
+    }
+  } else {
+    for (i = 0; i < length; i++) {
+      [parser processByte:bytes[i]];
+    }
+  }
+  time = -[start timeIntervalSinceNow];
+  [parser release];
+
+  return time;
+}
+
+int main(int argc, char *argv[])
+{
+  NSAutoreleasePool *pool = [NSAutoreleasePool new];
+  NSString *charset = @"UTF-8";
+  int width = 80, height = 25;
+  int i, failed = 0;
+
+  for (i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "-c") && i + 1 < argc) {
+      charset = [NSString stringWithCString:argv[++i]];
+    } else if (!strcmp(argv[i], "-w") && i + 1 < argc) {
+      width = atoi(argv[++i]);
+    } else if (!strcmp(argv[i], "-h") && i + 1 < argc) {
+      height = atoi(argv[++i]);
+    } else {
+      break;
+    }
+  }
+  if (i == argc || width < 1 || height < 1) {
+    fprintf(stderr, "Usage: %s [-c charset] [-w width] [-h height] file...\n", argv[0]);
+    return 1;
+  }
+
+  for (; i < argc; i++) {
+    NSData *stream = [NSData dataWithContentsOfFile:[NSString stringWithCString:argv[i]]];
+    NullScreen *bytewise, *bulk;
+    double mb, t_byte, t_bulk;
+    BOOL same;
+
+    if (stream == nil) {
+      fprintf(stderr, "%s: can't read\n", argv[i]);
+      failed++;
+      continue;
+    }
+    mb = [stream length] / (1024.0 * 1024.0);
+
+    bytewise = [[NullScreen alloc] initWithWidth:width height:height charset:charset];
+    bulk = [[NullScreen alloc] initWithWidth:width height:height charset:charset];
+    t_byte = runParser(stream, bytewise, NO);
+    t_bulk = runParser(stream, bulk, YES);
+
+    same = (memcmp(bytewise->screen, bulk->screen, width * height * sizeof(screen_char_t)) == 0 &&
+            bytewise->cursor_x == bulk->cursor_x && bytewise->cursor_y == bulk->cursor_y);
+    if (!same) {
+      failed++;
+    }
+
+    printf("%s: %.1f MB  processByte: %.1f MB/s  processBytes:length: %.1f MB/s  %s\n", argv[i],
+           mb, mb / t_byte, mb / t_bulk, same ? "" : "SCREEN MISMATCH");
+
+    [bytewise release];
+    [bulk release];
+  }
+
+  [pool release];
+
+  return failed ? 1 : 0;
+}
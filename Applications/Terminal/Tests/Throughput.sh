@@ -0,0 +1,34 @@
+#!/bin/sh
+# Output throughput: cat of a large file with scrollback filling up.
+# Run inside Terminal window. Set large "Scrollback" in preferences
+# (e.g. 100000 lines) to measure scrollback overhead.
+#
+# Usage: Throughput.sh [size in MB (default 500)]
+
+SIZE_MB=${1:-500}
+FILE=`mktemp /tmp/Throughput.XXXXXX`
+
+trap 'rm -f "$FILE"' EXIT
+
+# Log-like lines of ~90 characters
+awk -v size=$((SIZE_MB * 1024 * 1024)) 'BEGIN {
+  line = "";
+  while (length(line) < 80) line = line "0123456789abcdef";
+  for (n = 0; written < size; n++) {
+    s = sprintf("%08d %s", n, line);
+    print s;
+    written += length(s) + 1;
+  }
+}' > "$FILE"
+
+LINES=`wc -l < "$FILE"`
+
+START=`date +%s.%N`
+cat "$FILE"
+END=`date +%s.%N`
+
+awk -v s=$START -v e=$END -v mb=$SIZE_MB -v lines=$LINES 'BEGIN {
+  t = e - s;
+  printf("\n%d MB, %d lines in %.2f s: %.1f MB/s, %.0f lines/s\n",
+         mb, lines, t, mb / t, lines / t);
+}'
@@ -16,7 +16,9 @@
   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
 */
 
+#import <Foundation/NSAutoreleasePool.h>
 #import <Foundation/NSDebug.h>
+#import <Foundation/NSUserDefaults.h>
 
 #import <AppKit/NSApplication.h>
 #import <AppKit/NSMenu.h>
@@ -61,5 +63,16 @@
 
 int main(int argc, const char **argv)
 {
+  NSAutoreleasePool *pool = [NSAutoreleasePool new];
+
+  // Headless drawing performance check: `Terminal -RenderBenchmark YES`
+  if ([[NSUserDefaults standardUserDefaults] boolForKey:@"RenderBenchmark"]) {
+    [TerminalApplication sharedApplication];
+    [TerminalView renderingBenchmark];
+    [pool release];
+    return 0;
+  }
+  [pool release];
+
   return NSApplicationMain(argc, argv);
 }
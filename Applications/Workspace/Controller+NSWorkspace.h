@@ -225,6 +225,12 @@ APPKIT_EXPORT NSString *NSShellCommandFileType;
 /** Returns an icon of directory in opened state.*/
 - (NSImage *)iconForOpenedDirectory:(NSString *)fullPath;
 
+// ADDON
+/** Looks into contents of the files in dirPath which have no known
+    extension, all at once. Following iconForFile: calls for these files
+    get the file types from NXTFileManager's cache.*/
+- (void)prepareIconsForFiles:(NSArray *)fileNames inDirectory:(NSString *)dirPath;
+
 // ADDON
 /** Gets the applications cache (generated by the make_services tool)
     and looks up the special entry that contains a dictionary of all
@@ -47,6 +47,7 @@
 #import <DesktopKit/NXTFileManager.h>
 
 #import "Viewers/FileViewer.h"
+#import "Viewers/IconLoader.h"
 #import "WMNotificationCenter.h"
 #import "Processes/ProcessManager.h"
 #import "Workspace+WM.h"
@@ -55,9 +56,16 @@
 #define PosixExecutePermission (0111)
 
 #define FILE_CONTENTS_SCAN_SIZE 100
+#define IMAGE_FILE_CACHE_MAX 1000
 
 static NSMutableDictionary *folderPathIconDict = nil;
 static NSMutableDictionary *folderIconCache = nil;
+// Icons are resolved by IconLoader threads too. The lock guards icon
+// caches (_iconMap, folderIconCache, imageFileCache and the lazily created
+// images below) and replacement of _extPreferences and _appList.
+static NSRecursiveLock *iconLock = nil;
+// Decoded images of icon files: path -> @[modification date, image]
+static NSMutableDictionary *imageFileCache = nil;
 
 static NSImage *folderImage = nil;
 static NSImage *multipleFiles = nil;
@@ -190,6 +198,8 @@ static NSString *_rootPath = @"/";
   [folderPathIconDict setObject:@"NXHomeDirectory" forKey:NSHomeDirectory()];
   [folderPathIconDict setObject:@"NXRoot" forKey:_rootPath];
   folderIconCache = [[NSMutableDictionary alloc] init];
+  imageFileCache = [[NSMutableDictionary alloc] init];
+  iconLock = [[NSRecursiveLock alloc] init];
 
   // list of extensions of wrappers (will be shown as plain file in Workspace)
   _wrappers = [@"(bundle, preferences, inspector, service)" propertyList];
@@ -653,17 +663,21 @@ static NSLock *raceLock = nil;
         if (iconName != nil) {
           NSImage *iconImage;
 
+          [iconLock lock];
           iconImage = [folderIconCache objectForKey:iconName];
           if (iconImage == nil) {
             iconImage = [NSImage _standardImageWithName:iconName];
             /* the dictionary retains the image */
             [folderIconCache setObject:iconImage forKey:iconName];
           }
+          [iconLock unlock];
           image = iconImage;
         } else {
+          [iconLock lock];
           if (folderImage == nil) {
             folderImage = RETAIN([NSImage _standardImageWithName:@"NXFolder"]);
           }
+          [iconLock unlock];
           image = folderImage;
         }
       }
@@ -685,9 +699,11 @@ static NSLock *raceLock = nil;
     // By executable bit
     if (image == nil && ([fileType isEqual:NSFileTypeRegular] == YES) &&
         ([fileManager isExecutableFileAtPath:fullPath] == YES)) {
+      [iconLock lock];
       if (unknownTool == nil) {
         unknownTool = RETAIN([NSImage _standardImageWithName:@"NXTool"]);
       }
+      [iconLock unlock];
       image = unknownTool;
     }
 
@@ -702,6 +718,22 @@ static NSLock *raceLock = nil;
   return image;
 }
 
+- (void)prepareIconsForFiles:(NSArray *)fileNames inDirectory:(NSString *)dirPath
+{
+  NSMutableArray *unknownFiles = [NSMutableArray array];
+  NSImage *image;
+
+  for (NSString *fileName in fileNames) {
+    image = [self _iconForExtension:[fileName pathExtension]];
+    if (image == nil || image == [self _unknownFiletypeImage]) {
+      [unknownFiles addObject:fileName];
+    }
+  }
+  if ([unknownFiles count] > 0) {
+    [[NXTFileManager defaultManager] mimeTypesForFiles:unknownFiles inDirectory:dirPath];
+  }
+}
+
 - (NSImage *)iconForFiles:(NSArray *)pathArray
 {
   if ([pathArray count] == 1) {
@@ -764,9 +796,15 @@ static NSLock *raceLock = nil;
 {
   NSDictionary *map;
 
+  NSDictionary *apps;
+
   ext = [ext lowercaseString];
+  [iconLock lock];
   map = [_appList objectForKey:@"GSExtensionsMap"];
-  return [map objectForKey:ext];
+  apps = [[[map objectForKey:ext] retain] autorelease];
+  [iconLock unlock];
+
+  return apps;
 }
 
 //-------------------------------------------------------------------------------------------------
@@ -933,8 +971,10 @@ static NSLock *raceLock = nil;
   }
   [map setObject:inf forKey:ext];
   RELEASE(inf);
+  [iconLock lock];
   RELEASE(_extPreferences);
   _extPreferences = map;
+  [iconLock unlock];
   data = [NSSerializer serializePropertyList:_extPreferences];
   if ([data writeToFile:_extPreferencesPath atomically:YES]) {
     // [NSNotificationCenter defaultCenter] postNotificationName:GSWorkspacePreferencesChanged
@@ -1100,17 +1140,34 @@ static NSLock *raceLock = nil;
 {
   static NSImage *image = nil;
 
+  [iconLock lock];
   if (image == nil) {
     image = RETAIN([NSImage _standardImageWithName:@"NXUnknown"]);
   }
+  [iconLock unlock];
 
   return image;
 }
 
-/** Try to create the image in an exception handling context */
+/** Try to create the image in an exception handling context. Images are
+    cached until the file is modified. */
 - (NSImage *)_imageFromFile:(NSString *)iconPath
 {
   NSImage *tmp = nil;
+  NSDate *modDate;
+  NSArray *cached;
+
+  modDate = [[[NSFileManager defaultManager] fileAttributesAtPath:iconPath traverseLink:YES]
+      fileModificationDate];
+  [iconLock lock];
+  cached = [imageFileCache objectForKey:iconPath];
+  if (cached != nil && [[cached objectAtIndex:0] isEqualToDate:modDate]) {
+    tmp = [[[cached objectAtIndex:1] retain] autorelease];
+  }
+  [iconLock unlock];
+  if (tmp != nil) {
+    return tmp;
+  }
 
   NS_DURING
   {
@@ -1125,6 +1182,15 @@ static NSLock *raceLock = nil;
   }
   NS_ENDHANDLER
 
+  if (tmp != nil && modDate != nil) {
+    [iconLock lock];
+    if ([imageFileCache count] >= IMAGE_FILE_CACHE_MAX) {
+      [imageFileCache removeAllObjects];
+    }
+    [imageFileCache setObject:@[ modDate, tmp ] forKey:iconPath];
+    [iconLock unlock];
+  }
+
   return tmp;
 }
 
@@ -1139,6 +1205,7 @@ static NSLock *raceLock = nil;
    * extensions are case-insensitive - convert to lowercase.
    */
   ext = [ext lowercaseString];
+  [iconLock lock];
   if ((icon = [_iconMap objectForKey:ext]) == nil) {
     NSDictionary *prefs;
     NSDictionary *extInfo;
@@ -1206,6 +1273,9 @@ static NSLock *raceLock = nil;
       [_iconMap setObject:icon forKey:ext];
     }
   }
+  [[icon retain] autorelease];
+  [iconLock unlock];
+
   return icon;
 }
 
@@ -1246,7 +1316,9 @@ static NSLock *raceLock = nil;
    * Look for the name of the preferred app in this role.
    * A 'nil' roll is a wildcard - find the preferred Editor or Viewer.
    */
-  prefs = [_extPreferences objectForKey:ext];
+  [iconLock lock];
+  prefs = [[[_extPreferences objectForKey:ext] retain] autorelease];
+  [iconLock unlock];
   if (role == nil || [role isEqualToString:@"Editor"]) {
     appName = [prefs objectForKey:@"Editor"];
     if (appName != nil) {
@@ -1370,7 +1442,9 @@ static NSLock *raceLock = nil;
       data = [NSData dataWithContentsOfFile:_extPreferencesPath];
       if (data) {
         dict = [NSDeserializer deserializePropertyListFromData:data mutableContainers:NO];
+        [iconLock lock];
         ASSIGN(_extPreferences, dict);
+        [iconLock unlock];
       }
       [[self fileSystemMonitor] addPath:_extPreferencesPath];
     } else {
@@ -1384,7 +1458,9 @@ static NSLock *raceLock = nil;
       data = [NSData dataWithContentsOfFile:_appListPath];
       if (data) {
         dict = [NSDeserializer deserializePropertyListFromData:data mutableContainers:NO];
+        [iconLock lock];
         ASSIGN(_appList, dict);
+        [iconLock unlock];
       }
       [[self fileSystemMonitor] addPath:_appListPath];
     } else {
@@ -1392,7 +1468,10 @@ static NSLock *raceLock = nil;
     }
   }
   // Invalidate the cache of icons for file extensions.
+  [iconLock lock];
   [_iconMap removeAllObjects];
+  [iconLock unlock];
+  [[IconLoader sharedLoader] invalidateAll];
 
   // Update inspector info (may be opened at "Tools" section)
   if (inspector != nil && isAppListChanged != NO) {
@@ -1689,14 +1768,16 @@ static NSLock *raceLock = nil;
 {
   NSString *iconPath = nil;
 
+  [iconLock lock];
   if (_extPreferences != nil) {
     NSDictionary *inf;
 
     inf = [_extPreferences objectForKey:[ext lowercaseString]];
     if (inf != nil) {
-      iconPath = [inf objectForKey:@"Icon"];
+      iconPath = [[[inf objectForKey:@"Icon"] retain] autorelease];
     }
   }
+  [iconLock unlock];
   return iconPath;
 }
 
@@ -1848,8 +1929,10 @@ static NSLock *raceLock = nil;
   }
   [map setObject:inf forKey:ext];
   RELEASE(inf);
+  [iconLock lock];
   RELEASE(_extPreferences);
   _extPreferences = map;
+  [iconLock unlock];
   data = [NSSerializer serializePropertyList:_extPreferences];
   if ([data writeToFile:_extPreferencesPath atomically:YES]) {
     // [NSNotificationCenter defaultCenter] postNotificationName:GSWorkspacePreferencesChanged
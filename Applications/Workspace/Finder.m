@@ -29,6 +29,10 @@
 #import <Viewers/PathIcon.h>
 #import <Preferences/Shelf/ShelfPrefs.h>
 
+#import <SystemKit/OSEFileSystemMonitor.h>
+
+#import "Tools/DirWalker.h"
+#import "FinderSearch.h"
 #import "Finder.h"
 
 //=============================================================================
@@ -78,21 +82,361 @@
 }
 @end
 
+//=============================================================================
+// Index of file names under the searched folders
+//=============================================================================
+
+// Folders with more files are not indexed
+#define FINDER_INDEX_MAX 100000
+// Searched folders kept in the index, least recently searched go first
+#define FINDER_INDEX_ROOTS 16
+
+// Name searches answer from the index at once, then walk the folder to
+// find what the index misses and replace it. In between, the index is
+// updated with the changes OSEFileSystemMonitor reports (for the folders
+// it watches, i.e. the ones shown in viewers). The saved index is read by
+// the first search, on its operation thread.
+@interface FinderIndex : NSObject
+{
+  NSLock *lock;
+  NSMutableDictionary *roots;  // folder path -> NSMutableSet of paths under it
+  NSMutableArray *rootOrder;   // roots, most recently searched last
+  NSString *indexPath;
+  BOOL isLoaded;
+  BOOL isChanged;
+}
++ (FinderIndex *)sharedIndex;
+- (NSArray *)pathsUnderRoot:(NSString *)root;
+- (void)setPaths:(NSSet *)paths underRoot:(NSString *)root;
+- (void)synchronize;
+@end
+
+@interface FinderIndex (Private)
+- (void)_load;
+- (NSString *)_rootContainingRoot:(NSString *)root;
+- (void)_touchRoot:(NSString *)root;
+- (void)_setPaths:(NSSet *)paths underRoot:(NSString *)root;
+- (void)_updateFolder:(NSString *)folder inPaths:(NSMutableSet *)paths;
+@end
+
+static void RemovePathFromSet(NSMutableSet *paths, NSString *path)
+{
+  NSString *prefix = [path stringByAppendingString:@"/"];
+
+  [paths removeObject:path];
+  for (NSString *p in [paths allObjects]) {
+    if ([p hasPrefix:prefix]) {
+      [paths removeObject:p];
+    }
+  }
+}
+
+static BOOL IsPathUnderRoot(NSString *path, NSString *root)
+{
+  if ([root isEqualToString:@"/"]) {
+    return [path hasPrefix:@"/"];
+  }
+  return [path isEqualToString:root] || [path hasPrefix:[root stringByAppendingString:@"/"]];
+}
+
+@implementation FinderIndex
+
+static FinderIndex *sharedFinderIndex = nil;
+
++ (FinderIndex *)sharedIndex
+{
+  if (sharedFinderIndex == nil) {
+    sharedFinderIndex = [[FinderIndex alloc] init];
+  }
+  return sharedFinderIndex;
+}
+
+- (id)init
+{
+  if ((self = [super init]) == nil) {
+    return nil;
+  }
+
+  lock = [[NSLock alloc] init];
+  roots = [[NSMutableDictionary alloc] init];
+  rootOrder = [[NSMutableArray alloc] init];
+  indexPath = [[NSHomeDirectory() stringByAppendingPathComponent:@"Library/Workspace/FinderIndex"]
+      retain];
+  isLoaded = NO;
+  isChanged = NO;
+
+  [[NSNotificationCenter defaultCenter] addObserver:self
+                                           selector:@selector(fileSystemChangedAtPath:)
+                                               name:OSEFileSystemChangedAtPath
+                                             object:nil];
+  return self;
+}
+
+- (void)dealloc
+{
+  [[NSNotificationCenter defaultCenter] removeObserver:self];
+  [indexPath release];
+  [rootOrder release];
+  [roots release];
+  [lock release];
+  [super dealloc];
+}
+
+// Must be called with `lock' held. Changes reported before the saved index
+// is read are not applied to it: the search walk finds them.
+- (void)_load
+{
+  NSDictionary *saved;
+
+  if (isLoaded) {
+    return;
+  }
+  isLoaded = YES;
+
+  saved = [NSDictionary dictionaryWithContentsOfFile:indexPath];
+  for (NSString *root in saved) {
+    [self _setPaths:[NSSet setWithArray:[saved objectForKey:root]] underRoot:root];
+  }
+  isChanged = NO;
+}
+
+// Must be called with `lock' held. Indexed folder which contains `root'
+// (but is not `root').
+- (NSString *)_rootContainingRoot:(NSString *)root
+{
+  for (NSString *r in roots) {
+    if (![r isEqualToString:root] && IsPathUnderRoot(root, r)) {
+      return r;
+    }
+  }
+  return nil;
+}
+
+// Must be called with `lock' held
+- (void)_touchRoot:(NSString *)root
+{
+  [root retain];
+  [rootOrder removeObject:root];
+  [rootOrder addObject:root];
+  [root release];
+}
+
+// Must be called with `lock' held. Paths of a folder inside an indexed one
+// go to the latter, indexed folders inside `root' are replaced by it.
+- (void)_setPaths:(NSSet *)paths underRoot:(NSString *)root
+{
+  NSString *container = [self _rootContainingRoot:root];
+  NSMutableSet *containerPaths;
+
+  if (container != nil) {
+    if (paths) {
+      containerPaths = [roots objectForKey:container];
+      RemovePathFromSet(containerPaths, root);
+      [containerPaths addObject:root];
+      [containerPaths unionSet:paths];
+    }
+    [self _touchRoot:container];
+    isChanged = YES;
+    return;
+  }
+
+  for (NSString *r in [roots allKeys]) {
+    if (![r isEqualToString:root] && IsPathUnderRoot(r, root)) {
+      [roots removeObjectForKey:r];
+      [rootOrder removeObject:r];
+    }
+  }
+  if (paths) {
+    [roots setObject:[NSMutableSet setWithSet:paths] forKey:root];
+    [self _touchRoot:root];
+  } else {
+    [roots removeObjectForKey:root];
+    [rootOrder removeObject:root];
+  }
+  while ([rootOrder count] > FINDER_INDEX_ROOTS) {
+    [roots removeObjectForKey:[rootOrder objectAtIndex:0]];
+    [rootOrder removeObjectAtIndex:0];
+  }
+  isChanged = YES;
+}
+
+- (NSArray *)pathsUnderRoot:(NSString *)root
+{
+  NSMutableArray *paths;
+  NSString *container;
+
+  [lock lock];
+  [self _load];
+  if ([roots objectForKey:root] != nil) {
+    paths = [[[roots objectForKey:root] allObjects] mutableCopy];
+  } else if ((container = [self _rootContainingRoot:root]) != nil) {
+    paths = [[NSMutableArray alloc] init];
+    for (NSString *p in [roots objectForKey:container]) {
+      if (![p isEqualToString:root] && IsPathUnderRoot(p, root)) {
+        [paths addObject:p];
+      }
+    }
+  } else {
+    paths = nil;
+  }
+  [lock unlock];
+
+  return [paths autorelease];
+}
+
+- (void)setPaths:(NSSet *)paths underRoot:(NSString *)root
+{
+  [lock lock];
+  [self _load];
+  [self _setPaths:paths underRoot:root];
+  [lock unlock];
+}
+
+- (void)synchronize
+{
+  NSMutableDictionary *storable;
+
+  [lock lock];
+  if (isChanged) {
+    storable = [NSMutableDictionary dictionary];
+    for (NSString *root in roots) {
+      [storable setObject:[[roots objectForKey:root] allObjects] forKey:root];
+    }
+    [storable writeToFile:indexPath atomically:YES];
+    isChanged = NO;
+  }
+  [lock unlock];
+}
+
+// Must be called with `lock' held. Entries of `folder' in `paths' are
+// replaced with what the folder contains now. Contents of the new
+// subfolders are found by the next search walk.
+- (void)_updateFolder:(NSString *)folder inPaths:(NSMutableSet *)paths
+{
+  NXTFileManager *fm = [NXTFileManager defaultManager];
+  NSArray *contents;
+  NSSet *names;
+  NSString *prefix;
+  NSUInteger prefixLength;
+
+  contents = [fm directoryContentsAtPath:folder
+                                 forPath:nil
+                              showHidden:[fm isShowHiddenFiles]];
+  names = contents ? [NSSet setWithArray:contents] : [NSSet set];
+  prefix = [folder isEqualToString:@"/"] ? folder : [folder stringByAppendingString:@"/"];
+  prefixLength = [prefix length];
+
+  for (NSString *p in [paths allObjects]) {
+    NSString *name;
+    NSRange slash;
+
+    if (![p hasPrefix:prefix]) {
+      continue;
+    }
+    name = [p substringFromIndex:prefixLength];
+    slash = [name rangeOfString:@"/"];
+    if (slash.location != NSNotFound) {
+      name = [name substringToIndex:slash.location];
+    }
+    if (![names containsObject:name]) {
+      [paths removeObject:p];
+    }
+  }
+  for (NSString *name in names) {
+    [paths addObject:[prefix stringByAppendingString:name]];
+  }
+}
+
+// Same notification as FileViewer gets, see -[FileViewer
+// fileSystemChangedAtPath:]. Events are coalesced by folder: `Operations'
+// of the notification may belong to several files and `ChangedFile' names
+// the last one only, so the whole folder is listed again (the way
+// IconLoader marks it stale).
+- (void)fileSystemChangedAtPath:(NSNotification *)notif
+{
+  NSString *changedPath = [[notif userInfo] objectForKey:@"ChangedPath"];
+
+  if (changedPath == nil) {
+    return;
+  }
+
+  [lock lock];
+  for (NSString *root in roots) {
+    if (IsPathUnderRoot(changedPath, root)) {
+      [self _updateFolder:changedPath inPaths:[roots objectForKey:root]];
+      isChanged = YES;
+      break;
+    }
+  }
+  [lock unlock];
+}
+
+@end
+
 //=============================================================================
 // NSOperation to perform search asynchronously
 //=============================================================================
+
+// Found items are passed to Finder in batches
+#define FIND_RESULTS_INTERVAL 0.1
+
 @interface FindWorker : NSOperation
 {
   Finder *finder;
   NSArray *searchPaths;
   NSRegularExpression *expression;
   BOOL isContentSearch;
+
+  BOOL showHidden;
+  // Text every match contains, matching is done without regex if
+  // `isLiteral' is set
+  char literal[FINDER_LITERAL_MAX];
+  size_t literalLength;
+  BOOL isLiteral;
+
+  // Walker threads share these
+  NSLock *resultsLock;
+  NSMutableArray *results;        // found, not passed to Finder yet
+  NSMutableSet *reportedPaths;    // found in index
+  NSMutableSet *indexPaths;       // every path walked by a name search
+  NSMutableDictionary *hiddenNames;  // folder path -> names in its .hidden file
+  int hiddenCount;
+  int isStopped;
 }
 - (id)initWithFinder:(Finder *)onwer
                paths:(NSArray *)paths
           expression:(NSRegularExpression *)regexp
       searchContents:(BOOL)isContent;
+- (int)processEntry:(DirWalkerEntry *)entry;
+- (int)scanChunk:(const char *)text length:(size_t)length offset:(off_t)offset;
+- (int)passResults;
 @end
+
+static int FindEntry(DirWalkerEntry *entry, void *context)
+{
+  return [(FindWorker *)context processEntry:entry];
+}
+
+static int FindChunk(const char *text, size_t length, off_t offset, void *context)
+{
+  return [(FindWorker *)context scanChunk:text length:length offset:offset];
+}
+
+static int FindTick(void *context)
+{
+  return [(FindWorker *)context passResults];
+}
+
+// Walker threads use Foundation
+static void FindThread(int started, void *context)
+{
+  if (started) {
+    GSRegisterCurrentThread();
+  } else {
+    GSUnregisterCurrentThread();
+  }
+}
+
 @implementation FindWorker
 
 - (void)dealloc
@@ -100,6 +444,11 @@
   NSDebugLLog(@"Memory", @"[FindWorker] -dealloc");
   [searchPaths release];
   [expression release];
+  [resultsLock release];
+  [results release];
+  [reportedPaths release];
+  [indexPaths release];
+  [hiddenNames release];
   [super dealloc];
 }
 
@@ -116,6 +465,10 @@
     expression = regexp;
     [expression retain];
     isContentSearch = isContent;
+    resultsLock = [[NSLock alloc] init];
+    results = [[NSMutableArray alloc] init];
+    reportedPaths = [[NSMutableSet alloc] init];
+    hiddenNames = [[NSMutableDictionary alloc] init];
   }
 
   return self;
@@ -133,85 +486,267 @@
   return NO;
 }
 
-- (BOOL)isFileMatched:(NSString *)filePath
+// Bytes that aren't UTF-8 are taken as Latin-1
+- (BOOL)isBytesMatched:(const char *)bytes length:(size_t)length
 {
-  BOOL isMatched = NO;
-  NSFileHandle *handle = [NSFileHandle fileHandleForReadingAtPath:filePath];
-  NSData *dataChunk;
+  NSAutoreleasePool *pool = [NSAutoreleasePool new];
   NSString *text;
-  // NSUInteger   patternLength = [[expression pattern] length];
-  NSUInteger offset;
+  BOOL isMatched;
+
+  text = [[NSString alloc] initWithBytesNoCopy:(void *)bytes
+                                        length:length
+                                      encoding:NSUTF8StringEncoding
+                                  freeWhenDone:NO];
+  if (text == nil) {
+    text = [[NSString alloc] initWithBytesNoCopy:(void *)bytes
+                                          length:length
+                                        encoding:NSISOLatin1StringEncoding
+                                    freeWhenDone:NO];
+  }
+  isMatched = [self isTextMatched:text];
+  [text release];
+  [pool release];
 
-  // NSDebugLLog(@"Finder", @"Search for contents in file:%@", filePath);
+  return isMatched;
+}
 
-  dataChunk = [handle readDataOfLength:1024 * 1024];
-  while ([dataChunk length] > 0) {
-    text = [[NSString alloc] initWithData:dataChunk encoding:NSUTF8StringEncoding];
-    [text autorelease];
-    if ([self isTextMatched:text]) {
-      isMatched = YES;
-      break;
-    }
-    // Step down on the pattern length to omit cases when search string
-    // is located across the chunks of data read.
-    // offset = [handle offsetInFile];
-    // if (offset )
-    // [handle seekToFileOffset:offset-patternLength];
+- (BOOL)isNameMatched:(const char *)name
+{
+  size_t length = strlen(name);
 
-    dataChunk = [handle readDataOfLength:1024 * 1024];
+  if (literalLength > 0 && FinderFindLiteral(name, length, literal, literalLength) == NULL) {
+    return NO;
   }
+  return isLiteral || [self isBytesMatched:name length:length];
+}
 
-  [handle closeFile];
-  return isMatched;
+// Files are read by chunks, binary files are skipped. The literal is
+// looked for first, regex runs only if it's there. Returns 1 on match, -1
+// to stop reading without one.
+- (int)scanChunk:(const char *)text length:(size_t)length offset:(off_t)offset
+{
+  if (offset == 0 && FinderIsBinary(text, length)) {
+    return -1;
+  }
+  if (isLiteral) {
+    return (FinderFindLiteral(text, length, literal, literalLength) != NULL);
+  }
+  if (literalLength > 0 && FinderFindLiteral(text, length, literal, literalLength) == NULL) {
+    return 0;
+  }
+  if ([self isBytesMatched:text length:length]) {
+    return 1;
+  }
+  return __atomic_load_n(&isStopped, __ATOMIC_RELAXED) ? -1 : 0;
 }
 
-- (void)findInDirectory:(NSString *)dirPath
+// Literal-only search reads overlapping chunks, regex needs whole lines
+- (BOOL)isFileMatched:(DirWalkerEntry *)entry
 {
-  NXTFileManager *fm = [NXTFileManager defaultManager];
-  BOOL isDir;
-  NSArray *dirContents;
-  NSString *itemPath;
-  NSDictionary *attrs;
-  NSString *itemFormat;
+  size_t overlap = isLiteral ? literalLength - 1 : 0;
+
+  return (FinderScanFile(entry->path, overlap, FindChunk, self) > 0);
+}
 
-  // NSDebugLLog(@"Finder", @"Processing directory %@...", dirPath);
+- (NSString *)stringWithPath:(const char *)path
+{
+  return [[NSFileManager defaultManager] stringWithFileSystemRepresentation:path
+                                                                     length:strlen(path)];
+}
 
-  dirContents = [fm directoryContentsAtPath:dirPath forPath:nil showHidden:[fm isShowHiddenFiles]];
-  itemFormat = ([dirPath isEqualToString:@"/"] == NO) ? @"%@/%@" : @"%@%@";
+- (void)addResultAtPath:(NSString *)path
+{
+  [resultsLock lock];
+  if (![reportedPaths containsObject:path]) {
+    [results addObject:path];
+  }
+  [resultsLock unlock];
+}
 
-  for (NSString *item in dirContents) {
-    if ([self isCancelled]) {
-      break;
-    }
-    itemPath = [NSString stringWithFormat:itemFormat, dirPath, item];
-    [fm fileExistsAtPath:itemPath isDirectory:&isDir];
-    attrs = [fm fileAttributesAtPath:itemPath traverseLink:NO];
-
-    if ([[attrs fileType] isEqualToString:NSFileTypeSymbolicLink] == NO) {
-      if ([[attrs fileType] isEqualToString:NSFileTypeDirectory] != NO) {
-        [self findInDirectory:itemPath];
-      } else if (isContentSearch != NO) {
-        if ([self isFileMatched:itemPath]) {
-          [finder performSelectorOnMainThread:@selector(addResult:)
-                                   withObject:itemPath
-                                waitUntilDone:NO];
-        }
+// Names listed in .hidden file of a folder are not shown by viewers
+- (void)readHiddenNamesOfFolder:(DirWalkerEntry *)entry
+{
+  NSString *folder = [self stringWithPath:entry->path];
+  NSString *hidden = [folder stringByAppendingPathComponent:@".hidden"];
+  NSString *contents;
+
+  if (access([hidden fileSystemRepresentation], R_OK) != 0) {
+    return;
+  }
+  contents = [NSString stringWithContentsOfFile:hidden];
+  if (contents == nil) {
+    return;
+  }
+
+  [resultsLock lock];
+  [hiddenNames setObject:[NSSet setWithArray:[contents componentsSeparatedByString:@"\n"]]
+                  forKey:folder];
+  __atomic_add_fetch(&hiddenCount, 1, __ATOMIC_RELAXED);
+  [resultsLock unlock];
+}
+
+- (BOOL)isHiddenPath:(NSString *)path
+{
+  BOOL isHidden;
+
+  if (__atomic_load_n(&hiddenCount, __ATOMIC_RELAXED) == 0) {
+    return NO;
+  }
+
+  [resultsLock lock];
+  isHidden = [[hiddenNames objectForKey:[path stringByDeletingLastPathComponent]]
+      containsObject:[path lastPathComponent]];
+  [resultsLock unlock];
+
+  return isHidden;
+}
+
+// Called by walker threads
+- (int)processEntry:(DirWalkerEntry *)entry
+{
+  NSAutoreleasePool *pool;
+  NSString *path = nil;
+  int result = DirWalkerContinue;
+
+  if (__atomic_load_n(&isStopped, __ATOMIC_RELAXED)) {
+    return DirWalkerStop;
+  }
+  if (entry->error) {
+    return DirWalkerContinue;
+  }
+  if (entry->depth > 0 && showHidden == NO && entry->name[0] == '.') {
+    return DirWalkerSkip;
+  }
+  // Symbolic links are neither matched nor followed
+  if (S_ISLNK(entry->st.st_mode)) {
+    return DirWalkerContinue;
+  }
+
+  pool = [NSAutoreleasePool new];
+
+  if (showHidden == NO && S_ISDIR(entry->st.st_mode)) {
+    [self readHiddenNamesOfFolder:entry];
+  }
+  if (entry->depth > 0) {
+    path = [self stringWithPath:entry->path];
+    if ([self isHiddenPath:path]) {
+      result = DirWalkerSkip;
+    } else if (isContentSearch) {
+      if (S_ISREG(entry->st.st_mode) && [self isFileMatched:entry]) {
+        [self addResultAtPath:path];
       }
-      if (isContentSearch == NO && [self isTextMatched:item]) {
-        [finder performSelectorOnMainThread:@selector(addResult:)
-                                 withObject:itemPath
-                              waitUntilDone:NO];
+    } else {
+      if ([self isNameMatched:entry->name]) {
+        [self addResultAtPath:path];
+      }
+      [resultsLock lock];
+      [indexPaths addObject:path];
+      if ([indexPaths count] > FINDER_INDEX_MAX) {
+        DESTROY(indexPaths);
       }
+      [resultsLock unlock];
+    }
+  }
+
+  [pool release];
+  return result;
+}
+
+// Called on the operation thread
+- (int)passResults
+{
+  NSArray *found = nil;
+
+  [resultsLock lock];
+  if ([results count] > 0) {
+    found = [results copy];
+    [results removeAllObjects];
+  }
+  [resultsLock unlock];
+
+  if (found) {
+    [finder performSelectorOnMainThread:@selector(addResults:) withObject:found waitUntilDone:NO];
+    [found release];
+  }
+
+  if ([self isCancelled]) {
+    __atomic_store_n(&isStopped, 1, __ATOMIC_RELAXED);
+  }
+  return __atomic_load_n(&isStopped, __ATOMIC_RELAXED);
+}
+
+- (void)findInIndexForPath:(NSString *)rootPath
+{
+  NSArray *paths = [[FinderIndex sharedIndex] pathsUnderRoot:rootPath];
+  NSUInteger prefixLength = [rootPath length];
+  struct stat st;
+
+  for (NSString *path in paths) {
+    NSString *name = [path lastPathComponent];
+
+    if (showHidden == NO && ([name hasPrefix:@"."] ||
+                             [[path substringFromIndex:prefixLength] rangeOfString:@"/."].location !=
+                                 NSNotFound)) {
+      continue;
+    }
+    if ([self isNameMatched:[name fileSystemRepresentation]] &&
+        lstat([path fileSystemRepresentation], &st) == 0 && !S_ISLNK(st.st_mode)) {
+      [resultsLock lock];
+      [results addObject:path];
+      [reportedPaths addObject:path];
+      [resultsLock unlock];
     }
   }
+  [self passResults];
 }
 
 - (void)main
 {
+  NXTFileManager *fm = [NXTFileManager defaultManager];
+  DirWalkerOptions options = {0};
+  int literalOnly;
+
   NSDebugLLog(@"Finder", @"[Finder] will search contents: %@", isContentSearch ? @"Yes" : @"No");
 
+  if (expression == nil) {
+    return;
+  }
+
+  showHidden = [fm isShowHiddenFiles];
+  literalLength = FinderPatternLiteral([[expression pattern] UTF8String], literal, &literalOnly);
+  isLiteral = literalOnly;
+
+  options.flags = DirWalkerRecursive | DirWalkerFollowRoot;
+  options.threads = 0;
+  options.entry = FindEntry;
+  options.tick = FindTick;
+  options.interval = FIND_RESULTS_INTERVAL;
+  options.thread = FindThread;
+  options.context = self;
+
   for (NSString *path in searchPaths) {
-    [self findInDirectory:path];
+    NSAutoreleasePool *pool = [NSAutoreleasePool new];
+
+    if (isContentSearch == NO) {
+      [self findInIndexForPath:path];
+      indexPaths = [[NSMutableSet alloc] init];
+    }
+
+    DirWalk([path fileSystemRepresentation], &options);
+    [self passResults];
+
+    if (isContentSearch == NO) {
+      if (!isStopped) {
+        [[FinderIndex sharedIndex] setPaths:indexPaths underRoot:path];
+      }
+      DESTROY(indexPaths);
+      [reportedPaths removeAllObjects];
+    }
+    [pool release];
+
+    if (isStopped) {
+      break;
+    }
   }
 }
 
@@ -295,6 +830,7 @@
   fileViewer = fv;
   resultIndex = -1;
   variantList = [[NSMutableArray alloc] init];
+  [FinderIndex sharedIndex];
 
   return self;
 }
@@ -385,6 +921,7 @@
   [df setObject:[shelf storableRepresentation] forKey:@"FinderShelfContents"];
   [df setObject:[self storableShelfSelection] forKey:@"FinderShelfSelection"];
   [df synchronize];
+  [[FinderIndex sharedIndex] synchronize];
 
   [variantList removeAllObjects];
 }
@@ -444,22 +981,35 @@
 
 - (void)addResult:(NSString *)resultString
 {
-  [variantList addObject:resultString];
-  [resultsFound setStringValue:[NSString stringWithFormat:@"%lu found", [variantList count]]];
-  if ([variantList count] == 1) {
+  [self addResults:@[ resultString ]];
+}
+
+- (void)addResults:(NSArray *)results
+{
+  NSMatrix *matrix;
+  NSBrowserCell *cell;
+
+  if ([results count] == 0) {
+    return;
+  }
+
+  if ([variantList count] == 0) {
+    [variantList addObjectsFromArray:results];
     [resultList reloadColumn:0];
   } else {
-    NSBrowserCell *cell;
-    NSMatrix *matrix = [resultList matrixInColumn:0];
-
-    [matrix addRow];
-    cell = [matrix cellAtRow:[matrix numberOfRows] - 1 column:0];
-    [cell setLeaf:YES];
-    [cell setRefusesFirstResponder:YES];
-    [cell setTitle:resultString];
-    [cell setLoaded:YES];
+    matrix = [resultList matrixInColumn:0];
+    for (NSString *resultString in results) {
+      [variantList addObject:resultString];
+      [matrix addRow];
+      cell = [matrix cellAtRow:[matrix numberOfRows] - 1 column:0];
+      [cell setLeaf:YES];
+      [cell setRefusesFirstResponder:YES];
+      [cell setTitle:resultString];
+      [cell setLoaded:YES];
+    }
     [resultList displayColumn:0];
   }
+  [resultsFound setStringValue:[NSString stringWithFormat:@"%lu found", [variantList count]]];
 }
 
 - (void)finishFind
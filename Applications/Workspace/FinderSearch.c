@@ -0,0 +1,372 @@
+/* -*- mode: c -*- */
+//
+// Project: Workspace
+//
+// Description: Content scanning helpers of the Finder search.
+//
+// This application is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public
+// License as published by the Free Software Foundation; either
+// version 2 of the License, or (at your option) any later version.
+//
+// This application is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Library General Public License for more details.
+//
+// You should have received a copy of the GNU General Public
+// License along with this library; if not, write to the Free
+// Software Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111 USA.
+//
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "FinderSearch.h"
+
+// bytes checked for NUL by FinderIsBinary()
+#define BINARY_CHECK_LENGTH 8192
+
+static inline int IsAsciiLetter(unsigned char c)
+{
+  return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
+}
+
+static inline unsigned char AsciiLower(unsigned char c)
+{
+  return (c >= 'A' && c <= 'Z') ? c + ('a' - 'A') : c;
+}
+
+static inline unsigned char AsciiUpper(unsigned char c)
+{
+  return (c >= 'a' && c <= 'z') ? c - ('a' - 'A') : c;
+}
+
+// --- Pattern
+
+// Parsing is conservative: anything it doesn't know (inline flags, \Q..\E,
+// properties, top level alternation) gives no literal at all.
+size_t FinderPatternLiteral(const char *pattern, char *literal, int *isLiteral)
+{
+  const unsigned char *p = (const unsigned char *)pattern;
+  char run[FINDER_LITERAL_MAX];
+  size_t runLength = 0, bestLength = 0;
+  int depth = 0, exact = 1;
+  int c;
+
+  *isLiteral = 0;
+  literal[0] = '\0';
+  if (strstr(pattern, "(?") != NULL) {
+    return 0;
+  }
+
+#define END_RUN()                                \
+  do {                                           \
+    if (runLength > bestLength) {                \
+      memcpy(literal, run, runLength);           \
+      bestLength = runLength;                    \
+    }                                            \
+    runLength = 0;                               \
+    exact = 0;                                   \
+  } while (0)
+
+  while ((c = *p++) != 0) {
+    switch (c) {
+      case '\\':
+        if (*p == 0 || *p >= 0x80) {
+          return 0;
+        }
+        if ((*p >= '0' && *p <= '9') || IsAsciiLetter(*p)) {
+          // character classes and word boundaries, other escapes have
+          // arguments
+          if (strchr("dDwWsSbB", *p) == NULL) {
+            return 0;
+          }
+          p++;
+          END_RUN();
+          continue;
+        }
+        c = *p++;
+        break;
+      case '[': {
+        int setDepth = 1;
+
+        if (*p == '^') {
+          p++;
+        }
+        if (*p == ']') {
+          p++;
+        }
+        while (*p && setDepth > 0) {
+          if (*p == '\\' && p[1]) {
+            p++;
+          } else if (*p == '[') {
+            setDepth++;
+          } else if (*p == ']') {
+            setDepth--;
+          }
+          p++;
+        }
+        END_RUN();
+        continue;
+      }
+      case '(':
+        depth++;
+        END_RUN();
+        continue;
+      case ')':
+        depth--;
+        END_RUN();
+        continue;
+      case '|':
+        if (depth == 0) {
+          return 0;
+        }
+        END_RUN();
+        continue;
+      case '{':
+        while (*p && *p != '}') {
+          p++;
+        }
+        if (*p) {
+          p++;
+        }
+        // the last character may be repeated 0 times
+        // fall through
+      case '*':
+      case '?':
+        if (runLength > 0) {
+          runLength--;
+        }
+        END_RUN();
+        continue;
+      case '+':
+      case '.':
+      case '^':
+      case '$':
+      case ']':
+      case '}':
+        END_RUN();
+        continue;
+      default:
+        if (c >= 0x80) {
+          END_RUN();
+          continue;
+        }
+        break;
+    }
+
+    // `c' is a literal character
+    if (depth > 0) {
+      END_RUN();
+      continue;
+    }
+    if (runLength == FINDER_LITERAL_MAX - 1) {
+      END_RUN();
+    }
+    run[runLength++] = AsciiLower(c);
+  }
+
+  if (exact && runLength > 0) {
+    *isLiteral = 1;
+  }
+  exact = 0;
+  END_RUN();
+
+#undef END_RUN
+
+  literal[bestLength] = '\0';
+  return bestLength;
+}
+
+// --- Scanning
+
+static inline int MatchesAt(const char *text, const char *literal, size_t literalLength)
+{
+  size_t i;
+
+  for (i = 0; i < literalLength; i++) {
+    if (AsciiLower(text[i]) != (unsigned char)literal[i]) {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+const char *FinderFindLiteral(const char *text, size_t length, const char *literal,
+                              size_t literalLength)
+{
+  const char *p, *last, *none, *lower = NULL, *upper = NULL, *hit;
+  unsigned char lc, uc;
+  size_t k;
+
+  if (literalLength == 0) {
+    return text;
+  }
+  if (length < literalLength) {
+    return NULL;
+  }
+
+  // memchr() for a character of the literal, the first one that has no
+  // upper case if possible. For a letter both cases are looked for.
+  for (k = 0; k < literalLength && IsAsciiLetter(literal[k]); k++) {
+  }
+  if (k == literalLength) {
+    k = 0;
+  }
+  lc = literal[k];
+  uc = AsciiUpper(lc);
+
+  p = text + k;
+  last = text + length - literalLength + k;
+  none = last + 1;
+  while (p <= last) {
+    if (lc == uc) {
+      hit = memchr(p, lc, last - p + 1);
+    } else {
+      if (lower < p) {
+        lower = memchr(p, lc, last - p + 1);
+        lower = lower ? lower : none;
+      }
+      if (upper < p) {
+        upper = memchr(p, uc, last - p + 1);
+        upper = upper ? upper : none;
+      }
+      hit = (lower < upper) ? lower : upper;
+      hit = (hit == none) ? NULL : hit;
+    }
+    if (hit == NULL) {
+      return NULL;
+    }
+    if (MatchesAt(hit - k, literal, literalLength)) {
+      return hit - k;
+    }
+    p = hit + 1;
+  }
+
+  return NULL;
+}
+
+int FinderIsBinary(const char *text, size_t length)
+{
+  if (length > BINARY_CHECK_LENGTH) {
+    length = BINARY_CHECK_LENGTH;
+  }
+  return memchr(text, 0, length) != NULL;
+}
+
+size_t FinderChunkEnd(const char *text, size_t length, size_t start, size_t maxLength)
+{
+  const char *newline;
+  size_t end;
+
+  if (length - start <= maxLength) {
+    return length;
+  }
+
+  end = start + maxLength;
+  newline = memrchr(text + start, '\n', maxLength);
+  if (newline != NULL) {
+    return newline - text + 1;
+  }
+  while (end > start && ((unsigned char)text[end] & 0xc0) == 0x80) {
+    end--;
+  }
+
+  return (end > start) ? end : start + maxLength;
+}
+
+// --- Reading
+
+static pthread_key_t readBufferKey;
+static pthread_once_t readBufferOnce = PTHREAD_ONCE_INIT;
+
+static void CreateReadBufferKey(void)
+{
+  pthread_key_create(&readBufferKey, free);
+}
+
+// FINDER_CHUNK_LENGTH bytes, kept until the thread exits
+static char *ReadBuffer(void)
+{
+  char *buffer;
+
+  pthread_once(&readBufferOnce, CreateReadBufferKey);
+  buffer = pthread_getspecific(readBufferKey);
+  if (buffer == NULL) {
+    buffer = malloc(FINDER_CHUNK_LENGTH);
+    if (buffer != NULL) {
+      pthread_setspecific(readBufferKey, buffer);
+    }
+  }
+  return buffer;
+}
+
+int FinderScanFile(const char *path, size_t overlap, FinderScanFunc scan, void *context)
+{
+  char *buffer = ReadBuffer();
+  size_t length = 0, end, keep;
+  off_t readOffset = 0, chunkOffset = 0;
+  ssize_t n;
+  int isEnd = 0, result = 0;
+  int fd;
+
+  if (buffer == NULL || overlap >= FINDER_CHUNK_LENGTH / 2) {
+    return -1;
+  }
+  fd = open(path, O_RDONLY | O_CLOEXEC | O_NOFOLLOW);
+  if (fd < 0) {
+    return -1;
+  }
+  posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+  while (result == 0) {
+    while (!isEnd && length < FINDER_CHUNK_LENGTH) {
+      n = pread(fd, buffer + length, FINDER_CHUNK_LENGTH - length, readOffset);
+      if (n < 0 && errno == EINTR) {
+        continue;
+      }
+      if (n < 0) {
+        close(fd);
+        return -1;
+      }
+      if (n == 0) {
+        isEnd = 1;
+      }
+      length += n;
+      readOffset += n;
+    }
+    if (length == 0) {
+      break;
+    }
+
+    if (isEnd || overlap > 0) {
+      end = length;
+    } else {
+      // the buffer is full: end before its last byte, so the chunk is
+      // always cut at a line end or a character boundary inside it
+      end = FinderChunkEnd(buffer, length, 0, length - 1);
+    }
+    result = scan(buffer, end, chunkOffset, context);
+    if (isEnd && end == length) {
+      break;
+    }
+
+    // `end' is the whole buffer if there's an overlap
+    keep = overlap;
+    memmove(buffer, buffer + end - keep, length - end + keep);
+    length = length - end + keep;
+    chunkOffset += end - keep;
+  }
+
+  close(fd);
+  return result;
+}
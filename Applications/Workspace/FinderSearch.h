@@ -0,0 +1,61 @@
+/* -*- mode: c -*- */
+//
+// Project: Workspace
+//
+// Description: Content scanning helpers of the Finder search.
+//
+// This application is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public
+// License as published by the Free Software Foundation; either
+// version 2 of the License, or (at your option) any later version.
+//
+// This application is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Library General Public License for more details.
+//
+// You should have received a copy of the GNU General Public
+// License along with this library; if not, write to the Free
+// Software Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111 USA.
+//
+
+#ifndef __WORKSPACE_FINDERSEARCH_H__
+#define __WORKSPACE_FINDERSEARCH_H__
+
+#include <stddef.h>
+#include <sys/types.h>
+
+#define FINDER_LITERAL_MAX 256
+// Files are read and matched by chunks of this size
+#define FINDER_CHUNK_LENGTH (4 * 1024 * 1024)
+
+// Finds the longest run of ASCII characters every match of the regular
+// expression `pattern' must contain and writes it to `literal' in lower
+// case. Returns its length, 0 if there's no such run. `isLiteral' is set
+// if the whole pattern is that run, the regex isn't needed then.
+size_t FinderPatternLiteral(const char *pattern, char *literal, int *isLiteral);
+
+// ASCII case-insensitive search of lower case `literal' in `text'.
+const char *FinderFindLiteral(const char *text, size_t length, const char *literal,
+                              size_t literalLength);
+
+// Text files have no NUL bytes in the beginning.
+int FinderIsBinary(const char *text, size_t length);
+
+// End of the chunk of at most `maxLength' bytes starting at `start'. It
+// ends after a newline if there's one, never inside a UTF-8 sequence.
+size_t FinderChunkEnd(const char *text, size_t length, size_t start, size_t maxLength);
+
+// Called for each chunk of a file, `offset' is the position of `text' in
+// the file. Nonzero return value stops reading.
+typedef int (*FinderScanFunc)(const char *text, size_t length, off_t offset, void *context);
+
+// Reads the file at `path' with pread() into a buffer of the calling
+// thread and calls `scan' for chunks of at most FINDER_CHUNK_LENGTH bytes.
+// Chunks end at line ends (see FinderChunkEnd) or, if `overlap' isn't 0,
+// repeat the last `overlap' bytes of the previous chunk. A file that gets
+// shorter while it's read just ends early. Returns the nonzero value of
+// `scan', 0 at the end of file, -1 if the file can't be read.
+int FinderScanFile(const char *path, size_t overlap, FinderScanFunc scan, void *context);
+
+#endif
@@ -0,0 +1,608 @@
+/* -*- mode: c -*- */
+//
+// Project: Workspace
+//
+// Description: Directory tree walker shared by the Sizer and FileMover tools.
+//
+// This application is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public
+// License as published by the Free Software Foundation; either
+// version 2 of the License, or (at your option) any later version.
+//
+// This application is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Library General Public License for more details.
+//
+// You should have received a copy of the GNU General Public
+// License along with this library; if not, write to the Free
+// Software Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111 USA.
+//
+
+// Every directory still to be read is a job. Each thread has its own
+// queue of jobs: subdirectories found are pushed to it and taken back from
+// the same end (depth first, the tree stays warm in the caches). A thread
+// without jobs steals the oldest job of another thread, which is usually
+// the biggest piece of the tree left. Entries are read with getdents64()
+// into a large buffer and stat()ed relative to the directory descriptor.
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/types.h>
+
+#include "DirWalker.h"
+
+#define MAX_THREADS 16
+#define DIRENT_BUFFER_SIZE (64 * 1024)
+// entries reported between checks of the stop flag and the tick time
+#define CHECK_INTERVAL 256
+#define INODE_SHARDS 64
+
+typedef struct {
+  char *path;
+  int depth;
+} WalkJob;
+
+typedef struct {
+  pthread_mutex_t lock;
+  WalkJob *jobs;
+  int head, tail, capacity;  // jobs are in [head, tail)
+} WalkQueue;
+
+typedef struct {
+  dev_t dev;
+  ino_t ino;
+} Inode;
+
+typedef struct {
+  pthread_mutex_t lock;
+  Inode *inodes;
+  size_t count, capacity;  // capacity is 0 or a power of 2
+} InodeShard;
+
+typedef struct Walk Walk;
+
+typedef struct {
+  Walk *walk;
+  int id;
+  pthread_t thread;
+  char *buffer;
+  unsigned int checkCount;
+} WalkThread;
+
+struct Walk {
+  DirWalkerOptions *options;
+  int numThreads;
+  WalkThread *threads;
+  WalkQueue *queues;
+
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+  long pending;         // jobs queued or being done
+  int waiting;          // threads waiting for jobs
+  unsigned long pushes; // changes whenever a job is queued
+  int stop;             // read without the lock while reading directories
+
+  double nextTick;
+  InodeShard inodes[INODE_SHARDS];
+};
+
+static double MonotonicTime(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// --- Hard links
+
+static uint64_t InodeHash(dev_t dev, ino_t ino)
+{
+  return ((uint64_t)ino * 0x9e3779b97f4a7c15ULL) ^ ((uint64_t)dev * 0xc2b2ae3d27d4eb4fULL);
+}
+
+// Returns 1 if the inode wasn't seen before
+static int InodeAdd(Walk *w, dev_t dev, ino_t ino)
+{
+  uint64_t hash = InodeHash(dev, ino);
+  InodeShard *shard = &w->inodes[hash >> 58];
+  size_t i, mask;
+  int added = 1;
+
+  pthread_mutex_lock(&shard->lock);
+
+  if ((shard->count + 1) * 2 > shard->capacity) {
+    size_t capacity = shard->capacity ? shard->capacity * 2 : 64;
+    Inode *inodes = calloc(capacity, sizeof(Inode));
+
+    if (inodes == NULL) {
+      pthread_mutex_unlock(&shard->lock);
+      return 1;
+    }
+    for (i = 0; i < shard->capacity; i++) {
+      Inode *n = &shard->inodes[i];
+      size_t j;
+
+      if (n->ino == 0) {
+        continue;
+      }
+      for (j = InodeHash(n->dev, n->ino) & (capacity - 1); inodes[j].ino;
+           j = (j + 1) & (capacity - 1))
+        ;
+      inodes[j] = *n;
+    }
+    free(shard->inodes);
+    shard->inodes = inodes;
+    shard->capacity = capacity;
+  }
+
+  mask = shard->capacity - 1;
+  for (i = hash & mask; shard->inodes[i].ino; i = (i + 1) & mask) {
+    if (shard->inodes[i].ino == ino && shard->inodes[i].dev == dev) {
+      added = 0;
+      break;
+    }
+  }
+  if (added) {
+    shard->inodes[i].dev = dev;
+    shard->inodes[i].ino = ino;
+    shard->count++;
+  }
+
+  pthread_mutex_unlock(&shard->lock);
+  return added;
+}
+
+// --- Job queues
+
+static void QueuePush(Walk *w, int id, char *path, int depth)
+{
+  WalkQueue *q = &w->queues[id];
+
+  pthread_mutex_lock(&q->lock);
+  if (q->tail == q->capacity) {
+    if (q->head > q->capacity / 2) {
+      memmove(q->jobs, q->jobs + q->head, (q->tail - q->head) * sizeof(WalkJob));
+      q->tail -= q->head;
+      q->head = 0;
+    } else {
+      int capacity = q->capacity ? q->capacity * 2 : 64;
+      WalkJob *jobs = realloc(q->jobs, capacity * sizeof(WalkJob));
+
+      if (jobs == NULL) {
+        pthread_mutex_unlock(&q->lock);
+        free(path);
+        return;
+      }
+      q->jobs = jobs;
+      q->capacity = capacity;
+    }
+  }
+  q->jobs[q->tail].path = path;
+  q->jobs[q->tail].depth = depth;
+  q->tail++;
+  pthread_mutex_unlock(&q->lock);
+
+  pthread_mutex_lock(&w->lock);
+  w->pending++;
+  w->pushes++;
+  if (w->waiting) {
+    pthread_cond_signal(&w->cond);
+  }
+  pthread_mutex_unlock(&w->lock);
+}
+
+// Newest job of own queue or oldest job of another one
+static int QueueTake(Walk *w, int id, WalkJob *job)
+{
+  int i;
+
+  for (i = 0; i < w->numThreads; i++) {
+    int victim = (id + i) % w->numThreads;
+    WalkQueue *q = &w->queues[victim];
+    int found = 0;
+
+    pthread_mutex_lock(&q->lock);
+    if (q->head < q->tail) {
+      if (victim == id) {
+        *job = q->jobs[--q->tail];
+      } else {
+        *job = q->jobs[q->head++];
+      }
+      if (q->head == q->tail) {
+        q->head = q->tail = 0;
+      }
+      found = 1;
+    }
+    pthread_mutex_unlock(&q->lock);
+
+    if (found) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+static void JobDone(Walk *w)
+{
+  pthread_mutex_lock(&w->lock);
+  if (--w->pending == 0) {
+    pthread_cond_broadcast(&w->cond);
+  }
+  pthread_mutex_unlock(&w->lock);
+}
+
+static void Stop(Walk *w)
+{
+  pthread_mutex_lock(&w->lock);
+  __atomic_store_n(&w->stop, 1, __ATOMIC_RELAXED);
+  pthread_cond_broadcast(&w->cond);
+  pthread_mutex_unlock(&w->lock);
+}
+
+// --- Walking
+
+// Ticks on the calling thread (thread 0) when it's time
+static void Check(WalkThread *t)
+{
+  Walk *w = t->walk;
+  DirWalkerOptions *o = w->options;
+  double now;
+
+  if (t->id != 0 || o->tick == NULL) {
+    return;
+  }
+  now = MonotonicTime();
+  if (now >= w->nextTick) {
+    w->nextTick = now + o->interval;
+    if (o->tick(o->context)) {
+      Stop(w);
+    }
+  }
+}
+
+static void Report(WalkThread *t, DirWalkerEntry *entry)
+{
+  Walk *w = t->walk;
+  DirWalkerOptions *o = w->options;
+  int result;
+
+  if (!entry->error && (o->flags & DirWalkerUniqueInodes) && !S_ISDIR(entry->st.st_mode) &&
+      entry->st.st_nlink > 1) {
+    entry->duplicate = !InodeAdd(w, entry->st.st_dev, entry->st.st_ino);
+  }
+
+  result = o->entry(entry, o->context);
+
+  if (result == DirWalkerStop) {
+    Stop(w);
+  } else if (result != DirWalkerSkip && !entry->error && S_ISDIR(entry->st.st_mode) &&
+             (entry->depth == 0 || (o->flags & DirWalkerRecursive))) {
+    char *path = strdup(entry->path);
+
+    if (path != NULL) {
+      QueuePush(w, t->id, path, entry->depth + 1);
+    }
+  }
+
+  if (++t->checkCount % CHECK_INTERVAL == 0) {
+    Check(t);
+  }
+}
+
+typedef struct {
+  int fd;
+  int error;  // errno of a failed read, 0 otherwise
+#ifdef SYS_getdents64
+  char *buffer;
+  long pos, end;
+#else
+  DIR *dir;
+#endif
+} DirReader;
+
+#ifdef SYS_getdents64
+struct linux_dirent64 {
+  uint64_t d_ino;
+  int64_t d_off;
+  unsigned short d_reclen;
+  unsigned char d_type;
+  char d_name[];
+};
+#endif
+
+// Name of the next entry, NULL at the end or on error (`r->error' is set)
+static const char *ReadEntryName(DirReader *r)
+{
+#ifdef SYS_getdents64
+  struct linux_dirent64 *d;
+
+  if (r->pos >= r->end) {
+    long n = syscall(SYS_getdents64, r->fd, r->buffer, DIRENT_BUFFER_SIZE);
+
+    if (n < 0) {
+      r->error = errno;
+    }
+    if (n <= 0) {
+      return NULL;
+    }
+    r->pos = 0;
+    r->end = n;
+  }
+  d = (struct linux_dirent64 *)(r->buffer + r->pos);
+  r->pos += d->d_reclen;
+  return d->d_name;
+#else
+  struct dirent *d;
+
+  if (r->dir == NULL && (r->dir = fdopendir(dup(r->fd))) == NULL) {
+    r->error = errno;
+    return NULL;
+  }
+  errno = 0;
+  d = readdir(r->dir);
+  if (d == NULL) {
+    r->error = errno;
+    return NULL;
+  }
+  return d->d_name;
+#endif
+}
+
+// The directory itself is reported again, with the error
+static void ReportDirectoryError(WalkThread *t, WalkJob *job, int error)
+{
+  DirWalkerOptions *o = t->walk->options;
+  DirWalkerEntry entry;
+
+  memset(&entry, 0, sizeof(entry));
+  entry.path = job->path;
+  entry.name = strrchr(job->path, '/') ? strrchr(job->path, '/') + 1 : job->path;
+  entry.depth = job->depth - 1;
+  entry.error = error;
+  o->entry(&entry, o->context);
+}
+
+static void ReadDirectory(WalkThread *t, WalkJob *job)
+{
+  DirWalkerOptions *o = t->walk->options;
+  DirWalkerEntry entry;
+  DirReader reader;
+  size_t length = strlen(job->path);
+  size_t size = length + 256;
+  char *path = malloc(size);
+  char *name;
+  const char *dname;
+
+  if (path == NULL) {
+    return;
+  }
+  memcpy(path, job->path, length);
+  if (length == 0 || path[length - 1] != '/') {
+    path[length++] = '/';
+  }
+  name = path + length;
+
+  memset(&reader, 0, sizeof(reader));
+  if (job->depth == 1 && (o->flags & DirWalkerFollowRoot)) {
+    reader.fd = open(job->path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  } else {
+    reader.fd = open(job->path, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+  }
+  if (reader.fd < 0) {
+    ReportDirectoryError(t, job, errno);
+    free(path);
+    return;
+  }
+#ifdef SYS_getdents64
+  reader.buffer = t->buffer;
+#endif
+
+  while (!__atomic_load_n(&t->walk->stop, __ATOMIC_RELAXED) && (dname = ReadEntryName(&reader)) != NULL) {
+    size_t nameLength;
+
+    if (dname[0] == '.' && (dname[1] == 0 || (dname[1] == '.' && dname[2] == 0))) {
+      continue;
+    }
+
+    nameLength = strlen(dname);
+    if (length + nameLength + 1 > size) {
+      char *p;
+
+      size = length + nameLength + 256;
+      if ((p = realloc(path, size)) == NULL) {
+        continue;
+      }
+      path = p;
+      name = path + length;
+    }
+    memcpy(name, dname, nameLength + 1);
+
+    memset(&entry, 0, sizeof(entry));
+    entry.path = path;
+    entry.name = name;
+    entry.depth = job->depth;
+    if (fstatat(reader.fd, name, &entry.st, AT_SYMLINK_NOFOLLOW) < 0) {
+      entry.error = errno;
+    }
+    Report(t, &entry);
+  }
+  if (reader.error) {
+    ReportDirectoryError(t, job, reader.error);
+  }
+
+#ifndef SYS_getdents64
+  if (reader.dir) {
+    closedir(reader.dir);
+  }
+#endif
+  close(reader.fd);
+  free(path);
+}
+
+static void *WalkThreadMain(void *arg)
+{
+  WalkThread *t = arg;
+  Walk *w = t->walk;
+  WalkJob job;
+
+  for (;;) {
+    unsigned long pushes;
+
+    pthread_mutex_lock(&w->lock);
+    pushes = w->pushes;
+    if (w->stop || w->pending == 0) {
+      pthread_mutex_unlock(&w->lock);
+      break;
+    }
+    pthread_mutex_unlock(&w->lock);
+
+    if (QueueTake(w, t->id, &job)) {
+      ReadDirectory(t, &job);
+      free(job.path);
+      JobDone(w);
+      Check(t);
+      continue;
+    }
+
+    // Nothing to steal: wait for a push or the end of the walk. The
+    // calling thread wakes up for ticks.
+    pthread_mutex_lock(&w->lock);
+    if (!w->stop && w->pending > 0 && w->pushes == pushes) {
+      w->waiting++;
+      if (t->id == 0 && w->options->tick) {
+        double deadline = w->nextTick;
+        struct timespec ts;
+
+        clock_gettime(CLOCK_REALTIME, &ts);
+        deadline = deadline - MonotonicTime();
+        if (deadline < 0) {
+          deadline = 0;
+        }
+        ts.tv_sec += (time_t)deadline;
+        ts.tv_nsec += (long)((deadline - (time_t)deadline) * 1e9);
+        if (ts.tv_nsec >= 1000000000) {
+          ts.tv_sec++;
+          ts.tv_nsec -= 1000000000;
+        }
+        pthread_cond_timedwait(&w->cond, &w->lock, &ts);
+      } else {
+        pthread_cond_wait(&w->cond, &w->lock);
+      }
+      w->waiting--;
+    }
+    pthread_mutex_unlock(&w->lock);
+    Check(t);
+  }
+
+  return NULL;
+}
+
+static void *WalkThreadStart(void *arg)
+{
+  WalkThread *t = arg;
+  DirWalkerOptions *o = t->walk->options;
+
+  if (o->thread) {
+    o->thread(1, o->context);
+  }
+  WalkThreadMain(t);
+  if (o->thread) {
+    o->thread(0, o->context);
+  }
+
+  return NULL;
+}
+
+int DirWalk(const char *root, DirWalkerOptions *options)
+{
+  Walk w;
+  WalkThread *t;
+  DirWalkerEntry entry;
+  WalkJob job;
+  int i, started;
+
+  memset(&entry, 0, sizeof(entry));
+  entry.path = root;
+  entry.name = strrchr(root, '/') && strrchr(root, '/')[1] ? strrchr(root, '/') + 1 : root;
+  if (fstatat(AT_FDCWD, root, &entry.st,
+              (options->flags & DirWalkerFollowRoot) ? 0 : AT_SYMLINK_NOFOLLOW) < 0) {
+    return -1;
+  }
+
+  memset(&w, 0, sizeof(w));
+  w.options = options;
+  w.numThreads = options->threads;
+  if (w.numThreads <= 0) {
+    w.numThreads = sysconf(_SC_NPROCESSORS_ONLN);
+  }
+  if (w.numThreads < 1) {
+    w.numThreads = 1;
+  } else if (w.numThreads > MAX_THREADS) {
+    w.numThreads = MAX_THREADS;
+  }
+  w.nextTick = MonotonicTime() + options->interval;
+  pthread_mutex_init(&w.lock, NULL);
+  pthread_cond_init(&w.cond, NULL);
+  for (i = 0; i < INODE_SHARDS; i++) {
+    pthread_mutex_init(&w.inodes[i].lock, NULL);
+  }
+
+  w.threads = calloc(w.numThreads, sizeof(WalkThread));
+  w.queues = calloc(w.numThreads, sizeof(WalkQueue));
+  for (i = 0; i < w.numThreads; i++) {
+    w.threads[i].walk = &w;
+    w.threads[i].id = i;
+    w.threads[i].buffer = malloc(DIRENT_BUFFER_SIZE);
+    pthread_mutex_init(&w.queues[i].lock, NULL);
+  }
+
+  // The root is reported (and queued if it's a directory) by the calling
+  // thread, then every thread takes jobs.
+  Report(&w.threads[0], &entry);
+
+  for (started = 1; started < w.numThreads; started++) {
+    t = &w.threads[started];
+    if (pthread_create(&t->thread, NULL, WalkThreadStart, t) != 0) {
+      break;
+    }
+  }
+  WalkThreadMain(&w.threads[0]);
+  for (i = 1; i < started; i++) {
+    pthread_join(w.threads[i].thread, NULL);
+  }
+
+  // Left over after a stop
+  while (QueueTake(&w, 0, &job)) {
+    free(job.path);
+  }
+  for (i = 0; i < w.numThreads; i++) {
+    free(w.queues[i].jobs);
+    pthread_mutex_destroy(&w.queues[i].lock);
+    free(w.threads[i].buffer);
+  }
+  for (i = 0; i < INODE_SHARDS; i++) {
+    free(w.inodes[i].inodes);
+    pthread_mutex_destroy(&w.inodes[i].lock);
+  }
+  free(w.threads);
+  free(w.queues);
+  pthread_cond_destroy(&w.cond);
+  pthread_mutex_destroy(&w.lock);
+
+  return w.stop ? 1 : 0;
+}
@@ -0,0 +1,77 @@
+/* -*- mode: c -*- */
+//
+// Project: Workspace
+//
+// Description: Directory tree walker shared by the Sizer and FileMover tools.
+//
+// This application is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public
+// License as published by the Free Software Foundation; either
+// version 2 of the License, or (at your option) any later version.
+//
+// This application is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Library General Public License for more details.
+//
+// You should have received a copy of the GNU General Public
+// License along with this library; if not, write to the Free
+// Software Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111 USA.
+//
+
+#ifndef __TOOLS_DIRWALKER_H__
+#define __TOOLS_DIRWALKER_H__
+
+#include <sys/stat.h>
+
+// Walk flags
+#define DirWalkerRecursive 1     // descend into subdirectories
+#define DirWalkerUniqueInodes 2  // mark second and later hard links as duplicates
+#define DirWalkerFollowRoot 4    // root may be a symbolic link to a directory
+
+// Entry function results
+#define DirWalkerContinue 0
+#define DirWalkerSkip 1  // don't descend into this directory
+#define DirWalkerStop 2  // stop the walk
+
+typedef struct {
+  const char *path;  // root path + relative path of the entry
+  const char *name;  // last path component
+  int depth;         // 0 for the root
+  struct stat st;    // lstat() of the entry, not valid if `error' is set
+  int error;         // errno of failed stat or directory read, 0 otherwise
+  int duplicate;     // another hard link to this inode was reported
+} DirWalkerEntry;
+
+typedef int (*DirWalkerFunc)(DirWalkerEntry *entry, void *context);
+
+typedef struct {
+  int flags;
+
+  // Number of threads walking the tree, 0 for the number of CPUs. With 1
+  // the whole walk is done on the calling thread: every entry of a
+  // directory is reported before the walk descends into its subdirectories.
+  int threads;
+
+  // Called for every entry, the root included. With more than one thread
+  // it's called from any of them at the same time.
+  DirWalkerFunc entry;
+
+  // Called on the calling thread every `interval' seconds, nonzero stops
+  // the walk. May be NULL.
+  int (*tick)(void *context);
+  double interval;
+
+  // Called with 1 when a thread started by the walk begins and with 0
+  // before it ends, e.g. to register it with the Objective-C runtime.
+  // May be NULL.
+  void (*thread)(int started, void *context);
+
+  void *context;
+} DirWalkerOptions;
+
+// Walks the tree at `root'. Returns 0 when done, 1 if stopped and -1 with
+// errno set if `root' can't be read.
+int DirWalk(const char *root, DirWalkerOptions *options);
+
+#endif
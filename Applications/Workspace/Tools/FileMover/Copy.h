@@ -30,6 +30,9 @@ BOOL CopyOperation(NSString *sourceDir, NSArray *files, NSString *destDir, Opera
 BOOL CopyFile(NSString *filename, NSString *sourcePrefix, NSString *targetPrefix, BOOL traverseLink,
               OperationType opType);
 
+BOOL CopyFileWithAttributes(NSString *filename, NSString *sourcePrefix, NSString *targetPrefix,
+                            NSDictionary *fattrs, OperationType opType);
+
 void DuplicateOperation(NSString *sourceDir, NSArray *files);
 
 BOOL DuplicateSymbolicLink(NSString *sourceFile, NSString *targetFile, NSDictionary *fattrs);
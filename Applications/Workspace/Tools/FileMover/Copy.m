@@ -21,11 +21,16 @@
 //
 
 #import "Copy.h"
+#import "FileCopy.h"
+#import "../DirWalker.h"
 #import "NSStringAdditions.h"
 
 #include <sys/types.h>
 #include <sys/stat.h>
 
+// Seconds between progress reports while a file is copied
+#define PROGRESS_INTERVAL 0.1
+
 // --- Copy
 
 void CleanUpAfterCopy(NSString *destDir, NSArray *files)
@@ -67,13 +72,83 @@ BOOL CopyOperation(NSString *sourceDir, NSArray *files, NSString *destDir, Opera
   return opResult;
 }
 
+typedef struct {
+  NSString *sourceDir;
+  NSString *targetDir;
+  OperationType opType;
+  BOOL readError;
+} CopyDirectoryContext;
+
+// The walker's lstat() results, without asking NSFileManager again
+static NSDictionary *AttributesFromStat(const struct stat *st)
+{
+  NSString *type;
+
+  switch (st->st_mode & S_IFMT) {
+    case S_IFREG:
+      type = NSFileTypeRegular;
+      break;
+    case S_IFDIR:
+      type = NSFileTypeDirectory;
+      break;
+    case S_IFLNK:
+      type = NSFileTypeSymbolicLink;
+      break;
+    case S_IFSOCK:
+      type = NSFileTypeSocket;
+      break;
+    case S_IFIFO:
+      type = NSFileTypeFifo;
+      break;
+    case S_IFCHR:
+      type = NSFileTypeCharacterSpecial;
+      break;
+    case S_IFBLK:
+      type = NSFileTypeBlockSpecial;
+      break;
+    default:
+      type = NSFileTypeUnknown;
+      break;
+  }
+
+  return [NSDictionary
+      dictionaryWithObjectsAndKeys:type, NSFileType,
+                                   [NSNumber numberWithUnsignedLongLong:st->st_size], NSFileSize,
+                                   [NSNumber numberWithUnsignedLong:(st->st_mode & 07777)],
+                                   NSFilePosixPermissions, nil];
+}
+
+static int CopyDirectoryEntry(DirWalkerEntry *entry, void *context)
+{
+  CopyDirectoryContext *c = context;
+  NSString *filename;
+
+  if (entry->depth == 0) {
+    // the directory itself: it's read or it can't be
+    if (entry->error) {
+      c->readError = YES;
+    }
+    return DirWalkerContinue;
+  }
+
+  CREATE_AUTORELEASE_POOL(pool);
+  filename = [[NSFileManager defaultManager] stringWithFileSystemRepresentation:entry->name
+                                                                         length:strlen(entry->name)];
+  if (entry->error) {
+    CopyFile(filename, c->sourceDir, c->targetDir, NO, c->opType);
+  } else {
+    CopyFileWithAttributes(filename, c->sourceDir, c->targetDir, AttributesFromStat(&entry->st),
+                           c->opType);
+  }
+  DESTROY(pool);
+
+  return isStopped ? DirWalkerStop : DirWalkerContinue;
+}
+
 BOOL CopyDirectory(NSString *sourceDir, NSString *targetDir, NSDictionary *fileAttributes,
                    OperationType opType)
 {
   NSFileManager *fm = [NSFileManager defaultManager];
-  NSArray *contents;
-  NSEnumerator *e;
-  NSString *filename;
   BOOL dir;
   Communicator *comm = [Communicator shared];
 
@@ -99,15 +174,26 @@ BOOL CopyDirectory(NSString *sourceDir, NSString *targetDir, NSDictionary *fileA
     return NO;
   }
 
-  contents = [fm directoryContentsAtPath:sourceDir];
-  if (contents == nil) {
-    [comm howToHandleProblem:ReadError];
-    return NO;
-  }
-
-  e = [contents objectEnumerator];
-  while (((filename = [e nextObject]) != nil) && !isStopped) {
-    CopyFile(filename, sourceDir, targetDir, NO, opType);
+  {
+    CopyDirectoryContext context;
+    DirWalkerOptions options = {0};
+
+    context.sourceDir = sourceDir;
+    context.targetDir = targetDir;
+    context.opType = opType;
+    context.readError = NO;
+
+    // Entries are copied as they are listed, in the order the directory
+    // returns them. Subdirectories are copied by CopyFile().
+    options.flags = DirWalkerFollowRoot;
+    options.threads = 1;
+    options.entry = CopyDirectoryEntry;
+    options.context = &context;
+
+    if (DirWalk([sourceDir fileSystemRepresentation], &options) < 0 || context.readError) {
+      [comm howToHandleProblem:ReadError];
+      return NO;
+    }
   }
 
   if (chmod([targetDir cString], [fileAttributes filePosixPermissions]) == -1) {
@@ -117,10 +203,35 @@ BOOL CopyDirectory(NSString *sourceDir, NSString *targetDir, NSDictionary *fileA
   return YES;
 }
 
+typedef struct {
+  NSString *filename;
+  NSString *sourceDir;
+  NSString *targetDir;
+  OperationType opType;
+  unsigned long long doneSize;
+} CopyProgressContext;
+
+static void CopyProgress(void *context, unsigned long long bytes)
+{
+  CopyProgressContext *progress = context;
+
+  progress->doneSize += bytes;
+  [[Communicator shared] showProcessingFilename:progress->filename
+                                   sourcePrefix:progress->sourceDir
+                                   targetPrefix:progress->targetDir
+                                  bytesAdvanced:bytes
+                                  operationType:progress->opType];
+}
+
+static int CopyStopped(void *context)
+{
+  return isStopped;
+}
+
 BOOL CopyRegular(NSString *sourceFile, NSString *targetFile, NSDictionary *fileAttributes,
                  OperationType opType)
 {
-  NSUInteger doneSize = 0;
+  unsigned long long doneSize = 0;
   NSString *sourceDir = [sourceFile stringByDeletingLastPathComponent];
   NSString *targetDir = [targetFile stringByDeletingLastPathComponent];
   NSFileManager *fm = [NSFileManager defaultManager];
@@ -149,10 +260,9 @@ BOOL CopyRegular(NSString *sourceFile, NSString *targetFile, NSDictionary *fileA
   }
 
   {
-    int read_fd, write_fd;
-    ssize_t bytes_read = 1;
-    size_t block_size = 64 * 1024;
-    void *buf;
+    int read_fd, write_fd, result;
+    FileCopyHandler handler = {0};
+    CopyProgressContext progress;
 
     read_fd = open([sourceFile cString], O_RDONLY);
     if (read_fd < 0) {
@@ -165,23 +275,31 @@ BOOL CopyRegular(NSString *sourceFile, NSString *targetFile, NSDictionary *fileA
       close(read_fd);
       return NO;
     }
-    buf = malloc(64 * 1024);
 
-    while (!isStopped && bytes_read) {
-      bytes_read = read(read_fd, buf, block_size);
-      if (bytes_read > 0) {
-        write(write_fd, buf, bytes_read);
-      }
-      doneSize += bytes_read;
-      [comm showProcessingFilename:[sourceFile lastPathComponent]
-                      sourcePrefix:sourceDir
-                      targetPrefix:targetDir
-                     bytesAdvanced:(NSUInteger)bytes_read
-                     operationType:opType];
+    progress.filename = [sourceFile lastPathComponent];
+    progress.sourceDir = sourceDir;
+    progress.targetDir = targetDir;
+    progress.opType = opType;
+    progress.doneSize = 0;
+
+    handler.methods = FileCopyAllMethods;
+    handler.progress = CopyProgress;
+    handler.interval = PROGRESS_INTERVAL;
+    handler.stopped = CopyStopped;
+    handler.context = &progress;
+
+    result = FileCopyContents(read_fd, write_fd, &handler);
+    if (result < 0) {
+      [comm howToHandleProblem:WriteError argument:[NSString errnoDescription]];
     }
+    NSDebugLLog(@"Tools", @"Copy %@: methods used 0x%x", sourceFile, handler.usedMethods);
     close(read_fd);
     close(write_fd);
-    free(buf);
+
+    if (result < 0) {
+      return NO;
+    }
+    doneSize = progress.doneSize;
   }
 
   if (!isStopped) {
@@ -277,14 +395,24 @@ BOOL CopyFile(NSString *filename, NSString *sourcePrefix, NSString *targetPrefix
 {
   NSFileManager *fm = [NSFileManager defaultManager];
   NSString *sourceFile;
-  NSString *targetFile;
   NSDictionary *fattrs;
+
+  sourceFile = [sourcePrefix stringByAppendingPathComponent:filename];
+  fattrs = [fm fileAttributesAtPath:sourceFile traverseLink:traverseLink];
+
+  return CopyFileWithAttributes(filename, sourcePrefix, targetPrefix, fattrs, opType);
+}
+
+BOOL CopyFileWithAttributes(NSString *filename, NSString *sourcePrefix, NSString *targetPrefix,
+                            NSDictionary *fattrs, OperationType opType)
+{
+  NSString *sourceFile;
+  NSString *targetFile;
   NSString *fileType;
   Communicator *comm = [Communicator shared];
 
   sourceFile = [sourcePrefix stringByAppendingPathComponent:filename];
   targetFile = [targetPrefix stringByAppendingPathComponent:filename];
-  fattrs = [fm fileAttributesAtPath:sourceFile traverseLink:traverseLink];
 
   NSDebugLLog(@"Tools", @"Copy filename: %@ %@ %@", filename, sourcePrefix, targetPrefix);
   [comm showProcessingFilename:filename
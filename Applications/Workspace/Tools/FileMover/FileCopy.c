@@ -0,0 +1,297 @@
+/* -*- mode: c -*- */
+//
+// Project: Workspace
+//
+// Description: The FileOperation tool's file contents copying engine.
+//
+// This application is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public
+// License as published by the Free Software Foundation; either
+// version 2 of the License, or (at your option) any later version.
+//
+// This application is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Library General Public License for more details.
+//
+// You should have received a copy of the GNU General Public
+// License along with this library; if not, write to the Free
+// Software Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111 USA.
+//
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#ifdef __linux__
+#include <linux/fs.h>
+#include <sys/sendfile.h>
+#endif
+
+#include "FileCopy.h"
+
+// Size of the blocks between checks of `stopped' for in-kernel copies.
+#define KERNEL_BLOCK_SIZE (8 * 1024 * 1024)
+// Buffer size of the read()/write() copy.
+#define BUFFER_SIZE (1024 * 1024)
+#define BUFFER_ALIGN 4096
+
+typedef struct {
+  int in, out;
+  FileCopyHandler *handler;
+  int methods;                 // still worth trying
+  void *buffer;
+  size_t bufferSize;
+  unsigned long long pending;  // bytes not reported yet
+  double lastReport;
+} CopyState;
+
+static double MonotonicTime(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void Report(CopyState *s, unsigned long long bytes, int force)
+{
+  FileCopyHandler *h = s->handler;
+  double now;
+
+  s->pending += bytes;
+  if (h->progress == NULL || s->pending == 0) {
+    return;
+  }
+  now = MonotonicTime();
+  if (force || now - s->lastReport >= h->interval) {
+    h->progress(h->context, s->pending);
+    s->pending = 0;
+    s->lastReport = now;
+  }
+}
+
+static int IsStopped(CopyState *s)
+{
+  return s->handler->stopped && s->handler->stopped(s->handler->context);
+}
+
+// Errors that mean "this way of copying doesn't work here".
+static int IsUnsupported(int error)
+{
+  return (error == ENOSYS || error == EXDEV || error == EINVAL || error == EOPNOTSUPP ||
+          error == ENOTTY || error == ENOTSUP || error == EBADF || error == EPERM);
+}
+
+#ifdef __linux__
+// Returns bytes copied (short at end of file), -1 on error, -2 if the
+// method should be dropped.
+static ssize_t CopyRange(CopyState *s, off_t offset, size_t length)
+{
+  loff_t inOffset = offset, outOffset = offset;
+  ssize_t n;
+
+  do {
+    n = copy_file_range(s->in, &inOffset, s->out, &outOffset, length, 0);
+  } while (n < 0 && errno == EINTR);
+
+  if (n < 0 && IsUnsupported(errno) && inOffset == offset) {
+    return -2;
+  }
+  return n;
+}
+
+static ssize_t CopySendfile(CopyState *s, off_t offset, size_t length)
+{
+  off_t inOffset = offset;
+  ssize_t n;
+
+  // sendfile() writes at the current position of `out'
+  if (lseek(s->out, offset, SEEK_SET) < 0) {
+    return -1;
+  }
+  do {
+    n = sendfile(s->out, s->in, &inOffset, length);
+  } while (n < 0 && errno == EINTR);
+
+  if (n < 0 && IsUnsupported(errno)) {
+    return -2;
+  }
+  return n;
+}
+#endif
+
+static ssize_t CopyBuffer(CopyState *s, off_t offset, size_t length)
+{
+  ssize_t n, written, w;
+
+  if (s->buffer == NULL) {
+    // no bigger than the file, small files are the common case
+    if (s->bufferSize > BUFFER_SIZE) {
+      s->bufferSize = BUFFER_SIZE;
+    }
+    s->bufferSize = (s->bufferSize + BUFFER_ALIGN - 1) & ~(BUFFER_ALIGN - 1);
+    if (posix_memalign(&s->buffer, BUFFER_ALIGN, s->bufferSize) != 0) {
+      s->buffer = NULL;
+      errno = ENOMEM;
+      return -1;
+    }
+  }
+  if (length > s->bufferSize) {
+    length = s->bufferSize;
+  }
+
+  do {
+    n = pread(s->in, s->buffer, length, offset);
+  } while (n < 0 && errno == EINTR);
+  if (n <= 0) {
+    return n;
+  }
+
+  // write() may write less than asked
+  for (written = 0; written < n; written += w) {
+    w = pwrite(s->out, (char *)s->buffer + written, n - written, offset + written);
+    if (w < 0) {
+      if (errno == EINTR) {
+        w = 0;
+        continue;
+      }
+      return -1;
+    }
+  }
+  return n;
+}
+
+// Copies `length' bytes at `offset' with the best method still available.
+static int CopySegment(CopyState *s, off_t offset, off_t length)
+{
+  ssize_t n;
+
+  while (length > 0) {
+    size_t chunk = length < KERNEL_BLOCK_SIZE ? length : KERNEL_BLOCK_SIZE;
+    int method;
+
+    if (IsStopped(s)) {
+      return 1;
+    }
+
+#ifdef __linux__
+    if (s->methods & FileCopyRange) {
+      method = FileCopyRange;
+      n = CopyRange(s, offset, chunk);
+    } else if (s->methods & FileCopySendfile) {
+      method = FileCopySendfile;
+      n = CopySendfile(s, offset, chunk);
+    } else
+#endif
+    {
+      method = FileCopyBuffer;
+      n = CopyBuffer(s, offset, chunk);
+    }
+
+    if (n == -2) {
+      s->methods &= ~method;
+      continue;
+    }
+    if (n < 0) {
+      return -1;
+    }
+    if (n == 0) {
+      if (method != FileCopyBuffer) {
+        // copy_file_range() and sendfile() may copy nothing from pseudo
+        // files (e.g. in /sys) before their size, read() tells where the
+        // file really ends
+        s->methods &= ~method;
+        continue;
+      }
+      // file got shorter while being copied
+      break;
+    }
+
+    s->handler->usedMethods |= method;
+    offset += n;
+    length -= n;
+    Report(s, n, 0);
+  }
+  return 0;
+}
+
+int FileCopyContents(int in, int out, FileCopyHandler *handler)
+{
+  CopyState s = {0};
+  struct stat st;
+  off_t data, hole;
+  int result = 0;
+
+  s.in = in;
+  s.out = out;
+  s.handler = handler;
+  s.methods = handler->methods | FileCopyBuffer;
+  s.lastReport = MonotonicTime();
+  handler->usedMethods = 0;
+
+  if (fstat(in, &st) < 0) {
+    return -1;
+  }
+  s.bufferSize = st.st_size;
+
+#if defined(__linux__) && defined(FICLONE)
+  if ((s.methods & FileCopyClone) && st.st_size > 0 && ioctl(out, FICLONE, in) == 0) {
+    handler->usedMethods = FileCopyClone;
+    Report(&s, st.st_size, 1);
+    return 0;
+  }
+#endif
+
+#ifdef __linux__
+  posix_fadvise(in, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+
+  if (st.st_size == 0) {
+    // Empty, or a /proc or /sys file without a size: read until the end.
+    // copy_file_range() would copy nothing from the latter.
+    s.methods = FileCopyBuffer;
+    s.bufferSize = BUFFER_ALIGN;
+    result = CopySegment(&s, 0, (off_t)1 << 62);
+  } else if ((off_t)st.st_blocks * 512 < st.st_size) {
+    // Fewer blocks than the size needs: there are holes, copy only the data.
+    for (data = 0; data < st.st_size && result == 0; data = hole) {
+      data = lseek(in, data, SEEK_DATA);
+      if (data < 0) {
+        if (errno == ENXIO) {
+          // only a hole is left
+          break;
+        }
+        // SEEK_DATA is not supported, copy everything
+        data = 0;
+        hole = st.st_size;
+      } else if ((hole = lseek(in, data, SEEK_HOLE)) < 0) {
+        hole = st.st_size;
+      }
+      if (hole > st.st_size) {
+        hole = st.st_size;
+      }
+      result = CopySegment(&s, data, hole - data);
+    }
+    // trailing hole
+    if (result == 0 && ftruncate(out, st.st_size) < 0) {
+      result = -1;
+    }
+  } else {
+    result = CopySegment(&s, 0, st.st_size);
+  }
+
+  if (result >= 0) {
+    Report(&s, 0, 1);
+  }
+
+  free(s.buffer);
+  return result;
+}
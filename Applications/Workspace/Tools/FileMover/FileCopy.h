@@ -0,0 +1,62 @@
+/* -*- mode: c -*- */
+//
+// Project: Workspace
+//
+// Description: The FileOperation tool's file contents copying engine.
+//
+// This application is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public
+// License as published by the Free Software Foundation; either
+// version 2 of the License, or (at your option) any later version.
+//
+// This application is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Library General Public License for more details.
+//
+// You should have received a copy of the GNU General Public
+// License along with this library; if not, write to the Free
+// Software Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111 USA.
+//
+
+#ifndef __FILEMOVER_FILECOPY_H__
+#define __FILEMOVER_FILECOPY_H__
+
+// Ways of copying tried by FileCopyContents(), fastest first. Every one
+// that the file systems (or kernel) don't support falls back to the next.
+typedef enum {
+  FileCopyClone = 1,      // reflink, blocks are shared (FICLONE)
+  FileCopyRange = 2,      // in-kernel copy (copy_file_range)
+  FileCopySendfile = 4,   // in-kernel copy (sendfile)
+  FileCopyBuffer = 8      // read()/write() of large aligned blocks
+} FileCopyMethod;
+
+#define FileCopyAllMethods (FileCopyClone | FileCopyRange | FileCopySendfile | FileCopyBuffer)
+
+typedef struct {
+  // Methods allowed to be used, FileCopyAllMethods normally.
+  // FileCopyBuffer is used anyway if nothing else works.
+  int methods;
+
+  // Called with the number of bytes copied since the last call. Calls are
+  // made at most every `interval' seconds and once at the end. Holes
+  // skipped in sparse files are not counted.
+  void (*progress)(void *context, unsigned long long bytes);
+  double interval;
+
+  // Checked between blocks, nonzero stops the copy.
+  int (*stopped)(void *context);
+
+  void *context;
+
+  // Set by FileCopyContents(): methods that were actually used.
+  int usedMethods;
+} FileCopyHandler;
+
+// Copies contents of file opened for reading as `in' to an empty file
+// opened for writing as `out'. Holes of sparse files are kept.
+// Returns 0 on success, 1 if handler's `stopped' asked to stop and
+// -1 with errno set on error.
+int FileCopyContents(int in, int out, FileCopyHandler *handler);
+
+#endif
@@ -0,0 +1,225 @@
+/*
+  Compares FileCopyContents() with the 64 KB read()/write() loop FileMover
+  used before. Workloads are made in a scratch directory: many small files,
+  one large file and one large sparse file. Every method is run over each
+  of them, copies are checked against the originals and throughput is
+  reported. Put the scratch directory on the file system of interest (and
+  drop caches between runs for cold numbers).
+
+  Usage: copybench [scratch-dir] [large-file-MB]
+*/
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "FileCopy.h"
+
+#define SMALL_FILES 2000
+#define SMALL_SIZE 6000
+
+typedef struct {
+  const char *name;
+  int methods; /* 0 for the old loop */
+} method_t;
+
+static method_t methods[] = {
+  {"read/write 64K (old)", 0},
+  {"buffer", FileCopyBuffer},
+  {"sendfile", FileCopySendfile},
+  {"copy_file_range", FileCopyRange},
+  {"all (with reflink)", FileCopyAllMethods},
+};
+#define NUM_METHODS (sizeof(methods) / sizeof(methods[0]))
+
+static unsigned long long reports;
+
+static double now(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void progress(void *context, unsigned long long bytes)
+{
+  (void)context;
+  (void)bytes;
+  reports++;
+}
+
+static void fail(const char *what, const char *path)
+{
+  fprintf(stderr, "%s %s: %s\n", what, path, strerror(errno));
+  exit(1);
+}
+
+static void write_file(const char *path, long long size, int sparse)
+{
+  static char block[1024 * 1024];
+  long long done;
+  int fd, i;
+
+  for (i = 0; i < (int)sizeof(block); i++)
+    block[i] = rand();
+  if ((fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644)) < 0)
+    fail("create", path);
+  for (done = 0; done < size; done += sizeof(block)) {
+    int n = size - done < (long long)sizeof(block) ? size - done : (int)sizeof(block);
+
+    /* sparse: 1 MB of data every 16 MB */
+    if (sparse && (done / sizeof(block)) % 16)
+      continue;
+    if (pwrite(fd, block, n, done) != n)
+      fail("write", path);
+  }
+  if (ftruncate(fd, size) < 0)
+    fail("truncate", path);
+  close(fd);
+}
+
+/* the loop FileMover had */
+static int old_copy(int in, int out)
+{
+  char *buf = malloc(64 * 1024);
+  ssize_t n;
+
+  while ((n = read(in, buf, 64 * 1024)) > 0) {
+    write(out, buf, n);
+    reports++;
+  }
+  free(buf);
+  return n < 0 ? -1 : 0;
+}
+
+static void copy(const char *from, const char *to, method_t *m)
+{
+  FileCopyHandler handler = {0};
+  int in, out;
+
+  if ((in = open(from, O_RDONLY)) < 0)
+    fail("open", from);
+  if ((out = open(to, O_WRONLY | O_CREAT | O_TRUNC, 0644)) < 0)
+    fail("create", to);
+
+  if (!m->methods) {
+    if (old_copy(in, out) < 0)
+      fail("copy", from);
+  } else {
+    handler.methods = m->methods;
+    handler.progress = progress;
+    handler.interval = 0.1;
+    if (FileCopyContents(in, out, &handler) != 0)
+      fail("copy", from);
+  }
+  close(in);
+  close(out);
+}
+
+static int same(const char *a, const char *b)
+{
+  static char ba[1024 * 1024], bb[1024 * 1024];
+  FILE *fa = fopen(a, "r"), *fb = fopen(b, "r");
+  size_t na, nb;
+  int result = 1;
+
+  do {
+    na = fread(ba, 1, sizeof(ba), fa);
+    nb = fread(bb, 1, sizeof(bb), fb);
+    if (na != nb || memcmp(ba, bb, na))
+      result = 0;
+  } while (result && na);
+  fclose(fa);
+  fclose(fb);
+  return result;
+}
+
+static long long allocated(const char *path)
+{
+  struct stat st;
+
+  stat(path, &st);
+  return (long long)st.st_blocks * 512;
+}
+
+int main(int argc, char **argv)
+{
+  const char *dir = argc > 1 ? argv[1] : ".";
+  long long large = (argc > 2 ? atoll(argv[2]) : 512) * 1024 * 1024;
+  char src[4096], dst[4096];
+  unsigned int i, m;
+  double t;
+
+  snprintf(src, sizeof(src), "%s/copybench-small", dir);
+  mkdir(src, 0755);
+  for (i = 0; i < SMALL_FILES; i++) {
+    snprintf(src, sizeof(src), "%s/copybench-small/%u", dir, i);
+    write_file(src, SMALL_SIZE + i % 1000, 0);
+  }
+  snprintf(src, sizeof(src), "%s/copybench-large", dir);
+  write_file(src, large, 0);
+  snprintf(src, sizeof(src), "%s/copybench-sparse", dir);
+  write_file(src, large * 2, 1);
+
+  printf("%-22s %14s %14s %14s %10s\n", "", "small files/s", "large MB/s", "sparse MB/s",
+         "reports");
+  for (m = 0; m < NUM_METHODS; m++) {
+    double small_rate, large_rate, sparse_rate;
+    int ok = 1;
+
+    reports = 0;
+    t = now();
+    for (i = 0; i < SMALL_FILES; i++) {
+      snprintf(src, sizeof(src), "%s/copybench-small/%u", dir, i);
+      snprintf(dst, sizeof(dst), "%s/copybench-small/%u.copy", dir, i);
+      copy(src, dst, &methods[m]);
+    }
+    small_rate = SMALL_FILES / (now() - t);
+    for (i = 0; i < SMALL_FILES; i++) {
+      snprintf(src, sizeof(src), "%s/copybench-small/%u", dir, i);
+      snprintf(dst, sizeof(dst), "%s/copybench-small/%u.copy", dir, i);
+      ok &= same(src, dst);
+      unlink(dst);
+    }
+
+    snprintf(src, sizeof(src), "%s/copybench-large", dir);
+    snprintf(dst, sizeof(dst), "%s/copybench-large.copy", dir);
+    t = now();
+    copy(src, dst, &methods[m]);
+    large_rate = large / (now() - t) / (1024 * 1024);
+    ok &= same(src, dst);
+    unlink(dst);
+
+    snprintf(src, sizeof(src), "%s/copybench-sparse", dir);
+    snprintf(dst, sizeof(dst), "%s/copybench-sparse.copy", dir);
+    t = now();
+    copy(src, dst, &methods[m]);
+    sparse_rate = large * 2 / (now() - t) / (1024 * 1024);
+    ok &= same(src, dst);
+    printf("%-22s %14.0f %14.0f %14.0f %10llu%s", methods[m].name, small_rate, large_rate,
+           sparse_rate, reports, ok ? "" : "  COPIES DIFFER");
+    printf("  (sparse copy uses %lld of %lld MB)\n", allocated(dst) / (1024 * 1024),
+           large * 2 / (1024 * 1024));
+    unlink(dst);
+  }
+
+  for (i = 0; i < SMALL_FILES; i++) {
+    snprintf(src, sizeof(src), "%s/copybench-small/%u", dir, i);
+    unlink(src);
+  }
+  snprintf(src, sizeof(src), "%s/copybench-small", dir);
+  rmdir(src);
+  snprintf(src, sizeof(src), "%s/copybench-large", dir);
+  unlink(src);
+  snprintf(src, sizeof(src), "%s/copybench-sparse", dir);
+  unlink(src);
+  return 0;
+}
@@ -20,46 +20,100 @@
 //
 
 #import "Size.h"
+#import "../DirWalker.h"
+
+#include <limits.h>
+#include <pthread.h>
+
+// Seconds between reports of the file being processed
+#define PROGRESS_INTERVAL 0.1
 
 static unsigned long long batchSize = 0;
 static unsigned long filecount = 0;
 
-@implementation Size
+// Entries are counted by the walker threads. The main thread asks for the
+// path of one of them now and then to show it.
+typedef struct {
+  OperationType opType;
+  Communicator *comm;
+  int wantPath;
+  pthread_mutex_t lock;
+  char path[PATH_MAX];
+} SizeWalk;
+
+static int SizeEntry(DirWalkerEntry *entry, void *context)
+{
+  SizeWalk *walk = context;
+  BOOL isDir = S_ISDIR(entry->st.st_mode);
+
+  // Directory that's been asked for is not counted, its contents are
+  if (!entry->error && !(entry->depth == 0 && isDir)) {
+    __atomic_add_fetch(&filecount, 1, __ATOMIC_RELAXED);
+    // Hard links are walked with DirWalkerUniqueInodes for SizingOp only:
+    // copies write every link's contents.
+    if (walk->opType != DeleteOp && !isDir && !entry->duplicate) {
+      __atomic_add_fetch(&batchSize, entry->st.st_size, __ATOMIC_RELAXED);
+    }
+  }
 
-// Recursive calculation of the 'dir' contents
-- (void)calculateBatchSizeInDirectory:(NSString *)dir
-                        operationType:(OperationType)opType
-                         communicator:(Communicator *)comm
+  if (__atomic_exchange_n(&walk->wantPath, 0, __ATOMIC_RELAXED)) {
+    pthread_mutex_lock(&walk->lock);
+    strncpy(walk->path, entry->path, sizeof(walk->path) - 1);
+    pthread_mutex_unlock(&walk->lock);
+  }
+
+  return (isStopped == YES) ? DirWalkerStop : DirWalkerContinue;
+}
+
+static int SizeTick(void *context)
 {
-  NSFileManager *fm = [NSFileManager defaultManager];
-  NSArray *dirContents = [fm directoryContentsAtPath:dir];
+  SizeWalk *walk = context;
   NSString *path = nil;
-  NSDictionary *fattrs = nil;
 
-  for (NSString *file in dirContents) {
-    path = [dir stringByAppendingPathComponent:file];
-    fattrs = [fm fileAttributesAtPath:path traverseLink:NO];
+  pthread_mutex_lock(&walk->lock);
+  if (walk->path[0] != 0) {
+    path = [[NSFileManager defaultManager] stringWithFileSystemRepresentation:walk->path
+                                                                       length:strlen(walk->path)];
+    walk->path[0] = 0;
+  }
+  pthread_mutex_unlock(&walk->lock);
+  __atomic_store_n(&walk->wantPath, 1, __ATOMIC_RELAXED);
+
+  if (path != nil) {
+    [walk->comm showProcessingFilename:[path lastPathComponent]
+                          sourcePrefix:[path stringByDeletingLastPathComponent]
+                          targetPrefix:nil
+                         bytesAdvanced:0
+                         operationType:SizingOp];
+  }
 
-    [comm showProcessingFilename:[path lastPathComponent]
-                    sourcePrefix:[path stringByDeletingLastPathComponent]
-                    targetPrefix:nil
-                   bytesAdvanced:0
-                   operationType:SizingOp];
+  return (isStopped == YES);
+}
 
-    if ([[fattrs fileType] isEqualToString:NSFileTypeDirectory]) {
-      // Recursion
-      [self calculateBatchSizeInDirectory:path operationType:opType communicator:comm];
-    } else {
-      if (opType != DeleteOp) {
-        batchSize += [fattrs fileSize];
-      }
-      filecount++;
-    }
-    filecount++;
+@implementation Size
+
+// Calculation of the 'path' contents on all CPUs
+- (void)calculateBatchSizeAtPath:(NSString *)path walk:(SizeWalk *)walk
+{
+  DirWalkerOptions options = {0};
 
-    if (isStopped == YES)
-      return;
+  options.flags = DirWalkerRecursive;
+  if (walk->opType == SizingOp) {
+    options.flags |= DirWalkerUniqueInodes;
   }
+  options.threads = 0;
+  options.entry = SizeEntry;
+  options.tick = SizeTick;
+  options.interval = PROGRESS_INTERVAL;
+  options.context = walk;
+
+  [walk->comm showProcessingFilename:[path lastPathComponent]
+                        sourcePrefix:[path stringByDeletingLastPathComponent]
+                        targetPrefix:nil
+                       bytesAdvanced:0
+                       operationType:SizingOp];
+
+  DirWalk([path fileSystemRepresentation], &options);
 }
 
 // Should update with printf:
@@ -74,6 +128,8 @@ static unsigned long filecount = 0;
                         sendIncrement:(BOOL)isIncrement
                          communicator:(Communicator *)comm
 {
+  SizeWalk walk;
+
   isStopped = NO;
 
   // if (opType == LinkOp || opType == MoveOp)
@@ -87,36 +143,26 @@ static unsigned long filecount = 0;
     return;
   }
 
+  memset(&walk, 0, sizeof(walk));
+  walk.opType = opType;
+  walk.comm = comm;
+  walk.wantPath = 1;
+  pthread_mutex_init(&walk.lock, NULL);
+
   if (!filenames) {  // Process all FS heirarchy starting from -Source directory
-    [self calculateBatchSizeInDirectory:sourceDir operationType:opType communicator:comm];
+    [self calculateBatchSizeAtPath:sourceDir walk:&walk];
   } else {  // Process objects specified in -Files located in -Source
-    NSFileManager *fm = [NSFileManager defaultManager];
-    NSString *path = nil;
-    NSDictionary *fattrs = nil;
-
     for (NSString *file in filenames) {
-      path = [sourceDir stringByAppendingPathComponent:file];
-      fattrs = [fm fileAttributesAtPath:path traverseLink:NO];
-
-      [comm showProcessingFilename:[file lastPathComponent]
-                      sourcePrefix:sourceDir
-                      targetPrefix:nil
-                     bytesAdvanced:0
-                     operationType:SizingOp];
-
-      if ([[fattrs fileType] isEqualToString:NSFileTypeDirectory]) {  // recursive
-        [self calculateBatchSizeInDirectory:path operationType:opType communicator:comm];
-      } else {
-        if (opType != DeleteOp) {
-          batchSize += [fattrs fileSize];
-        }
-        filecount++;
-      }
+      [self calculateBatchSizeAtPath:[sourceDir stringByAppendingPathComponent:file] walk:&walk];
       if (isStopped == YES)
-        return;
+        break;
     }
   }
 
+  pthread_mutex_destroy(&walk.lock);
+  if (isStopped == YES)
+    return;
+
   if (isIncrement) {
     printf("Q\tF\t%lu\t+\n", filecount);
     printf("Q\tS\t%llu\t+\n", batchSize);
@@ -95,6 +95,8 @@ int main(int argc, const char **argv)
     opType = DuplicateOp;
   } else if ([op isEqualToString:@"Delete"]) {
     opType = DeleteOp;
+  } else if ([op isEqualToString:@"Size"]) {
+    opType = SizingOp;
   } else {
     opType = CopyOp;
   }
@@ -639,7 +639,7 @@
 {
   NSString *path = [view pathToColumn:column];
   NSString *fullPath;
-  NSArray  *dirContents;
+  NXTDirectoryListing *dirContents;
 
   NSDebugLLog(@"Browser", @"<NSBrowser> load coumn:%@ for path:%@ %li/%li",
         path, [view path], [view selectedColumn], column);
@@ -657,7 +657,7 @@
 
   // Get sorted directory contents
   fullPath = [rootPath stringByAppendingPathComponent:currentPath];
-  dirContents = [fileViewer directoryContentsAtPath:path forPath:fullPath];
+  dirContents = [fileViewer directoryListingAtPath:path forPath:fullPath];
   fullPath = [self fullPath];
 
   int i = 0;
@@ -669,27 +669,28 @@
   }
   
   dispatch_sync(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_LOW, 0), ^{
-      NSString *fPath = [NSString stringWithString:fullPath];
-      NSArray  *dc = [dirContents copy];
+      NSString                *fPath = [NSString stringWithString:fullPath];
+      const NXTDirectoryEntry *entries = [dirContents entries];
     
-      // Fill column
-      // for (NSString *filename in dc) {
-      for (int i = 0; i < [dc count]; i++) {
+      // Fill column. Listing has attributes of entries: only folders need
+      // Workspace file type (applications and other bundles are leaves).
+      for (int i = 0; i < [dirContents count]; i++) {
         NSString    *fileName;
         NSString    *filePath;
         NSString    *wmFileType = nil;
-        NSString    *fmFileType = nil;
         NSString    *appName = nil;
         BrowserCell *bc;
 
         // [matrix addRow];
         bc = [matrix cellAtRow:i column:0];
 
-        fileName = [dc objectAtIndex:i];
-        filePath = [fPath stringByAppendingPathComponent:fileName];
-        [(NSWorkspace *)[NSApp delegate] getInfoForFile:filePath
-                                            application:&appName
-                                                   type:&wmFileType];
+        fileName = entries[i].name;
+        if (entries[i].isDirectory) {
+          filePath = [fPath stringByAppendingPathComponent:fileName];
+          [(NSWorkspace *)[NSApp delegate] getInfoForFile:filePath
+                                              application:&appName
+                                                     type:&wmFileType];
+        }
 
         if (![wmFileType isEqualToString:NSDirectoryFileType] &&
             ![wmFileType isEqualToString:NSFilesystemFileType]) {
@@ -697,9 +698,7 @@
         }
 
         // Modify display attributes and set title of cell
-        fmFileType = [[fileManager fileAttributesAtPath:filePath
-                                           traverseLink:NO] fileType];
-        if ([fmFileType isEqualToString:NSFileTypeSymbolicLink]) {
+        if (S_ISLNK(entries[i].mode)) {
           [bc setFont:[NSFont fontWithName:@"Helvetica-Oblique" size:12.0]];
         }
       
@@ -707,7 +706,6 @@
         [bc setLoaded:YES];
         // [sender displayColumn:column];
       }
-      [dc release];
       [fileViewer setWindowEdited:NO];
       [sender displayColumn:column];
     });
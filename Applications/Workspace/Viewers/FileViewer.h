@@ -33,7 +33,7 @@
 #import "PathView.h"
 #import "PathViewScroller.h"
 
-@class NXTIconView, NXTIcon, NXTIconLabel, ProcessManager;
+@class NXTIconView, NXTIcon, NXTIconLabel, NXTDirectoryListing, ProcessManager;
 
 @interface FileViewer : NSObject
 {
@@ -101,6 +101,7 @@
 - (NSString *)pathFromAbsolutePath:(NSString *)absolutePath;
 - (NSArray *)absolutePathsForPaths:(NSArray *)relPaths;
 - (NSArray *)directoryContentsAtPath:(NSString *)relPath forPath:(NSString *)targetPath;
+- (NXTDirectoryListing *)directoryListingAtPath:(NSString *)relPath forPath:(NSString *)targetPath;
 
 //=============================================================================
 // Actions
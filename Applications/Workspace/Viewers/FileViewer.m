@@ -606,6 +606,11 @@
 }
 
 - (NSArray *)directoryContentsAtPath:(NSString *)relPath forPath:(NSString *)targetPath
+{
+  return [[self directoryListingAtPath:relPath forPath:targetPath] names];
+}
+
+- (NXTDirectoryListing *)directoryListingAtPath:(NSString *)relPath forPath:(NSString *)targetPath
 {
   NXTFileManager *fm = [NXTFileManager defaultManager];
   NSString *path = [rootPath stringByAppendingPathComponent:relPath];
@@ -620,10 +625,10 @@
 
   showHiddenFiles = [fm isShowHiddenFiles];
 
-  return [fm directoryContentsAtPath:path
-                             forPath:targetPath
-                            sortedBy:sortFilesBy
-                          showHidden:showHiddenFiles];
+  return [fm directoryListingAtPath:path
+                            forPath:targetPath
+                           sortedBy:sortFilesBy
+                         showHidden:showHiddenFiles];
 }
 
 //=============================================================================
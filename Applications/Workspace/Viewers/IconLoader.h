@@ -0,0 +1,64 @@
+/* -*- mode: objc -*- */
+//
+// Project: Workspace
+//
+// Description: Resolves icons of files for viewers in background threads
+//              and caches them.
+//
+// This application is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public
+// License as published by the Free Software Foundation; either
+// version 2 of the License, or (at your option) any later version.
+//
+// This application is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Library General Public License for more details.
+//
+// You should have received a copy of the GNU General Public
+// License along with this library; if not, write to the Free
+// Software Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111 USA.
+//
+
+#import <Foundation/Foundation.h>
+
+@class NSImage, NXTIcon;
+
+// -[Controller iconForFile:] stats the file (and its folder), looks for
+// .dir.png and .dir.tiff and reads file contents. On a slow file system it
+// stalls the caller, so viewers get icons through IconLoader: cached image
+// (or a placeholder) is set at once, the icon is resolved by one of a few
+// worker threads and set on the main thread.
+//
+// Icons are cached by path together with device, inode, mtime and ctime of
+// the file. OSEFileSystemMonitor notifications mark them for checking,
+// cached icon is also checked when it's requested a while after the last
+// check.
+@interface IconLoader : NSObject
+{
+  NSLock *lock;
+  NSMutableDictionary *folders;  // folder path -> NSMutableDictionary: file name -> entry
+  NSUInteger entryCount;
+  NSMapTable *requests;          // NXTIcon -> path of the latest request
+  NSOperationQueue *queue;
+  NSImage *placeholder;
+}
+
++ (IconLoader *)sharedLoader;
+
+// Sets cached image or placeholder to `icon' and resolves the icon of
+// `path' if needed. May be called from any thread, the icon is updated on
+// the main thread. The latest request for icon wins.
+- (void)loadIconForFile:(NSString *)path intoIcon:(NXTIcon *)icon;
+// The same for icons of `paths', one icon per path.
+- (void)loadIconsForFiles:(NSArray *)paths intoIcons:(NSArray *)icons;
+
+// Cached icon, resolved in calling thread if there's none.
+- (NSImage *)iconForFile:(NSString *)path;
+
+// Forgets cached icon of `path'.
+- (void)invalidateFile:(NSString *)path;
+// Forgets all cached icons, e.g. when applications list has changed.
+- (void)invalidateAll;
+
+@end
@@ -0,0 +1,465 @@
+/* -*- mode: objc -*- */
+//
+// Project: Workspace
+//
+// Description: Resolves icons of files for viewers in background threads
+//              and caches them.
+//
+// This application is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public
+// License as published by the Free Software Foundation; either
+// version 2 of the License, or (at your option) any later version.
+//
+// This application is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Library General Public License for more details.
+//
+// You should have received a copy of the GNU General Public
+// License along with this library; if not, write to the Free
+// Software Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111 USA.
+//
+
+#include <sys/stat.h>
+
+#import <AppKit/AppKit.h>
+#import <DesktopKit/NXTIcon.h>
+#import <SystemKit/OSEFileSystemMonitor.h>
+
+#import "Controller.h"
+#import "Controller+NSWorkspace.h"
+#import "IconLoader.h"
+
+// Worker threads
+#define ICON_LOADER_THREADS 4
+// Files resolved by one operation
+#define ICON_LOADER_BATCH 32
+// Cached icons not checked for so many seconds are checked when requested
+#define ICON_CHECK_INTERVAL 10.0
+// Cache is emptied when it grows larger
+#define ICON_CACHE_MAX 20000
+
+@interface IconCacheEntry : NSObject
+{
+ @public
+  NSImage *image;
+  dev_t dev;
+  ino_t ino;
+  struct timespec mtime;
+  struct timespec ctime;
+  NSTimeInterval checkTime;
+  BOOL isStale;
+}
+@end
+
+@implementation IconCacheEntry
+- (void)dealloc
+{
+  [image release];
+  [super dealloc];
+}
+@end
+
+static inline BOOL EntryMatchesStat(IconCacheEntry *entry, struct stat *st)
+{
+  return (entry->ino == st->st_ino && entry->dev == st->st_dev &&
+          entry->mtime.tv_sec == st->st_mtim.tv_sec &&
+          entry->mtime.tv_nsec == st->st_mtim.tv_nsec &&
+          entry->ctime.tv_sec == st->st_ctim.tv_sec &&
+          entry->ctime.tv_nsec == st->st_ctim.tv_nsec);
+}
+
+@interface IconLoader (Private)
+- (IconCacheEntry *)_entryForFile:(NSString *)path;
+- (BOOL)_isRequestedFile:(NSString *)path forIcon:(NXTIcon *)icon;
+- (NSImage *)_resolveIconForFile:(NSString *)path;
+- (void)_setIcons:(NSArray *)results;
+- (void)_setCachedIcons:(NSArray *)results;
+@end
+
+//=============================================================================
+// Resolves icons of a batch of files
+//=============================================================================
+@interface IconLoaderOperation : NSOperation
+{
+  IconLoader *loader;
+  NSArray *paths;
+  NSArray *icons;
+}
+- (id)initWithLoader:(IconLoader *)aLoader paths:(NSArray *)filePaths icons:(NSArray *)fileIcons;
+@end
+
+@implementation IconLoaderOperation
+
+- (id)initWithLoader:(IconLoader *)aLoader paths:(NSArray *)filePaths icons:(NSArray *)fileIcons
+{
+  [super init];
+
+  if (self != nil) {
+    loader = [aLoader retain];
+    paths = [filePaths copy];
+    icons = [fileIcons copy];
+  }
+
+  return self;
+}
+
+- (void)dealloc
+{
+  [loader release];
+  [paths release];
+  [icons release];
+  [super dealloc];
+}
+
+- (void)main
+{
+  NSAutoreleasePool *pool = [NSAutoreleasePool new];
+  NSMutableArray *results = [NSMutableArray array];
+  NSString *folder = [[paths objectAtIndex:0] stringByDeletingLastPathComponent];
+  NSMutableArray *names = [NSMutableArray array];
+  NSUInteger i, count = [paths count];
+  NSString *path;
+  NXTIcon *icon;
+
+  for (i = 0; i < count; i++) {
+    path = [paths objectAtIndex:i];
+    if ([loader _isRequestedFile:path forIcon:[icons objectAtIndex:i]] == NO) {
+      continue;
+    }
+    if (names != nil && [[path stringByDeletingLastPathComponent] isEqualToString:folder]) {
+      [names addObject:[path lastPathComponent]];
+    } else {
+      names = nil;
+    }
+  }
+  // Files of the folder with unknown extensions are read at once
+  if ([names count] > 1) {
+    [[NSApp delegate] prepareIconsForFiles:names inDirectory:folder];
+  }
+
+  for (i = 0; i < count; i++) {
+    path = [paths objectAtIndex:i];
+    icon = [icons objectAtIndex:i];
+    if ([self isCancelled] == NO && [loader _isRequestedFile:path forIcon:icon]) {
+      [results addObject:@[ icon, path, [loader _resolveIconForFile:path] ]];
+    }
+  }
+
+  if ([results count] > 0) {
+    [loader performSelectorOnMainThread:@selector(_setIcons:)
+                             withObject:results
+                          waitUntilDone:NO];
+  }
+  [pool release];
+}
+
+@end
+
+//=============================================================================
+// IconLoader
+//=============================================================================
+@implementation IconLoader
+
+static IconLoader *sharedLoader = nil;
+
++ (IconLoader *)sharedLoader
+{
+  if (sharedLoader == nil) {
+    sharedLoader = [[IconLoader alloc] init];
+  }
+  return sharedLoader;
+}
+
+- (id)init
+{
+  [super init];
+
+  lock = [[NSLock alloc] init];
+  folders = [[NSMutableDictionary alloc] init];
+  requests = NSCreateMapTable(NSObjectMapKeyCallBacks, NSObjectMapValueCallBacks, 64);
+  queue = [[NSOperationQueue alloc] init];
+  [queue setMaxConcurrentOperationCount:ICON_LOADER_THREADS];
+  placeholder = [[NSImage _standardImageWithName:@"NXUnknown"] retain];
+
+  [[NSNotificationCenter defaultCenter] addObserver:self
+                                           selector:@selector(fileSystemChangedAtPath:)
+                                               name:OSEFileSystemChangedAtPath
+                                             object:nil];
+  return self;
+}
+
+- (void)dealloc
+{
+  [[NSNotificationCenter defaultCenter] removeObserver:self];
+  [queue cancelAllOperations];
+  [queue release];
+  NSFreeMapTable(requests);
+  [folders release];
+  [lock release];
+  [placeholder release];
+  [super dealloc];
+}
+
+// Must be called with `lock' held
+- (IconCacheEntry *)_entryForFile:(NSString *)path
+{
+  return [[folders objectForKey:[path stringByDeletingLastPathComponent]]
+      objectForKey:[path lastPathComponent]];
+}
+
+- (BOOL)_isRequestedFile:(NSString *)path forIcon:(NXTIcon *)icon
+{
+  BOOL isRequested;
+
+  [lock lock];
+  isRequested = [(NSString *)NSMapGet(requests, icon) isEqualToString:path];
+  [lock unlock];
+
+  return isRequested;
+}
+
+// Icon is resolved again only if the file has changed since it was cached.
+- (NSImage *)_resolveIconForFile:(NSString *)path
+{
+  struct stat st;
+  BOOL exists = (stat([path fileSystemRepresentation], &st) == 0);
+  IconCacheEntry *entry;
+  NSMutableDictionary *folder;
+  NSImage *image = nil;
+
+  [lock lock];
+  entry = [self _entryForFile:path];
+  if (entry != nil && exists && EntryMatchesStat(entry, &st)) {
+    entry->isStale = NO;
+    entry->checkTime = [NSDate timeIntervalSinceReferenceDate];
+    image = [[entry->image retain] autorelease];
+  }
+  [lock unlock];
+
+  if (image != nil) {
+    return image;
+  }
+
+  image = [[NSApp delegate] iconForFile:path];
+  if (exists == NO || image == nil) {
+    return image;
+  }
+
+  entry = [IconCacheEntry new];
+  entry->image = [image retain];
+  entry->dev = st.st_dev;
+  entry->ino = st.st_ino;
+  entry->mtime = st.st_mtim;
+  entry->ctime = st.st_ctim;
+  entry->checkTime = [NSDate timeIntervalSinceReferenceDate];
+
+  [lock lock];
+  if (entryCount >= ICON_CACHE_MAX) {
+    [folders removeAllObjects];
+    entryCount = 0;
+  }
+  folder = [folders objectForKey:[path stringByDeletingLastPathComponent]];
+  if (folder == nil) {
+    folder = [NSMutableDictionary dictionary];
+    [folders setObject:folder forKey:[path stringByDeletingLastPathComponent]];
+  }
+  if ([folder objectForKey:[path lastPathComponent]] == nil) {
+    entryCount++;
+  }
+  [folder setObject:entry forKey:[path lastPathComponent]];
+  [lock unlock];
+  [entry release];
+
+  return image;
+}
+
+// Results of IconLoaderOperation: arrays of icon, path and image.
+- (void)_setIcons:(NSArray *)results
+{
+  NXTIcon *icon;
+  NSString *path;
+  NSImage *image;
+  BOOL isRequested;
+
+  for (NSArray *result in results) {
+    icon = [result objectAtIndex:0];
+    path = [result objectAtIndex:1];
+    image = [result objectAtIndex:2];
+
+    [lock lock];
+    isRequested = [(NSString *)NSMapGet(requests, icon) isEqualToString:path];
+    if (isRequested) {
+      NSMapRemove(requests, icon);
+    }
+    [lock unlock];
+
+    if (isRequested && [icon iconImage] != image) {
+      [icon setIconImage:image];
+    }
+  }
+}
+
+// Cached images and placeholders set by -loadIconsForFiles:intoIcons:,
+// arrays of icon, path, image (or NSNull) and whether the icon is being
+// resolved. Request for icon may have been replaced since then.
+- (void)_setCachedIcons:(NSArray *)results
+{
+  NXTIcon *icon;
+  NSString *path;
+  id image;
+  BOOL isPending, isRequested;
+
+  for (NSArray *result in results) {
+    icon = [result objectAtIndex:0];
+    path = [result objectAtIndex:1];
+    image = [result objectAtIndex:2];
+    isPending = [[result objectAtIndex:3] boolValue];
+
+    [lock lock];
+    isRequested = [(NSString *)NSMapGet(requests, icon) isEqualToString:path];
+    if (isRequested && isPending == NO) {
+      NSMapRemove(requests, icon);
+    }
+    [lock unlock];
+
+    if (isRequested == NO) {
+      continue;
+    }
+    if (image != [NSNull null]) {
+      if ([icon iconImage] != image) {
+        [icon setIconImage:image];
+      }
+    } else if ([icon iconImage] == nil) {
+      [icon setIconImage:placeholder];
+    }
+  }
+}
+
+- (void)loadIconForFile:(NSString *)path intoIcon:(NXTIcon *)icon
+{
+  [self loadIconsForFiles:@[ path ] intoIcons:@[ icon ]];
+}
+
+- (void)loadIconsForFiles:(NSArray *)paths intoIcons:(NSArray *)icons
+{
+  NSTimeInterval now = [NSDate timeIntervalSinceReferenceDate];
+  NSMutableArray *loadPaths = [NSMutableArray array];
+  NSMutableArray *loadIcons = [NSMutableArray array];
+  NSMutableArray *cached = [NSMutableArray array];
+  IconLoaderOperation *op;
+  IconCacheEntry *entry;
+  NSUInteger i, count = [paths count];
+  NSString *path;
+  NXTIcon *icon;
+  id image;
+  BOOL isPending;
+
+  for (i = 0; i < count; i++) {
+    path = [paths objectAtIndex:i];
+    icon = [icons objectAtIndex:i];
+    image = [NSNull null];
+
+    [lock lock];
+    entry = [self _entryForFile:path];
+    if (entry != nil) {
+      image = [[entry->image retain] autorelease];
+    }
+    isPending = (entry == nil || entry->isStale || now - entry->checkTime > ICON_CHECK_INTERVAL);
+    NSMapInsert(requests, icon, path);
+    [lock unlock];
+
+    if (isPending) {
+      [loadPaths addObject:path];
+      [loadIcons addObject:icon];
+    }
+    [cached addObject:@[ icon, path, image, [NSNumber numberWithBool:isPending] ]];
+  }
+
+  // Icons are views: they're changed on the main thread only. Cached icons
+  // are queued before the operations, so they're set before resolved ones.
+  if ([NSThread isMainThread]) {
+    [self _setCachedIcons:cached];
+  } else if ([cached count] > 0) {
+    [self performSelectorOnMainThread:@selector(_setCachedIcons:)
+                           withObject:cached
+                        waitUntilDone:NO];
+  }
+
+  for (i = 0; i < [loadPaths count]; i += ICON_LOADER_BATCH) {
+    NSRange range = NSMakeRange(i, MIN(ICON_LOADER_BATCH, [loadPaths count] - i));
+
+    op = [[IconLoaderOperation alloc] initWithLoader:self
+                                               paths:[loadPaths subarrayWithRange:range]
+                                               icons:[loadIcons subarrayWithRange:range]];
+    [queue addOperation:op];
+    [op release];
+  }
+}
+
+- (NSImage *)iconForFile:(NSString *)path
+{
+  IconCacheEntry *entry;
+  NSImage *image = nil;
+
+  [lock lock];
+  entry = [self _entryForFile:path];
+  if (entry != nil && entry->isStale == NO) {
+    image = [[entry->image retain] autorelease];
+  }
+  [lock unlock];
+
+  return (image != nil) ? image : [self _resolveIconForFile:path];
+}
+
+- (void)invalidateFile:(NSString *)path
+{
+  NSMutableDictionary *folder;
+
+  [lock lock];
+  folder = [folders objectForKey:[path stringByDeletingLastPathComponent]];
+  if ([folder objectForKey:[path lastPathComponent]] != nil) {
+    [folder removeObjectForKey:[path lastPathComponent]];
+    entryCount--;
+  }
+  [lock unlock];
+}
+
+- (void)invalidateAll
+{
+  [lock lock];
+  [folders removeAllObjects];
+  entryCount = 0;
+  [lock unlock];
+}
+
+// Changes are coalesced per folder and only the last changed file is
+// reported, so all icons of the folder get checked. The folder's own icon
+// depends on .dir.png or .dir.tiff inside it.
+- (void)fileSystemChangedAtPath:(NSNotification *)notif
+{
+  NSDictionary *changes = [notif userInfo];
+  NSString *changedPath = [changes objectForKey:@"ChangedPath"];
+  NSString *changedFile = [changes objectForKey:@"ChangedFile"];
+  IconCacheEntry *entry;
+
+  if (changedPath == nil) {
+    return;
+  }
+
+  if ([changedFile hasPrefix:@".dir."]) {
+    [self invalidateFile:changedPath];
+  }
+
+  [lock lock];
+  for (entry in [[folders objectForKey:changedPath] objectEnumerator]) {
+    entry->isStale = YES;
+  }
+  entry = [self _entryForFile:changedPath];
+  if (entry != nil) {
+    entry->isStale = YES;
+  }
+  [lock unlock];
+}
+
+@end
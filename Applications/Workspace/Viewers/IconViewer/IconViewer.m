@@ -29,6 +29,7 @@
 #import <DesktopKit/NXTFileManager.h>
 
 #import <Viewers/FileViewer.h>
+#import <Viewers/IconLoader.h>
 #import <Viewers/PathIcon.h>
 #import <Viewers/PathView.h>
 #import "IconViewer.h"
@@ -77,10 +78,14 @@
     }
   }
 
-  // Leave in `items` array items to add.
+  // Leave in `items` array items to add. Icons of existing items are
+  // checked for changes.
   for (NSString *filename in itemsCopy) {
     icon = [view iconWithLabelString:filename];
     if (icon) {
+      [[IconLoader sharedLoader]
+          loadIconForFile:[directoryPath stringByAppendingPathComponent:filename]
+                 intoIcon:icon];
       [items removeObject:filename];
     }
   }
@@ -95,6 +100,7 @@
   NSUInteger     x, y, slotsWide, slotsTallVisible;
   NSMutableSet   *selectedIcons = [NSMutableSet new];
   NSMutableArray *iconsToAdd = [NSMutableArray new];
+  NSMutableArray *iconPaths = [NSMutableArray new];
 
   if (isAnimate != NO) {
     [iconView performSelectorOnMainThread:@selector(drawOpenAnimation)
@@ -114,16 +120,17 @@
   
   selectedIcons = [NSMutableSet new];
   iconsToAdd = [NSMutableArray new];
+
   
   for (NSString *filename in directoryContents) {
     path = [directoryPath stringByAppendingPathComponent:filename];
 
     anIcon = [[PathIcon alloc] init];
     [anIcon setLabelString:filename];
-    [anIcon setIconImage:[[NSApp delegate] iconForFile:path]];
     [anIcon setPaths:[NSArray arrayWithObject:path]];
 
     [iconsToAdd addObject:anIcon];
+    [iconPaths addObject:path];
     if ([selectedFiles containsObject:filename]) {
       [selectedIcons addObject:anIcon];
     }
@@ -136,15 +143,18 @@
     }
     // Add icons on per page basis
     if (y == slotsTallVisible && [iconView isAnimating] == NO) {
+      [[IconLoader sharedLoader] loadIconsForFiles:iconPaths intoIcons:iconsToAdd];
       [iconView performSelectorOnMainThread:@selector(addIcons:)
                                  withObject:iconsToAdd
                               waitUntilDone:YES];
       [iconsToAdd removeAllObjects];
+      [iconPaths removeAllObjects];
       x = y = 0;
     }
   }
 
   if ([iconsToAdd count] > 0) {
+    [[IconLoader sharedLoader] loadIconsForFiles:iconPaths intoIcons:iconsToAdd];
     [iconView performSelectorOnMainThread:@selector(addIcons:)
                                withObject:iconsToAdd
                             waitUntilDone:YES];
@@ -168,6 +178,7 @@
   NSDebugLLog(@"IconViewer", @"IconView: End path loading...");
   [selectedIcons release];
   [iconsToAdd release];
+  [iconPaths release];
   
   [directoryPath release];
   [directoryContents release];
@@ -555,7 +566,7 @@ static NSRect viewFrame;
   if (icon) {
     [icon setLabelString:[newName lastPathComponent]];
     path = [rootPath stringByAppendingPathComponent:newName];
-    [icon setIconImage:[[NSApp delegate] iconForFile:path]];
+    [[IconLoader sharedLoader] loadIconForFile:path intoIcon:icon];
   } else {
     [self displayPath:newName selection:selection];
   }
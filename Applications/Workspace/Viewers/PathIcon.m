@@ -37,6 +37,7 @@
 
 #import "Controller+NSWorkspace.h"
 #import "FileViewer.h"
+#import "IconLoader.h"
 #import <Processes/ProcessManager.h>
 #import "PathIcon.h"
 
@@ -763,11 +764,9 @@ static NSDragOperation savedMask;
 
 - (void)draggingExited:(id<NSDraggingInfo>)sender
 {
-  Controller *wsDelegate = [NSApp delegate];
-
   NSDebugLLog(@"PathIcon", @"[PathIcon] draggingExited");
   if (draggingMask != NSDragOperationNone) {
-    [self setIconImage:[wsDelegate iconForFile:[paths objectAtIndex:0]]];
+    [self setIconImage:[[IconLoader sharedLoader] iconForFile:[paths objectAtIndex:0]]];
   }
 }
 
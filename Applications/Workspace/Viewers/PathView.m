@@ -26,6 +26,7 @@
 #import <DesktopKit/NXTIconLabel.h>
 
 #import "FileViewer.h"
+#import "IconLoader.h"
 #import "PathIcon.h"
 #import "PathView.h"
 #import "PathViewScroller.h"
@@ -218,7 +219,7 @@
       }
       [icon deselect:nil];
       [icon setEditable:NO];
-      [icon setIconImage:[self imageForPath:path]];
+      [self loadImageOfIcon:icon forPath:path];
       [icon setPaths:[_owner absolutePathsForPaths:@[ path ]]];
     }
   }
@@ -245,7 +246,7 @@
       }
       [icon deselect:nil];
       [icon setEditable:NO];
-      [icon setIconImage:[self imageForPath:path]];
+      [self loadImageOfIcon:icon forPath:path];
       [icon setPaths:[_owner absolutePathsForPaths:@[ path ]]];
     } else {
       NSMutableArray *relPaths = [[NSMutableArray new] autorelease];
@@ -281,12 +282,11 @@
   [icons makeObjectsPerform:@selector(setDelegate:) withObject:self];
 }
 
-- (NSImage *)imageForPath:(NSString *)aPath
+- (void)loadImageOfIcon:(PathIcon *)icon forPath:(NSString *)aPath
 {
   NSString *fullPath = [[_owner rootPath] stringByAppendingPathComponent:aPath];
   // NSDebugLLog(@"PathView", @"[FileViewer] imageForIconAtPath: %@", aPath);
-  fullPath = [[_owner rootPath] stringByAppendingPathComponent:aPath];
-  return [[NSApp delegate] iconForFile:fullPath];
+  [[IconLoader sharedLoader] loadIconForFile:fullPath intoIcon:icon];
 }
 
 - (NSString *)path
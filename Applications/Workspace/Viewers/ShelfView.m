@@ -31,6 +31,7 @@
 #import <Controller.h>
 
 #import "Recycler.h"
+#import "IconLoader.h"
 #import "PathIcon.h"
 #import "ShelfView.h"
 
@@ -234,7 +235,7 @@
 
   icon = [[PathIcon new] autorelease];
   if ([paths count] == 1) {
-    [icon setIconImage:[[NSApp delegate] iconForFile:path]];
+    [[IconLoader sharedLoader] loadIconForFile:path intoIcon:icon];
   }
   [icon setPaths:paths];
   [icon setDoubleClickPassesClick:NO];
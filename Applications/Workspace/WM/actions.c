@@ -53,6 +53,7 @@
 #include "event.h"
 #include "animations.h"
 #include "iconyard.h"
+#include "moveres.h"
 
 #include "actions.h"
 
@@ -301,6 +302,7 @@ void wShadeWindow(WWindow *wwin)
 
   /* for the client it's just like iconification */
   wFrameWindowResize(wwin->frame, wwin->frame->core->width, wwin->frame->top_width - 1);
+  wMoveEdgesUpdateWindow(wwin);
 
   wwin->client.y = wwin->frame_y - wwin->client.height + wwin->frame->top_width;
   wWindowSynthConfigureNotify(wwin);
@@ -342,6 +344,7 @@ void wUnshadeWindow(WWindow *wwin)
   wwin->flags.skip_next_animation = 0;
   wFrameWindowResize(wwin->frame, wwin->frame->core->width,
                      wwin->frame->top_width + wwin->client.height + wwin->frame->bottom_width);
+  wMoveEdgesUpdateWindow(wwin);
 
   wwin->client.y = wwin->frame_y + wwin->frame->top_width;
   wWindowSynthConfigureNotify(wwin);
@@ -1516,6 +1519,8 @@ void wSelectWindow(WWindow *wwin, Bool flag)
       }
     }
   }
+  /* the border adds to the window size */
+  wMoveEdgesUpdateWindow(wwin);
 }
 
 void wMakeWindowVisible(WWindow *wwin)
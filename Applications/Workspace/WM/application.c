@@ -309,7 +309,6 @@ void wApplicationSwitchWindow(WWindow *wwin, Bool forward)
   new_wwin = (WWindow *)CFArrayGetValueAtIndex(wapp->windows, new_index);
   if (new_wwin->frame) {
       wRaiseFrame(new_wwin->frame->core);
-      CommitStacking(new_wwin->screen);
       if (!new_wwin->flags.mapped) {
         wMakeWindowVisible(new_wwin);
       } else {
@@ -193,7 +193,8 @@ void wClientConfigure(WWindow *wwin, XConfigureRequestEvent *xcre)
 #endif
   if (xcre->value_mask & CWStackMode) {
     WObjDescriptor *desc;
-    WWindow *sibling;
+    WWindow *sibling = NULL;
+    WCoreWindow *frame = wwin->frame->core;
 
     if ((xcre->value_mask & CWSibling) &&
         (XFindContext(dpy, xcre->above, w_global.context.client_win, (XPointer *)&desc) ==
@@ -204,11 +205,37 @@ void wClientConfigure(WWindow *wwin, XConfigureRequestEvent *xcre)
     } else {
       xwc.sibling = xcre->above;
     }
-    xwc.stack_mode = xcre->detail;
-    XConfigureWindow(dpy, wwin->frame->core->window, xcre->value_mask & (CWSibling | CWStackMode),
-                     &xwc);
-    /* fix stacking order */
-    RemakeStackList(wwin->screen);
+
+    /* Restack through the stacking list where it's possible - it restacks
+       only the frame in question. */
+    if (!(xcre->value_mask & CWSibling) && xcre->detail == Above) {
+      wRaiseFrame(frame);
+    } else if (!(xcre->value_mask & CWSibling) && xcre->detail == Below) {
+      wLowerFrame(frame);
+    } else if (sibling && sibling->frame->core == frame) {
+      /* X server refuses a window as its own sibling */
+    } else if (sibling && (xcre->detail == Above || xcre->detail == Below)) {
+      WCoreWindow *other = sibling->frame->core;
+
+      /* Window levels are kept: next to a window of another level means on
+         top or at the bottom of its own level. */
+      if (other->stacking->window_level > frame->stacking->window_level) {
+        wRaiseFrame(frame);
+      } else if (other->stacking->window_level < frame->stacking->window_level) {
+        wLowerFrame(frame);
+      } else if (xcre->detail == Above) {
+        MoveInStackListAbove(other, frame);
+      } else {
+        MoveInStackListUnder(other, frame);
+      }
+    } else {
+      /* TopIf, BottomIf and Opposite depend on what overlaps the window on
+         the X server (unmanaged windows included), and so does a sibling
+         we don't manage: the server restacks, the order is read back. */
+      xwc.stack_mode = xcre->detail;
+      XConfigureWindow(dpy, frame->window, xcre->value_mask & (CWSibling | CWStackMode), &xwc);
+      RemakeStackList(wwin->screen);
+    }
   }
 
   wClientGetGravityOffsets(wwin, &ofs_x, &ofs_y);
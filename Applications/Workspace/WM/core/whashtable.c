@@ -35,27 +35,46 @@
 #include "util.h"
 #include "string_utils.h"
 
-#define INITIAL_CAPACITY	23
+/*
+ * Open addressing with Robin Hood probing. All items of a table live in one
+ * slot array: no per-item allocation. Each slot caches the full hash of its
+ * key, so growing the table never calls the hash callback again and probing
+ * calls keyIsEqual only for slots whose hash matches.
+ */
+
+#define INITIAL_CAPACITY	32	/* must be a power of two */
 
+/* grow when the table is 7/8 full */
+#define MAX_LOAD(size)		((size) - ((size) >> 3))
 
 typedef struct HashItem {
   const void *key;
   const void *data;
 
-  struct HashItem *next;	/* collided item list */
+  unsigned hash;		/* cached hash of key */
+  unsigned distance;		/* probe distance + 1, 0 marks an empty slot */
 } HashItem;
 
 typedef struct WMHashTable {
   WMHashTableCallbacks callbacks;
 
   unsigned itemCount;
-  unsigned size;		/* table size */
+  unsigned size;		/* table size, power of two */
+  unsigned shift;		/* 32 - log2(size) */
 
-  HashItem **table;
+  HashItem *table;
 } HashTable;
 
-#define HASH(table, key)  (((table)->callbacks.hash ?                   \
-                            (*(table)->callbacks.hash)(key) : hashPtr(key)) % (table)->size)
+#define HASH(table, key)  ((table)->callbacks.hash ?                    \
+                           (*(table)->callbacks.hash)(key) : hashPtr(key))
+
+/* Fibonacci hashing: spreads weak hashes (pointers, small ints) over the
+ * high bits before they are used as a slot index */
+#define HOME(table, h)  (((unsigned)(h) * 2654435769U) >> (table)->shift)
+
+#define KEYEQ(table, k1, k2) ((table)->callbacks.keyIsEqual ?                 \
+                              (*(table)->callbacks.keyIsEqual)((k1), (k2)) :  \
+                              (k1) == (k2))
 
 #define DUPKEY(table, key) ((table)->callbacks.retainKey ?              \
                             (*(table)->callbacks.retainKey)(key) : (key))
@@ -65,13 +84,13 @@ typedef struct WMHashTable {
 
 static inline unsigned hashString(const void *param)
 {
-  const char *key = param;
-  unsigned ret = 0;
-  unsigned ctr = 0;
+  const unsigned char *key = param;
+  unsigned ret = 2166136261U;
 
+  /* FNV-1a */
   while (*key) {
-    ret ^= *key++ << ctr;
-    ctr = (ctr + 1) % sizeof(char *);
+    ret ^= *key++;
+    ret *= 16777619U;
   }
 
   return ret;
@@ -82,42 +101,76 @@ static inline unsigned hashPtr(const void *key)
   return ((size_t) key / sizeof(char *));
 }
 
-static void rellocateItem(WMHashTable *table, HashItem *item)
+static void allocTable(WMHashTable *table, unsigned size)
+{
+  unsigned bits = 0;
+
+  while ((1U << bits) < size)
+    bits++;
+
+  table->size = size;
+  table->shift = 32 - bits;
+  table->table = wmalloc(sizeof(HashItem) * size);
+}
+
+/* place an item that is known not to be in the table yet */
+static void placeItem(WMHashTable *table, HashItem item)
 {
-  unsigned h;
+  unsigned mask = table->size - 1;
+  unsigned i = HOME(table, item.hash);
+  HashItem tmp;
 
-  h = HASH(table, item->key);
+  item.distance = 1;
+  for (;;) {
+    HashItem *slot = &table->table[i];
 
-  item->next = table->table[h];
-  table->table[h] = item;
+    if (slot->distance == 0) {
+      *slot = item;
+      return;
+    }
+    /* take the slot from an item that is closer to its home */
+    if (slot->distance < item.distance) {
+      tmp = *slot;
+      *slot = item;
+      item = tmp;
+    }
+    i = (i + 1) & mask;
+    item.distance++;
+  }
 }
 
 static void rebuildTable(WMHashTable *table)
 {
-  HashItem *next;
-  HashItem **oldArray;
-  int i;
-  int oldSize;
-  int newSize;
+  HashItem *oldArray;
+  unsigned oldSize;
+  unsigned i;
 
   oldArray = table->table;
   oldSize = table->size;
 
-  newSize = table->size *2;
-
-  table->table = wmalloc(sizeof(char *) *newSize);
-  table->size = newSize;
+  allocTable(table, oldSize * 2);
 
   for (i = 0; i < oldSize; i++) {
-    while (oldArray[i] != NULL) {
-      next = oldArray[i]->next;
-      rellocateItem(table, oldArray[i]);
-      oldArray[i] = next;
-    }
+    if (oldArray[i].distance)
+      placeItem(table, oldArray[i]);
   }
   wfree(oldArray);
 }
 
+static void releaseKeys(WMHashTable *table)
+{
+  unsigned i;
+
+  if (!table->callbacks.releaseKey || table->itemCount == 0)
+    return;
+
+  for (i = 0; i < table->size; i++) {
+    if (table->table[i].distance) {
+      RELKEY(table, table->table[i].key);
+    }
+  }
+}
+
 WMHashTable *WMCreateHashTable(const WMHashTableCallbacks callbacks)
 {
   HashTable *table;
@@ -126,53 +179,28 @@ WMHashTable *WMCreateHashTable(const WMHashTableCallbacks callbacks)
 
   table->callbacks = callbacks;
 
-  table->size = INITIAL_CAPACITY;
-
-  table->table = wmalloc(sizeof(HashItem *) *table->size);
+  allocTable(table, INITIAL_CAPACITY);
 
   return table;
 }
 
 void WMResetHashTable(WMHashTable *table)
 {
-  HashItem *item, *tmp;
-  int i;
-
-  for (i = 0; i < table->size; i++) {
-    item = table->table[i];
-    while (item) {
-      tmp = item->next;
-      RELKEY(table, item->key);
-      wfree(item);
-      item = tmp;
-    }
-  }
+  releaseKeys(table);
 
   table->itemCount = 0;
 
   if (table->size > INITIAL_CAPACITY) {
     wfree(table->table);
-    table->size = INITIAL_CAPACITY;
-    table->table = wmalloc(sizeof(HashItem *) *table->size);
+    allocTable(table, INITIAL_CAPACITY);
   } else {
-    memset(table->table, 0, sizeof(HashItem *) *table->size);
+    memset(table->table, 0, sizeof(HashItem) * table->size);
   }
 }
 
 void WMFreeHashTable(WMHashTable *table)
 {
-  HashItem *item, *tmp;
-  int i;
-
-  for (i = 0; i < table->size; i++) {
-    item = table->table[i];
-    while (item) {
-      tmp = item->next;
-      RELKEY(table, item->key);
-      wfree(item);
-      item = tmp;
-    }
-  }
+  releaseKeys(table);
   wfree(table->table);
   wfree(table);
 }
@@ -182,37 +210,30 @@ unsigned WMCountHashTable(WMHashTable *table)
   return table->itemCount;
 }
 
-static HashItem *hashGetItem(WMHashTable *table, const void *key)
+static HashItem *hashGetItem(WMHashTable *table, const void *key, unsigned h)
 {
-  unsigned h;
+  unsigned mask = table->size - 1;
+  unsigned i = HOME(table, h);
+  unsigned distance = 1;
   HashItem *item;
 
-  h = HASH(table, key);
-  item = table->table[h];
-
-  if (table->callbacks.keyIsEqual) {
-    while (item) {
-      if ((*table->callbacks.keyIsEqual) (key, item->key)) {
-        break;
-      }
-      item = item->next;
-    }
-  } else {
-    while (item) {
-      if (key == item->key) {
-        break;
-      }
-      item = item->next;
-    }
+  /* an item can't be further away than the ones we pass by */
+  for (;;) {
+    item = &table->table[i];
+    if (item->distance < distance)
+      return NULL;
+    if (item->hash == h && KEYEQ(table, key, item->key))
+      return item;
+    i = (i + 1) & mask;
+    distance++;
   }
-  return item;
 }
 
 void *WMHashGet(WMHashTable *table, const void *key)
 {
   HashItem *item;
 
-  item = hashGetItem(table, key);
+  item = hashGetItem(table, key, HASH(table, key));
   if (!item)
     return NULL;
   return (void *)item->data;
@@ -222,7 +243,7 @@ Bool WMHashGetItemAndKey(WMHashTable *table, const void *key, void **retItem, vo
 {
   HashItem *item;
 
-  item = hashGetItem(table, key);
+  item = hashGetItem(table, key, HASH(table, key));
   if (!item)
     return False;
 
@@ -235,97 +256,77 @@ Bool WMHashGetItemAndKey(WMHashTable *table, const void *key, void **retItem, vo
 
 void *WMHashInsert(WMHashTable *table, const void *key, const void *data)
 {
-  unsigned h;
+  unsigned h = HASH(table, key);
   HashItem *item;
-  int replacing = 0;
-
-  h = HASH(table, key);
-  /* look for the entry */
-  item = table->table[h];
-  if (table->callbacks.keyIsEqual) {
-    while (item) {
-      if ((*table->callbacks.keyIsEqual) (key, item->key)) {
-        replacing = 1;
-        break;
-      }
-      item = item->next;
-    }
-  } else {
-    while (item) {
-      if (key == item->key) {
-        replacing = 1;
-        break;
-      }
-      item = item->next;
-    }
-  }
+  HashItem nitem;
 
-  if (replacing) {
-    const void *old;
+  item = hashGetItem(table, key, h);
+  if (item) {
+    const void *old = item->data;
+    const void *oldKey = item->key;
 
-    old = item->data;
     item->data = data;
-    RELKEY(table, item->key);
     item->key = DUPKEY(table, key);
+    RELKEY(table, oldKey);
 
     return (void *)old;
-  } else {
-    HashItem *nitem;
-
-    nitem = wmalloc(sizeof(HashItem));
-    nitem->key = DUPKEY(table, key);
-    nitem->data = data;
-    nitem->next = table->table[h];
-    table->table[h] = nitem;
-
-    table->itemCount++;
   }
 
-  /* OPTIMIZE: put this in an idle handler. */
-  if (table->itemCount > table->size) {
-#ifdef DEBUG0
-    printf("rebuilding hash table...\n");
-#endif
+  if (table->itemCount + 1 > MAX_LOAD(table->size))
     rebuildTable(table);
-#ifdef DEBUG0
-    printf("finished rebuild.\n");
-#endif
-  }
+
+  nitem.key = DUPKEY(table, key);
+  nitem.data = data;
+  nitem.hash = h;
+  nitem.distance = 0;
+  placeItem(table, nitem);
+
+  table->itemCount++;
 
   return NULL;
 }
 
-static HashItem *deleteFromList(HashTable *table, HashItem *item, const void *key)
+void WMHashRemove(WMHashTable *table, const void *key)
 {
-  HashItem *next;
-
-  if (item == NULL)
-    return NULL;
-
-  if ((table->callbacks.keyIsEqual && (*table->callbacks.keyIsEqual) (key, item->key))
-      || (!table->callbacks.keyIsEqual && key == item->key)) {
-
-    next = item->next;
-    RELKEY(table, item->key);
-    wfree(item);
-
-    table->itemCount--;
+  unsigned mask = table->size - 1;
+  HashItem *item;
+  unsigned i, next;
 
-    return next;
+  item = hashGetItem(table, key, HASH(table, key));
+  if (!item)
+    return;
+
+  RELKEY(table, item->key);
+  table->itemCount--;
+
+  /* backward shift: pull the following displaced items one slot closer to
+   * their home, so no tombstones are needed */
+  i = item - table->table;
+  next = (i + 1) & mask;
+  while (table->table[next].distance > 1) {
+    table->table[i] = table->table[next];
+    table->table[i].distance--;
+    i = next;
+    next = (next + 1) & mask;
   }
-
-  item->next = deleteFromList(table, item->next, key);
-
-  return item;
+  memset(&table->table[i], 0, sizeof(HashItem));
 }
 
-void WMHashRemove(WMHashTable *table, const void *key)
+/* enumerator->index is the next slot to look at, nextItem is not used */
+static HashItem *nextEnumeratorItem(WMHashEnumerator *enumerator)
 {
-  unsigned h;
+  HashTable *table = enumerator->table;
 
-  h = HASH(table, key);
+  /* this assumes the table doesn't change between
+   * WMEnumerateHashTable() and WMNextHashEnumerator*() calls */
+
+  while (enumerator->index < table->size) {
+    HashItem *item = &table->table[enumerator->index++];
+    if (item->distance)
+      return item;
+  }
 
-  table->table[h] = deleteFromList(table, table->table[h], key);
+  return NULL;
 }
 
 WMHashEnumerator WMEnumerateHashTable(WMHashTable *table)
@@ -334,82 +335,34 @@ WMHashEnumerator WMEnumerateHashTable(WMHashTable *table)
 
   enumerator.table = table;
   enumerator.index = 0;
-  enumerator.nextItem = table->table[0];
+  enumerator.nextItem = NULL;
 
   return enumerator;
 }
 
 void *WMNextHashEnumeratorItem(WMHashEnumerator *enumerator)
 {
-  const void *data = NULL;
-
-  /* this assumes the table doesn't change between
-   *WMEnumerateHashTable() and WMNextHashEnumeratorItem() calls */
-
-  if (enumerator->nextItem == NULL) {
-    HashTable *table = enumerator->table;
-    while (++enumerator->index < table->size) {
-      if (table->table[enumerator->index] != NULL) {
-        enumerator->nextItem = table->table[enumerator->index];
-        break;
-      }
-    }
-  }
-
-  if (enumerator->nextItem) {
-    data = ((HashItem *) enumerator->nextItem)->data;
-    enumerator->nextItem = ((HashItem *) enumerator->nextItem)->next;
-  }
+  HashItem *item = nextEnumeratorItem(enumerator);
 
-  return (void *)data;
+  return item ? (void *)item->data : NULL;
 }
 
 void *WMNextHashEnumeratorKey(WMHashEnumerator *enumerator)
 {
-  const void *key = NULL;
+  HashItem *item = nextEnumeratorItem(enumerator);
 
-  /* this assumes the table doesn't change between
-   *WMEnumerateHashTable() and WMNextHashEnumeratorKey() calls */
-
-  if (enumerator->nextItem == NULL) {
-    HashTable *table = enumerator->table;
-    while (++enumerator->index < table->size) {
-      if (table->table[enumerator->index] != NULL) {
-        enumerator->nextItem = table->table[enumerator->index];
-        break;
-      }
-    }
-  }
-
-  if (enumerator->nextItem) {
-    key = ((HashItem *) enumerator->nextItem)->key;
-    enumerator->nextItem = ((HashItem *) enumerator->nextItem)->next;
-  }
-
-  return (void *)key;
+  return item ? (void *)item->key : NULL;
 }
 
 Bool WMNextHashEnumeratorItemAndKey(WMHashEnumerator *enumerator, void **item, void **key)
 {
-  /* this assumes the table doesn't change between
-   *WMEnumerateHashTable() and WMNextHashEnumeratorItemAndKey() calls */
-
-  if (enumerator->nextItem == NULL) {
-    HashTable *table = enumerator->table;
-    while (++enumerator->index < table->size) {
-      if (table->table[enumerator->index] != NULL) {
-        enumerator->nextItem = table->table[enumerator->index];
-        break;
-      }
-    }
-  }
+  HashItem *next = nextEnumeratorItem(enumerator);
 
-  if (enumerator->nextItem) {
+  if (next) {
     if (item)
-      *item = (void *)((HashItem *) enumerator->nextItem)->data;
+      *item = (void *)next->data;
     if (key)
-      *key = (void *)((HashItem *) enumerator->nextItem)->key;
-    enumerator->nextItem = ((HashItem *) enumerator->nextItem)->next;
+      *key = (void *)next->key;
 
     return True;
   }
@@ -180,10 +180,10 @@ void wFrameWindowUpdateBorders(WFrameWindow *fwin, int flags)
     } else {
       /* we had a titlebar, but now we don't need it anymore */
       for (i = 0; i < (fwin->flags.single_texture ? 1 : 3); i++) {
-        FREE_PIXMAP(fwin->title_back[i]);
+        RELEASE_PIXMAP(fwin->screen_ptr, fwin->title_back[i]);
         if (wPreferences.titlebar_style == TS_NEW) {
-          FREE_PIXMAP(fwin->lbutton_back[i]);
-          FREE_PIXMAP(fwin->rbutton_back[i]);
+          RELEASE_PIXMAP(fwin->screen_ptr, fwin->lbutton_back[i]);
+          RELEASE_PIXMAP(fwin->screen_ptr, fwin->rbutton_back[i]);
         }
       }
       if (fwin->left_button)
@@ -299,6 +299,7 @@ void wFrameWindowUpdateBorders(WFrameWindow *fwin, int flags)
       fwin->bottom_width = 0;
       wCoreDestroy(fwin->resizebar);
       fwin->resizebar = NULL;
+      RELEASE_PIXMAP(fwin->screen_ptr, fwin->resizebar_back[0]);
     }
   }
 
@@ -387,12 +388,13 @@ void wFrameWindowDestroy(WFrameWindow *fwin)
     wfree(fwin->title);
 
   for (i = 0; i < (fwin->flags.single_texture ? 1 : 3); i++) {
-    FREE_PIXMAP(fwin->title_back[i]);
+    RELEASE_PIXMAP(fwin->screen_ptr, fwin->title_back[i]);
     if (wPreferences.titlebar_style == TS_NEW) {
-      FREE_PIXMAP(fwin->lbutton_back[i]);
-      FREE_PIXMAP(fwin->rbutton_back[i]);
+      RELEASE_PIXMAP(fwin->screen_ptr, fwin->lbutton_back[i]);
+      RELEASE_PIXMAP(fwin->screen_ptr, fwin->rbutton_back[i]);
     }
   }
+  RELEASE_PIXMAP(fwin->screen_ptr, fwin->resizebar_back[0]);
 
   wfree(fwin);
 }
@@ -508,11 +510,30 @@ static void renderTexture(WScreen *scr, WTexture *texture, int width, int height
   RImage *img;
   RImage *limg, *rimg, *mimg;
   int x, w;
+  int variant;
+  Bool new_style = (wPreferences.titlebar_style == TS_NEW);
 
   *title = None;
   *lbutton = None;
   *rbutton = None;
 
+  variant = (wPreferences.titlebar_style << 2) | (right ? 2 : 0) | (left ? 1 : 0);
+
+  *title = wTextureCacheGet(scr, texture, width, height, WTC_TITLEBAR, variant);
+  if (*title != None) {
+    if (new_style && left)
+      *lbutton = wTextureCacheGet(scr, texture, width, height, WTC_LBUTTON, variant);
+    if (new_style && right)
+      *rbutton = wTextureCacheGet(scr, texture, width, height, WTC_RBUTTON, variant);
+    if ((!new_style || !left || *lbutton != None) && (!new_style || !right || *rbutton != None))
+      return;
+
+    /* partially evicted, render everything again */
+    RELEASE_PIXMAP(scr, *title);
+    RELEASE_PIXMAP(scr, *lbutton);
+    RELEASE_PIXMAP(scr, *rbutton);
+  }
+
   img = wTextureRenderImage(texture, width, height, WREL_FLAT);
   if (!img) {
     WMLogWarning(_("could not render texture: %s"), RMessageForError(RErrorCode));
@@ -574,6 +595,10 @@ static void renderTexture(WScreen *scr, WTexture *texture, int width, int height
   }
 
   RReleaseImage(img);
+
+  wTextureCachePut(scr, texture, width, height, WTC_TITLEBAR, variant, *title);
+  wTextureCachePut(scr, texture, width, height, WTC_LBUTTON, variant, *lbutton);
+  wTextureCachePut(scr, texture, width, height, WTC_RBUTTON, variant, *rbutton);
 }
 
 static void renderResizebarTexture(WScreen *scr, WTexture *texture, int width, int height,
@@ -583,7 +608,9 @@ static void renderResizebarTexture(WScreen *scr, WTexture *texture, int width, i
   RColor light;
   RColor dark;
 
-  *pmap = None;
+  *pmap = wTextureCacheGet(scr, texture, width, height, WTC_RESIZEBAR, cwidth);
+  if (*pmap != None)
+    return;
 
   img = wTextureRenderImage(texture, width, height, WREL_FLAT);
   if (!img) {
@@ -618,6 +645,8 @@ static void renderResizebarTexture(WScreen *scr, WTexture *texture, int width, i
     WMLogWarning(_("error rendering image: %s"), RMessageForError(RErrorCode));
 
   RReleaseImage(img);
+
+  wTextureCachePut(scr, texture, width, height, WTC_RESIZEBAR, cwidth, *pmap);
 }
 
 static void updateTexture(WFrameWindow *fwin)
@@ -664,10 +693,10 @@ static void remakeTexture(WFrameWindow *fwin, int state)
   Pixmap pmap, lpmap, rpmap;
 
   if (fwin->title_texture[state] && fwin->titlebar) {
-    FREE_PIXMAP(fwin->title_back[state]);
+    RELEASE_PIXMAP(fwin->screen_ptr, fwin->title_back[state]);
     if (wPreferences.titlebar_style == TS_NEW) {
-      FREE_PIXMAP(fwin->lbutton_back[state]);
-      FREE_PIXMAP(fwin->rbutton_back[state]);
+      RELEASE_PIXMAP(fwin->screen_ptr, fwin->lbutton_back[state]);
+      RELEASE_PIXMAP(fwin->screen_ptr, fwin->rbutton_back[state]);
     }
 
     if (fwin->title_texture[state]->any.type != WTEX_SOLID) {
@@ -692,7 +721,7 @@ static void remakeTexture(WFrameWindow *fwin, int state)
     }
   }
   if (fwin->resizebar_texture && fwin->resizebar_texture[0] && fwin->resizebar && state == 0) {
-    FREE_PIXMAP(fwin->resizebar_back[0]);
+    RELEASE_PIXMAP(fwin->screen_ptr, fwin->resizebar_back[0]);
 
     if (fwin->resizebar_texture[0]->any.type != WTEX_SOLID) {
       renderResizebarTexture(fwin->screen_ptr, fwin->resizebar_texture[0], fwin->resizebar->width,
@@ -735,14 +735,25 @@ static Pixmap renderTexture(WMenu *menu)
   RColor light;
   RColor dark;
   RColor mid;
+  int height, variant;
   WScreen *scr = menu->menu->screen_ptr;
   WTexture *texture = scr->menu_item_texture;
 
   if (wPreferences.menu_style == MS_NORMAL) {
-    img = wTextureRenderImage(texture, menu->menu->width, menu->item_height, WREL_MENUENTRY);
+    height = menu->item_height;
   } else {
-    img = wTextureRenderImage(texture, menu->menu->width, menu->menu->height + 1, WREL_MENUENTRY);
+    height = menu->menu->height + 1;
   }
+  /* separators of single texture menus depend on item layout */
+  variant = wPreferences.menu_style;
+  if (wPreferences.menu_style == MS_SINGLE_TEXTURE)
+    variant |= (menu->item_height << 4) | (menu->items_count << 16);
+
+  pix = wTextureCacheGet(scr, texture, menu->menu->width, height, WTC_MENU, variant);
+  if (pix != None)
+    return pix;
+
+  img = wTextureRenderImage(texture, menu->menu->width, height, WREL_MENUENTRY);
   if (!img) {
     WMLogWarning(_("could not render texture: %s"), RMessageForError(RErrorCode));
 
@@ -775,6 +786,8 @@ static Pixmap renderTexture(WMenu *menu)
   }
   RReleaseImage(img);
 
+  wTextureCachePut(scr, texture, menu->menu->width, height, WTC_MENU, variant, pix);
+
   return pix;
 }
 
@@ -785,7 +798,7 @@ static void updateTexture(WMenu *menu)
   /* setup background texture */
   if (scr->menu_item_texture->any.type != WTEX_SOLID) {
     if (!menu->flags.brother) {
-      FREE_PIXMAP(menu->menu_texture_data);
+      RELEASE_PIXMAP(scr, menu->menu_texture_data);
 
       menu->menu_texture_data = renderTexture(menu);
 
@@ -937,7 +950,7 @@ void wMenuDestroy(WMenu *menu, int recurse)
     }
   }
 
-  FREE_PIXMAP(menu->menu_texture_data);
+  RELEASE_PIXMAP(menu->menu->screen_ptr, menu->menu_texture_data);
 
   if (menu->submenus) {
     wfree(menu->submenus);
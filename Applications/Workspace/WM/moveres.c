@@ -622,15 +622,40 @@ static void crossDesktop(WScreen *scr, WWindow *wwin, int opaque_move, int new_d
   }
 }
 
+/* Border of a window as seen by edge resistance */
 typedef struct {
-  /* arrays of WWindows sorted by the respective border position */
-  WWindow **topList;    /* top border */
-  WWindow **leftList;   /* left border */
-  WWindow **rightList;  /* right border */
-  WWindow **bottomList; /* bottom border */
+  int pos;      /* border coordinate */
+  int lo, hi;   /* extent of the border along the other axis */
+  WWindow *wwin;
+} MoveEdge;
+
+/* Borders of a window the last time it was put into the index */
+typedef struct {
+  int top, left, right, bottom;
+} MoveEdgeBox;
+
+/*
+ * Borders of all managed windows of a screen. The lists are kept sorted
+ * while windows are managed, moved, resized and unmanaged, so a move only
+ * has to look its neighbours up. Whether a border counts (desktop, hidden,
+ * miniaturized...) is decided when it is looked at.
+ */
+typedef struct WMoveEdges {
+  /* sorted from closest to the border of the screen to farthest */
+  MoveEdge *topList;    /* top border, descending */
+  MoveEdge *leftList;   /* left border, descending */
+  MoveEdge *rightList;  /* right border, ascending */
+  MoveEdge *bottomList; /* bottom border, ascending */
   int count;
+  int size;
 
-  /* index of window in the above lists indicating the relative position
+  WMHashTable *boxes; /* WWindow -> MoveEdgeBox it is indexed with */
+} WMoveEdges;
+
+typedef struct {
+  WMoveEdges *edges;
+
+  /* index of window in the edge lists indicating the relative position
    * of the window with the others */
   int topIndex;
   int leftIndex;
@@ -667,231 +692,171 @@ typedef struct {
   ((w)->frame_y + (int)(w)->frame->core->height - 1 + \
    (HAS_BORDER_WITH_SELECT(w) ? 2 * (w)->screen->frame_border_width : 0))
 
-static int compareWTop(const void *a, const void *b)
+/*
+ * Returns number of leading list entries that lie before `value` in list
+ * order: below it (ascending lists) or above it (descending lists).
+ * Entries equal to `value` are counted if `inclusive` is set.
+ */
+static int edgeIndex(MoveEdge *list, int count, int value, Bool ascending, Bool inclusive)
 {
-  WWindow *wwin1 = *(WWindow **)a;
-  WWindow *wwin2 = *(WWindow **)b;
-
-  if (WTOP(wwin1) > WTOP(wwin2))
-    return -1;
-  else if (WTOP(wwin1) < WTOP(wwin2))
-    return 1;
-  else
-    return 0;
+  int low = 0, high = count;
+  int mid, pos;
+  Bool before;
+
+  while (low < high) {
+    mid = (low + high) / 2;
+    pos = list[mid].pos;
+    if (ascending)
+      before = inclusive ? (pos <= value) : (pos < value);
+    else
+      before = inclusive ? (pos >= value) : (pos > value);
+    if (before)
+      low = mid + 1;
+    else
+      high = mid;
+  }
+  return low;
 }
 
-static int compareWLeft(const void *a, const void *b)
+static void insertEdge(MoveEdge *list, int count, Bool ascending, MoveEdge edge)
 {
-  WWindow *wwin1 = *(WWindow **)a;
-  WWindow *wwin2 = *(WWindow **)b;
+  int i = edgeIndex(list, count, edge.pos, ascending, True);
 
-  if (WLEFT(wwin1) > WLEFT(wwin2))
-    return -1;
-  else if (WLEFT(wwin1) < WLEFT(wwin2))
-    return 1;
-  else
-    return 0;
+  memmove(&list[i + 1], &list[i], sizeof(MoveEdge) * (count - i));
+  list[i] = edge;
 }
 
-static int compareWRight(const void *a, const void *b)
+static void removeEdge(MoveEdge *list, int count, Bool ascending, int pos, WWindow *wwin)
 {
-  WWindow *wwin1 = *(WWindow **)a;
-  WWindow *wwin2 = *(WWindow **)b;
+  int i = edgeIndex(list, count, pos, ascending, False);
 
-  if (WRIGHT(wwin1) < WRIGHT(wwin2))
-    return -1;
-  else if (WRIGHT(wwin1) > WRIGHT(wwin2))
-    return 1;
-  else
-    return 0;
+  while (i < count && list[i].pos == pos && list[i].wwin != wwin)
+    i++;
+  if (i < count && list[i].wwin == wwin)
+    memmove(&list[i], &list[i + 1], sizeof(MoveEdge) * (count - i - 1));
 }
 
-static int compareWBottom(const void *a, const void *b)
+static void getEdgeBox(WWindow *wwin, MoveEdgeBox *box)
 {
-  WWindow *wwin1 = *(WWindow **)a;
-  WWindow *wwin2 = *(WWindow **)b;
+  box->top = WTOP(wwin);
+  box->left = WLEFT(wwin);
+  box->right = WRIGHT(wwin);
+  box->bottom = WBOTTOM(wwin);
+}
 
-  if (WBOTTOM(wwin1) < WBOTTOM(wwin2))
-    return -1;
-  else if (WBOTTOM(wwin1) > WBOTTOM(wwin2))
-    return 1;
-  else
-    return 0;
+static void insertEdgeBox(WMoveEdges *edges, WWindow *wwin, MoveEdgeBox *box)
+{
+  MoveEdge horizontal = {0, box->left, box->right, wwin};
+  MoveEdge vertical = {0, box->top, box->bottom, wwin};
+
+  horizontal.pos = box->top;
+  insertEdge(edges->topList, edges->count, False, horizontal);
+  horizontal.pos = box->bottom;
+  insertEdge(edges->bottomList, edges->count, True, horizontal);
+  vertical.pos = box->left;
+  insertEdge(edges->leftList, edges->count, False, vertical);
+  vertical.pos = box->right;
+  insertEdge(edges->rightList, edges->count, True, vertical);
+  edges->count++;
 }
 
-static void updateResistance(MoveData *data, int newX, int newY)
+static void removeEdgeBox(WMoveEdges *edges, WWindow *wwin, MoveEdgeBox *box)
 {
-  int i;
-  int newX2 = newX + data->winWidth;
-  int newY2 = newY + data->winHeight;
-  Bool ok = False;
-
-  if (newX < data->realX) {
-    if (data->rightIndex > 0 && newX < WRIGHT(data->rightList[data->rightIndex - 1])) {
-      ok = True;
-    } else if (data->leftIndex <= data->count - 1 &&
-               newX2 <= WLEFT(data->leftList[data->leftIndex])) {
-      ok = True;
-    }
-  } else if (newX > data->realX) {
-    if (data->leftIndex > 0 && newX2 > WLEFT(data->leftList[data->leftIndex - 1])) {
-      ok = True;
-    } else if (data->rightIndex <= data->count - 1 &&
-               newX >= WRIGHT(data->rightList[data->rightIndex])) {
-      ok = True;
-    }
-  }
+  removeEdge(edges->topList, edges->count, False, box->top, wwin);
+  removeEdge(edges->leftList, edges->count, False, box->left, wwin);
+  removeEdge(edges->rightList, edges->count, True, box->right, wwin);
+  removeEdge(edges->bottomList, edges->count, True, box->bottom, wwin);
+  edges->count--;
+}
 
-  if (!ok) {
-    if (newY < data->realY) {
-      if (data->bottomIndex > 0 && newY < WBOTTOM(data->bottomList[data->bottomIndex - 1])) {
-        ok = True;
-      } else if (data->topIndex <= data->count - 1 &&
-                 newY2 <= WTOP(data->topList[data->topIndex])) {
-        ok = True;
-      }
-    } else if (newY > data->realY) {
-      if (data->topIndex > 0 && newY2 > WTOP(data->topList[data->topIndex - 1])) {
-        ok = True;
-      } else if (data->bottomIndex <= data->count - 1 &&
-                 newY >= WBOTTOM(data->bottomList[data->bottomIndex])) {
-        ok = True;
-      }
-    }
-  }
+struct WMoveEdges *wMoveEdgesCreate(void)
+{
+  WMoveEdges *edges = wmalloc(sizeof(WMoveEdges));
+
+  edges->boxes = WMCreateHashTable(WMIntHashCallbacks);
+  return edges;
+}
+
+void wMoveEdgesAddWindow(WWindow *wwin)
+{
+  WMoveEdges *edges = wwin->screen->move_edges;
+  MoveEdgeBox *box;
 
-  if (!ok)
+  if (!edges || WMHashGet(edges->boxes, wwin))
     return;
 
-  /* TODO: optimize this */
-  if (data->realY < WBOTTOM(data->bottomList[0])) {
-    data->bottomIndex = 0;
-  }
-  if (data->realX < WRIGHT(data->rightList[0])) {
-    data->rightIndex = 0;
-  }
-  if ((data->realX + data->winWidth) > WLEFT(data->leftList[0])) {
-    data->leftIndex = 0;
-  }
-  if ((data->realY + data->winHeight) > WTOP(data->topList[0])) {
-    data->topIndex = 0;
+  if (edges->count == edges->size) {
+    edges->size = edges->size ? edges->size * 2 : 16;
+    edges->topList = wrealloc(edges->topList, sizeof(MoveEdge) * edges->size);
+    edges->leftList = wrealloc(edges->leftList, sizeof(MoveEdge) * edges->size);
+    edges->rightList = wrealloc(edges->rightList, sizeof(MoveEdge) * edges->size);
+    edges->bottomList = wrealloc(edges->bottomList, sizeof(MoveEdge) * edges->size);
   }
-  for (i = 0; i < data->count; i++) {
-    if (data->realY > WBOTTOM(data->bottomList[i])) {
-      data->bottomIndex = i + 1;
-    }
-    if (data->realX > WRIGHT(data->rightList[i])) {
-      data->rightIndex = i + 1;
-    }
-    if ((data->realX + data->winWidth) < WLEFT(data->leftList[i])) {
-      data->leftIndex = i + 1;
-    }
-    if ((data->realY + data->winHeight) < WTOP(data->topList[i])) {
-      data->topIndex = i + 1;
-    }
-  }
-}
 
-static void freeMoveData(MoveData *data)
-{
-  if (data->topList)
-    wfree(data->topList);
-  if (data->leftList)
-    wfree(data->leftList);
-  if (data->rightList)
-    wfree(data->rightList);
-  if (data->bottomList)
-    wfree(data->bottomList);
+  box = wmalloc(sizeof(MoveEdgeBox));
+  getEdgeBox(wwin, box);
+  insertEdgeBox(edges, wwin, box);
+  WMHashInsert(edges->boxes, wwin, box);
 }
 
-static void updateMoveData(WWindow *wwin, MoveData *data)
+void wMoveEdgesUpdateWindow(WWindow *wwin)
 {
-  WScreen *scr = wwin->screen;
-  WWindow *tmp;
-  int i;
-
-  data->count = 0;
-  tmp = scr->focused_window;
-  while (tmp) {
-    if (tmp != wwin && scr->current_desktop == tmp->frame->desktop && !tmp->flags.miniaturized &&
-        !tmp->flags.hidden && !tmp->flags.obscured && !WFLAGP(tmp, sunken)) {
-      data->topList[data->count] = tmp;
-      data->leftList[data->count] = tmp;
-      data->rightList[data->count] = tmp;
-      data->bottomList[data->count] = tmp;
-      data->count++;
-    }
-    tmp = tmp->prev;
-  }
+  WMoveEdges *edges = wwin->screen->move_edges;
+  MoveEdgeBox *box, newBox;
 
-  if (data->count == 0) {
-    data->topIndex = 0;
-    data->leftIndex = 0;
-    data->rightIndex = 0;
-    data->bottomIndex = 0;
+  if (!edges || !(box = WMHashGet(edges->boxes, wwin)))
     return;
-  }
 
-  /* order from closest to the border of the screen to farthest */
+  getEdgeBox(wwin, &newBox);
+  if (memcmp(box, &newBox, sizeof(MoveEdgeBox)) == 0)
+    return;
 
-  qsort(data->topList, data->count, sizeof(data->topList[0]), compareWTop);
-  qsort(data->leftList, data->count, sizeof(data->leftList[0]), compareWLeft);
-  qsort(data->rightList, data->count, sizeof(data->rightList[0]), compareWRight);
-  qsort(data->bottomList, data->count, sizeof(data->bottomList[0]), compareWBottom);
+  removeEdgeBox(edges, wwin, box);
+  *box = newBox;
+  insertEdgeBox(edges, wwin, box);
+}
 
-  /* figure the position of the window relative to the others */
+void wMoveEdgesRemoveWindow(WWindow *wwin)
+{
+  WMoveEdges *edges = wwin->screen->move_edges;
+  MoveEdgeBox *box;
 
-  data->topIndex = -1;
-  data->leftIndex = -1;
-  data->rightIndex = -1;
-  data->bottomIndex = -1;
+  if (!edges || !(box = WMHashGet(edges->boxes, wwin)))
+    return;
 
-  if (WTOP(wwin) < WBOTTOM(data->bottomList[0])) {
-    data->bottomIndex = 0;
-  }
-  if (WLEFT(wwin) < WRIGHT(data->rightList[0])) {
-    data->rightIndex = 0;
-  }
-  if (WRIGHT(wwin) > WLEFT(data->leftList[0])) {
-    data->leftIndex = 0;
-  }
-  if (WBOTTOM(wwin) > WTOP(data->topList[0])) {
-    data->topIndex = 0;
-  }
-  for (i = 0; i < data->count; i++) {
-    if (WTOP(wwin) >= WBOTTOM(data->bottomList[i])) {
-      data->bottomIndex = i + 1;
-    }
-    if (WLEFT(wwin) >= WRIGHT(data->rightList[i])) {
-      data->rightIndex = i + 1;
-    }
-    if (WRIGHT(wwin) <= WLEFT(data->leftList[i])) {
-      data->leftIndex = i + 1;
-    }
-    if (WBOTTOM(wwin) <= WTOP(data->topList[i])) {
-      data->topIndex = i + 1;
-    }
-  }
+  removeEdgeBox(edges, wwin, box);
+  WMHashRemove(edges->boxes, wwin);
+  wfree(box);
 }
 
-static void initMoveData(WWindow *wwin, MoveData *data)
+/* whether the border of another window should resist to moving wwin */
+static Bool isEdgeActive(WWindow *wwin, MoveEdge *edge)
 {
-  int i;
-  WWindow *tmp;
+  WWindow *tmp = edge->wwin;
 
-  memset(data, 0, sizeof(MoveData));
+  return (tmp != wwin && wwin->screen->current_desktop == tmp->frame->desktop &&
+          !tmp->flags.miniaturized && !tmp->flags.hidden && !tmp->flags.obscured &&
+          !WFLAGP(tmp, sunken));
+}
 
-  for (i = 0, tmp = wwin->screen->focused_window; tmp != NULL; tmp = tmp->prev, i++)
-    ;
+/* figure the position of the window relative to the others */
+static void updateResistance(MoveData *data)
+{
+  WMoveEdges *edges = data->edges;
+
+  data->bottomIndex = edgeIndex(edges->bottomList, edges->count, data->realY, True, True);
+  data->rightIndex = edgeIndex(edges->rightList, edges->count, data->realX, True, True);
+  data->leftIndex =
+      edgeIndex(edges->leftList, edges->count, data->realX + data->winWidth - 1, False, True);
+  data->topIndex =
+      edgeIndex(edges->topList, edges->count, data->realY + data->winHeight - 1, False, True);
+}
 
-  if (i > 1) {
-    data->topList = wmalloc(sizeof(WWindow *) * i);
-    data->leftList = wmalloc(sizeof(WWindow *) * i);
-    data->rightList = wmalloc(sizeof(WWindow *) * i);
-    data->bottomList = wmalloc(sizeof(WWindow *) * i);
+static void initMoveData(WWindow *wwin, MoveData *data)
+{
+  memset(data, 0, sizeof(MoveData));
 
-    updateMoveData(wwin, data);
-  }
+  data->edges = wwin->screen->move_edges;
 
   data->realX = wwin->frame_x;
   data->realY = wwin->frame_y;
@@ -1002,6 +967,8 @@ static void updateWindowPosition(WWindow *wwin, MoveData *data, Bool doResistanc
     attract = wPreferences.attract;
     /* horizontal movement: check horizontal edge resistances */
     if (dx || dy) {
+      WMoveEdges *edges;
+      MoveEdge *looprw;
       WMRect rect;
       int i, head;
       /* window is the leftmost window: check against screen edge */
@@ -1016,57 +983,63 @@ static void updateWindowPosition(WWindow *wwin, MoveData *data, Bool doResistanc
       r_edge = edge_r + resist;
 
       /* 1 */
-      if ((data->rightIndex >= 0) && (data->rightIndex <= data->count)) {
-        WWindow *looprw;
-
-        for (i = data->rightIndex - 1; i >= 0; i--) {
-          looprw = data->rightList[i];
-          if (!(data->realY > WBOTTOM(looprw) || (data->realY + data->winHeight) < WTOP(looprw))) {
-            if (attract || ((data->realX < (WRIGHT(looprw) + 2)) && dx < 0)) {
-              l_edge = WRIGHT(looprw) + 1;
-              resist = WIN_RESISTANCE(wPreferences.edge_resistance);
-            }
-            break;
+      updateResistance(data);
+      edges = data->edges;
+
+      for (i = data->rightIndex - 1; i >= 0; i--) {
+        looprw = &edges->rightList[i];
+        if (looprw->pos + 1 < winL - resist)
+          break;
+        if (isEdgeActive(wwin, looprw) &&
+            !(data->realY > looprw->hi || (data->realY + data->winHeight) < looprw->lo)) {
+          if (attract || ((data->realX < (looprw->pos + 2)) && dx < 0)) {
+            l_edge = looprw->pos + 1;
+            resist = WIN_RESISTANCE(wPreferences.edge_resistance);
           }
+          break;
         }
+      }
 
-        if (attract) {
-          for (i = data->rightIndex; i < data->count; i++) {
-            looprw = data->rightList[i];
-            if (!(data->realY > WBOTTOM(looprw) ||
-                  (data->realY + data->winHeight) < WTOP(looprw))) {
-              r_edge = WRIGHT(looprw) + 1;
-              resist = WIN_RESISTANCE(wPreferences.edge_resistance);
-              break;
-            }
+      if (attract) {
+        for (i = data->rightIndex; i < edges->count; i++) {
+          looprw = &edges->rightList[i];
+          if (looprw->pos + 1 > winL + resist)
+            break;
+          if (isEdgeActive(wwin, looprw) &&
+              !(data->realY > looprw->hi || (data->realY + data->winHeight) < looprw->lo)) {
+            r_edge = looprw->pos + 1;
+            resist = WIN_RESISTANCE(wPreferences.edge_resistance);
+            break;
           }
         }
       }
 
-      if ((data->leftIndex >= 0) && (data->leftIndex <= data->count)) {
-        WWindow *looprw;
-
-        for (i = data->leftIndex - 1; i >= 0; i--) {
-          looprw = data->leftList[i];
-          if (!(data->realY > WBOTTOM(looprw) || (data->realY + data->winHeight) < WTOP(looprw))) {
-            if (attract || (((data->realX + data->winWidth) > (WLEFT(looprw) - 1)) && dx > 0)) {
-              edge_r = WLEFT(looprw);
-              resist = WIN_RESISTANCE(wPreferences.edge_resistance);
-            }
-            break;
+      for (i = data->leftIndex - 1; i >= 0; i--) {
+        looprw = &edges->leftList[i];
+        if (looprw->pos > winR + resist)
+          break;
+        if (isEdgeActive(wwin, looprw) &&
+            !(data->realY > looprw->hi || (data->realY + data->winHeight) < looprw->lo)) {
+          if (attract || (((data->realX + data->winWidth) > (looprw->pos - 1)) && dx > 0)) {
+            edge_r = looprw->pos;
+            resist = WIN_RESISTANCE(wPreferences.edge_resistance);
           }
+          break;
         }
+      }
 
-        if (attract)
-          for (i = data->leftIndex; i < data->count; i++) {
-            looprw = data->leftList[i];
-            if (!(data->realY > WBOTTOM(looprw) ||
-                  (data->realY + data->winHeight) < WTOP(looprw))) {
-              edge_l = WLEFT(looprw);
-              resist = WIN_RESISTANCE(wPreferences.edge_resistance);
-              break;
-            }
+      if (attract) {
+        for (i = data->leftIndex; i < edges->count; i++) {
+          looprw = &edges->leftList[i];
+          if (looprw->pos < winR - resist)
+            break;
+          if (isEdgeActive(wwin, looprw) &&
+              !(data->realY > looprw->hi || (data->realY + data->winHeight) < looprw->lo)) {
+            edge_l = looprw->pos;
+            resist = WIN_RESISTANCE(wPreferences.edge_resistance);
+            break;
           }
+        }
       }
 
       /*
@@ -1111,55 +1084,60 @@ static void updateWindowPosition(WWindow *wwin, MoveData *data, Bool doResistanc
       edge_b = WMIN(scr->totalUsableArea[head].y2, rect.pos.y + rect.size.height);
       b_edge = edge_b + resist;
 
-      if ((data->bottomIndex >= 0) && (data->bottomIndex <= data->count)) {
-        WWindow *looprw;
+      for (i = data->bottomIndex - 1; i >= 0; i--) {
+        looprw = &edges->bottomList[i];
+        if (looprw->pos + 1 < winT - resist)
+          break;
+        if (isEdgeActive(wwin, looprw) &&
+            !(data->realX > looprw->hi || (data->realX + data->winWidth) < looprw->lo)) {
+          if (attract || ((data->realY < (looprw->pos + 2)) && dy < 0)) {
+            t_edge = looprw->pos + 1;
+            resist = WIN_RESISTANCE(wPreferences.edge_resistance);
+          }
+          break;
+        }
+      }
 
-        for (i = data->bottomIndex - 1; i >= 0; i--) {
-          looprw = data->bottomList[i];
-          if (!(data->realX > WRIGHT(looprw) || (data->realX + data->winWidth) < WLEFT(looprw))) {
-            if (attract || ((data->realY < (WBOTTOM(looprw) + 2)) && dy < 0)) {
-              t_edge = WBOTTOM(looprw) + 1;
-              resist = WIN_RESISTANCE(wPreferences.edge_resistance);
-            }
+      if (attract) {
+        for (i = data->bottomIndex; i < edges->count; i++) {
+          looprw = &edges->bottomList[i];
+          if (looprw->pos + 1 > winT + resist)
+            break;
+          if (isEdgeActive(wwin, looprw) &&
+              !(data->realX > looprw->hi || (data->realX + data->winWidth) < looprw->lo)) {
+            b_edge = looprw->pos + 1;
+            resist = WIN_RESISTANCE(wPreferences.edge_resistance);
             break;
           }
         }
+      }
 
-        if (attract) {
-          for (i = data->bottomIndex; i < data->count; i++) {
-            looprw = data->bottomList[i];
-            if (!(data->realX > WRIGHT(looprw) || (data->realX + data->winWidth) < WLEFT(looprw))) {
-              b_edge = WBOTTOM(looprw) + 1;
-              resist = WIN_RESISTANCE(wPreferences.edge_resistance);
-              break;
-            }
+      for (i = data->topIndex - 1; i >= 0; i--) {
+        looprw = &edges->topList[i];
+        if (looprw->pos > winB + resist)
+          break;
+        if (isEdgeActive(wwin, looprw) &&
+            !(data->realX > looprw->hi || (data->realX + data->winWidth) < looprw->lo)) {
+          if (attract || (((data->realY + data->winHeight) > (looprw->pos - 1)) && dy > 0)) {
+            edge_b = looprw->pos;
+            resist = WIN_RESISTANCE(wPreferences.edge_resistance);
           }
+          break;
         }
       }
 
-      if ((data->topIndex >= 0) && (data->topIndex <= data->count)) {
-        WWindow *looprw;
-
-        for (i = data->topIndex - 1; i >= 0; i--) {
-          looprw = data->topList[i];
-          if (!(data->realX > WRIGHT(looprw) || (data->realX + data->winWidth) < WLEFT(looprw))) {
-            if (attract || (((data->realY + data->winHeight) > (WTOP(looprw) - 1)) && dy > 0)) {
-              edge_b = WTOP(looprw);
-              resist = WIN_RESISTANCE(wPreferences.edge_resistance);
-            }
+      if (attract) {
+        for (i = data->topIndex; i < edges->count; i++) {
+          looprw = &edges->topList[i];
+          if (looprw->pos < winB - resist)
+            break;
+          if (isEdgeActive(wwin, looprw) &&
+              !(data->realX > looprw->hi || (data->realX + data->winWidth) < looprw->lo)) {
+            edge_t = looprw->pos;
+            resist = WIN_RESISTANCE(wPreferences.edge_resistance);
             break;
           }
         }
-
-        if (attract)
-          for (i = data->topIndex; i < data->count; i++) {
-            looprw = data->topList[i];
-            if (!(data->realX > WRIGHT(looprw) || (data->realX + data->winWidth) < WLEFT(looprw))) {
-              edge_t = WTOP(looprw);
-              resist = WIN_RESISTANCE(wPreferences.edge_resistance);
-              break;
-            }
-          }
       }
 
       if ((winT - t_edge) < (b_edge - winT)) {
@@ -1233,11 +1211,6 @@ static void updateWindowPosition(WWindow *wwin, MoveData *data, Bool doResistanc
     }
   }
 
-  /* recalc relative window position */
-  if (doResistance && (data->realX != newX || data->realY != newY)) {
-    updateResistance(data, newX, newY);
-  }
-
   data->realX = newX;
   data->realY = newY;
 }
@@ -1860,8 +1833,6 @@ int wMouseMoveWindow(WWindow *wwin, XEvent *ev)
             draw_snap_frame(wwin, moveData.snap);
 
           if (!warped && !wPreferences.no_autowrap) {
-            int oldDesktop = scr->current_desktop;
-
             if (wPreferences.move_display == WDIS_NEW && !scr->selected_windows) {
               showPosition(wwin, moveData.realX, moveData.realY);
               XUngrabServer(dpy);
@@ -1871,9 +1842,6 @@ int wMouseMoveWindow(WWindow *wwin, XEvent *ev)
                          moveData.realY - wwin->frame_y);
             }
             if (checkDesktopChange(wwin, &moveData, opaqueMove)) {
-              if (scr->current_desktop != oldDesktop && wPreferences.edge_resistance > 0 &&
-                  scr->selected_windows == NULL)
-                updateMoveData(wwin, &moveData);
               warped = 1;
             }
             if (!opaqueMove) {
@@ -2012,8 +1980,6 @@ int wMouseMoveWindow(WWindow *wwin, XEvent *ev)
     XChangeWindowAttributes(dpy, wwin->frame->core->window, CWSaveUnder, &attr);
   }
 
-  freeMoveData(&moveData);
-
   if (started && wPreferences.auto_arrange_icons && wScreenHeads(scr) > 1 &&
       head != wGetHeadForWindow(wwin)) {
     wArrangeIcons(scr, True);
@@ -23,6 +23,8 @@
 #ifndef __WORKSPACE_WM_MOVERES__
 #define __WORKSPACE_WM_MOVERES__
 
+#include "window.h"
+
 /* How many pixels to move before dragging windows and other objects */
 #define MOVE_THRESHOLD 5
 
@@ -34,4 +36,10 @@
 #define WDIS_TITLEBAR 4     /* titlebar */
 #define WDIS_NONE 5
 
+/* Window borders of a screen sorted for edge resistance */
+struct WMoveEdges *wMoveEdgesCreate(void);
+void wMoveEdgesAddWindow(WWindow *wwin);
+void wMoveEdgesUpdateWindow(WWindow *wwin); /* after move, resize or border change */
+void wMoveEdgesRemoveWindow(WWindow *wwin);
+
 #endif /* __WORKSPACE_WM_MOVERES__ */
@@ -66,6 +66,7 @@
 #include "defaults.h"
 #include "misc.h"
 #include "iconyard.h"
+#include "moveres.h"
 
 /* Window titlebar text alignment */
 #define WTB_LEFT 0
@@ -796,6 +797,9 @@ WScreen *wScreenInit(int screen_number)
   scr->light_pixel = WMColorPixel(scr->gray);
   scr->dark_pixel = WMColorPixel(scr->darkGray);
 
+  scr->texture_cache = wTextureCacheCreate(scr);
+  scr->move_edges = wMoveEdgesCreate();
+
   /* create GCs with default values */
   allocGCs(scr);
 
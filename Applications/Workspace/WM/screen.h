@@ -117,6 +117,7 @@ typedef struct _WScreen {
                          */
 
   int window_count; /* number of windows in window_list */
+  int stacking_changes; /* windows with uncommitted stacking position */
 
   struct WDesktop **desktops; /* workspace array */
   int desktop_count;          /* number of workspaces */
@@ -236,6 +237,8 @@ typedef struct _WScreen {
   struct WDock *attracting_drawer; /* The drawer that auto-attracts icons, or NULL */
 
   struct RContext *rcontext; /* wrlib context */
+  struct WTextureCache *texture_cache; /* rendered texture pixmaps */
+  struct WMoveEdges *move_edges;       /* window borders for edge resistance */
 
   WMScreen *wmscreen; /* for widget library */
 
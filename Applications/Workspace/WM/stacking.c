@@ -40,6 +40,9 @@
 #include "stacking.h"
 #include "desktop.h"
 
+static void moveFrameToUnder(WCoreWindow *under, WCoreWindow *frame);
+static void commitFullStacking(WScreen *scr);
+
 static void __notifyStackChange(WCoreWindow *frame, char *detail)
 {
   WWindow *wwin = wWindowFor(frame->window);
@@ -107,21 +110,24 @@ void RemakeStackList(WScreen *scr)
     scr->window_count = c;
   }
 
-  CommitStacking(scr);
+  commitFullStacking(scr);
+  CFNotificationCenterPostNotification(scr->notificationCenter,
+                                       WMDidResetWindowStackingNotification, scr, NULL, TRUE);
 }
 
-/*
- *----------------------------------------------------------------------
- * CommitStacking--
- * 	Reorders the actual window stacking, so that it has the stacking
- * order in the internal window stacking lists. It does the opposite
- * of RemakeStackList().
- *
- * Side effects:
- * 	Windows may be restacked.
- *----------------------------------------------------------------------
- */
-void CommitStacking(WScreen *scr)
+/* If more windows than this changed position, restack all of them at once */
+#define STACKING_MAX_CHANGES(scr) ((scr)->window_count / 2)
+
+/* Remembers that frame position in stacking list differs from the X server one */
+static void logStackingChange(WCoreWindow *frame)
+{
+  if (!frame->stacking->changed) {
+    frame->stacking->changed = 1;
+    frame->screen_ptr->stacking_changes++;
+  }
+}
+
+static void commitFullStacking(WScreen *scr)
 {
   WCoreWindow *tmp;
   int nwindows, i;
@@ -136,11 +142,64 @@ void CommitStacking(WScreen *scr)
   {
     while (tmp) {
       windows[i++] = tmp->window;
+      tmp->stacking->changed = 0;
       tmp = tmp->stacking->under;
     }
   }
   XRestackWindows(dpy, windows, i);
   wfree(windows);
+  scr->stacking_changes = 0;
+}
+
+/* Restacks the logged windows, see CommitStacking() */
+static void commitStackingChanges(WScreen *scr)
+{
+  WCoreWindow *tmp, *prev = NULL;
+  WMBagIterator iter;
+  int changes = scr->stacking_changes;
+
+  if (changes > STACKING_MAX_CHANGES(scr)) {
+    commitFullStacking(scr);
+  } else if (changes > 0) {
+    /* Go from top to bottom: window above the changed one is always at its
+       final place already. */
+    WM_ETARETI_BAG(scr->stacking_list, tmp, iter)
+    {
+      while (tmp && changes > 0) {
+        if (tmp->stacking->changed) {
+          if (prev)
+            moveFrameToUnder(prev, tmp);
+          else
+            XRaiseWindow(dpy, tmp->window);
+          tmp->stacking->changed = 0;
+          changes--;
+        }
+        prev = tmp;
+        tmp = tmp->stacking->under;
+      }
+      if (changes == 0)
+        break;
+    }
+    scr->stacking_changes = 0;
+  }
+}
+
+/*
+ *----------------------------------------------------------------------
+ * CommitStacking--
+ * 	Reorders the actual window stacking, so that it has the stacking
+ * order in the internal window stacking lists. It does the opposite
+ * of RemakeStackList(). Only windows logged as changed are restacked,
+ * each one under the window that precedes it in the stacking list.
+ * Every change of the stacking lists is committed here.
+ *
+ * Side effects:
+ * 	Windows may be restacked.
+ *----------------------------------------------------------------------
+ */
+void CommitStacking(WScreen *scr)
+{
+  commitStackingChanges(scr);
   CFNotificationCenterPostNotification(scr->notificationCenter,
                                        WMDidResetWindowStackingNotification, scr, NULL, TRUE);
 }
@@ -178,32 +237,8 @@ static void moveFrameToUnder(WCoreWindow *under, WCoreWindow *frame)
  */
 void CommitStackingForWindow(WCoreWindow *frame)
 {
-  int level = frame->stacking->window_level;
-  WScreen *scr = frame->screen_ptr;
-
-  if (frame->stacking->above == NULL) {
-    WMBagIterator iter;
-    WCoreWindow *above = WMBagLast(scr->stacking_list, &iter);
-    int i, last = above->stacking->window_level;
-
-    /* find the 1st level above us which has windows in it */
-    for (i = level + 1, above = NULL; i <= last; i++) {
-      above = WMGetFromBag(scr->stacking_list, i);
-      if (above != NULL)
-        break;
-    }
-
-    if (above != frame && above != NULL) {
-      while (above->stacking->under)
-        above = above->stacking->under;
-      moveFrameToUnder(above, frame);
-    } else {
-      /* no window above us */
-      XRaiseWindow(dpy, frame->window);
-    }
-  } else {
-    moveFrameToUnder(frame->stacking->above, frame);
-  }
+  logStackingChange(frame);
+  commitStackingChanges(frame->screen_ptr);
 }
 
 /*
@@ -242,6 +277,7 @@ void wRaiseFrame(WCoreWindow *frame)
     frame->stacking->under->stacking->above = frame;
   }
   WMSetInBag(scr->stacking_list, level, frame);
+  logStackingChange(frame);
 
   /* raise transients under us from bottom to top
    * so that the order is kept */
@@ -257,31 +293,7 @@ again:
     wlist = wlist->stacking->above;
   }
 
-  /* try to optimize things a little */
-  if (frame->stacking->above == NULL) {
-    WMBagIterator iter;
-    WCoreWindow *above = WMBagLast(scr->stacking_list, &iter);
-    int i, last = above->stacking->window_level;
-
-    /* find the 1st level above us which has windows in it */
-    for (i = level + 1, above = NULL; i <= last; i++) {
-      above = WMGetFromBag(scr->stacking_list, i);
-      if (above != NULL)
-        break;
-    }
-
-    if (above != frame && above != NULL) {
-      while (above->stacking->under)
-        above = above->stacking->under;
-      moveFrameToUnder(above, frame);
-    } else {
-      /* no window above us */
-      above = NULL;
-      XRaiseWindow(dpy, frame->window);
-    }
-  } else {
-    moveFrameToUnder(frame->stacking->above, frame);
-  }
+  commitStackingChanges(scr);
 
   __notifyStackChange(frame, "raise");
 }
@@ -366,29 +378,8 @@ void wLowerFrame(WCoreWindow *frame)
     frame->stacking->under = NULL;
   }
 
-  if (frame->stacking->above == NULL) {
-    WMBagIterator iter;
-    WCoreWindow *above = WMBagLast(scr->stacking_list, &iter);
-    int i, last = above->stacking->window_level;
-
-    /* find the 1st level above us which has windows in it */
-    for (i = level + 1, above = NULL; i <= last; i++) {
-      above = WMGetFromBag(scr->stacking_list, i);
-      if (above != NULL)
-        break;
-    }
-
-    if (above != frame && above != NULL) {
-      while (above->stacking->under)
-        above = above->stacking->under;
-      moveFrameToUnder(above, frame);
-    } else {
-      /* no window below us */
-      XLowerWindow(dpy, frame->window);
-    }
-  } else {
-    moveFrameToUnder(frame->stacking->above, frame);
-  }
+  logStackingChange(frame);
+  commitStackingChanges(scr);
 
   __notifyStackChange(frame, "lower");
 }
@@ -422,6 +413,7 @@ void AddToStackList(WCoreWindow *frame)
     WMSetInBag(scr->stacking_list, index, frame);
     frame->stacking->above = NULL;
     frame->stacking->under = NULL;
+    logStackingChange(frame);
     CommitStacking(scr);
     return;
   }
@@ -452,6 +444,7 @@ void AddToStackList(WCoreWindow *frame)
     curtop->stacking->above = frame;
     WMSetInBag(scr->stacking_list, index, frame);
   }
+  logStackingChange(frame);
   CommitStacking(scr);
 }
 
@@ -497,29 +490,8 @@ void MoveInStackListAbove(WCoreWindow *next, WCoreWindow *frame)
   if (tmpw == next)
     WMSetInBag(scr->stacking_list, index, frame);
 
-  /* try to optimize things a little */
-  if (frame->stacking->above == NULL) {
-    WCoreWindow *above = NULL;
-    WMBagIterator iter;
-
-    for (above = WMBagIteratorAtIndex(scr->stacking_list, index + 1, &iter); above != NULL;
-         above = WMBagNext(scr->stacking_list, &iter)) {
-      /* can't optimize */
-      while (above->stacking->under)
-        above = above->stacking->under;
-      break;
-    }
-    if (above == NULL) {
-      XRaiseWindow(dpy, frame->window);
-    } else {
-      moveFrameToUnder(above, frame);
-    }
-  } else {
-    moveFrameToUnder(frame->stacking->above, frame);
-  }
-
-  CFNotificationCenterPostNotification(scr->notificationCenter,
-                                       WMDidResetWindowStackingNotification, scr, NULL, TRUE);
+  logStackingChange(frame);
+  CommitStacking(scr);
 }
 
 /*
@@ -561,10 +533,9 @@ void MoveInStackListUnder(WCoreWindow *prev, WCoreWindow *frame)
   frame->stacking->above = prev;
   frame->stacking->under = prev->stacking->under;
   prev->stacking->under = frame;
-  moveFrameToUnder(prev, frame);
 
-  CFNotificationCenterPostNotification(scr->notificationCenter,
-                                       WMDidResetWindowStackingNotification, scr, NULL, TRUE);
+  logStackingChange(frame);
+  CommitStacking(scr);
 }
 
 void RemoveFromStackList(WCoreWindow *frame)
@@ -584,6 +555,10 @@ void RemoveFromStackList(WCoreWindow *frame)
     WMSetInBag(frame->screen_ptr->stacking_list, index, frame->stacking->under);
 
   frame->screen_ptr->window_count--;
+  if (frame->stacking->changed) {
+    frame->stacking->changed = 0;
+    frame->screen_ptr->stacking_changes--;
+  }
 
   CFNotificationCenterPostNotification(frame->screen_ptr->notificationCenter,
                                        WMDidResetWindowStackingNotification, frame->screen_ptr,
@@ -888,7 +888,6 @@ void wSwitchPanelStart(WWindow *wwin, XEvent *event, Bool next)
       }
     } else if (new_focused_wwin->frame) {
       wRaiseFrame(new_focused_wwin->frame->core);
-      CommitStacking(scr);
       if (!new_focused_wwin->flags.mapped) {
         wMakeWindowVisible(new_focused_wwin);
       } else {
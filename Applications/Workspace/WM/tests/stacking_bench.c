@@ -0,0 +1,201 @@
+/*
+ * Stacking benchmark: a model of three ways to commit the stacking order
+ * to the X server. It does not call stacking.c and does not need a window
+ * manager: bare override-redirect windows are raised and lowered with the
+ * Xlib requests each strategy would send, and the X requests, round-trips
+ * and time are reported. The numbers show the X server side cost of each
+ * strategy, not of the window manager code.
+ *
+ *   full        - whole stacking order is sent with XRestackWindows() after
+ *                 every change, like CommitStacking() before the change
+ *                 log;
+ *   remake      - window is restacked, then order is read back with
+ *                 XQueryTree(), like RemakeStackList();
+ *   incremental - only the moved window is restacked under its new
+ *                 neighbour, the requests CommitStacking() sends for one
+ *                 logged window.
+ *
+ * Usage: stacking_bench [windows] [operations]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+#include <X11/Xlib.h>
+#include <X11/Xutil.h>
+
+enum { MODE_FULL, MODE_REMAKE, MODE_INCREMENTAL, MODE_COUNT };
+static const char *mode_names[MODE_COUNT] = {"full", "remake", "incremental"};
+
+static Display *dpy;
+static Window *windows; /* created windows */
+static Window *order;   /* stacking order, topmost first */
+static int nwindows;
+static unsigned long round_trips;
+
+static double now_ms(void)
+{
+  struct timeval tv;
+
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec * 1000.0 + tv.tv_usec / 1000.0;
+}
+
+static int position_of(Window w)
+{
+  int i;
+
+  for (i = 0; i < nwindows; i++) {
+    if (order[i] == w)
+      return i;
+  }
+  return -1;
+}
+
+static void move_in_order(int from, int to)
+{
+  Window w = order[from];
+
+  if (from < to)
+    memmove(&order[from], &order[from + 1], (to - from) * sizeof(Window));
+  else if (from > to)
+    memmove(&order[to + 1], &order[to], (from - to) * sizeof(Window));
+  order[to] = w;
+}
+
+static void read_back_order(void)
+{
+  Window root, parent, *children;
+  unsigned int count;
+
+  XQueryTree(dpy, DefaultRootWindow(dpy), &root, &parent, &children, &count);
+  round_trips++;
+  XFree(children);
+}
+
+/* Returns number of our windows that are not in expected place */
+static int verify_order(void)
+{
+  Window root, parent, *children;
+  unsigned int count, i;
+  int j = nwindows - 1, errors = 0;
+
+  XQueryTree(dpy, DefaultRootWindow(dpy), &root, &parent, &children, &count);
+  /* children are bottom to top */
+  for (i = 0; i < count && j >= 0; i++) {
+    int k;
+    for (k = 0; k < nwindows; k++) {
+      if (windows[k] == children[i])
+        break;
+    }
+    if (k == nwindows)
+      continue;
+    if (children[i] != order[j])
+      errors++;
+    j--;
+  }
+  XFree(children);
+  return errors;
+}
+
+static void run(int mode, int operations)
+{
+  unsigned long first_request;
+  double start, elapsed;
+  int i, from, to;
+  Window wins[2];
+
+  /* initial order */
+  for (i = 0; i < nwindows; i++)
+    order[i] = windows[nwindows - 1 - i];
+  XRestackWindows(dpy, order, nwindows);
+  XSync(dpy, False);
+
+  srandom(1);
+  round_trips = 0;
+  first_request = NextRequest(dpy);
+  start = now_ms();
+
+  for (i = 0; i < operations; i++) {
+    Window w = windows[random() % nwindows];
+    Bool raise = random() & 1;
+
+    from = position_of(w);
+    to = raise ? 0 : nwindows - 1;
+    move_in_order(from, to);
+
+    switch (mode) {
+      case MODE_FULL:
+        XRestackWindows(dpy, order, nwindows);
+        break;
+      case MODE_REMAKE:
+        if (raise)
+          XRaiseWindow(dpy, w);
+        else
+          XLowerWindow(dpy, w);
+        read_back_order();
+        break;
+      case MODE_INCREMENTAL:
+        if (raise) {
+          XRaiseWindow(dpy, w);
+        } else {
+          wins[0] = order[to - 1];
+          wins[1] = w;
+          XRestackWindows(dpy, wins, 2);
+        }
+        break;
+    }
+  }
+  XSync(dpy, False);
+  round_trips++;
+  elapsed = now_ms() - start;
+
+  printf("%-12s %8lu requests %8lu round-trips %10.2f ms  %s\n", mode_names[mode],
+         NextRequest(dpy) - first_request - 1, round_trips, elapsed,
+         verify_order() ? "ORDER MISMATCH" : "ok");
+  fflush(stdout);
+}
+
+int main(int argc, char *argv[])
+{
+  XSetWindowAttributes attrs;
+  int operations;
+  int i, mode;
+
+  nwindows = (argc > 1) ? atoi(argv[1]) : 200;
+  operations = (argc > 2) ? atoi(argv[2]) : 2000;
+  if (nwindows < 2 || operations < 1) {
+    fprintf(stderr, "Usage: %s [windows] [operations]\n", argv[0]);
+    return 1;
+  }
+
+  dpy = XOpenDisplay(NULL);
+  if (!dpy) {
+    fprintf(stderr, "Can't open display\n");
+    return 1;
+  }
+
+  /* override-redirect: window manager must not intercept restacking */
+  attrs.override_redirect = True;
+  windows = malloc(sizeof(Window) * nwindows);
+  order = malloc(sizeof(Window) * nwindows);
+  for (i = 0; i < nwindows; i++) {
+    windows[i] = XCreateWindow(dpy, DefaultRootWindow(dpy), i % 50, i % 50, 10, 10, 0,
+                               CopyFromParent, InputOutput, CopyFromParent, CWOverrideRedirect,
+                               &attrs);
+  }
+
+  printf("model: %d windows, %d raise/lower operations\n", nwindows, operations);
+  for (mode = 0; mode < MODE_COUNT; mode++)
+    run(mode, operations);
+
+  for (i = 0; i < nwindows; i++)
+    XDestroyWindow(dpy, windows[i]);
+  XCloseDisplay(dpy);
+  free(windows);
+  free(order);
+
+  return 0;
+}
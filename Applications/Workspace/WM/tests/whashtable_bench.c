@@ -0,0 +1,194 @@
+/*
+ * WMHashTable benchmark: inserts, looks up (hits and misses) and removes
+ * pointer and string keys and reports nanoseconds per operation. Built
+ * twice from the same source:
+ *
+ *   whashtable_bench         - core/whashtable.c (open addressing);
+ *   whashtable_chained_bench - whashtable_chained.c (the chained table
+ *                              core/whashtable.c replaced).
+ *
+ * Usage: whashtable_bench [keys] [rounds]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "whashtable.h"
+
+/* The table only needs these from core/util.c and core/string_utils.c */
+void *wmalloc(size_t size)
+{
+  void *tmp = calloc(1, size);
+
+  if (tmp == NULL) {
+    fputs("virtual memory exhausted\n", stderr);
+    exit(1);
+  }
+  return tmp;
+}
+
+void wfree(void *ptr)
+{
+  free(ptr);
+}
+
+char *wstrdup(const char *str)
+{
+  char *copy = wmalloc(strlen(str) + 1);
+
+  return strcpy(copy, str);
+}
+
+static double now_ns(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static unsigned nkeys;
+static int errors;
+
+/* lookups don't come in allocation order: don't let the benchmark favour
+ * a table that keeps neighbouring addresses in neighbouring buckets */
+static void shuffle(void **keys, unsigned count)
+{
+  void *tmp;
+  unsigned i, j;
+
+  srand(1);
+  for (i = count - 1; i > 0; i--) {
+    j = rand() % (i + 1);
+    tmp = keys[i];
+    keys[i] = keys[j];
+    keys[j] = tmp;
+  }
+}
+
+/* keys[0..nkeys) are inserted, keys[nkeys..2*nkeys) are used for misses */
+static void run(const char *name, WMHashTableCallbacks callbacks, void **keys)
+{
+  double insert = 0, hit = 0, miss = 0, removal = 0, t;
+  WMHashTable *table;
+  unsigned i;
+
+  table = WMCreateHashTable(callbacks);
+
+  t = now_ns();
+  for (i = 0; i < nkeys; i++)
+    WMHashInsert(table, keys[i], keys[i]);
+  insert += now_ns() - t;
+
+  if (WMCountHashTable(table) != nkeys)
+    errors++;
+
+  t = now_ns();
+  for (i = 0; i < nkeys; i++) {
+    if (WMHashGet(table, keys[i]) != keys[i])
+      errors++;
+  }
+  hit += now_ns() - t;
+
+  t = now_ns();
+  for (i = nkeys; i < nkeys * 2; i++) {
+    if (WMHashGet(table, keys[i]) != NULL)
+      errors++;
+  }
+  miss += now_ns() - t;
+
+  t = now_ns();
+  for (i = 0; i < nkeys; i++)
+    WMHashRemove(table, keys[i]);
+  removal += now_ns() - t;
+
+  if (WMCountHashTable(table) != 0)
+    errors++;
+
+  WMFreeHashTable(table);
+
+  printf("%-8s insert %7.1f  hit %7.1f  miss %7.1f  remove %7.1f  ns/op\n", name,
+         insert / nkeys, hit / nkeys, miss / nkeys, removal / nkeys);
+}
+
+/* mixed inserts and removes over a table of steady size, as window and
+ * app icon tables see */
+static void run_churn(void **keys, unsigned rounds)
+{
+  WMHashTable *table;
+  double t;
+  unsigned i, r, live = nkeys / 2;
+
+  table = WMCreateHashTable(WMIntHashCallbacks);
+  for (i = 0; i < live; i++)
+    WMHashInsert(table, keys[i], keys[i]);
+
+  t = now_ns();
+  for (r = 0; r < rounds; r++) {
+    for (i = 0; i < nkeys; i++) {
+      unsigned in = (i + r * live) % (nkeys * 2);
+      unsigned out = (i + r * live + nkeys * 2 - live) % (nkeys * 2);
+
+      WMHashRemove(table, keys[out]);
+      WMHashInsert(table, keys[in], keys[in]);
+      if (WMHashGet(table, keys[in]) != keys[in])
+        errors++;
+    }
+  }
+  t = now_ns() - t;
+
+  if (WMCountHashTable(table) != live)
+    errors++;
+  WMFreeHashTable(table);
+
+  printf("%-8s remove+insert+get %7.1f ns/op\n", "churn", t / ((double)rounds * nkeys));
+}
+
+int main(int argc, char *argv[])
+{
+  void **pointers, **strings;
+  char buf[32];
+  unsigned i, r, rounds;
+  int count, nrounds;
+
+  count = (argc > 1) ? atoi(argv[1]) : 100000;
+  nrounds = (argc > 2) ? atoi(argv[2]) : 5;
+  if (count < 2 || nrounds < 1) {
+    fprintf(stderr, "Usage: %s [keys] [rounds]\n", argv[0]);
+    return 1;
+  }
+  nkeys = count;
+  rounds = nrounds;
+
+  pointers = wmalloc(sizeof(void *) * nkeys * 2);
+  strings = wmalloc(sizeof(void *) * nkeys * 2);
+  for (i = 0; i < nkeys * 2; i++) {
+    /* distinct heap addresses, like WWindow and WAppIcon keys */
+    pointers[i] = wmalloc(48);
+    snprintf(buf, sizeof(buf), "Window.%u.class", i);
+    strings[i] = wstrdup(buf);
+  }
+  shuffle(pointers, nkeys * 2);
+  shuffle(strings, nkeys * 2);
+
+  printf("%u keys, %u rounds\n", nkeys, rounds);
+  for (r = 0; r < rounds; r++) {
+    run("pointer", WMIntHashCallbacks, pointers);
+    run("string", WMStringHashCallbacks, strings);
+  }
+  run_churn(pointers, rounds);
+
+  for (i = 0; i < nkeys * 2; i++) {
+    wfree(pointers[i]);
+    wfree(strings[i]);
+  }
+  wfree(pointers);
+  wfree(strings);
+
+  if (errors)
+    printf("%d errors\n", errors);
+
+  return errors ? 1 : 0;
+}
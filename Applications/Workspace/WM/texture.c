@@ -27,6 +27,7 @@
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <stdint.h>
 #include <string.h>
 
 #include <wraster.h>
@@ -34,6 +35,7 @@
 #include <core/util.h>
 #include <core/log_utils.h>
 #include <core/file_utils.h>
+#include <core/whashtable.h>
 
 #include "WM.h"
 #include "texture.h"
@@ -128,6 +130,8 @@ void wTextureDestroy(WScreen *scr, WTexture *texture)
   int count = 0;
   unsigned long colors[8];
 
+  wTextureCachePurge(scr, texture);
+
   /*
    * some stupid servers don't like white or black being freed...
    */
@@ -585,3 +589,271 @@ void wDrawBevel(Drawable d, unsigned width, unsigned height, WTexSolid *texture,
       break;
   }
 }
+
+/*
+ * Rendered texture cache.
+ *
+ * Converting a texture into a server side Pixmap (render gradient, bevel,
+ * RConvertImage, upload) is the most expensive part of painting titlebars,
+ * resizebars and menus. Pixmaps are cached per screen, keyed by texture
+ * identity, size, kind of decoration and a kind specific variant (button
+ * layout, corner width, menu style...). Entries are reference counted by the
+ * owners of the pixmaps; unreferenced entries stay around in LRU order until
+ * the byte budget is exceeded.
+ */
+
+#define TEXTURE_CACHE_MAX_BYTES (4 * 1024 * 1024)
+
+typedef struct WTextureCacheKey {
+  WTexture *texture;
+  int width;
+  int height;
+  int kind;
+  int variant;
+} WTextureCacheKey;
+
+typedef struct WTextureCacheEntry {
+  WTextureCacheKey key;
+  Pixmap pixmap;
+  size_t size;
+  int refcount;
+  Bool orphaned; /* texture was destroyed while pixmap was in use */
+
+  /* list of unreferenced entries, most recently released first */
+  struct WTextureCacheEntry *prev;
+  struct WTextureCacheEntry *next;
+} WTextureCacheEntry;
+
+typedef struct WTextureCache {
+  WMHashTable *entries; /* WTextureCacheKey -> WTextureCacheEntry */
+  WMHashTable *pixmaps; /* Pixmap -> WTextureCacheEntry */
+  WTextureCacheEntry *lru_head;
+  WTextureCacheEntry *lru_tail;
+  int depth;
+  WTextureCacheStats stats;
+} WTextureCache;
+
+static unsigned hashCacheKey(const void *key)
+{
+  const WTextureCacheKey *k = key;
+  unsigned h;
+
+  h = (unsigned)((uintptr_t)k->texture >> 4);
+  h = h * 31 + (unsigned)k->width;
+  h = h * 31 + (unsigned)k->height;
+  h = h * 31 + (unsigned)k->kind;
+  h = h * 31 + (unsigned)k->variant;
+
+  return h;
+}
+
+static Bool cacheKeyIsEqual(const void *key1, const void *key2)
+{
+  const WTextureCacheKey *k1 = key1;
+  const WTextureCacheKey *k2 = key2;
+
+  return (k1->texture == k2->texture && k1->width == k2->width && k1->height == k2->height &&
+          k1->kind == k2->kind && k1->variant == k2->variant);
+}
+
+static const WMHashTableCallbacks cacheKeyCallbacks = {hashCacheKey, cacheKeyIsEqual, NULL, NULL};
+
+static void lruUnlink(WTextureCache *cache, WTextureCacheEntry *entry)
+{
+  if (entry->prev)
+    entry->prev->next = entry->next;
+  else if (cache->lru_head == entry)
+    cache->lru_head = entry->next;
+  if (entry->next)
+    entry->next->prev = entry->prev;
+  else if (cache->lru_tail == entry)
+    cache->lru_tail = entry->prev;
+  entry->prev = entry->next = NULL;
+}
+
+static void lruPush(WTextureCache *cache, WTextureCacheEntry *entry)
+{
+  entry->prev = NULL;
+  entry->next = cache->lru_head;
+  if (cache->lru_head)
+    cache->lru_head->prev = entry;
+  cache->lru_head = entry;
+  if (!cache->lru_tail)
+    cache->lru_tail = entry;
+}
+
+static void freeCacheEntry(WTextureCache *cache, WTextureCacheEntry *entry)
+{
+  if (!entry->orphaned)
+    WMHashRemove(cache->entries, &entry->key);
+  WMHashRemove(cache->pixmaps, (void *)entry->pixmap);
+
+  cache->stats.entries--;
+  cache->stats.bytes -= entry->size;
+
+  XFreePixmap(dpy, entry->pixmap);
+  wfree(entry);
+}
+
+static void trimCache(WTextureCache *cache)
+{
+  WTextureCacheEntry *entry;
+
+  while (cache->stats.bytes > cache->stats.max_bytes && cache->lru_tail) {
+    entry = cache->lru_tail;
+    lruUnlink(cache, entry);
+    freeCacheEntry(cache, entry);
+    cache->stats.evictions++;
+  }
+}
+
+struct WTextureCache *wTextureCacheCreate(WScreen *scr)
+{
+  WTextureCache *cache;
+
+  cache = wmalloc(sizeof(WTextureCache));
+  cache->entries = WMCreateHashTable(cacheKeyCallbacks);
+  cache->pixmaps = WMCreateHashTable(WMIntHashCallbacks);
+  cache->depth = scr->w_depth;
+  cache->stats.max_bytes = TEXTURE_CACHE_MAX_BYTES;
+
+  return cache;
+}
+
+Pixmap wTextureCacheGet(WScreen *scr, WTexture *texture, int width, int height, int kind,
+                        int variant)
+{
+  WTextureCache *cache = scr->texture_cache;
+  WTextureCacheEntry *entry;
+  WTextureCacheKey key;
+
+  if (!cache)
+    return None;
+
+  key.texture = texture;
+  key.width = width;
+  key.height = height;
+  key.kind = kind;
+  key.variant = variant;
+
+  entry = WMHashGet(cache->entries, &key);
+  if (!entry) {
+    cache->stats.misses++;
+    return None;
+  }
+
+  if (entry->refcount++ == 0)
+    lruUnlink(cache, entry);
+  cache->stats.hits++;
+
+  return entry->pixmap;
+}
+
+void wTextureCachePut(WScreen *scr, WTexture *texture, int width, int height, int kind,
+                      int variant, Pixmap pixmap)
+{
+  WTextureCache *cache = scr->texture_cache;
+  WTextureCacheEntry *entry;
+  size_t size;
+
+  if (!cache || pixmap == None)
+    return;
+
+  /* not cached: the pixmap will be freed by wTextureCacheRelease() */
+  size = (size_t)width * height * ((cache->depth + 7) / 8);
+  if (size > cache->stats.max_bytes / 4)
+    return;
+
+  entry = wmalloc(sizeof(WTextureCacheEntry));
+  entry->key.texture = texture;
+  entry->key.width = width;
+  entry->key.height = height;
+  entry->key.kind = kind;
+  entry->key.variant = variant;
+
+  if (WMHashGet(cache->entries, &entry->key)) {
+    wfree(entry);
+    return;
+  }
+
+  entry->pixmap = pixmap;
+  entry->size = size;
+  entry->refcount = 1;
+
+  WMHashInsert(cache->entries, &entry->key, entry);
+  WMHashInsert(cache->pixmaps, (void *)pixmap, entry);
+
+  cache->stats.entries++;
+  cache->stats.bytes += size;
+
+  trimCache(cache);
+}
+
+void wTextureCacheRelease(WScreen *scr, Pixmap pixmap)
+{
+  WTextureCache *cache = scr->texture_cache;
+  WTextureCacheEntry *entry;
+
+  if (pixmap == None)
+    return;
+
+  entry = cache ? WMHashGet(cache->pixmaps, (void *)pixmap) : NULL;
+  if (!entry) {
+    XFreePixmap(dpy, pixmap);
+    return;
+  }
+
+  if (--entry->refcount > 0)
+    return;
+
+  if (entry->orphaned) {
+    freeCacheEntry(cache, entry);
+  } else {
+    lruPush(cache, entry);
+    trimCache(cache);
+  }
+}
+
+void wTextureCachePurge(WScreen *scr, WTexture *texture)
+{
+  WTextureCache *cache = scr->texture_cache;
+  WTextureCacheEntry *entry;
+  WTextureCacheEntry *purge = NULL;
+  WMHashEnumerator e;
+
+  if (!cache)
+    return;
+
+  /* collect first, the table can't be modified while enumerating */
+  e = WMEnumerateHashTable(cache->entries);
+  while ((entry = WMNextHashEnumeratorItem(&e))) {
+    if (entry->key.texture == texture) {
+      if (entry->refcount == 0)
+        lruUnlink(cache, entry);
+      entry->next = purge;
+      purge = entry;
+    }
+  }
+
+  while (purge) {
+    entry = purge;
+    purge = entry->next;
+    entry->next = NULL;
+
+    if (entry->refcount == 0) {
+      freeCacheEntry(cache, entry);
+    } else {
+      /* owners still use the pixmap; forget the key and free on release */
+      WMHashRemove(cache->entries, &entry->key);
+      entry->orphaned = True;
+    }
+  }
+}
+
+void wTextureCacheGetStats(WScreen *scr, WTextureCacheStats *stats)
+{
+  if (scr->texture_cache)
+    *stats = scr->texture_cache->stats;
+  else
+    memset(stats, 0, sizeof(WTextureCacheStats));
+}
@@ -166,6 +166,39 @@ struct RImage *wTextureRenderImage(WTexture *, int, int, int);
 
 void wTexturePaintTitlebar(struct WWindow *wwin, WTexture *texture, Pixmap *tdata, int repaint);
 
+/* rendered texture cache kinds */
+#define WTC_TITLEBAR 0
+#define WTC_LBUTTON 1
+#define WTC_RBUTTON 2
+#define WTC_RESIZEBAR 3
+#define WTC_MENU 4
+
+typedef struct WTextureCacheStats {
+  unsigned long hits;
+  unsigned long misses;
+  unsigned long evictions;
+  unsigned entries;
+  size_t bytes;
+  size_t max_bytes;
+} WTextureCacheStats;
+
+struct WTextureCache *wTextureCacheCreate(WScreen *scr);
+/* Returns None on miss, otherwise a pixmap that must be released with
+ * wTextureCacheRelease() */
+Pixmap wTextureCacheGet(WScreen *scr, WTexture *texture, int width, int height, int kind,
+                        int variant);
+/* Hands over a freshly rendered pixmap; the caller keeps one reference */
+void wTextureCachePut(WScreen *scr, WTexture *texture, int width, int height, int kind,
+                      int variant, Pixmap pixmap);
+/* Works for uncached pixmaps too, they are freed immediately */
+void wTextureCacheRelease(WScreen *scr, Pixmap pixmap);
+void wTextureCachePurge(WScreen *scr, WTexture *texture);
+void wTextureCacheGetStats(WScreen *scr, WTextureCacheStats *stats);
+
+#define RELEASE_PIXMAP(scr, p)        \
+  if ((p) != None)                    \
+  wTextureCacheRelease((scr), (p)), (p) = None
+
 #define FREE_PIXMAP(p) \
   if ((p) != None)     \
   XFreePixmap(dpy, (p)), (p) = None
@@ -30,6 +30,7 @@ typedef struct WStacking {
   struct _WCoreWindow *under;
   short window_level;
   struct _WCoreWindow *child_of; /* owner for transient window */
+  unsigned int changed : 1;      /* position is not committed to X server yet */
 } WStacking;
 
 typedef struct _WCoreWindow {
@@ -72,6 +72,7 @@
 #include "iconyard.h"
 #include "application.h"
 #include "appmenu.h"
+#include "moveres.h"
 
 #ifdef USE_MWM_HINTS
 #include "motif.h"
@@ -120,6 +121,7 @@ static void appearanceObserver(CFNotificationCenterRef center,
       wwin->client.y = wwin->frame_y - wwin->client.height + wwin->frame->top_width;
       wWindowSynthConfigureNotify(wwin);
     }
+    wMoveEdgesUpdateWindow(wwin);
   }
   if (flags & WTextureSettings)
     wwin->frame->flags.need_texture_remake = 1;
@@ -1265,6 +1267,7 @@ WWindow *wManageWindow(WScreen *scr, Window window)
     wwin->next = tmp;
     wwin->prev = NULL;
   }
+  wMoveEdgesAddWindow(wwin);
 
   /* raise is set to true if we un-hid the app when this window was born.
    * we raise, else old windows of this app will be above this new one. */
@@ -1439,6 +1442,7 @@ WWindow *wManageInternalWindow(WScreen *scr, Window window, Window owner, const
     wwin->next = tmp;
     wwin->prev = NULL;
   }
+  wMoveEdgesAddWindow(wwin);
 
   if (wwin->flags.is_gnustep == 0)
     wFrameWindowChangeState(wwin->frame, WS_UNFOCUSED);
@@ -1547,6 +1551,7 @@ void wUnmanageWindow(WWindow *wwin, Bool restore, Bool destroyed)
 
     new_focused_window = wNextWindowToFocus(wwin);
   }
+  wMoveEdgesRemoveWindow(wwin);
 
   if (!wwin->flags.internal_window && scr->notificationCenter) {
     CFNotificationCenterPostNotification(scr->notificationCenter, WMDidUnmanageWindowNotification,
@@ -2171,6 +2176,7 @@ void wWindowConfigure(WWindow *wwin, int req_x, int req_y, int req_width, int re
     wWindowSynthConfigureNotify(wwin);
 
   wNETFrameExtents(wwin);
+  wMoveEdgesUpdateWindow(wwin);
 
   XFlush(dpy);
 }
@@ -2204,6 +2210,7 @@ void wWindowMove(WWindow *wwin, int req_x, int req_y)
 
   wwin->frame_x = req_x;
   wwin->frame_y = req_y;
+  wMoveEdgesUpdateWindow(wwin);
 
 #ifdef CONFIGURE_WINDOW_WHILE_MOVING
   if (synth_notify)
@@ -2347,6 +2354,7 @@ void wWindowConfigureBorders(WWindow *wwin)
       XMoveWindow(dpy, wwin->client_win, 0, wwin->frame->top_width);
       wWindowConfigure(wwin, wwin->frame_x, newy, wwin->client.width, wwin->client.height);
     }
+    wMoveEdgesUpdateWindow(wwin);
 
     flags = 0;
     if (!WFLAGP(wwin, no_miniaturize_button) && wwin->frame->flags.hide_left_button)
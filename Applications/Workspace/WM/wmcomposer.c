@@ -41,14 +41,33 @@
 #include <X11/extensions/Xdamage.h>
 #include <X11/extensions/Xrender.h>
 #include <X11/extensions/shape.h>
+#include <pthread.h>
+
+#include "wmcomposer.h"
+#include "xrandr.h"
 
 typedef struct _ignore {
   struct _ignore *next;
   unsigned long sequence;
 } CMPIgnoreSequence;
 
+typedef struct _shadow {
+  struct _shadow *hnext;
+  struct _shadow *lru_prev; /* unreferenced shadows, most recent first */
+  struct _shadow *lru_next;
+  int width;
+  int height;
+  int opacity; /* opacity level, 0..25 */
+  Picture picture;
+  int swidth;
+  int sheight;
+  int refcount;
+} CMPShadow;
+
 typedef struct _win {
-  struct _win *next;
+  struct _win *next;  /* stacking order, topmost first */
+  struct _win *prev;
+  struct _win *hnext; /* window_hash bucket chain */
   Window id;
   Pixmap pixmap;
   XWindowAttributes a;
@@ -61,6 +80,7 @@ typedef struct _win {
   XserverRegion borderSize;
   XserverRegion extents;
   Picture shadow;
+  CMPShadow *shadowRef; /* shared entry owning `shadow` */
   int shadow_dx;
   int shadow_dy;
   int shadow_width;
@@ -79,8 +99,10 @@ typedef struct _win {
 typedef struct _conv {
   int size;
   double *data;
+  double *sum; /* summed-area table of data, (size + 1) x (size + 1) */
 } conv;
 
+
 typedef struct _fade {
   struct _fade *next;
   Display *dpy;
@@ -92,8 +114,10 @@ typedef struct _fade {
   Bool gone;
 } CMPFade;
 
-static Display *dpy;
+/* composer own connection, not the WM one (dpy) */
+static Display *cmp_dpy;
 static CMPWindow *list;
+static CMPWindow *list_tail;
 static CMPFade *fades;
 static int scr;
 static Window root_window;
@@ -150,6 +174,7 @@ static unsigned int get_window_opacity_property(Display *dpy, CMPWindow *w, unsi
 
 static XserverRegion window_extents_region(Display *dpy, CMPWindow *w);
 static XserverRegion window_border_size(Display *dpy, CMPWindow *w);
+static void release_window_shadow(Display *dpy, CMPWindow *w);
     
 static void wComposerDiscardEventIgnore(Display *dpy, unsigned long sequence);
 static void wComposerSetEventIgnore(Display *dpy, unsigned long sequence);
@@ -176,6 +201,25 @@ static int Gsize = -1;
 static unsigned char *shadowCorner = NULL;
 static unsigned char *shadowTop = NULL;
 
+/* Shadow pictures shared by windows of the same size and opacity */
+#define SHADOW_HASH_SIZE 64
+#define SHADOW_CACHE_MAX_BYTES (16 * 1024 * 1024)
+static CMPShadow *shadowHash[SHADOW_HASH_SIZE];
+static CMPShadow *shadowLRUHead, *shadowLRUTail;
+static size_t shadowCacheBytes; /* unreferenced shadows only */
+
+/* Repaint scheduling: damage is coalesced into one repaint per frame */
+#define DEFAULT_FRAME_INTERVAL 16
+static int frameInterval = 0; /* 0 - take it from XRandR */
+static int lastPaintTime;
+static WComposerStats stats;
+static pthread_mutex_t statsLock = PTHREAD_MUTEX_INITIALIZER;
+
+/* Window lookup by XID */
+static CMPWindow **windowHash;
+static unsigned windowHashSize;
+static unsigned windowCount;
+
 static int get_time_in_milliseconds(void)
 {
   struct timeval tv;
@@ -272,8 +316,7 @@ static void set_fade(Display *dpy, CMPWindow *w, double start, double finish, do
   w->opacity = f->cur * OPAQUE;
   determine_mode(dpy, w);
   if (w->shadow) {
-    XRenderFreePicture(dpy, w->shadow);
-    w->shadow = None;
+    release_window_shadow(dpy, w);
     w->extents = window_extents_region(dpy, w);
   }
 }
@@ -329,8 +372,7 @@ static void run_fades(Display *dpy)
     }
     determine_mode(dpy, w);
     if (w->shadow) {
-      XRenderFreePicture(dpy, w->shadow);
-      w->shadow = None;
+      release_window_shadow(dpy, w);
       w->extents = window_extents_region(dpy, w);
     }
     /* Must do this last as it might destroy f->w in callbacks */
@@ -358,9 +400,10 @@ static conv *make_gaussian_map(Display *dpy, double r)
   double t;
   double g;
 
-  c = malloc(sizeof(conv) + size * size * sizeof(double));
+  c = malloc(sizeof(conv) + (size * size + (size + 1) * (size + 1)) * sizeof(double));
   c->size = size;
   c->data = (double *)(c + 1);
+  c->sum = c->data + size * size;
   t = 0.0;
   for (y = 0; y < size; y++)
     for (x = 0; x < size; x++) {
@@ -373,6 +416,18 @@ static conv *make_gaussian_map(Display *dpy, double r)
       c->data[y * size + x] /= t;
     }
   }
+  /* sum[y][x] is the sum of data above and to the left of (x, y) */
+  for (x = 0; x <= size; x++) {
+    c->sum[x] = 0;
+  }
+  for (y = 0; y < size; y++) {
+    double row = 0;
+    c->sum[(y + 1) * (size + 1)] = 0;
+    for (x = 0; x < size; x++) {
+      row += c->data[y * size + x];
+      c->sum[(y + 1) * (size + 1) + x + 1] = c->sum[y * (size + 1) + x + 1] + row;
+    }
+  }
   return c;
 }
 
@@ -395,8 +450,7 @@ static conv *make_gaussian_map(Display *dpy, double r)
 
 static unsigned char sum_gaussian(conv *map, double opacity, int x, int y, int width, int height)
 {
-  int fx, fy;
-  double *g_line = map->data;
+  double *sum = map->sum;
   int g_size = map->size;
   int center = g_size / 2;
   int fx_start, fx_end;
@@ -431,16 +485,14 @@ static unsigned char sum_gaussian(conv *map, double opacity, int x, int y, int w
     fy_end = g_size;
   }
 
-  g_line = g_line + fy_start * g_size + fx_start;
-
-  v = 0;
-  for (fy = fy_start; fy < fy_end; fy++) {
-    double *g_data = g_line;
-    g_line += g_size;
+  if (fx_start >= fx_end || fy_start >= fy_end) {
+    return 0;
+  }
 
-    for (fx = fx_start; fx < fx_end; fx++) {
-      v += *g_data++;
-    }
+  v = (sum[fy_end * (g_size + 1) + fx_end] - sum[fy_start * (g_size + 1) + fx_end] -
+       sum[fy_end * (g_size + 1) + fx_start] + sum[fy_start * (g_size + 1) + fx_start]);
+  if (v < 0) {
+    v = 0;
   }
   if (v > 1) {
     v = 1;
@@ -503,6 +555,8 @@ static XImage *create_shadow_image(Display *dpy, double opacity, int width, int
   unsigned char d;
   int x_diff;
   int opacity_int = (int)(opacity * 25);
+  /* quantize like the presummed tables so shadows can be shared */
+  double level_opacity = opacity_int / 25.0;
   data = malloc(swidth * sheight * sizeof(unsigned char));
   if (!data)
     return NULL;
@@ -522,7 +576,7 @@ static XImage *create_shadow_image(Display *dpy, double opacity, int width, int
   if (Gsize > 0)
     d = shadowTop[opacity_int * (Gsize + 1) + Gsize];
   else
-    d = sum_gaussian(gaussianMap, opacity, center, center, width, height);
+    d = sum_gaussian(gaussianMap, level_opacity, center, center, width, height);
   memset(data, d, sheight * swidth);
 
   /*
@@ -542,7 +596,7 @@ static XImage *create_shadow_image(Display *dpy, double opacity, int width, int
       if (xlimit == Gsize && ylimit == Gsize) {
         d = shadowCorner[opacity_int * (Gsize + 1) * (Gsize + 1) + y * (Gsize + 1) + x];
       } else {
-        d = sum_gaussian(gaussianMap, opacity, x - center, y - center, width, height);
+        d = sum_gaussian(gaussianMap, level_opacity, x - center, y - center, width, height);
       }
       data[y * swidth + x] = d;
       data[(sheight - y - 1) * swidth + x] = d;
@@ -559,7 +613,7 @@ static XImage *create_shadow_image(Display *dpy, double opacity, int width, int
       if (ylimit == Gsize) {
         d = shadowTop[opacity_int * (Gsize + 1) + y];
       } else {
-        d = sum_gaussian(gaussianMap, opacity, center, y - center, width, height);
+        d = sum_gaussian(gaussianMap, level_opacity, center, y - center, width, height);
       }
       memset(&data[y * swidth + gsize], d, x_diff);
       memset(&data[(sheight - y - 1) * swidth + gsize], d, x_diff);
@@ -574,7 +628,7 @@ static XImage *create_shadow_image(Display *dpy, double opacity, int width, int
     if (xlimit == Gsize) {
       d = shadowTop[opacity_int * (Gsize + 1) + x];
     } else {
-      d = sum_gaussian(gaussianMap, opacity, x - center, center, width, height);
+      d = sum_gaussian(gaussianMap, level_opacity, x - center, center, width, height);
     }
     for (y = gsize; y < sheight - gsize; y++) {
       data[y * swidth + x] = d;
@@ -629,6 +683,112 @@ static Picture create_shadow_picture(Display *dpy, double opacity, Picture alpha
   return shadowPicture;
 }
 
+static unsigned shadow_hash(int width, int height, int opacity)
+{
+  return ((unsigned)width * 31 + (unsigned)height) * 31 + (unsigned)opacity;
+}
+
+static void shadow_lru_unlink(CMPShadow *sh)
+{
+  if (sh->lru_prev)
+    sh->lru_prev->lru_next = sh->lru_next;
+  else
+    shadowLRUHead = sh->lru_next;
+  if (sh->lru_next)
+    sh->lru_next->lru_prev = sh->lru_prev;
+  else
+    shadowLRUTail = sh->lru_prev;
+  sh->lru_prev = sh->lru_next = NULL;
+}
+
+static void free_shadow(Display *dpy, CMPShadow *sh)
+{
+  CMPShadow **prev;
+
+  for (prev = &shadowHash[shadow_hash(sh->width, sh->height, sh->opacity) % SHADOW_HASH_SIZE];
+       *prev; prev = &(*prev)->hnext) {
+    if (*prev == sh) {
+      *prev = sh->hnext;
+      break;
+    }
+  }
+  XRenderFreePicture(dpy, sh->picture);
+  free(sh);
+}
+
+/* Returns a shared shadow, release it with release_shadow() */
+static CMPShadow *get_shadow(Display *dpy, double opacity, Picture alpha_pict, int width,
+                             int height)
+{
+  int level = (int)(opacity * 25);
+  unsigned h = shadow_hash(width, height, level) % SHADOW_HASH_SIZE;
+  CMPShadow *sh;
+
+  for (sh = shadowHash[h]; sh; sh = sh->hnext) {
+    if (sh->width == width && sh->height == height && sh->opacity == level) {
+      if (sh->refcount++ == 0) {
+        shadow_lru_unlink(sh);
+        shadowCacheBytes -= (size_t)sh->swidth * sh->sheight;
+      }
+      return sh;
+    }
+  }
+
+  sh = malloc(sizeof(CMPShadow));
+  if (!sh) {
+    return NULL;
+  }
+  sh->picture = create_shadow_picture(dpy, opacity, alpha_pict, width, height, &sh->swidth,
+                                      &sh->sheight);
+  if (!sh->picture) {
+    free(sh);
+    return NULL;
+  }
+  sh->width = width;
+  sh->height = height;
+  sh->opacity = level;
+  sh->refcount = 1;
+  sh->lru_prev = sh->lru_next = NULL;
+  sh->hnext = shadowHash[h];
+  shadowHash[h] = sh;
+
+  return sh;
+}
+
+static void release_shadow(Display *dpy, CMPShadow *sh)
+{
+  if (--sh->refcount > 0) {
+    return;
+  }
+
+  /* keep it around for windows resized back to this size */
+  sh->lru_next = shadowLRUHead;
+  if (shadowLRUHead)
+    shadowLRUHead->lru_prev = sh;
+  shadowLRUHead = sh;
+  if (!shadowLRUTail)
+    shadowLRUTail = sh;
+  shadowCacheBytes += (size_t)sh->swidth * sh->sheight;
+
+  while (shadowCacheBytes > SHADOW_CACHE_MAX_BYTES && shadowLRUTail) {
+    sh = shadowLRUTail;
+    shadow_lru_unlink(sh);
+    shadowCacheBytes -= (size_t)sh->swidth * sh->sheight;
+    free_shadow(dpy, sh);
+  }
+}
+
+static void release_window_shadow(Display *dpy, CMPWindow *w)
+{
+  if (w->shadowRef) {
+    release_shadow(dpy, w->shadowRef);
+  } else if (w->shadow) {
+    XRenderFreePicture(dpy, w->shadow);
+  }
+  w->shadowRef = NULL;
+  w->shadow = None;
+}
+
 static Picture create_solid_picture(Display *dpy, Bool argb, double a, double r, double g, double b)
 {
   Pixmap pixmap;
@@ -863,6 +1023,9 @@ static void add_damage_region(Display *dpy, XserverRegion damage)
   if (allDamage) {
     XFixesUnionRegion(dpy, allDamage, allDamage, damage);
     XFixesDestroyRegion(dpy, damage);
+    pthread_mutex_lock(&statsLock);
+    stats.damage_merged++;
+    pthread_mutex_unlock(&statsLock);
   } else {
     allDamage = damage;
   }
@@ -871,11 +1034,65 @@ static void add_damage_region(Display *dpy, XserverRegion damage)
 // ----------------------------------------------------------------------------------------------
 // Windows
 // ----------------------------------------------------------------------------------------------
+static unsigned window_hash(Window id)
+{
+  /* XIDs of one client are sequential, mix in the client bits */
+  return (unsigned)(id ^ (id >> 16)) & (windowHashSize - 1);
+}
+
+static void window_hash_insert(CMPWindow *w)
+{
+  unsigned h;
+
+  if (windowCount >= windowHashSize) {
+    unsigned old_size = windowHashSize;
+    CMPWindow **old_hash = windowHash;
+    CMPWindow **new_hash;
+    unsigned i;
+
+    new_hash = calloc(old_size ? old_size * 2 : 64, sizeof(CMPWindow *));
+    if (new_hash) {
+      windowHash = new_hash;
+      windowHashSize = old_size ? old_size * 2 : 64;
+      for (i = 0; i < old_size; i++) {
+        CMPWindow *next, *o;
+        for (o = old_hash[i]; o; o = next) {
+          next = o->hnext;
+          h = window_hash(o->id);
+          o->hnext = windowHash[h];
+          windowHash[h] = o;
+        }
+      }
+      free(old_hash);
+    }
+  }
+  h = window_hash(w->id);
+  w->hnext = windowHash[h];
+  windowHash[h] = w;
+  windowCount++;
+}
+
+static void window_hash_remove(CMPWindow *w)
+{
+  CMPWindow **prev;
+
+  for (prev = &windowHash[window_hash(w->id)]; *prev; prev = &(*prev)->hnext) {
+    if (*prev == w) {
+      *prev = w->hnext;
+      windowCount--;
+      break;
+    }
+  }
+}
+
 static CMPWindow *find_window(Display *dpy, Window id)
 {
   CMPWindow *w;
 
-  for (w = list; w; w = w->next) {
+  if (!windowHashSize) {
+    return NULL;
+  }
+  for (w = windowHash[window_hash(id)]; w; w = w->hnext) {
     if (w->id == id) {
       return w;
     }
@@ -883,6 +1100,45 @@ static CMPWindow *find_window(Display *dpy, Window id)
   return NULL;
 }
 
+static void stack_unlink(CMPWindow *w)
+{
+  if (w->prev) {
+    w->prev->next = w->next;
+  } else {
+    list = w->next;
+  }
+  if (w->next) {
+    w->next->prev = w->prev;
+  } else {
+    list_tail = w->prev;
+  }
+  w->next = w->prev = NULL;
+}
+
+/* Insert `w` right on top of `above`, at the bottom if `above` is NULL */
+static void stack_link(CMPWindow *w, CMPWindow *above)
+{
+  if (above) {
+    w->next = above;
+    w->prev = above->prev;
+    if (above->prev) {
+      above->prev->next = w;
+    } else {
+      list = w;
+    }
+    above->prev = w;
+  } else {
+    w->next = NULL;
+    w->prev = list_tail;
+    if (list_tail) {
+      list_tail->next = w;
+    } else {
+      list = w;
+    }
+    list_tail = w;
+  }
+}
+
 static XserverRegion window_extents_region(Display *dpy, CMPWindow *w)
 {
   XRectangle r;
@@ -908,9 +1164,13 @@ static XserverRegion window_extents_region(Display *dpy, CMPWindow *w)
           if (w->mode == WINDOW_TRANS) {
             opacity = opacity * ((double)w->opacity) / ((double)OPAQUE);
           }
-          w->shadow = create_shadow_picture(dpy, opacity, w->alphaPict, w->a.width + w->a.border_width * 2,
-                                     w->a.height + w->a.border_width * 2, &w->shadow_width,
-                                     &w->shadow_height);
+          w->shadowRef = get_shadow(dpy, opacity, w->alphaPict, w->a.width + w->a.border_width * 2,
+                                    w->a.height + w->a.border_width * 2);
+          if (w->shadowRef) {
+            w->shadow = w->shadowRef->picture;
+            w->shadow_width = w->shadowRef->swidth;
+            w->shadow_height = w->shadowRef->sheight;
+          }
         }
       }
       sr.x = w->a.x + w->shadow_dx;
@@ -1031,8 +1291,7 @@ static void finish_unmap_window(Display *dpy, CMPWindow *w)
     w->borderSize = None;
   }
   if (w->shadow) {
-    XRenderFreePicture(dpy, w->shadow);
-    w->shadow = None;
+    release_window_shadow(dpy, w);
   }
   if (w->borderClip) {
     XFixesDestroyRegion(dpy, w->borderClip);
@@ -1191,18 +1450,14 @@ static Atom get_window_type(Display *dpy, Window window)
 static void add_window(Display *dpy, Window id, Window prev)
 {
   CMPWindow *new = malloc(sizeof(CMPWindow));
-  CMPWindow **p;
+  CMPWindow *above;
 
   if (!new)
     return;
   if (prev) {
-    for (p = &list; *p; p = &(*p)->next) {
-      if ((*p)->id == prev) {
-        break;
-      }
-    }
+    above = find_window(dpy, prev);
   } else {
-    p = &list;
+    above = list;
   }
   new->id = id;
   wComposerSetEventIgnore(dpy, NextRequest(dpy));
@@ -1231,6 +1486,7 @@ static void add_window(Display *dpy, Window id, Window prev)
   new->borderSize = None;
   new->extents = None;
   new->shadow = None;
+  new->shadowRef = NULL;
   new->shadow_dx = 0;
   new->shadow_dy = 0;
   new->shadow_width = 0;
@@ -1242,8 +1498,8 @@ static void add_window(Display *dpy, Window id, Window prev)
 
   new->windowType = get_window_type(dpy, new->id);
 
-  new->next = *p;
-  *p = new;
+  stack_link(new, above);
+  window_hash_insert(new);
   if (new->a.map_state == IsViewable) {
     map_window(dpy, id, new->damage_sequence - 1, True);
   }
@@ -1259,24 +1515,8 @@ static void restack_window(Display *dpy, CMPWindow *w, Window new_above)
     old_above = None;
   }
   if (old_above != new_above) {
-    CMPWindow **prev;
-
-    /* unhook */
-    for (prev = &list; *prev; prev = &(*prev)->next) {
-      if ((*prev) == w) {
-        break;
-      }
-    }
-    *prev = w->next;
-
-    /* rehook */
-    for (prev = &list; *prev; prev = &(*prev)->next) {
-      if ((*prev)->id == new_above) {
-        break;
-      }
-    }
-    w->next = *prev;
-    *prev = w;
+    stack_unlink(w);
+    stack_link(w, new_above ? find_window(dpy, new_above) : NULL);
   }
 }
 
@@ -1314,8 +1554,7 @@ static void configure_window(Display *dpy, XConfigureEvent *ce)
       }
     }
     if (w->shadow) {
-      XRenderFreePicture(dpy, w->shadow);
-      w->shadow = None;
+      release_window_shadow(dpy, w);
     }
   }
   w->a.width = ce->width;
@@ -1358,41 +1597,39 @@ static void circulate_windows(Display *dpy, XCirculateEvent *ce)
 
 static void finish_destroy_window(Display *dpy, Window id, Bool gone)
 {
-  CMPWindow **prev, *w;
+  CMPWindow *w = find_window(dpy, id);
 
-  for (prev = &list; (w = *prev); prev = &w->next) {
-    if (w->id == id) {
-      if (gone) {
-        finish_unmap_window(dpy, w);
-      }
-      *prev = w->next;
-      if (w->picture) {
-        wComposerSetEventIgnore(dpy, NextRequest(dpy));
-        XRenderFreePicture(dpy, w->picture);
-        w->picture = None;
-      }
-      if (w->alphaPict) {
-        XRenderFreePicture(dpy, w->alphaPict);
-        w->alphaPict = None;
-      }
-      if (w->shadowPict) {
-        XRenderFreePicture(dpy, w->shadowPict);
-        w->shadowPict = None;
-      }
-      if (w->shadow) {
-        XRenderFreePicture(dpy, w->shadow);
-        w->shadow = None;
-      }
-      if (w->damage != None) {
-        wComposerSetEventIgnore(dpy, NextRequest(dpy));
-        XDamageDestroy(dpy, w->damage);
-        w->damage = None;
-      }
-      cleanup_fade(dpy, w);
-      free(w);
-      break;
-    }
+  if (!w) {
+    return;
+  }
+  if (gone) {
+    finish_unmap_window(dpy, w);
   }
+  stack_unlink(w);
+  window_hash_remove(w);
+  if (w->picture) {
+    wComposerSetEventIgnore(dpy, NextRequest(dpy));
+    XRenderFreePicture(dpy, w->picture);
+    w->picture = None;
+  }
+  if (w->alphaPict) {
+    XRenderFreePicture(dpy, w->alphaPict);
+    w->alphaPict = None;
+  }
+  if (w->shadowPict) {
+    XRenderFreePicture(dpy, w->shadowPict);
+    w->shadowPict = None;
+  }
+  if (w->shadow) {
+    release_window_shadow(dpy, w);
+  }
+  if (w->damage != None) {
+    wComposerSetEventIgnore(dpy, NextRequest(dpy));
+    XDamageDestroy(dpy, w->damage);
+    w->damage = None;
+  }
+  cleanup_fade(dpy, w);
+  free(w);
 }
 
 static void destroy_callback(Display *dpy, CMPWindow *w, Bool gone)
@@ -1646,8 +1883,7 @@ void wComposerProcessEvent(Display *dpy, XEvent ev)
               w->opacity = get_window_opacity_property(dpy, w, OPAQUE);
               determine_mode(dpy, w);
               if (w->shadow) {
-                XRenderFreePicture(dpy, w->shadow);
-                w->shadow = None;
+                release_window_shadow(dpy, w);
                 w->extents = window_extents_region(dpy, w);
               }
             }
@@ -1666,48 +1902,101 @@ void wComposerProcessEvent(Display *dpy, XEvent ev)
 }
 
 #include "core/log_utils.h"
+/* Milliseconds until the next repaint is allowed, -1 if there's nothing to paint */
+static int frame_timeout(void)
+{
+  int delta;
+
+  if (!allDamage || autoRedirect) {
+    return -1;
+  }
+  delta = lastPaintTime + frameInterval - get_time_in_milliseconds();
+  return (delta < 0) ? 0 : delta;
+}
+
+static void paint_frame(Display *dpy)
+{
+  struct timespec start, end;
+  unsigned long usec;
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  paint_all(dpy, allDamage);
+  XSync(dpy, False);
+  clock_gettime(CLOCK_MONOTONIC, &end);
+
+  allDamage = None;
+  is_clip_changed = False;
+  lastPaintTime = get_time_in_milliseconds();
+
+  usec = (end.tv_sec - start.tv_sec) * 1000000 + (end.tv_nsec - start.tv_nsec) / 1000;
+  pthread_mutex_lock(&statsLock);
+  stats.frames++;
+  stats.paint_time += usec;
+  if (usec > stats.max_paint_time) {
+    stats.max_paint_time = usec;
+  }
+  pthread_mutex_unlock(&statsLock);
+}
+
+void wComposerSetFrameInterval(int msec)
+{
+  frameInterval = (msec > 0) ? msec : 0;
+}
+
+void wComposerGetStats(WComposerStats *s)
+{
+  pthread_mutex_lock(&statsLock);
+  *s = stats;
+  s->frame_interval = frameInterval;
+  pthread_mutex_unlock(&statsLock);
+}
+
 void wComposerRunLoop()
 {
   struct pollfd ufd;
   XEvent ev;
+  int timeout, frame_wait;
   // XRectangle *expose_rects = NULL;
   // int size_expose = 0;
   // int n_expose = 0;
   // int p;
 
-  WMLogError("Composer: Entering runloop with X connection: %i", ConnectionNumber(dpy));
+  WMLogError("Composer: Entering runloop with X connection: %i", ConnectionNumber(cmp_dpy));
 
-  ufd.fd = ConnectionNumber(dpy);
+  ufd.fd = ConnectionNumber(cmp_dpy);
   ufd.events = POLLIN;
   if (!autoRedirect) {
-    paint_all(dpy, None);
+    paint_all(cmp_dpy, None);
+    lastPaintTime = get_time_in_milliseconds();
   }
 
   for (;;) {
     do {
       if (autoRedirect) {
-        XFlush(dpy);
+        XFlush(cmp_dpy);
       }
-      if (!QLength(dpy)) {
-        if (poll(&ufd, 1, fade_timeout()) == 0) {
-          run_fades(dpy);
+      if (!QLength(cmp_dpy)) {
+        /* sleep until next event, fade step or frame - whatever comes first */
+        timeout = fade_timeout();
+        frame_wait = frame_timeout();
+        if (frame_wait >= 0 && (timeout < 0 || frame_wait < timeout)) {
+          timeout = frame_wait;
+        }
+        if (poll(&ufd, 1, timeout) == 0) {
+          run_fades(cmp_dpy);
           break;
         }
       }
-      XNextEvent(dpy, &ev);
+      XNextEvent(cmp_dpy, &ev);
       if ((ev.type & 0x7f) != KeymapNotify) {
-        wComposerDiscardEventIgnore(dpy, ev.xany.serial);
+        wComposerDiscardEventIgnore(cmp_dpy, ev.xany.serial);
       }
-      wComposerProcessEvent(dpy, ev);
-    } while (QLength(dpy));
-
-    if (allDamage && !autoRedirect) {
-      static int paint;
-      paint_all(dpy, allDamage);
-      paint++;
-      XSync(dpy, False);
-      allDamage = None;
-      is_clip_changed = False;
+      wComposerProcessEvent(cmp_dpy, ev);
+    } while (QLength(cmp_dpy));
+
+    /* damage that came in before the frame is due waits for the next pass */
+    if (frame_timeout() == 0) {
+      paint_frame(cmp_dpy);
     }
   }
 }
@@ -1861,7 +2150,6 @@ static Bool wComposerExtensionsCheck(Display *dpy)
 // }
 Bool wComposerInitialize()
 {
-  // Display *dpy;
   char *display = NULL;
   Window root_return, parent_return;
   Window *children;
@@ -1876,8 +2164,8 @@ Bool wComposerInitialize()
   // CompClientShadows - use window extents for shadow, blurred
   compMode = CompSimple;
 
-  dpy = XOpenDisplay(display);
-  if (!dpy) {
+  cmp_dpy = XOpenDisplay(display);
+  if (!cmp_dpy) {
     fprintf(stderr, "Can't open display\n");
     return False;
   }
@@ -1885,54 +2173,62 @@ Bool wComposerInitialize()
   XSetErrorHandler(wComposerErrorHandler);
 
   if (should_synchronize) {
-    XSynchronize(dpy, 1);
+    XSynchronize(cmp_dpy, 1);
   }
-  scr = DefaultScreen(dpy);
-  root_window = RootWindow(dpy, scr);
+  scr = DefaultScreen(cmp_dpy);
+  root_window = RootWindow(cmp_dpy, scr);
 
-  if (wComposerExtensionsCheck(dpy) == False) {
+  if (wComposerExtensionsCheck(cmp_dpy) == False) {
     return False;
   }
 
-  if (wComposerRegister(dpy) == False) {
+  if (wComposerRegister(cmp_dpy) == False) {
     return False;
   }
 
-  wComposerAtomsCreate(dpy);
+  wComposerAtomsCreate(cmp_dpy);
 
   pa.subwindow_mode = IncludeInferiors;
 
   if (compMode == CompClientShadows) {
-    gaussianMap = make_gaussian_map(dpy, shadowRadius);
+    gaussianMap = make_gaussian_map(cmp_dpy, shadowRadius);
     presum_gaussian(gaussianMap);
   }
 
-  root_width = DisplayWidth(dpy, scr);
-  root_height = DisplayHeight(dpy, scr);
+  root_width = DisplayWidth(cmp_dpy, scr);
+  root_height = DisplayHeight(cmp_dpy, scr);
 
   root_picture = XRenderCreatePicture(
-      dpy, root_window, XRenderFindVisualFormat(dpy, DefaultVisual(dpy, scr)), CPSubwindowMode, &pa);
-  black_picture = create_solid_picture(dpy, True, 1, 0, 0, 0);
+      cmp_dpy, root_window, XRenderFindVisualFormat(cmp_dpy, DefaultVisual(cmp_dpy, scr)), CPSubwindowMode, &pa);
+  black_picture = create_solid_picture(cmp_dpy, True, 1, 0, 0, 0);
   if (compMode == CompServerShadows) {
-    trans_black_picture = create_solid_picture(dpy, True, 0.3, 0, 0, 0);
+    trans_black_picture = create_solid_picture(cmp_dpy, True, 0.3, 0, 0, 0);
   }
   allDamage = None;
   is_clip_changed = True;
 
-  XGrabServer(dpy);
+  if (frameInterval <= 0) {
+    double rate = wGetXrandrRefreshRate(cmp_dpy, root_window);
+    frameInterval = (rate >= 1.0) ? (int)(1000.0 / rate) : DEFAULT_FRAME_INTERVAL;
+    if (frameInterval <= 0) {
+      frameInterval = 1;
+    }
+  }
+
+  XGrabServer(cmp_dpy);
   if (autoRedirect) {
-    XCompositeRedirectSubwindows(dpy, root_window, CompositeRedirectAutomatic);
+    XCompositeRedirectSubwindows(cmp_dpy, root_window, CompositeRedirectAutomatic);
   } else {
-    XCompositeRedirectSubwindows(dpy, root_window, CompositeRedirectManual);
-    XSelectInput(dpy, root_window,
+    XCompositeRedirectSubwindows(cmp_dpy, root_window, CompositeRedirectManual);
+    XSelectInput(cmp_dpy, root_window,
                  SubstructureNotifyMask | ExposureMask | StructureNotifyMask | PropertyChangeMask);
-    XShapeSelectInput(dpy, root_window, ShapeNotifyMask);
-    XQueryTree(dpy, root_window, &root_return, &parent_return, &children, &nchildren);
+    XShapeSelectInput(cmp_dpy, root_window, ShapeNotifyMask);
+    XQueryTree(cmp_dpy, root_window, &root_return, &parent_return, &children, &nchildren);
     for (unsigned int i = 0; i < nchildren; i++)
-      add_window(dpy, children[i], i ? children[i - 1] : None);
+      add_window(cmp_dpy, children[i], i ? children[i - 1] : None);
     XFree(children);
   }
-  XUngrabServer(dpy);
+  XUngrabServer(cmp_dpy);
 
   return True;
 }
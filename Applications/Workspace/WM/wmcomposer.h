@@ -2,5 +2,17 @@
 
 Bool wComposerInitialize();
 void wComposerRunLoop();
-void wComposerProcessEvent(XEvent ev);
-Bool wComposerErrorHandler(Display *dpy, XErrorEvent *ev);
\ No newline at end of file
+void wComposerProcessEvent(Display *dpy, XEvent ev);
+Bool wComposerErrorHandler(Display *dpy, XErrorEvent *ev);
+
+typedef struct WComposerStats {
+  unsigned long frames;         /* repaints done */
+  unsigned long damage_merged;  /* damage regions coalesced into a pending repaint */
+  unsigned long paint_time;     /* total paint_all() time, microseconds */
+  unsigned long max_paint_time; /* longest paint_all(), microseconds */
+  int frame_interval;           /* minimal time between repaints, milliseconds */
+} WComposerStats;
+
+/* 0 - use refresh rate of the primary XRandR output */
+void wComposerSetFrameInterval(int msec);
+void wComposerGetStats(WComposerStats *stats);
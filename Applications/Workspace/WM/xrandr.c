@@ -100,6 +100,64 @@ void wUpdateXrandrInfo(WScreen *scr)
 #endif
 }
 
+/* Returns refresh rate (Hz) of the primary output or the fastest active output.
+   Takes a display connection explicitly because it is used by composer thread. */
+double wGetXrandrRefreshRate(Display *xdpy, Window root)
+{
+  double rate = 0.0;
+#ifdef USE_XRANDR
+  XRRScreenResources *screen_res;
+  RROutput primary_output;
+  XRROutputInfo *output_info;
+  XRRCrtcInfo *crtc_info;
+  XRRModeInfo *mode;
+  double mode_rate;
+  int i, m;
+
+  screen_res = XRRGetScreenResourcesCurrent(xdpy, root);
+  if (screen_res == NULL) {
+    return 0.0;
+  }
+  primary_output = XRRGetOutputPrimary(xdpy, root);
+  for (i = 0; i < screen_res->noutput; i++) {
+    output_info = XRRGetOutputInfo(xdpy, screen_res, screen_res->outputs[i]);
+    if (output_info == NULL) {
+      continue;
+    }
+    crtc_info = NULL;
+    if (output_info->crtc) {
+      crtc_info = XRRGetCrtcInfo(xdpy, screen_res, output_info->crtc);
+    }
+    if (crtc_info) {
+      for (m = 0; m < screen_res->nmode; m++) {
+        mode = &screen_res->modes[m];
+        if (mode->id != crtc_info->mode || !mode->hTotal || !mode->vTotal) {
+          continue;
+        }
+        mode_rate = (double)mode->dotClock / ((double)mode->hTotal * (double)mode->vTotal);
+        if (mode->modeFlags & RR_DoubleScan) {
+          mode_rate /= 2;
+        }
+        if (mode->modeFlags & RR_Interlace) {
+          mode_rate *= 2;
+        }
+        if (screen_res->outputs[i] == primary_output || mode_rate > rate) {
+          rate = mode_rate;
+        }
+        break;
+      }
+      XRRFreeCrtcInfo(crtc_info);
+    }
+    XRRFreeOutputInfo(output_info);
+    if (screen_res->outputs[i] == primary_output && rate > 0) {
+      break;
+    }
+  }
+  XRRFreeScreenResources(screen_res);
+#endif
+  return rate;
+}
+
 int wGetRectPlacementInfo(WScreen *scr, WMRect rect, int *flags)
 {
   int best;
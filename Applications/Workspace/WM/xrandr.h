@@ -29,6 +29,7 @@
 
 void wInitXrandr(WScreen *scr);
 void wUpdateXrandrInfo(WScreen *scr);
+double wGetXrandrRefreshRate(Display *xdpy, Window root);
 
 #define wScreenHeads(scr) ((scr)->xrandr_info.count ? (scr)->xrandr_info.count : 1)
 
@@ -163,6 +163,8 @@ int main(int argc, const char **argv)
     NXTDefaults *defs = [[NXTDefaults alloc] initDefaultsWithPath:NSUserDomainMask
                                                            domain:@"Workspace"];
     if ([defs boolForKey:@"ComposerEnabled"] != NO) {
+      // Minimal time between repaints in ms, 0 - monitor refresh rate
+      wComposerSetFrameInterval([defs integerForKey:@"ComposerFrameInterval"]);
       dispatch_queue_t composer_q = dispatch_queue_create("ns.workspace.composer", DISPATCH_QUEUE_CONCURRENT);
       dispatch_async(composer_q, ^{
         fprintf(stderr, "=== Initializing Composer ===\n");
@@ -174,6 +176,24 @@ int main(int argc, const char **argv)
           fprintf(stderr, "=== Failed to initialize Composer ===\n");
         }
       });
+      // Repaint statistics are logged with --GNU-Debug=Composer
+      if (GSDebugSet(@"Composer") == YES) {
+        dispatch_source_t stats_timer =
+            dispatch_source_create(DISPATCH_SOURCE_TYPE_TIMER, 0, 0, composer_q);
+        dispatch_source_set_timer(stats_timer, dispatch_time(DISPATCH_TIME_NOW, 10 * NSEC_PER_SEC),
+                                  10 * NSEC_PER_SEC, NSEC_PER_SEC);
+        dispatch_source_set_event_handler(stats_timer, ^{
+          WComposerStats stats;
+
+          wComposerGetStats(&stats);
+          fprintf(stderr,
+                  "=== Composer: %lu frames, %lu damages merged, paint time %lu us"
+                  " (max %lu us), frame interval %i ms ===\n",
+                  stats.frames, stats.damage_merged, stats.paint_time, stats.max_paint_time,
+                  stats.frame_interval);
+        });
+        dispatch_resume(stats_timer);
+      }
     }
     [defs release];
 
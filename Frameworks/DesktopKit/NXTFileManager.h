@@ -24,6 +24,8 @@
 
 #import <Foundation/NSString.h>
 #import <Foundation/NSFileManager.h>
+
+#include <sys/types.h>
  
 @class NSString, NSObject;
 
@@ -43,6 +45,30 @@ typedef enum {
 extern NSString *NXTSortFilesBy;
 extern NSString *NXTShowHiddenFiles;
 
+// Directory entry attributes read with one lstat()
+typedef struct {
+  NSString           *name;
+  mode_t             mode;        // file type and permissions, 0 if lstat() failed
+  BOOL               isDirectory; // directory or symbolic link to directory
+  unsigned long long size;
+  time_t             mtime;
+  time_t             ctime;
+  uid_t              uid;
+} NXTDirectoryEntry;
+
+// Contents of directory, filtered and sorted like directoryContentsAtPath:...
+@interface NXTDirectoryListing : NSObject
+{
+  NSString          *path;
+  NXTDirectoryEntry *entries;
+  NSUInteger        count;
+}
+- (NSString *)path;
+- (NSUInteger)count;
+- (const NXTDirectoryEntry *)entries;
+- (NSArray *)names;
+@end
+
 @interface NXTFileManager : NSFileManager
 {
 }
@@ -62,6 +88,10 @@ extern NSString *NXTShowHiddenFiles;
                              forPath:(NSString *)targetPath
                             sortedBy:(NXTSortType)sortType
                           showHidden:(BOOL)showHidden;
+- (NXTDirectoryListing *)directoryListingAtPath:(NSString *)path
+                                        forPath:(NSString *)targetPath
+                                       sortedBy:(NXTSortType)sortType
+                                     showHidden:(BOOL)showHidden;
 
 - (NSArray *)executablesForSubstring:(NSString *)substring;
 - (NSArray *)completionForPath:(NSString *)path
@@ -74,5 +104,9 @@ extern NSString *NXTShowHiddenFiles;
 - (NSString *)mimeTypeForFile:(NSString *)fullPath;
 - (NSString *)mimeEncodingForFile:(NSString *)fullPath;
 - (NSString *)descriptionForFile:(NSString *)fullPath;
+// MIME types of files in `dirPath' keyed by file name, found concurrently.
+// Files libmagic fails to read are left out.
+- (NSDictionary *)mimeTypesForFiles:(NSArray *)fileNames
+                        inDirectory:(NSString *)dirPath;
 
 @end
@@ -23,12 +23,25 @@
 //
 
 #include <magic.h> // libmagic
+#include <dirent.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <pwd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <dispatch/dispatch.h>
+#include <unicode/ucol.h>
 
 #import <Foundation/NSDictionary.h>
 #import <Foundation/NSUserDefaults.h>
 #import <Foundation/NSFileManager.h>
 #import <Foundation/NSArray.h>
+#import <Foundation/NSAutoreleasePool.h>
 #import <Foundation/NSDebug.h>
+#import <Foundation/NSLocale.h>
+#import <Foundation/NSMapTable.h>
 
 #import "NXTDefaults.h"
 #import "NXTFileManager.h"
@@ -37,7 +50,6 @@ NSString *NXTSortFilesBy = @"SortFilesBy";
 NSString *NXTShowHiddenFiles = @"ShowHiddenFiles";
 
 static NXTFileManager *sharedManager;
-static NSString      *dirPath;
 
 NSString *NXTIntersectionPath(NSString *aPath, NSString *bPath)
 {
@@ -68,67 +80,258 @@ NSString *NXTIntersectionPath(NSString *aPath, NSString *bPath)
   return subPath;
 }
 
-@implementation NSString (Sorting)
+//-----------------------------------------------------------------------------
+// Directory listing
+//-----------------------------------------------------------------------------
+
+// Sort keys are computed once for every entry, before sorting. Strings
+// are compared by ICU collation keys of the current locale, the order of
+// -localizedCompare:, which opens a collator on every call.
+typedef struct {
+  NXTDirectoryEntry *entry;
+  NSString          *key;      // extension or owner name
+  char              *keyKey;   // collation keys, NULL if there's no collator
+  char              *nameKey;
+  NXTSortType       sortType;
+  BOOL              foldersFirst;
+} NXTSortRecord;
+
+// Returned key is NUL-terminated and compared with strcmp()
+static char *CollationKey(UCollator *collator, NSString *string)
+{
+  NSUInteger length = [string length];
+  UChar *chars = malloc((length + 1) * sizeof(UChar));
+  char *key = NULL;
+  int32_t size;
+
+  if (chars == NULL) {
+    return NULL;
+  }
+  [string getCharacters:chars range:NSMakeRange(0, length)];
+  size = ucol_getSortKey(collator, chars, length, NULL, 0);
+  if (size > 0 && (key = malloc(size)) != NULL) {
+    ucol_getSortKey(collator, chars, length, (uint8_t *)key, size);
+  }
+  free(chars);
+
+  return key;
+}
 
-- (NSComparisonResult)byTypeCompare:(NSString *)string
+static inline NSComparisonResult CompareStrings(NSString *s1, const char *k1, NSString *s2,
+                                                const char *k2)
 {
-  NSString *ext1 = [self pathExtension];
-  NSString *ext2 = [string pathExtension];
-  
-  return [ext1 localizedCompare:ext2];
+  int result;
+
+  if (k1 == NULL || k2 == NULL) {
+    return [s1 localizedCompare:s2];
+  }
+  result = strcmp(k1, k2);
+  return (result < 0) ? NSOrderedAscending : (result > 0) ? NSOrderedDescending : NSOrderedSame;
 }
 
-- (NSComparisonResult)byDateCompare:(NSString *)string
+static int CompareSortRecords(const void *a, const void *b)
 {
-  NSFileManager *fm = [NSFileManager defaultManager];
-  
-  NSString      *path1 = [dirPath stringByAppendingPathComponent:self];
-  NSDate        *date1 = [[fm fileAttributesAtPath:path1 traverseLink:NO]
-                           fileCreationDate];
-  
-  NSString      *path2 = [dirPath stringByAppendingPathComponent:string];
-  NSDate        *date2 = [[fm fileAttributesAtPath:path2 traverseLink:NO]
-                           fileCreationDate];
-  
-  return [date1 compare:date2];
+  const NXTSortRecord *r1 = a, *r2 = b;
+  const NXTDirectoryEntry *e1 = r1->entry, *e2 = r2->entry;
+  NSComparisonResult result = NSOrderedSame;
+
+  if (r1->foldersFirst && e1->isDirectory != e2->isDirectory) {
+    return e1->isDirectory ? -1 : 1;
+  }
+
+  switch (r1->sortType) {
+    case NXTSortByType:
+    case NXTSortByOwner:
+      result = CompareStrings(r1->key, r1->keyKey, r2->key, r2->keyKey);
+      break;
+    case NXTSortByDate: {
+      // -fileCreationDate of GNUstep on Linux: the earlier of ctime and mtime
+      time_t t1 = MIN(e1->ctime, e1->mtime);
+      time_t t2 = MIN(e2->ctime, e2->mtime);
+
+      if (t1 != t2) {
+        result = (t1 < t2) ? NSOrderedAscending : NSOrderedDescending;
+      }
+    } break;
+    case NXTSortBySize:
+      if (e1->size != e2->size) {
+        result = (e1->size < e2->size) ? NSOrderedAscending : NSOrderedDescending;
+      }
+      break;
+    default:
+      break;
+  }
+  if (result == NSOrderedSame) {
+    result = CompareStrings(e1->name, r1->nameKey, e2->name, r2->nameKey);
+  }
+
+  return (int)result;
 }
 
-- (NSComparisonResult)bySizeCompare:(NSString *)string
+static NSString *OwnerName(uid_t uid, NSMapTable *cache)
 {
-  NSFileManager *fm = [NSFileManager defaultManager];
-  
-  NSString           *path1 = [dirPath stringByAppendingPathComponent:self];
-  unsigned long long size1;
-  NSString           *path2 = [dirPath stringByAppendingPathComponent:string];
-  unsigned long long size2;
+  NSString *name = NSMapGet(cache, (void *)(uintptr_t)uid);
+  struct passwd pwd, *result = NULL;
+  char buffer[1024];
+
+  if (name == nil) {
+    if (getpwuid_r(uid, &pwd, buffer, sizeof(buffer), &result) == 0 && result != NULL) {
+      name = [NSString stringWithCString:pwd.pw_name];
+    } else {
+      name = [NSString stringWithFormat:@"%u", (unsigned)uid];
+    }
+    NSMapInsert(cache, (void *)(uintptr_t)uid, name);
+  }
+  return name;
+}
 
-  size1 = [[fm fileAttributesAtPath:path1 traverseLink:NO] fileSize];
-  size2 = [[fm fileAttributesAtPath:path2 traverseLink:NO] fileSize];
+static void SortEntries(NXTDirectoryEntry *entries, NSUInteger count, NXTSortType sortType)
+{
+  NXTSortRecord *records;
+  NXTDirectoryEntry *sorted;
+  NSMapTable *owners = nil;
+  UCollator *collator;
+  UErrorCode status = U_ZERO_ERROR;
+  NSUInteger i;
+
+  if (count < 2) {
+    return;
+  }
+  collator = ucol_open([[[NSLocale currentLocale] localeIdentifier] UTF8String], &status);
+  if (U_FAILURE(status)) {
+    collator = NULL;
+  }
+  if (sortType == NXTSortByOwner) {
+    owners = NSCreateMapTable(NSIntegerMapKeyCallBacks, NSObjectMapValueCallBacks, 0);
+  }
 
-  if (size1 == size2)
-    return NSOrderedSame;
+  records = malloc(count * sizeof(NXTSortRecord));
+  for (i = 0; i < count; i++) {
+    records[i].entry = &entries[i];
+    records[i].sortType = sortType;
+    records[i].foldersFirst = (sortType == NXTSortByKind || sortType == NXTSortByType);
+    if (sortType == NXTSortByType) {
+      records[i].key = [entries[i].name pathExtension];
+    } else if (sortType == NXTSortByOwner) {
+      records[i].key = OwnerName(entries[i].uid, owners);
+    } else {
+      records[i].key = nil;
+    }
+    records[i].keyKey = NULL;
+    records[i].nameKey = NULL;
+    if (collator != NULL) {
+      records[i].nameKey = CollationKey(collator, entries[i].name);
+      if (records[i].key != nil) {
+        records[i].keyKey = CollationKey(collator, records[i].key);
+      }
+    }
+  }
 
-  if (size1 > size2)
-    return NSOrderedDescending;
+  qsort(records, count, sizeof(NXTSortRecord), CompareSortRecords);
 
-  if (size1 < size2)
-    return NSOrderedAscending;
+  sorted = malloc(count * sizeof(NXTDirectoryEntry));
+  for (i = 0; i < count; i++) {
+    sorted[i] = *records[i].entry;
+  }
+  memcpy(entries, sorted, count * sizeof(NXTDirectoryEntry));
 
-  return NSOrderedSame;
+  free(sorted);
+  for (i = 0; i < count; i++) {
+    free(records[i].keyKey);
+    free(records[i].nameKey);
+  }
+  free(records);
+  if (collator != NULL) {
+    ucol_close(collator);
+  }
+  if (owners) {
+    NSFreeMapTable(owners);
+  }
 }
 
-- (NSComparisonResult)byOwnerCompare:(NSString *)string
+// Names listed in `.hidden' file and names started with `.' are removed,
+// except the ones `targetPath' goes through.
+static NSUInteger RemoveHiddenEntries(NXTDirectoryEntry *entries, NSUInteger count,
+                                      NSString *path, NSString *targetPath)
 {
-  NSFileManager *fm = [NSFileManager defaultManager];
-  
-  NSString *path1 = [dirPath stringByAppendingPathComponent:self];
-  NSString *owner1 = [[fm fileAttributesAtPath:path1 traverseLink:NO]
-                       fileOwnerAccountName];
-  NSString *path2 = [dirPath stringByAppendingPathComponent:string];
-  NSString *owner2 = [[fm fileAttributesAtPath:path2 traverseLink:NO]
-                       fileOwnerAccountName];
-  
-  return [owner1 localizedCompare:owner2];
+  NSString *hiddenFilename = [path stringByAppendingPathComponent:@".hidden"];
+  NSSet *hidden = nil;
+  NSUInteger i, n;
+
+  if (access([hiddenFilename fileSystemRepresentation], F_OK) == 0) {
+    NSString *h = [NSString stringWithContentsOfFile:hiddenFilename];
+    NSMutableSet *names = [NSMutableSet set];
+
+    for (NSString *filename in [h componentsSeparatedByString:@"\n"]) {
+      if (![targetPath hasPrefix:[path stringByAppendingPathComponent:filename]]) {
+        [names addObject:filename];
+      }
+    }
+    hidden = names;
+  }
+
+  for (i = 0, n = 0; i < count; i++) {
+    NSString *filename = entries[i].name;
+
+    if ([filename length] <= 0 || [filename hasPrefix:@"."] || [hidden containsObject:filename]) {
+      [filename release];
+      continue;
+    }
+    entries[n++] = entries[i];
+  }
+
+  return n;
+}
+
+@implementation NXTDirectoryListing
+
+- (id)initWithPath:(NSString *)dirPath entries:(NXTDirectoryEntry *)list count:(NSUInteger)n
+{
+  self = [super init];
+
+  path = [dirPath copy];
+  entries = list;
+  count = n;
+
+  return self;
+}
+
+- (void)dealloc
+{
+  NSUInteger i;
+
+  for (i = 0; i < count; i++) {
+    [entries[i].name release];
+  }
+  free(entries);
+  [path release];
+  [super dealloc];
+}
+
+- (NSString *)path
+{
+  return path;
+}
+
+- (NSUInteger)count
+{
+  return count;
+}
+
+- (const NXTDirectoryEntry *)entries
+{
+  return entries;
+}
+
+- (NSArray *)names
+{
+  NSMutableArray *names = [NSMutableArray arrayWithCapacity:count];
+  NSUInteger i;
+
+  for (i = 0; i < count; i++) {
+    [names addObject:entries[i].name];
+  }
+  return names;
 }
 
 @end
@@ -200,44 +403,10 @@ NSString *NXTIntersectionPath(NSString *aPath, NSString *bPath)
                              forPath:(NSString *)targetPath
                           showHidden:(BOOL)showHidden
 {
-  NSFileManager  *fm = [NSFileManager defaultManager];
-  NSMutableArray *dirContents;
-
-  dirContents = [[fm directoryContentsAtPath:path] mutableCopy];
-
-  if (showHidden == NO) {
-    NSString *hiddenFilename;
-    unsigned i, n;
-    NSString *filename;
-    NSString *pathIntersection = NXTIntersectionPath(path, targetPath);
-
-    hiddenFilename = [path stringByAppendingPathComponent:@".hidden"];
-    if ([fm fileExistsAtPath:hiddenFilename])	{
-      NSString     *h = [NSString stringWithContentsOfFile:hiddenFilename];
-      NSArray      *hidden = [h componentsSeparatedByString:@"\n"];
-      NSEnumerator *e = [hidden objectEnumerator];
-
-      while ((filename = [e nextObject]) != nil) {
-        if (![targetPath
-                     hasPrefix:[path stringByAppendingPathComponent:filename]]) {
-          [dirContents removeObject:filename];
-        }
-      }
-    }
-    for (i = 0, n = [dirContents count]; i < n; i++) {
-      NSString *filename = [dirContents objectAtIndex:i];
-
-      if ([filename length] <= 0 || [filename hasPrefix:@"."]) {
-        [dirContents removeObjectAtIndex:i];
-        n--;
-        i--;
-      }
-    }
-  }
-
-  [dirContents sortUsingSelector:@selector(localizedCompare:)];
-
-  return [dirContents autorelease];
+  return [[self directoryListingAtPath:path
+                               forPath:targetPath
+                              sortedBy:NXTSortByName
+                            showHidden:showHidden] names];
 }
 
 - (NSArray *)directoryContentsAtPath:(NSString *)path
@@ -245,83 +414,68 @@ NSString *NXTIntersectionPath(NSString *aPath, NSString *bPath)
                             sortedBy:(NXTSortType)sortType
                           showHidden:(BOOL)showHidden
 {
-  
-  NSFileManager  *fm = [NSFileManager defaultManager];
-  NSMutableArray *dirContents;
-  SEL            compareSelector = 0;
-  BOOL           foldersFirst = NO;
+  return [[self directoryListingAtPath:path
+                               forPath:targetPath
+                              sortedBy:sortType
+                            showHidden:showHidden] names];
+}
 
-  dirPath = path;
-  
-  switch (sortType)
-    {
-    case NXTSortByName:  // = 0
-      compareSelector = @selector(localizedCompare:);
-      break;
-    case NXTSortByKind:  // = 1
-      compareSelector = @selector(localizedCompare:);
-      foldersFirst = YES;
-      break;
-    case NXTSortByType:  // = 2
-      compareSelector = @selector(byTypeCompare:);
-      foldersFirst = YES;
-      break;
-    case NXTSortByDate:  // = 3
-      compareSelector = @selector(byDateCompare:);
-      break;
-    case NXTSortBySize:  // = 4
-      compareSelector = @selector(bySizeCompare:);
-      break;
-    case NXTSortByOwner: // = 5
-      compareSelector = @selector(byOwnerCompare:);
-      break;
-    }
+// Directory is read once: every entry is lstat()ed relative to directory
+// descriptor (symbolic links are stat()ed again to find folders) and
+// sorting uses these attributes.
+- (NXTDirectoryListing *)directoryListingAtPath:(NSString *)path
+                                        forPath:(NSString *)targetPath
+                                       sortedBy:(NXTSortType)sortType
+                                     showHidden:(BOOL)showHidden
+{
+  DIR               *dir;
+  struct dirent     *de;
+  struct stat       st;
+  NXTDirectoryEntry *entries;
+  NSUInteger        count = 0, capacity = 64;
 
-  dirContents = [[self directoryContentsAtPath:path
-                                       forPath:targetPath
-                                    showHidden:showHidden] mutableCopy];
-  if (!dirContents)
+  if ((dir = opendir([path fileSystemRepresentation])) == NULL) {
     return nil;
-  
-  if (foldersFirst) {
-    NSEnumerator   *e = [dirContents objectEnumerator];
-    NSMutableArray *dirs = [[NSMutableArray alloc] init];
-    NSMutableArray *files = [[NSMutableArray alloc] init];
-    NSString       *entry = nil;
-    NSDictionary   *fattrs;
-    BOOL           isDir;
-    NSString       *fp;
-
-    while ((entry = [e nextObject]) != nil) {
-      fp = [path stringByAppendingPathComponent:entry];
-      fattrs = [fm fileAttributesAtPath:fp traverseLink:YES];
-
-      if ([[fattrs fileType] isEqualToString:NSFileTypeDirectory]) {
-        [dirs addObject:entry];
-      }
-      else {
-        [files addObject:entry];
-      }
-    }
+  }
 
-    // Empty dirContents
-    [dirContents removeAllObjects];
+  entries = malloc(capacity * sizeof(NXTDirectoryEntry));
+  while ((de = readdir(dir)) != NULL) {
+    NXTDirectoryEntry *entry;
 
-    // Add sorted directories
-    [dirs sortUsingSelector:compareSelector];
-    [dirContents addObjectsFromArray:dirs];
-    [dirs release];
+    if (de->d_name[0] == '.' &&
+        (de->d_name[1] == '\0' || (de->d_name[1] == '.' && de->d_name[2] == '\0'))) {
+      continue;
+    }
+    if (count == capacity) {
+      capacity *= 2;
+      entries = realloc(entries, capacity * sizeof(NXTDirectoryEntry));
+    }
 
-    // Add sorted files
-    [files sortUsingSelector:compareSelector];
-    [dirContents addObjectsFromArray:files];
-    [files release];
+    entry = &entries[count++];
+    memset(entry, 0, sizeof(NXTDirectoryEntry));
+    entry->name = [[self stringWithFileSystemRepresentation:de->d_name
+                                                     length:strlen(de->d_name)] retain];
+    if (fstatat(dirfd(dir), de->d_name, &st, AT_SYMLINK_NOFOLLOW) == 0) {
+      entry->mode = st.st_mode;
+      entry->size = st.st_size;
+      entry->mtime = st.st_mtime;
+      entry->ctime = st.st_ctime;
+      entry->uid = st.st_uid;
+      entry->isDirectory = S_ISDIR(st.st_mode);
+      if (S_ISLNK(st.st_mode) && fstatat(dirfd(dir), de->d_name, &st, 0) == 0) {
+        entry->isDirectory = S_ISDIR(st.st_mode);
+      }
+    }
   }
-  else {
-    [dirContents sortUsingSelector:compareSelector];
+  closedir(dir);
+
+  if (showHidden == NO) {
+    count = RemoveHiddenEntries(entries, count, path, targetPath);
   }
+  SortEntries(entries, count, sortType);
 
-  return AUTORELEASE(dirContents);
+  return [[[NXTDirectoryListing alloc] initWithPath:path entries:entries count:count]
+      autorelease];
 }
 
 // --- Search path
@@ -446,58 +600,210 @@ NSString *NXTIntersectionPath(NSString *aPath, NSString *bPath)
 
 
 // --- Files (libmagic)
-- (NSString *)mimeTypeForFile:(NSString *)fullPath
+
+// Loading the magic database is expensive and handles can't be shared
+// between threads: every thread keeps its own handles, opened on first use
+// and closed on thread exit.
+typedef enum {
+  NXTMagicType = 0,
+  NXTMagicEncoding,
+  NXTMagicDescription,
+  NXTMagicKinds
+} NXTMagicKind;
+
+static const int magicFlags[NXTMagicKinds] = {MAGIC_MIME_TYPE, MAGIC_MIME_ENCODING, MAGIC_NONE};
+static pthread_key_t magicHandlesKey;
+static pthread_once_t magicHandlesOnce = PTHREAD_ONCE_INIT;
+
+static void CloseMagicHandles(void *data)
 {
-  magic_t    cookie;
-  const char *mime_type;
-  NSString   *mimeType;
-  
-  cookie = magic_open(MAGIC_MIME_TYPE);
-  magic_load(cookie, NULL);
+  magic_t *handles = data;
+  int i;
 
-  mime_type = magic_file(cookie, [fullPath cString]);
-  
-  mimeType = [NSString stringWithCString:mime_type];
+  for (i = 0; i < NXTMagicKinds; i++) {
+    if (handles[i] != NULL) {
+      magic_close(handles[i]);
+    }
+  }
+  free(handles);
+}
 
-  magic_close(cookie);
+static void CreateMagicHandlesKey(void)
+{
+  pthread_key_create(&magicHandlesKey, CloseMagicHandles);
+}
 
-  return mimeType;
+static magic_t MagicHandle(NXTMagicKind kind)
+{
+  magic_t *handles;
+
+  pthread_once(&magicHandlesOnce, CreateMagicHandlesKey);
+  handles = pthread_getspecific(magicHandlesKey);
+  if (handles == NULL) {
+    handles = calloc(NXTMagicKinds, sizeof(magic_t));
+    if (handles == NULL) {
+      return NULL;
+    }
+    pthread_setspecific(magicHandlesKey, handles);
+  }
+  if (handles[kind] == NULL) {
+    handles[kind] = magic_open(magicFlags[kind]);
+    if (handles[kind] != NULL && magic_load(handles[kind], NULL) != 0) {
+      NSLog(@"NXTFileManager: failed to load magic database: %s", magic_error(handles[kind]));
+      magic_close(handles[kind]);
+      handles[kind] = NULL;
+    }
+  }
+
+  return handles[kind];
 }
 
-- (NSString *)mimeEncodingForFile:(NSString *)fullPath
+// Results are cached by file identity and modification, so an edited or
+// replaced file gets a different key. The cache is split into sets of
+// MAGIC_CACHE_WAYS slots; when a set is full, its slots are reused in turn.
+#define MAGIC_CACHE_SIZE 4096
+#define MAGIC_CACHE_WAYS 4
+
+typedef struct {
+  dev_t        dev;
+  ino_t        ino;
+  time_t       mtime;
+  long         mtimeNsec;
+  off_t        size;
+  NXTMagicKind kind;
+  NSString     *result;
+} NXTMagicCacheSlot;
+
+static NXTMagicCacheSlot magicCache[MAGIC_CACHE_SIZE];
+static unsigned int magicCacheVictim;
+static pthread_mutex_t magicCacheLock = PTHREAD_MUTEX_INITIALIZER;
+
+static inline BOOL MagicCacheSlotMatches(NXTMagicCacheSlot *slot, struct stat *st,
+                                         NXTMagicKind kind)
 {
-  magic_t    cookie;
-  const char *mime_enc;
-  NSString   *mimeEncoding;
-  
-  cookie = magic_open(MAGIC_MIME_ENCODING);
-  magic_load(cookie, NULL);
+  return (slot->result != nil && slot->ino == st->st_ino && slot->dev == st->st_dev &&
+          slot->kind == kind && slot->mtime == st->st_mtim.tv_sec &&
+          slot->mtimeNsec == st->st_mtim.tv_nsec && slot->size == st->st_size);
+}
 
-  mime_enc = magic_file(cookie, [fullPath cString]);
-  
-  mimeEncoding = [NSString stringWithCString:mime_enc];
+// Returns the slot holding the result for `st' or, if there's none, the one
+// to store it in. Must be called with magicCacheLock held.
+static NXTMagicCacheSlot *MagicCacheSlot(struct stat *st, NXTMagicKind kind)
+{
+  NXTMagicCacheSlot  *set;
+  unsigned long long h;
+  int                i;
+
+  h = (unsigned long long)st->st_ino * 0x9e3779b97f4a7c15ULL;
+  h ^= ((unsigned long long)st->st_dev + kind) * 0xc2b2ae3d27d4eb4fULL;
+  h ^= h >> 29;
+  set = &magicCache[(h % (MAGIC_CACHE_SIZE / MAGIC_CACHE_WAYS)) * MAGIC_CACHE_WAYS];
+
+  for (i = 0; i < MAGIC_CACHE_WAYS; i++) {
+    if (MagicCacheSlotMatches(&set[i], st, kind)) {
+      return &set[i];
+    }
+  }
+  for (i = 0; i < MAGIC_CACHE_WAYS; i++) {
+    if (set[i].result == nil) {
+      return &set[i];
+    }
+  }
+  return &set[magicCacheVictim++ % MAGIC_CACHE_WAYS];
+}
+
+// libmagic doesn't follow symbolic links, so the link itself is the key.
+static NSString *MagicResult(NSString *fullPath, NXTMagicKind kind)
+{
+  const char        *path = [fullPath fileSystemRepresentation];
+  struct stat       st;
+  NXTMagicCacheSlot *slot;
+  NSString          *result = nil;
+  magic_t           cookie;
+  const char        *magicResult;
+
+  if (lstat(path, &st) != 0) {
+    return nil;
+  }
+
+  pthread_mutex_lock(&magicCacheLock);
+  slot = MagicCacheSlot(&st, kind);
+  if (MagicCacheSlotMatches(slot, &st, kind)) {
+    result = [[slot->result retain] autorelease];
+  }
+  pthread_mutex_unlock(&magicCacheLock);
+  if (result != nil) {
+    return result;
+  }
+
+  if ((cookie = MagicHandle(kind)) == NULL ||
+      (magicResult = magic_file(cookie, path)) == NULL) {
+    return nil;
+  }
+  result = [NSString stringWithCString:magicResult];
+
+  pthread_mutex_lock(&magicCacheLock);
+  slot = MagicCacheSlot(&st, kind);
+  [slot->result release];
+  slot->dev = st.st_dev;
+  slot->ino = st.st_ino;
+  slot->mtime = st.st_mtim.tv_sec;
+  slot->mtimeNsec = st.st_mtim.tv_nsec;
+  slot->size = st.st_size;
+  slot->kind = kind;
+  slot->result = [result retain];
+  pthread_mutex_unlock(&magicCacheLock);
+
+  return result;
+}
 
-  magic_close(cookie);
+- (NSString *)mimeTypeForFile:(NSString *)fullPath
+{
+  return MagicResult(fullPath, NXTMagicType);
+}
 
-  return mimeEncoding;
+- (NSString *)mimeEncodingForFile:(NSString *)fullPath
+{
+  return MagicResult(fullPath, NXTMagicEncoding);
 }
 
 - (NSString *)descriptionForFile:(NSString *)fullPath
 {
-  magic_t    cookie;
-  const char *description;
-  NSString   *fileDescription;
-  
-  cookie = magic_open(MAGIC_NONE);
-  magic_load(cookie, NULL);
+  return MagicResult(fullPath, NXTMagicDescription);
+}
 
-  description = magic_file(cookie, [fullPath cString]);
-  
-  fileDescription = [NSString stringWithCString:description];
-  
-  magic_close(cookie);
+- (NSDictionary *)mimeTypesForFiles:(NSArray *)fileNames
+                        inDirectory:(NSString *)dirPath
+{
+  NSUInteger          count = [fileNames count];
+  NSString            **types;
+  NSMutableDictionary *mimeTypes;
+  NSUInteger          i;
+
+  types = calloc(count ? count : 1, sizeof(NSString *));
+  if (types == NULL) {
+    return nil;
+  }
+
+  dispatch_apply(count, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_LOW, 0), ^(size_t n) {
+      NSAutoreleasePool *pool = [NSAutoreleasePool new];
+      NSString          *path;
+
+      path = [dirPath stringByAppendingPathComponent:[fileNames objectAtIndex:n]];
+      types[n] = [MagicResult(path, NXTMagicType) retain];
+      [pool release];
+    });
+
+  mimeTypes = [NSMutableDictionary dictionaryWithCapacity:count];
+  for (i = 0; i < count; i++) {
+    if (types[i] != nil) {
+      [mimeTypes setObject:types[i] forKey:[fileNames objectAtIndex:i]];
+      [types[i] release];
+    }
+  }
+  free(types);
 
-  return fileDescription;
+  return mimeTypes;
 }
 
 @end
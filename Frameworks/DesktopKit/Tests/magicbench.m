@@ -0,0 +1,181 @@
+/*
+  Classifies files of a directory with libmagic and reports files per
+  second: the way NXTFileManager did it before (magic database loaded for
+  every file), -mimeTypeForFile: with and without cached results and
+  -mimeTypesForFiles:inDirectory:. Without a directory argument a
+  temporary one with mixed contents is made.
+
+  Usage: magicbench [-files n] [directory]
+*/
+
+#include <magic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#import <Foundation/Foundation.h>
+#import <DesktopKit/NXTFileManager.h>
+
+static double now(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void write_file(NSString *path, const void *bytes, size_t length, mode_t mode)
+{
+  FILE *f = fopen([path fileSystemRepresentation], "w");
+
+  if (f == NULL) {
+    perror([path fileSystemRepresentation]);
+    exit(1);
+  }
+  fwrite(bytes, 1, length, f);
+  fclose(f);
+  chmod([path fileSystemRepresentation], mode);
+}
+
+/* text, scripts, XML, random data, copies of an executable, empty files */
+static NSString *make_directory(int count)
+{
+  NSString *dir = [NSTemporaryDirectory() stringByAppendingPathComponent:
+                     [NSString stringWithFormat:@"magicbench-%d", getpid()]];
+  NSData *binary = [NSData dataWithContentsOfFile:@"/bin/sh"];
+  char buf[4096];
+  int i, j;
+
+  [[NSFileManager defaultManager] createDirectoryAtPath:dir
+                            withIntermediateDirectories:YES
+                                             attributes:nil
+                                                  error:NULL];
+  for (i = 0; i < count; i++) {
+    NSString *path = [dir stringByAppendingPathComponent:[NSString stringWithFormat:@"file%d", i]];
+
+    switch (i % 6) {
+      case 0:
+        for (j = 0; j < (int)sizeof(buf); j++) {
+          buf[j] = (j % 64 == 63) ? '\n' : 'a' + (i + j) % 26;
+        }
+        write_file(path, buf, sizeof(buf), 0644);
+        break;
+      case 1:
+        snprintf(buf, sizeof(buf), "#!/bin/sh\necho %d\nexit 0\n", i);
+        write_file(path, buf, strlen(buf), 0755);
+        break;
+      case 2:
+        snprintf(buf, sizeof(buf), "<?xml version=\"1.0\"?>\n<item n=\"%d\"/>\n", i);
+        write_file(path, buf, strlen(buf), 0644);
+        break;
+      case 3:
+        for (j = 0; j < (int)sizeof(buf); j++) {
+          buf[j] = rand();
+        }
+        write_file(path, buf, sizeof(buf), 0644);
+        break;
+      case 4:
+        if (binary != nil) {
+          write_file(path, [binary bytes], [binary length], 0755);
+          break;
+        }
+      default:
+        write_file(path, "", 0, 0644);
+        break;
+    }
+  }
+
+  return dir;
+}
+
+static void remove_directory(NSString *dir)
+{
+  [[NSFileManager defaultManager] removeItemAtPath:dir error:NULL];
+}
+
+/* new modification time makes cached results stale */
+static void touch_files(NSString *dir, NSArray *names)
+{
+  for (NSString *name in names) {
+    utimes([[dir stringByAppendingPathComponent:name] fileSystemRepresentation], NULL);
+  }
+}
+
+static void report(const char *what, NSUInteger count, double seconds)
+{
+  printf("%-36s %8.0f files/s\n", what, count / seconds);
+}
+
+int main(int argc, char **argv)
+{
+  NSAutoreleasePool *pool = [NSAutoreleasePool new];
+  NXTFileManager *fm = [NXTFileManager defaultManager];
+  NSString *dir = nil;
+  NSArray *names;
+  NSUInteger count, i, limit;
+  BOOL made = NO;
+  int files = 600;
+  double t;
+
+  for (i = 1; i < (NSUInteger)argc; i++) {
+    if (strcmp(argv[i], "-files") == 0 && i + 1 < (NSUInteger)argc) {
+      files = atoi(argv[++i]);
+    } else {
+      dir = [NSString stringWithUTF8String:argv[i]];
+    }
+  }
+  if (dir == nil) {
+    dir = make_directory(files);
+    made = YES;
+  }
+  names = [[NSFileManager defaultManager] contentsOfDirectoryAtPath:dir error:NULL];
+  count = [names count];
+  if (count == 0) {
+    fprintf(stderr, "magicbench: no files in %s\n", [dir fileSystemRepresentation]);
+    return 1;
+  }
+  printf("%lu files in %s\n", (unsigned long)count, [dir fileSystemRepresentation]);
+
+  /* loading the database dominates, a sample is enough */
+  limit = (count < 100) ? count : 100;
+  t = now();
+  for (i = 0; i < limit; i++) {
+    NSString *path = [dir stringByAppendingPathComponent:[names objectAtIndex:i]];
+    magic_t cookie = magic_open(MAGIC_MIME_TYPE);
+
+    magic_load(cookie, NULL);
+    magic_file(cookie, [path fileSystemRepresentation]);
+    magic_close(cookie);
+  }
+  report("magic_load for every file", limit, now() - t);
+
+  t = now();
+  for (NSString *name in names) {
+    CREATE_AUTORELEASE_POOL(arp);
+    [fm mimeTypeForFile:[dir stringByAppendingPathComponent:name]];
+    RELEASE(arp);
+  }
+  report("mimeTypeForFile:", count, now() - t);
+
+  t = now();
+  for (NSString *name in names) {
+    CREATE_AUTORELEASE_POOL(arp);
+    [fm mimeTypeForFile:[dir stringByAppendingPathComponent:name]];
+    RELEASE(arp);
+  }
+  report("mimeTypeForFile: (cached)", count, now() - t);
+
+  touch_files(dir, names);
+  t = now();
+  [fm mimeTypesForFiles:names inDirectory:dir];
+  report("mimeTypesForFiles:inDirectory:", count, now() - t);
+
+  if (made) {
+    remove_directory(dir);
+  }
+  [pool release];
+  return 0;
+}
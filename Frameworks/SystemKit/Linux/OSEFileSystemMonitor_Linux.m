@@ -33,47 +33,82 @@
 
 #include <sys/inotify.h>
 #include <unistd.h>
-#include <poll.h>
-#include <sys/ioctl.h>
+#include <errno.h>
+
+// Room for 4096 events with names up to 16 bytes, longer names fit less
+#define EVENT_BUFFER_SIZE (4096 * (sizeof(struct inotify_event) + 16))
+// Default for OSEFileSystemMonitorCoalescingInterval
+#define COALESCING_INTERVAL 0.1
 
 int in_fd = -1;
 
 NSMutableDictionary *_pathFDList = nil;
+NSMapTable          *_descriptorPathList = nil; // watch descriptor -> path
 NSLock              *monitorLock = nil;
 
+// Read events, sent to the owner when coalescing interval ends
+static char           *eventBuffer = NULL;
+static NSMapTable     *eventList = nil;     // watch descriptor -> event info
+static NSTimer        *coalescingTimer = nil;
+static NSTimeInterval coalescingInterval = COALESCING_INTERVAL;
+static BOOL           isWatching = NO;
+
+// Statistics
+static unsigned long long eventsRead = 0;
+static unsigned long long eventsSent = 0;
+static unsigned long      overflowCount = 0;
+// EventsPerSecond is the rate since the previous -statistics call
+static NSTimeInterval     statisticsTime = 0;
+static unsigned long long statisticsEventsRead = 0;
+
 @implementation OSEFileSystemMonitorThread (Linux)
 
 // So all kqueue related ivars must be shared:
 //   in_fd - initify descriptor
 //   _pathFDList - list of file descriptors to monitor. It's a dictionary 
 //                 which conatins pairs of "path = file descriptor'
+//   _descriptorPathList - the same in reverse, to find path of event
 - (id)initWithConnection:(NSConnection *)conn
 {
+  id interval;
+
   self = [super init];
 
   // Initialize OS-specific part
   _pathFDList = [[NSMutableDictionary alloc] init];
+  _descriptorPathList = NSCreateMapTable(NSIntegerMapKeyCallBacks,
+                                         NSObjectMapValueCallBacks, 0);
+  eventList = NSCreateMapTable(NSIntegerMapKeyCallBacks,
+                               NSObjectMapValueCallBacks, 0);
+  eventBuffer = malloc(EVENT_BUFFER_SIZE);
 
   // inotify
   if (in_fd < 0)
     {
       // Creates a new kernel event queue and returns a descriptor.
-      if ((in_fd = inotify_init()) < 0)
+      // Events are read until there's no more, so it's nonblocking.
+      if ((in_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC)) < 0)
 	{
 	  NSLog(@"OSEFileSystemMonitorThread(Linux): Could not open inotify(7)"
                 " descriptor. Error: %s.\n", strerror(errno));
 	}
     }
 
+  interval = [[NSUserDefaults standardUserDefaults]
+               objectForKey:@"OSEFileSystemMonitorCoalescingInterval"];
+  if (interval != nil)
+    {
+      coalescingInterval = [interval doubleValue];
+    }
+
   monitorOwner = (OSEFileSystemMonitor *)[conn rootProxy];
 
   threadDict = [[NSThread currentThread] threadDictionary];
   [threadDict setValue:[NSNumber numberWithBool:NO] 
 		forKey:@"ThreadShouldExitNow"];
-  [threadDict setValue:[NSNumber numberWithBool:NO] 
-		forKey:@"ThreadShouldCheckForEvents"];
 
   monitorLock = [[NSLock alloc] init];
+  statisticsTime = [NSDate timeIntervalSinceReferenceDate];
 
   return self;
 }
@@ -96,17 +131,7 @@ NSLock              *monitorLock = nil;
 // }
 - (NSString *)_pathForDescriptor:(int)wd
 {
-  NSNumber *aDescriptor = [NSNumber numberWithInt:wd];
-  NSArray  *pathList = [_pathFDList allKeys];
-
-  for (NSString *path in pathList)
-    {
-      NSDictionary *element = [_pathFDList objectForKey:path];
-      if ([[element objectForKey:@"Descriptor"] isEqualToValue:aDescriptor])
-        return path;
-    }
-
-  return nil;
+  return NSMapGet(_descriptorPathList, (void *)(intptr_t)wd);
 }
 
 - (void)_addPath:(NSString *)absolutePath
@@ -142,6 +167,10 @@ NSLock              *monitorLock = nil;
       //IN_CREATE|IN_DELETE|IN_DELETE_SELF|IN_MODIFY|IN_MOVED_FROM|IN_MOVED_TO|IN_ATTRIB);
       path_fd = inotify_add_watch(in_fd, [pathString cString],
                                   IN_CREATE|IN_DELETE|IN_DELETE_SELF|IN_MOVED_FROM|IN_MOVED_TO|IN_ATTRIB);
+      if (path_fd >= 0)
+        {
+          NSMapInsert(_descriptorPathList, (void *)(intptr_t)path_fd, pathString);
+        }
     }
   else
     {
@@ -194,9 +223,14 @@ NSLock              *monitorLock = nil;
   link_count = [[pathDict objectForKey:@"LinkCount"] intValue];
   if (link_count == 1)
     {
-      // Last link: remove path from dictionary and watch list
-      inotify_rm_watch(in_fd, path_fd);
+      // Last link: send what is read for the path, then remove it from
+      // dictionary and watch list
       [self checkForEvents];
+      inotify_rm_watch(in_fd, path_fd);
+      if ([[self _pathForDescriptor:path_fd] isEqualToString:absolutePath])
+        {
+          NSMapRemove(_descriptorPathList, (void *)(intptr_t)path_fd);
+        }
       [_pathFDList removeObjectForKey:absolutePath];
     }
   else
@@ -210,6 +244,8 @@ NSLock              *monitorLock = nil;
     }
 }
 
+// Thread sleeps in its run loop until inotify descriptor becomes readable
+// (see receivedEvent:type:extra:forMode:).
 - (oneway void)_startThread
 {
   NSDebugLLog(@"OSEFileSystemMonitor",
@@ -225,8 +261,20 @@ NSLock              *monitorLock = nil;
     }
   
   // Start checking for events
-  [threadDict setValue:[NSNumber numberWithBool:YES] 
-		forKey:@"ThreadShouldCheckForEvents"];
+  if (in_fd >= 0 && isWatching == NO)
+    {
+      [[NSRunLoop currentRunLoop] addEvent:(void *)(intptr_t)in_fd
+                                      type:ET_RDESC
+                                   watcher:self
+                                   forMode:NSDefaultRunLoopMode];
+      isWatching = YES;
+    }
+
+  // Deliver events that were held while the thread was stopped
+  if (NSCountMapTable(eventList) > 0)
+    {
+      [self _sendEvents:nil];
+    }
 }
 
 - (oneway void)_stopThread
@@ -235,9 +283,18 @@ NSLock              *monitorLock = nil;
               @"OSEFileSystemMonitorThread(Linux): stopEventMonitorThread: "
               "inotify descriptor %i", in_fd);
 
-  // Stop checking for events
-  [threadDict setValue:[NSNumber numberWithBool:NO] 
-		forKey:@"ThreadShouldCheckForEvents"];
+  // Stop checking for events. Events already read are held until the
+  // thread is started again.
+  [coalescingTimer invalidate];
+  DESTROY(coalescingTimer);
+  if (isWatching)
+    {
+      [[NSRunLoop currentRunLoop] removeEvent:(void *)(intptr_t)in_fd
+                                         type:ET_RDESC
+                                      forMode:NSDefaultRunLoopMode
+                                          all:YES];
+      isWatching = NO;
+    }
 }
 
 - (oneway void)_terminateThread
@@ -258,6 +315,15 @@ NSLock              *monitorLock = nil;
   close(in_fd);
   in_fd = -1;
 
+  [coalescingTimer invalidate];
+  DESTROY(coalescingTimer);
+  NSFreeMapTable(eventList);
+  eventList = NULL;
+  NSFreeMapTable(_descriptorPathList);
+  _descriptorPathList = NULL;
+  free(eventBuffer);
+  eventBuffer = NULL;
+
   [_pathFDList release];
  
   // Instruct thread to exit
@@ -265,167 +331,220 @@ NSLock              *monitorLock = nil;
 		forKey:@"ThreadShouldExitNow"];
 }
 
-// #define EVENT_SIZE  ( sizeof (struct inotify_event) )
-// #define BUF_LEN     ( 1024 * ( EVENT_SIZE + 16 ) )
-
-- (void)checkForEvents
+- (oneway void)_setCoalescingInterval:(NSTimeInterval)seconds
 {
-  int           ret, i;
-  struct pollfd pfd = { in_fd, POLLIN, 0 };
-
-  // NSLog(@"OSEFileSystemMonitorThread [checkForFSEvents]: checking for events...");
+  coalescingInterval = seconds;
+}
 
-  // Sanity check
-  if (!_pathFDList || [[_pathFDList allKeys] count] <= 0)
-    return;
+- (bycopy NSDictionary *)statistics
+{
+  NSTimeInterval now = [NSDate timeIntervalSinceReferenceDate];
+  double         eventsPerSecond = 0;
 
-  // Determine if inotify(7) file descriptor has events to read
-  ret = poll(&pfd, 1, 10); // timeout of 50ms
-  if (ret < 0)
+  if (now > statisticsTime)
     {
-      fprintf(stderr, "poll failed: %s\n", strerror(errno));
+      eventsPerSecond = (eventsRead - statisticsEventsRead) / (now - statisticsTime);
     }
-  else if (ret > 0)
+  statisticsTime = now;
+  statisticsEventsRead = eventsRead;
+
+  return @{
+    @"EventsRead" : @(eventsRead),
+    @"EventsSent" : @(eventsSent),
+    @"EventsPerSecond" : @(eventsPerSecond),
+    @"QueueOverflows" : @(overflowCount),
+    @"WatchedPaths" : @([_pathFDList count])
+  };
+}
+
+// RunLoopEvents protocol method
+- (void)receivedEvent:(void *)data
+                 type:(RunLoopEventType)type
+                extra:(void *)extra
+              forMode:(NSString *)mode
+{
+  [self _readEvents];
+
+  if (NSCountMapTable(eventList) > 0)
     {
-      int          event_count, i;
-      unsigned int data_size;
-      // Find size of available data
-      ioctl(in_fd, FIONREAD, &data_size);
-      // Define buffer based on found size of available data
-      char buffer[data_size];
-
-      event_count = read(in_fd, buffer, data_size);
-      
-      if (event_count < 0)
+      if (coalescingInterval <= 0)
+        {
+          [self _sendEvents:nil];
+        }
+      else if (coalescingTimer == nil)
         {
-          // An error occurred.
-          fprintf(stderr, "An error occurred (event count %d).  " \
-                  "The error was %i: %s.\n", 
-                  event_count, errno, strerror(errno));
-          return;
+          // Interval starts with the first event, so a steady stream of
+          // events is sent every interval
+          coalescingTimer = [NSTimer
+                              scheduledTimerWithTimeInterval:coalescingInterval
+                                                      target:self
+                                                    selector:@selector(_sendEvents:)
+                                                    userInfo:nil
+                                                     repeats:NO];
+          [coalescingTimer retain];
         }
+    }
+}
+
+// Reads everything available and merges it into eventList. One event info
+// is kept for the directory:
+// {
+//   Operations = (Rename);
+//   ChangedPath = "/Users/me";
+//   ChangedFile = "111.txt";
+//   ChangedFileTo = "222.txt"; // only for rename
+// };
+- (void)_readEvents
+{
+  NSAutoreleasePool *pool = [NSAutoreleasePool new];
+  ssize_t           length;
 
-      // eventList
-      // 3 =
-      // {
-      //   Operations = (Rename);
-      //   ChangedPath = "/Users/me";
-      //   ChangedFile = "111.txt";
-      //   ChangedPathTo = "222.txt"; // only for rename
-      // };
-      NSMutableDictionary *eventList = [[NSMutableDictionary alloc] init];
-      NSMutableDictionary *eventInfo = nil;
-      i = 0;
-      while (i < event_count)
+  while ((length = read(in_fd, eventBuffer, EVENT_BUFFER_SIZE)) > 0)
+    {
+      ssize_t i = 0;
+
+      while (i < length)
         {
-          struct inotify_event *event = (struct inotify_event *)&buffer[i];
-          NSString *path = [self _pathForDescriptor:event->wd];
-          NSString *file = [NSString stringWithCString:event->name];
-          NSString *watchDescriptor = [NSString stringWithFormat:@"%i", event->wd];
-          NSArray  *operations = nil, *exOps = nil;
+          struct inotify_event *event = (struct inotify_event *)&eventBuffer[i];
+          NSString            *path;
+          NSString            *file;
+          NSMutableDictionary *eventInfo;
+          NSArray             *operations = nil, *exOps = nil;
+
+          i += sizeof(struct inotify_event) + event->len;
+          eventsRead++;
 
-          if ((eventInfo = [eventList objectForKey:watchDescriptor]) != nil)
+          if (event->mask & IN_Q_OVERFLOW)
+            {
+              // Kernel queue was full, events since then are lost
+              if (overflowCount++ == 0)
+                {
+                  NSLog(@"OSEFileSystemMonitorThread(Linux): inotify(7) "
+                        "queue overflow, events were lost.");
+                }
+              continue;
+            }
+
+          path = [self _pathForDescriptor:event->wd];
+          if (event->len == 0 || path == nil)
+            {
+              continue;
+            }
+          file = [NSString stringWithCString:event->name];
+
+          eventInfo = NSMapGet(eventList, (void *)(intptr_t)event->wd);
+          if (eventInfo != nil)
             {
               exOps = [eventInfo objectForKey:@"Operations"];
             }
           else
             {
-              eventInfo = [NSMutableDictionary new];
+              eventInfo = [NSMutableDictionary dictionary];
             }
           
-          if (event->len)
+          if (event->mask & IN_CREATE)
             {
-              if (event->mask & IN_CREATE)
-                {
-                  operations = [NSArray arrayWithObjects:@"Write", @"Create", nil];
-                  [eventInfo setObject:path forKey:@"ChangedPath"];
-                  [eventInfo setObject:file forKey:@"ChangedFile"];
-
-                  // fprintf(stderr, ">>> The %s was created.\n", event->name);
-                }
-              else if ((event->mask & IN_DELETE) || (event->mask & IN_DELETE_SELF))
-                {
-                  operations = [NSArray arrayWithObjects:@"Write", @"Delete", nil];
-                  [eventInfo setObject:path forKey:@"ChangedPath"];
-                  [eventInfo setObject:file forKey:@"ChangedFile"];
-
-                  // fprintf(stderr, ">>> The %s was deleted.\n", event->name);
-                }
-              else if (event->mask & IN_MODIFY)
-                {
-                  // During file downloading generates event every 10-20ms.
-                  // Currently it's switched off in _addPath:.
-                  operations = [NSArray arrayWithObjects:@"Write", nil];
-                  [eventInfo setObject:path forKey:@"ChangedPath"];
-                  [eventInfo setObject:file forKey:@"ChangedFile"];
-
-                  // fprintf(stderr, ">>> The %s was modified.\n", event->name);
-                }
-              else if (event->mask & IN_ATTRIB)
+              operations = [NSArray arrayWithObjects:@"Write", @"Create", nil];
+              [eventInfo setObject:path forKey:@"ChangedPath"];
+              [eventInfo setObject:file forKey:@"ChangedFile"];
+            }
+          else if ((event->mask & IN_DELETE) || (event->mask & IN_DELETE_SELF))
+            {
+              operations = [NSArray arrayWithObjects:@"Write", @"Delete", nil];
+              [eventInfo setObject:path forKey:@"ChangedPath"];
+              [eventInfo setObject:file forKey:@"ChangedFile"];
+            }
+          else if (event->mask & IN_MODIFY)
+            {
+              // During file downloading generates event every 10-20ms.
+              // Currently it's switched off in _addPath:.
+              operations = [NSArray arrayWithObjects:@"Write", nil];
+              [eventInfo setObject:path forKey:@"ChangedPath"];
+              [eventInfo setObject:file forKey:@"ChangedFile"];
+            }
+          else if (event->mask & IN_ATTRIB)
+            {
+              operations = [NSArray arrayWithObjects:@"Attributes", nil];
+              [eventInfo setObject:path forKey:@"ChangedPath"];
+              [eventInfo setObject:file forKey:@"ChangedFile"];
+            }
+          else if (event->mask & IN_MOVED_FROM)
+            {
+              operations = [NSArray arrayWithObjects:@"Write", @"MovedFrom", nil];
+              [eventInfo setObject:path forKey:@"ChangedPath"];
+              [eventInfo setObject:file forKey:@"ChangedFile"];
+            }
+          else if (event->mask & IN_MOVED_TO)
+            {
+              if (exOps &&
+                  ([exOps indexOfObject:@"MovedFrom"] != NSNotFound))
                 {
-                  operations = [NSArray arrayWithObjects:@"Attributes", nil];
-                  [eventInfo setObject:path forKey:@"ChangedPath"];
-                  [eventInfo setObject:file forKey:@"ChangedFile"];
-
-                  // fprintf(stderr, ">>> The %s attributes was modified.\n", event->name);
+                  operations = [NSArray arrayWithObjects:@"Rename", nil];
+                  // ChangedPath & ChangedFile was added in IN_MOVED_FROM part
+                  [eventInfo setObject:file forKey:@"ChangedFileTo"];
                 }
-              else if (event->mask & IN_MOVED_FROM)
+              else
                 {
-                  operations = [NSArray arrayWithObjects:@"Write", @"MovedFrom", nil];
+                  operations = [NSArray arrayWithObjects:@"Write", @"Create", nil];
                   [eventInfo setObject:path forKey:@"ChangedPath"];
                   [eventInfo setObject:file forKey:@"ChangedFile"];
-                  
-                  // fprintf(stderr, ">>> The %s was moved from.\n", event->name);
                 }
-              else if (event->mask & IN_MOVED_TO)
-                {
-                  NSString *fileTo = nil;
-
-                  if (exOps &&
-                      ([exOps indexOfObject:@"MovedFrom"] != NSNotFound))
-                    {
-                      fileTo = [NSString stringWithCString:event->name];
-                      
-                      operations = [NSArray arrayWithObjects:@"Rename", nil];
-                      // ChangedPath & ChangedFile was added in IN_MOVED_FROM part
-                      [eventInfo setObject:fileTo forKey:@"ChangedFileTo"];
-                      
-                      // fprintf(stderr, ">>> The %s was renamed to %s.\n",
-                      //         [file cString], event->name);
-                    }
-                  else
-                    {
-                      operations = [NSArray arrayWithObjects:@"Write", @"Create", nil];
-                      [eventInfo setObject:path forKey:@"ChangedPath"];
-                      [eventInfo setObject:file forKey:@"ChangedFile"];
-
-                      // fprintf(stderr, ">>> The %s was moved to.\n", event->name);
-                    }
-                }
-              
-              if (exOps)
-                {
-                  operations = [exOps arrayByAddingObjectsFromArray:operations];
-                }
-              [eventInfo setObject:operations forKey:@"Operations"];
-              [eventList setObject:eventInfo forKey:watchDescriptor];
             }
-
-          i += sizeof(struct inotify_event) + event->len;
-        }
-
-      // Now we have an eventList dictionary which contains information about
-      // all read file system events
-      if (eventList && [[eventList allKeys] count] > 0)
-        {
-          NSDebugLLog(@"OSEFileSystemMonitor",
-                      @"[NXFSM_Linux] send eventList: %@", eventList);
-          for (NSString *wd in [eventList allKeys])
+          else
+            {
+              continue;
+            }
+              
+          if (exOps)
             {
-              [monitorOwner handleEvent:[eventList objectForKey:wd]];
+              operations = [exOps arrayByAddingObjectsFromArray:operations];
             }
+          [eventInfo setObject:operations forKey:@"Operations"];
+          NSMapInsert(eventList, (void *)(intptr_t)event->wd, eventInfo);
         }
     }
+
+  if (length < 0 && errno != EAGAIN && errno != EINTR)
+    {
+      NSLog(@"OSEFileSystemMonitorThread(Linux): reading of inotify(7) "
+            "events failed: %s.", strerror(errno));
+    }
+
+  [pool release];
+}
+
+- (void)_sendEvents:(NSTimer *)timer
+{
+  NSArray *events;
+
+  [coalescingTimer invalidate];
+  DESTROY(coalescingTimer);
+
+  if (NSCountMapTable(eventList) == 0)
+    {
+      return;
+    }
+
+  events = NSAllMapTableValues(eventList);
+  NSResetMapTable(eventList);
+
+  NSDebugLLog(@"OSEFileSystemMonitor",
+              @"[NXFSM_Linux] send eventList: %@", events);
+  for (NSDictionary *event in events)
+    {
+      [monitorOwner handleEvent:event];
+      eventsSent++;
+    }
+}
+
+// Sends events without waiting for the end of coalescing interval
+- (void)checkForEvents
+{
+  if (in_fd < 0)
+    return;
+
+  [self _readEvents];
+  [self _sendEvents:nil];
 }
 
 @end
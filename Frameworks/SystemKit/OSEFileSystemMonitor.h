@@ -78,6 +78,16 @@ extern NSString *OSEFileSystemChangedAtPath;
 - (void)terminate;
 - (void)handleEvent:(NSDictionary *)event;
 
+// --- Events delivery
+// Events of a directory that occur within `seconds' after the first one
+// are sent as one notification. 0 sends them as soon as they are read.
+// Default is taken from OSEFileSystemMonitorCoalescingInterval user
+// default or is 0.1 second.
+- (void)setCoalescingInterval:(NSTimeInterval)seconds;
+// EventsRead, EventsSent, EventsPerSecond, QueueOverflows, WatchedPaths.
+// EventsPerSecond is counted since the previous call.
+- (NSDictionary *)statistics;
+
 @end
 
 @interface OSEFileSystemMonitorThread : NSObject
@@ -97,6 +107,8 @@ extern NSString *OSEFileSystemChangedAtPath;
 - (oneway void)_startThread;
 - (oneway void)_stopThread;
 - (oneway void)_terminateThread;
+- (oneway void)_setCoalescingInterval:(NSTimeInterval)seconds;
+- (bycopy NSDictionary *)statistics;
 
 - (void)checkForEvents;
 
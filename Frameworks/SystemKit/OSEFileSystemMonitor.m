@@ -240,6 +240,16 @@ NSString *OSEFileSystemChangedAtPath = @"OSEFileSystemChangedAtPath";
   [monitorThread release];
 }
 
+- (void)setCoalescingInterval:(NSTimeInterval)seconds
+{
+  [monitorThread _setCoalescingInterval:seconds];
+}
+
+- (NSDictionary *)statistics
+{
+  return [monitorThread statistics];
+}
+
 // It's called from NFileSystemMonitor thread and should be fast.
 // Otherwise NSRunLoop blocked until all events will be handled.
 - (void)handleEvent:(NSDictionary *)event
@@ -288,15 +298,11 @@ NSString *OSEFileSystemChangedAtPath = @"OSEFileSystemChangedAtPath";
   threadDict = [[NSThread currentThread] threadDictionary];
   while (!exitNow)
     {
-      // Process AppKit and Foundation events
+      // Process AppKit and Foundation events. OS-specific part adds its
+      // kernel event descriptor to the run loop in _startThread, so thread
+      // sleeps until there's an event or a message from the owner.
       [runLoop runMode:NSDefaultRunLoopMode 
-            beforeDate:[NSDate dateWithTimeIntervalSinceNow:0.5]];
-
-      // Process kernel events
-      if ([[threadDict valueForKey:@"ThreadShouldCheckForEvents"] boolValue])
-	{
-          [threadObject checkForEvents];
-	}
+            beforeDate:[NSDate distantFuture]];
 
       // Check to see if an input source handler changed the exitNow value.
       exitNow = [[threadDict valueForKey:@"ThreadShouldExitNow"] boolValue];
@@ -368,7 +374,18 @@ NSString *OSEFileSystemChangedAtPath = @"OSEFileSystemChangedAtPath";
               "No OS-specific code found!");
 }
 
-// Overriden method must call handleEvents:atPath: if events available
+- (oneway void)_setCoalescingInterval:(NSTimeInterval)seconds
+{
+  // OS specific part
+}
+
+- (bycopy NSDictionary *)statistics
+{
+  // OS specific part
+  return nil;
+}
+
+// Overriden method must call handleEvent: for events available
 - (void)checkForEvents
 {
   // OS specific part
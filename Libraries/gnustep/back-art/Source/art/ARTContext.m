@@ -47,6 +47,7 @@
 
   gamma = [[NSUserDefaults standardUserDefaults] floatForKey:@"back-art-text-gamma"];
   artcontext_setup_gamma(gamma);
+  artcontext_setup_simd(![[NSUserDefaults standardUserDefaults] boolForKey:@"back-art-no-simd"]);
 }
 
 + (Class)GStateClass
@@ -101,6 +101,8 @@
 
 #define CACHE_SIZE 257
 
+typedef struct ft_glyph_atlas_s ft_glyph_atlas_t;
+
 @interface FTFontInfo : GSFontInfo <FTFontInfo>
 {
 @public
@@ -124,6 +126,9 @@
   unsigned int cachedGlyph[CACHE_SIZE];
   NSSize cachedSize[CACHE_SIZE];
 
+  /* the bitmaps drawn so far, screen fonts only */
+  ft_glyph_atlas_t *atlas;
+
   CGFloat lineHeight;
 }
 @end
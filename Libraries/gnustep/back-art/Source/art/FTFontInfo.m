@@ -108,6 +108,178 @@ static FT_Error ft_get_face(FTC_FaceID fid, FT_Library lib, FT_Pointer data, FT_
   return 0;
 }
 
+/*
+Glyph atlas of a screen font. Every FTFontInfo is one face at one size with
+one set of load flags, so it renders each glyph the same way every time.
+Instead of asking the shared sbit cache (which may also have evicted the
+glyph) for every glyph drawn, the font keeps its own copy: the bitmaps are
+packed into large pages and FTC_SBitRec copies pointing into them are kept
+in an open addressing table on the glyph index. ASCII characters also map
+straight to their slot, which skips the cmap lookup as well.
+
+Nothing is ever evicted; once the pages are full, the remaining glyphs come
+from the sbit cache like before.
+*/
+
+#define ATLAS_PAGE_SIZE 65536
+#define ATLAS_MAX_PAGES 32
+
+typedef struct {
+  unsigned int glyph; /* glyph index + 1, 0 for an empty slot */
+  FTC_SBitRec sbit;
+} ft_atlas_entry_t;
+
+struct ft_glyph_atlas_s {
+  ft_atlas_entry_t *entries;
+  unsigned int size, count; /* size is 0 or a power of 2 */
+
+  unsigned char *pages[ATLAS_MAX_PAGES];
+  int num_pages, page_used;
+
+  /* slot + 1 of each ASCII character's glyph, 0 if not known yet */
+  unsigned int ascii[128];
+};
+
+/* from the back-art-no-glyph-atlas defaults key */
+static BOOL no_glyph_atlas;
+
+static ft_glyph_atlas_t *ft_atlas_new(void)
+{
+  if (no_glyph_atlas)
+    return NULL;
+  return calloc(1, sizeof(ft_glyph_atlas_t));
+}
+
+static void ft_atlas_free(ft_glyph_atlas_t *atlas)
+{
+  int i;
+
+  if (!atlas)
+    return;
+  for (i = 0; i < atlas->num_pages; i++)
+    free(atlas->pages[i]);
+  free(atlas->entries);
+  free(atlas);
+}
+
+/* copy of the bitmap in the pages, NULL if there's no room left */
+static unsigned char *ft_atlas_store(ft_glyph_atlas_t *atlas, const unsigned char *bitmap, int size)
+{
+  unsigned char *p;
+
+  if (size > ATLAS_PAGE_SIZE)
+    return NULL;
+  if (!atlas->num_pages || atlas->page_used + size > ATLAS_PAGE_SIZE) {
+    if (atlas->num_pages == ATLAS_MAX_PAGES || !(p = malloc(ATLAS_PAGE_SIZE)))
+      return NULL;
+    atlas->pages[atlas->num_pages++] = p;
+    atlas->page_used = 0;
+  }
+
+  p = atlas->pages[atlas->num_pages - 1] + atlas->page_used;
+  memcpy(p, bitmap, size);
+  atlas->page_used += (size + 3) & ~3;
+  return p;
+}
+
+static BOOL ft_atlas_grow(ft_glyph_atlas_t *atlas)
+{
+  unsigned int size = atlas->size ? atlas->size * 2 : 256;
+  ft_atlas_entry_t *entries, *e;
+  unsigned int i, j;
+
+  if (!(entries = calloc(size, sizeof(ft_atlas_entry_t))))
+    return NO;
+
+  for (i = 0, e = atlas->entries; i < atlas->size; i++, e++) {
+    if (!e->glyph)
+      continue;
+    for (j = (e->glyph - 1) & (size - 1); entries[j].glyph; j = (j + 1) & (size - 1))
+      ;
+    entries[j] = *e;
+  }
+
+  free(atlas->entries);
+  atlas->entries = entries;
+  atlas->size = size;
+  /* the slots have moved */
+  memset(atlas->ascii, 0, sizeof(atlas->ascii));
+  return YES;
+}
+
+/*
+Same as FTC_SBitCache_Lookup(), but the glyph is added to the atlas (if
+there is one). *slot is set to the glyph's slot + 1, or 0 if it isn't in
+the atlas.
+*/
+static FT_Error ft_atlas_lookup(ft_glyph_atlas_t *atlas, FTC_ImageType type, unsigned int glyph,
+                                FTC_SBit *psbit, unsigned int *slot)
+{
+  FTC_SBit sbit;
+  FT_Error error;
+  unsigned char *bitmap = NULL;
+  unsigned int i, mask;
+
+  *slot = 0;
+  if (atlas && atlas->size) {
+    mask = atlas->size - 1;
+    for (i = glyph & mask; atlas->entries[i].glyph; i = (i + 1) & mask) {
+      if (atlas->entries[i].glyph == glyph + 1) {
+        *psbit = &atlas->entries[i].sbit;
+        *slot = i + 1;
+        return 0;
+      }
+    }
+  }
+
+  if ((error = FTC_SBitCache_Lookup(ftc_sbitcache, type, glyph, &sbit, NULL)))
+    return error;
+  *psbit = sbit;
+
+  if (!atlas || glyph + 1 == 0)
+    return 0;
+  if (sbit->buffer) {
+    if (sbit->pitch < 0 || !(bitmap = ft_atlas_store(atlas, sbit->buffer, sbit->pitch * sbit->height)))
+      return 0;
+  }
+  if ((atlas->count + 1) * 4 > atlas->size * 3 && !ft_atlas_grow(atlas))
+    return 0;
+
+  mask = atlas->size - 1;
+  for (i = glyph & mask; atlas->entries[i].glyph; i = (i + 1) & mask)
+    ;
+  atlas->entries[i].glyph = glyph + 1;
+  atlas->entries[i].sbit = *sbit;
+  atlas->entries[i].sbit.buffer = bitmap;
+  atlas->count++;
+
+  *psbit = &atlas->entries[i].sbit;
+  *slot = i + 1;
+  return 0;
+}
+
+/* the same for a character, *glyph is set to its glyph index */
+static FT_Error ft_atlas_char_lookup(ft_glyph_atlas_t *atlas, FTC_ImageType type,
+                                     int cmap, unsigned int uch, unsigned int *glyph,
+                                     FTC_SBit *psbit)
+{
+  FT_Error error;
+  unsigned int slot;
+
+  if (atlas && uch < 128 && (slot = atlas->ascii[uch])) {
+    *glyph = atlas->entries[slot - 1].glyph - 1;
+    *psbit = &atlas->entries[slot - 1].sbit;
+    return 0;
+  }
+
+  *glyph = FTC_CMapCache_Lookup(ftc_cmapcache, type->face_id, cmap, uch);
+  if ((error = ft_atlas_lookup(atlas, type, *glyph, psbit, &slot)))
+    return error;
+  if (slot && uch < 128)
+    atlas->ascii[uch] = slot;
+  return 0;
+}
+
 @implementation FTFontInfo
 
 - (id)initWithFontName:(NSString *)name
@@ -269,9 +441,18 @@ static FT_Error ft_get_face(FTC_FaceID fid, FT_Library lib, FT_Pointer data, FT_
   */
   cachedGlyph[0] = 1;
 
+  if (screenFont)
+    atlas = ft_atlas_new();
+
   return self;
 }
 
+- (void)dealloc
+{
+  ft_atlas_free(atlas);
+  [super dealloc];
+}
+
 - (NSString *)displayName
 {
   return face_info->displayName;
@@ -498,10 +679,8 @@ static FT_Error ft_get_face(FTC_FaceID fid, FT_Library lib, FT_Pointer data, FT_
     }
 #undef ADD_UTF_BYTE
 
-    glyph = FTC_CMapCache_Lookup(ftc_cmapcache, faceId, unicodeCmap, uch);
-
     if (use_sbit) {
-      if ((error = FTC_SBitCache_Lookup(ftc_sbitcache, &imageType, glyph, &sbit, NULL))) {
+      if ((error = ft_atlas_char_lookup(atlas, &imageType, unicodeCmap, uch, &glyph, &sbit))) {
         NSLog(@"FTC_SBitCache_Lookup() failed with error %08x "
               @"(%08x, %08x, %ix%i, %08x)",
               error, glyph, (unsigned)imageType.face_id, imageType.width, imageType.height,
@@ -653,6 +832,8 @@ static FT_Error ft_get_face(FTC_FaceID fid, FT_Library lib, FT_Pointer data, FT_
       FT_Size size;
       FT_BitmapGlyph gb;
 
+      glyph = FTC_CMapCache_Lookup(ftc_cmapcache, faceId, unicodeCmap, uch);
+
       if ((error = FTC_Manager_LookupSize(ftc_manager, &scaler, &size))) {
         NSLog(@"FTC_Manager_Lookup_Size() failed with error %08x", error);
         continue;
@@ -789,6 +970,7 @@ static FT_Error ft_get_face(FTC_FaceID fid, FT_Library lib, FT_Pointer data, FT_
   int use_sbit;
 
   FTC_SBit sbit;
+  unsigned int slot;
 
   FT_Matrix ftmatrix;
   FT_Vector ftdelta;
@@ -856,7 +1038,7 @@ static FT_Error ft_get_face(FTC_FaceID fid, FT_Library lib, FT_Pointer data, FT_
     glyph = *glyphs - 1;
 
     if (use_sbit) {
-      if ((error = FTC_SBitCache_Lookup(ftc_sbitcache, &imageType, glyph, &sbit, NULL))) {
+      if ((error = ft_atlas_lookup(atlas, &imageType, glyph, &sbit, &slot))) {
         NSLog(@"FTC_SBitCache_Lookup() failed with error %08x "
               @"(%08x, %08x, %ix%i, %08x)",
               error, glyph, (unsigned)imageType.face_id, imageType.width, imageType.height,
@@ -1070,6 +1252,7 @@ static FT_Error ft_get_face(FTC_FaceID fid, FT_Library lib, FT_Pointer data, FT_
   int use_sbit;
 
   FTC_SBit sbit;
+  unsigned int slot;
 
   FT_Matrix ftmatrix;
   FT_Vector ftdelta;
@@ -1137,7 +1320,7 @@ static FT_Error ft_get_face(FTC_FaceID fid, FT_Library lib, FT_Pointer data, FT_
     glyph = *glyphs - 1;
 
     if (use_sbit) {
-      if ((error = FTC_SBitCache_Lookup(ftc_sbitcache, &imageType, glyph, &sbit, NULL))) {
+      if ((error = ft_atlas_lookup(atlas, &imageType, glyph, &sbit, &slot))) {
         if (glyph != 0xffffffff)
           NSLog(@"FTC_SBitCache_Lookup() failed with error %08x (%08x, %08x, %ix%i, %08x)", error,
                 glyph, (unsigned)imageType.face_id, imageType.width, imageType.height,
@@ -1357,11 +1540,12 @@ static FT_Error ft_get_face(FTC_FaceID fid, FT_Library lib, FT_Pointer data, FT_
   if (screenFont) {
     int entry = glyph % CACHE_SIZE;
     FTC_SBit sbit;
+    unsigned int slot;
 
     if (cachedGlyph[entry] == glyph)
       return cachedSize[entry];
 
-    if ((error = FTC_SBitCache_Lookup(ftc_sbitcache, &imageType, glyph, &sbit, NULL))) {
+    if ((error = ft_atlas_lookup(atlas, &imageType, glyph, &sbit, &slot))) {
       NSLog(@"FTC_SBitCache_Lookup() failed with error %08x (%08x, %08x, %ix%i, %08x)", error,
             glyph, (unsigned)imageType.face_id, imageType.width, imageType.height, imageType.flags);
       return NSZeroSize;
@@ -1492,11 +1676,10 @@ static FT_Error ft_get_face(FTC_FaceID fid, FT_Library lib, FT_Pointer data, FT_
   total = 0;
   for (i = 0; i < c; i++) {
     ch = [string characterAtIndex:i];
-    glyph = FTC_CMapCache_Lookup(ftc_cmapcache, faceId, unicodeCmap, ch);
 
     /* TODO: shouldn't use sbit cache for this */
     if (1) {
-      if (FTC_SBitCache_Lookup(ftc_sbitcache, &imageType, glyph, &sbit, NULL))
+      if (ft_atlas_char_lookup(atlas, &imageType, unicodeCmap, ch, &glyph, &sbit))
         continue;
 
       total += sbit->xadvance;
@@ -1914,6 +2097,7 @@ static int filters[3][7] = {{0 * 65536 / 9, 1 * 65536 / 9, 2 * 65536 / 9, 3 * 65
     int i;
 
     subpixel_text = [ud integerForKey:@"back-art-subpixel-text"];
+    no_glyph_atlas = [ud boolForKey:@"back-art-no-glyph-atlas"];
 
     /* To make it easier to find an optimal (or at least good) filter,
     the filters are configurable (for now). */
@@ -1952,6 +2136,12 @@ static int filters[3][7] = {{0 * 65536 / 9, 1 * 65536 / 9, 2 * 65536 / 9, 3 * 65
 {
   NSGlyph g;
 
+  /* glyph index + 1 is what the atlas stores */
+  if (atlas && ch < 128 && atlas->ascii[ch]) {
+    g = atlas->entries[atlas->ascii[ch] - 1].glyph;
+    return g > 1 ? g : NSNullGlyph;
+  }
+
   g = FTC_CMapCache_Lookup(ftc_cmapcache, faceId, unicodeCmap, ch);
   if (g)
     return g + 1;
@@ -0,0 +1,207 @@
+/*
+  Runs every vector operator of blit-simd.m against its scalar version in
+  blit.m for all 32-bit formats and vector sizes the CPU supports. Runs of
+  random pixels of many lengths and alignments are composited by both and
+  the results (and bytes around them) must be identical. After that speed
+  of both versions is reported in megapixels per second.
+
+  Usage: blittest [pixels-per-run]
+*/
+
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "blit-main.m"
+#include "blit-simd.m"
+
+#define RUN 0       /* render_run_t, destination only */
+#define COMPOSITE 1 /* composite_run_t, source and destination */
+
+typedef struct {
+  const char *name;
+  size_t offset;
+  int kind;
+} operator_t;
+
+#define OP(f, k) {#f, offsetof(draw_info_t, f), k}
+
+static operator_t operators[] = {
+  OP(render_run_opaque, RUN),   OP(render_run_opaque_a, RUN),
+  OP(render_run_alpha, RUN),    OP(render_run_alpha_a, RUN),
+  OP(read_pixels_o, COMPOSITE), OP(read_pixels_a, COMPOSITE),
+  OP(composite_sover_aa, COMPOSITE), OP(composite_sover_ao, COMPOSITE),
+  OP(composite_plusl_aa, COMPOSITE), OP(composite_plusl_oa, COMPOSITE),
+  OP(composite_plusl_ao, COMPOSITE), OP(composite_plusl_oo, COMPOSITE),
+  OP(dissolve_aa, COMPOSITE),   OP(dissolve_ao, COMPOSITE),
+  OP(dissolve_oa, COMPOSITE),   OP(dissolve_oo, COMPOSITE),
+};
+#define NUM_OPERATORS (sizeof(operators) / sizeof(operators[0]))
+
+static const char *format_names[DI_NUM] = {
+  NULL, NULL, NULL, NULL, NULL, "RGBA", "BGRA", "ARGB", "ABGR"
+};
+static const char *level_names[] = {"scalar", "SSE2", "AVX2"};
+
+typedef void (*run_func_t)(render_run_t *ri, int num);
+typedef void (*composite_func_t)(composite_run_t *c, int num);
+
+#define OPERATOR(di, op) (*(void **)((char *)(di) + (op)->offset))
+
+/* Both 0 and 255 alpha have their own paths in blit.m */
+static void random_pixels(unsigned char *p, int num)
+{
+  int i, alpha_ofs = rand() % 2 ? 3 : 0;
+
+  for (i = 0; i < num * 4; i++)
+    p[i] = rand();
+  for (i = 0; i < num; i++) {
+    switch (rand() % 4) {
+      case 0: p[i * 4 + alpha_ofs] = 0; break;
+      case 1: p[i * 4 + alpha_ofs] = 255; break;
+    }
+  }
+}
+
+static void random_parameters(render_run_t *ri, composite_run_t *c)
+{
+  ri->r = rand();
+  ri->g = rand() % 3 ? rand() : ri->r;
+  ri->b = ri->g == ri->r ? ri->r : rand();
+  ri->a = rand() % 5 ? rand() : (rand() % 2) * 255;
+  c->fraction = rand() % 5 ? rand() : (rand() % 2) * 255;
+}
+
+static void call(draw_info_t *di, operator_t *op, render_run_t *ri,
+                 composite_run_t *c, unsigned char *src, unsigned char *dst,
+                 int num)
+{
+  if (op->kind == RUN) {
+    ri->dst = dst;
+    ((run_func_t)OPERATOR(di, op))(ri, num);
+  } else {
+    c->src = src;
+    c->dst = dst;
+    ((composite_func_t)OPERATOR(di, op))(c, num);
+  }
+}
+
+#define GUARD 64
+#define MAX_NUM 300
+
+static int check(draw_info_t *ref, draw_info_t *vec, operator_t *op)
+{
+  unsigned char src[(MAX_NUM + 2 * GUARD) * 4];
+  unsigned char dst1[(MAX_NUM + 2 * GUARD) * 4], dst2[(MAX_NUM + 2 * GUARD) * 4];
+  render_run_t ri;
+  composite_run_t c;
+  int num, ofs, trial, i, errors = 0;
+
+  for (num = 0; num <= MAX_NUM; num += num < 40 ? 1 : 37) {
+    for (ofs = 0; ofs < 4; ofs++) {
+      for (trial = 0; trial < 20; trial++) {
+        random_pixels(src, MAX_NUM + 2 * GUARD);
+        random_pixels(dst1, MAX_NUM + 2 * GUARD);
+        memcpy(dst2, dst1, sizeof(dst1));
+        random_parameters(&ri, &c);
+
+        /* pixels are misaligned by ofs bytes as in 24-bit aligned rows */
+        call(ref, op, &ri, &c, src + GUARD * 4 + ofs, dst1 + GUARD * 4 + ofs, num);
+        call(vec, op, &ri, &c, src + GUARD * 4 + ofs, dst2 + GUARD * 4 + ofs, num);
+
+        if (memcmp(dst1, dst2, sizeof(dst1))) {
+          for (i = 0; i < (int)sizeof(dst1) && dst1[i] == dst2[i]; i++)
+            ;
+          if (errors < 5) {
+            printf("  %s: num=%i ofs=%i: byte %i is %02x, should be %02x"
+                   " (rgba %02x %02x %02x %02x, fraction %02x)\n",
+                   op->name, num, ofs, i - GUARD * 4 - ofs, dst2[i], dst1[i],
+                   ri.r, ri.g, ri.b, ri.a, c.fraction);
+          }
+          errors++;
+        }
+      }
+    }
+  }
+  return errors;
+}
+
+static double now(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* megapixels per second */
+static double measure(draw_info_t *di, operator_t *op, int num)
+{
+  unsigned char *src = malloc(num * 4), *dst = malloc(num * 4);
+  render_run_t ri;
+  composite_run_t c;
+  double start, t;
+  long pixels = 0;
+
+  random_pixels(src, num);
+  random_pixels(dst, num);
+  ri.r = 10, ri.g = 20, ri.b = 30, ri.a = 100;
+  c.fraction = 100;
+
+  start = now();
+  do {
+    int i;
+    for (i = 0; i < 100; i++)
+      call(di, op, &ri, &c, src, dst, num);
+    pixels += 100 * num;
+    t = now() - start;
+  } while (t < 0.05);
+
+  free(src);
+  free(dst);
+  return pixels / t / 1e6;
+}
+
+int main(int argc, char **argv)
+{
+  int num = argc > 1 ? atoi(argv[1]) : 1024;
+  int supported = blit_simd_supported();
+  int failed = 0;
+  int how, level;
+  unsigned int i;
+
+  srand(1);
+  artcontext_setup_gamma(0);
+
+  printf("CPU supports %s\n", level_names[supported]);
+
+  for (level = BLIT_SIMD_SSE2; level <= supported; level++) {
+    for (how = DI_32_RGBA; how <= DI_32_ABGR; how++) {
+      draw_info_t ref = draw_infos[how], vec = ref;
+
+      blit_simd_setup(&vec, level);
+      printf("%s %s\n", level_names[level], format_names[how]);
+      for (i = 0; i < NUM_OPERATORS; i++) {
+        operator_t *op = &operators[i];
+        int errors;
+
+        if (OPERATOR(&ref, op) == OPERATOR(&vec, op)) {
+          printf("  %-20s no vector version\n", op->name);
+          continue;
+        }
+        errors = check(&ref, &vec, op);
+        if (errors) {
+          failed++;
+          printf("  %-20s FAILED: %i runs differ\n", op->name, errors);
+        } else {
+          printf("  %-20s ok  %8.1f -> %8.1f Mpixel/s\n", op->name,
+                 measure(&ref, op, num), measure(&vec, op, num));
+        }
+      }
+    }
+  }
+
+  return failed ? 1 : 0;
+}
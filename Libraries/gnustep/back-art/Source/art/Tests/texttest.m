@@ -0,0 +1,115 @@
+/*
+  Draws pages of text with DPSshow, which ends up in -[FTFontInfo
+  drawString:...], into an offscreen image and reports glyphs per second.
+  Run it once as it is and once with the glyph atlas turned off to compare:
+
+  Usage: texttest [-pages n] [-font name] [-size points]
+         texttest -back-art-no-glyph-atlas YES
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#import <Foundation/Foundation.h>
+#import <AppKit/AppKit.h>
+
+#define WIDTH 600
+#define HEIGHT 800
+
+static const char *lines[] = {
+  "The quick brown fox jumps over the lazy dog. 0123456789",
+  "THE QUICK BROWN FOX JUMPS OVER THE LAZY DOG. !?@#$%&*()",
+  "  if (sbit->format == ft_pixel_mode_grays) { x += 1; }",
+  "Pack my box with five dozen liquor jugs; {}[]<>=+-/\\|~",
+  "Sphinx of black quartz, judge my vow: \"\xc3\xa9\xc3\xa8\xc3\xbc\xc3\xb1\".",
+};
+#define NUM_LINES (sizeof(lines) / sizeof(lines[0]))
+
+static double now(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* returns the number of glyphs drawn */
+static long draw_page(NSGraphicsContext *ctxt, CGFloat line_height)
+{
+  const char *s;
+  CGFloat y;
+  long glyphs = 0;
+  int i;
+
+  for (i = 0, y = HEIGHT - line_height; y > 0; i++, y -= line_height) {
+    s = lines[i % NUM_LINES];
+    DPSmoveto(ctxt, 4, y);
+    DPSshow(ctxt, s);
+    for (; *s; s++)
+      if ((*s & 0xc0) != 0x80)
+        glyphs++;
+  }
+  return glyphs;
+}
+
+int main(int argc, char **argv)
+{
+  NSAutoreleasePool *pool = [NSAutoreleasePool new];
+  NSUserDefaults *ud;
+  NSGraphicsContext *ctxt;
+  NSImage *image;
+  NSFont *font;
+  NSString *name;
+  CGFloat size;
+  int pages, i;
+  long glyphs;
+  double start, elapsed;
+
+  [NSApplication sharedApplication];
+  ud = [NSUserDefaults standardUserDefaults];
+
+  pages = [ud integerForKey:@"pages"];
+  if (pages <= 0)
+    pages = 200;
+  size = [ud floatForKey:@"size"];
+  if (size <= 0)
+    size = 12;
+  name = [ud stringForKey:@"font"];
+  font = name ? [NSFont fontWithName:name size:size] : [NSFont userFixedPitchFontOfSize:size];
+  if (!font) {
+    fprintf(stderr, "no font '%s'\n", [name UTF8String]);
+    return 1;
+  }
+  /* only screen fonts use the bitmaps (and the atlas) */
+  if ([font screenFont])
+    font = [font screenFont];
+
+  image = [[NSImage alloc] initWithSize:NSMakeSize(WIDTH, HEIGHT)];
+  [image lockFocus];
+  ctxt = GSCurrentContext();
+  [[NSColor whiteColor] set];
+  NSRectFill(NSMakeRect(0, 0, WIDTH, HEIGHT));
+  [[NSColor blackColor] set];
+  [font set];
+
+  /* the first page fills the caches */
+  draw_page(ctxt, size + 2);
+
+  glyphs = 0;
+  start = now();
+  for (i = 0; i < pages; i++)
+    glyphs += draw_page(ctxt, size + 2);
+  elapsed = now() - start;
+
+  [image unlockFocus];
+
+  printf("%s %g, glyph atlas %s\n", [[font fontName] UTF8String], size,
+         [ud boolForKey:@"back-art-no-glyph-atlas"] ? "off" : "on");
+  printf("%i pages, %li glyphs in %.3f s: %.0f glyphs/s\n", pages, glyphs, elapsed,
+         glyphs / elapsed);
+
+  [image release];
+  [pool release];
+  return 0;
+}
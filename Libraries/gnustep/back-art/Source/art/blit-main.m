@@ -364,6 +364,13 @@ static draw_info_t draw_infos[DI_NUM] = {
     {DI_32_ABGR, 4, 24, 1, 0, C(abgr)},
 };
 
+static int simd_level = -1;
+
+void artcontext_setup_simd(int enable)
+{
+  simd_level = enable ? blit_simd_supported() : BLIT_SIMD_NONE;
+}
+
 static int byte_ofs_of_mask(unsigned int m) {
   union {
     unsigned char b[4];
@@ -434,6 +441,11 @@ void artcontext_setup_draw_info(draw_info_t *di, unsigned int red_mask,
           @"Better: implement it and send a patch.)");
     exit(1);
   }
+
+  if (simd_level < 0)
+    simd_level = blit_simd_supported();
+  blit_simd_setup(di, simd_level);
+  NSDebugLLog(@"back-art", @"simd level=%i", simd_level);
 }
 
 void artcontext_setup_gamma(float gamma)
@@ -0,0 +1,316 @@
+/*
+   This file is part of GNUstep.
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 2 of the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	 See the GNU
+   Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with this library; see the file COPYING.LIB.
+   If not, see <http://www.gnu.org/licenses/> or write to the
+   Free Software Foundation, 51 Franklin Street, Fifth Floor,
+   Boston, MA 02110-1301, USA.
+*/
+
+/*
+  Included by blit-simd.m for each vector size (VEC_* macros) and 32-bit
+  pixel format (byte offsets of the channels in R_OFS, G_OFS, B_OFS and
+  A_OFS). Each function gives exactly the same result as its counterpart
+  in blit.m.
+
+  Vectors hold VN pixels. Multiplications are done with pixels unpacked to
+  16-bit lanes: 4 lanes per pixel, lane i holds byte i of the pixel.
+*/
+
+/* alpha byte of each pixel */
+#define A_MASK VSET1_32(0xff << (A_OFS * 8))
+
+/* (x * f + 0xff) >> 8 for every byte of x, with factors of the low and
+   high halves of x unpacked to 16-bit lanes */
+static inline VTARGET VEC VPRE(scale)(VEC x, VEC flo, VEC fhi)
+{
+  VEC lo = VUNPACKLO8(x, VZERO), hi = VUNPACKHI8(x, VZERO);
+  VEC ff = VSET1_16(0xff);
+
+  lo = VSRL16(VADD16(VMUL16(lo, flo), ff), 8);
+  hi = VSRL16(VADD16(VMUL16(hi, fhi), ff), 8);
+  return VPACKUS16(lo, hi);
+}
+
+/* s + d * (1 - srca), bytes wrap around like the assignments in blit.m */
+static inline VTARGET VEC VPRE(over)(VEC s, VEC d)
+{
+  VEC c255 = VSET1_16(255);
+  VEC slo = VUNPACKLO8(s, VZERO), shi = VUNPACKHI8(s, VZERO);
+
+  return VADD8(s, VPRE(scale)(d, VSUB16(c255, VSHUFFLE16(slo, A_OFS)),
+                              VSUB16(c255, VSHUFFLE16(shi, A_OFS))));
+}
+
+/* color of r with alpha of d */
+static inline VTARGET VEC VPRE(keep_alpha)(VEC r, VEC d)
+{
+  return VOR(VANDNOT(A_MASK, r), VAND(A_MASK, d));
+}
+
+/* pixels to 32bpp RGBA */
+static inline VTARGET VEC VPRE(to_rgba)(VEC v)
+{
+#if FORMAT_HOW == DI_32_RGBA
+  return v;
+#elif FORMAT_HOW == DI_32_BGRA
+  return VOR(VAND(v, VSET1_32(0xff00ff00)),
+             VOR(VAND(VSRL32(v, 16), VSET1_32(0xff)), VSLL32(VAND(v, VSET1_32(0xff)), 16)));
+#elif FORMAT_HOW == DI_32_ARGB
+  return VOR(VSRL32(v, 8), VSLL32(v, 24));
+#else
+  return VOR(VOR(VSRL32(v, 24), VSLL32(v, 24)),
+             VOR(VAND(VSRL32(v, 8), VSET1_32(0xff00)), VAND(VSLL32(v, 8), VSET1_32(0xff0000))));
+#endif
+}
+
+/*
+  Loops over the run, the last incomplete vector is done in a temporary
+  buffer. `op' computes VEC r from VEC s and VEC d.
+*/
+#define COMPOSITE_LOOP(op) \
+  unsigned char *sp = c->src, *dp = c->dst; \
+  VEC s, d, r; \
+  unsigned int ts[VN], td[VN]; \
+\
+  for (; num >= VN; num -= VN, sp += VN * 4, dp += VN * 4) { \
+    s = VLOAD(sp); \
+    d = VLOAD(dp); \
+    op \
+    VSTORE(dp, r); \
+  } \
+  if (num) { \
+    memcpy(ts, sp, num * 4); \
+    memcpy(td, dp, num * 4); \
+    s = VLOAD(ts); \
+    d = VLOAD(td); \
+    op \
+    VSTORE(td, r); \
+    memcpy(dp, td, num * 4); \
+  }
+
+/* same for the source only */
+#define CONVERT_LOOP(op) \
+  unsigned char *sp = c->src, *dp = c->dst; \
+  VEC s, r; \
+  unsigned int ts[VN], td[VN]; \
+\
+  for (; num >= VN; num -= VN, sp += VN * 4, dp += VN * 4) { \
+    s = VLOAD(sp); \
+    op \
+    VSTORE(dp, r); \
+  } \
+  if (num) { \
+    memcpy(ts, sp, num * 4); \
+    s = VLOAD(ts); \
+    op \
+    VSTORE(td, r); \
+    memcpy(dp, td, num * 4); \
+  }
+
+#define FILL_LOOP(op) \
+  unsigned char *dp = ri->dst; \
+  VEC d, r; \
+  unsigned int td[VN]; \
+\
+  for (; num >= VN; num -= VN, dp += VN * 4) { \
+    d = VLOAD(dp); \
+    op \
+    VSTORE(dp, r); \
+  } \
+  if (num) { \
+    memcpy(td, dp, num * 4); \
+    d = VLOAD(td); \
+    op \
+    VSTORE(td, r); \
+    memcpy(dp, td, num * 4); \
+  }
+
+static inline VTARGET void VPRE(fill)(unsigned char *dst, unsigned int v, int num)
+{
+  VEC p = VSET1_32(v);
+
+  for (; num >= VN; num -= VN, dst += VN * 4)
+    VSTORE(dst, p);
+  for (; num; num--, dst += 4)
+    memcpy(dst, &v, 4);
+}
+
+static VTARGET void VPRE(run_opaque)(render_run_t *ri, int num)
+{
+  unsigned char p[4];
+  unsigned int v;
+
+  /* blit.m does memset() for grays, alpha byte gets the color too */
+  p[R_OFS] = ri->r;
+  p[G_OFS] = ri->g;
+  p[B_OFS] = ri->b;
+  p[A_OFS] = (ri->r == ri->g && ri->r == ri->b) ? ri->r : 0;
+  memcpy(&v, p, 4);
+  VPRE(fill)(ri->dst, v, num);
+}
+
+static VTARGET void VPRE(run_opaque_a)(render_run_t *ri, int num)
+{
+  unsigned char p[4];
+  unsigned int v;
+
+  p[R_OFS] = ri->r;
+  p[G_OFS] = ri->g;
+  p[B_OFS] = ri->b;
+  p[A_OFS] = 0xff;
+  memcpy(&v, p, 4);
+  VPRE(fill)(ri->dst, v, num);
+}
+
+/* (color * a + d * (255 - a) + 0xff) >> 8, `k' holds color * a + 0xff */
+static inline VTARGET VEC VPRE(run_blend)(VEC d, VEC k, VEC a)
+{
+  VEC lo = VUNPACKLO8(d, VZERO), hi = VUNPACKHI8(d, VZERO);
+
+  lo = VSRL16(VADD16(VMUL16(lo, a), k), 8);
+  hi = VSRL16(VADD16(VMUL16(hi, a), k), 8);
+  return VPACKUS16(lo, hi);
+}
+
+static inline VTARGET VEC VPRE(run_constant)(render_run_t *ri, int alpha_value)
+{
+  unsigned long long k = 0;
+  int a = ri->a;
+
+  k |= (unsigned long long)(ri->r * a + 0xff) << (R_OFS * 16);
+  k |= (unsigned long long)(ri->g * a + 0xff) << (G_OFS * 16);
+  k |= (unsigned long long)(ri->b * a + 0xff) << (B_OFS * 16);
+  k |= (unsigned long long)alpha_value << (A_OFS * 16);
+  return VSET1_64(k);
+}
+
+static VTARGET void VPRE(run_alpha)(render_run_t *ri, int num)
+{
+  VEC k = VPRE(run_constant)(ri, 0);
+  VEC a = VSET1_16(255 - ri->a);
+
+  FILL_LOOP(r = VPRE(keep_alpha)(VPRE(run_blend)(d, k, a), d);)
+}
+
+static VTARGET void VPRE(run_alpha_a)(render_run_t *ri, int num)
+{
+  /* na = (na * (255 - a) + 0xffff - ((255 - a) << 8)) >> 8 */
+  VEC k = VPRE(run_constant)(ri, (ri->a << 8) + 0xff);
+  VEC a = VSET1_16(255 - ri->a);
+
+  FILL_LOOP(r = VPRE(run_blend)(d, k, a);)
+}
+
+static VTARGET void VPRE(read_pixels_o)(composite_run_t *c, int num)
+{
+  CONVERT_LOOP(r = VOR(VPRE(to_rgba)(s), VSET1_32(0xff000000));)
+}
+
+static VTARGET void VPRE(read_pixels_a)(composite_run_t *c, int num)
+{
+  CONVERT_LOOP(r = VPRE(to_rgba)(s);)
+}
+
+/*
+  Pixels with srca == 0 are left alone, srca == 255 gives the source pixel.
+  Whole vectors of such pixels are common in images, they skip the math.
+*/
+#define SOVER(finish) \
+  { \
+    VEC sa = VAND(s, A_MASK); \
+    VEC transparent = VCMPEQ32(sa, VZERO); \
+\
+    if (VMOVEMASK8(transparent) == VALL) { \
+      r = d; \
+    } else if (VMOVEMASK8(VCMPEQ32(sa, A_MASK)) == VALL) { \
+      r = s; \
+      finish \
+    } else { \
+      r = VPRE(over)(s, d); \
+      finish \
+      r = VOR(VAND(transparent, d), VANDNOT(transparent, r)); \
+    } \
+  }
+
+static VTARGET void VPRE(sover_aa)(composite_run_t *c, int num)
+{
+  COMPOSITE_LOOP(SOVER(;))
+}
+
+static VTARGET void VPRE(sover_ao)(composite_run_t *c, int num)
+{
+  COMPOSITE_LOOP(SOVER(r = VPRE(keep_alpha)(r, d);))
+}
+
+#undef SOVER
+
+static VTARGET void VPRE(plusl_aa)(composite_run_t *c, int num)
+{
+  COMPOSITE_LOOP(r = VADDS8U(s, d);)
+}
+
+static VTARGET void VPRE(plusl_oa)(composite_run_t *c, int num)
+{
+  COMPOSITE_LOOP(r = VOR(VADDS8U(s, d), A_MASK);)
+}
+
+static VTARGET void VPRE(plusl_ao_oo)(composite_run_t *c, int num)
+{
+  COMPOSITE_LOOP(r = VPRE(keep_alpha)(VADDS8U(s, d), d);)
+}
+
+/*
+  Source is scaled by fraction, then composited with sover. Opaque source
+  has srca == fraction, the same as 255 scaled by fraction.
+*/
+static VTARGET void VPRE(dissolve_aa)(composite_run_t *c, int num)
+{
+  VEC f = VSET1_16(c->fraction);
+
+  COMPOSITE_LOOP(r = VPRE(over)(VPRE(scale)(s, f, f), d);)
+}
+
+static VTARGET void VPRE(dissolve_ao)(composite_run_t *c, int num)
+{
+  VEC f = VSET1_16(c->fraction);
+
+  COMPOSITE_LOOP(r = VPRE(keep_alpha)(VPRE(over)(VPRE(scale)(s, f, f), d), d);)
+}
+
+static VTARGET void VPRE(dissolve_oa)(composite_run_t *c, int num)
+{
+  VEC f = VSET1_16(c->fraction);
+
+  COMPOSITE_LOOP(r = VPRE(over)(VPRE(scale)(VOR(s, A_MASK), f, f), d);)
+}
+
+static VTARGET void VPRE(dissolve_oo)(composite_run_t *c, int num)
+{
+  VEC f = VSET1_16(c->fraction);
+
+  COMPOSITE_LOOP(r = VPRE(keep_alpha)(VPRE(over)(VPRE(scale)(VOR(s, A_MASK), f, f), d), d);)
+}
+
+#undef COMPOSITE_LOOP
+#undef CONVERT_LOOP
+#undef FILL_LOOP
+#undef A_MASK
+
+#undef FORMAT_INSTANCE
+#undef FORMAT_HOW
+#undef R_OFS
+#undef G_OFS
+#undef B_OFS
+#undef A_OFS
@@ -0,0 +1,259 @@
+/*
+   This file is part of GNUstep.
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 2 of the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	 See the GNU
+   Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with this library; see the file COPYING.LIB.
+   If not, see <http://www.gnu.org/licenses/> or write to the
+   Free Software Foundation, 51 Franklin Street, Fifth Floor,
+   Boston, MA 02110-1301, USA.
+*/
+
+#include <string.h>
+
+#include "blit.h"
+
+/*
+SSE2 and AVX2 versions of the operators for the 32-bit formats. Like
+blit-main.m does with blit.m, blit-simd-ops.m is included once for each
+vector size and pixel format.
+
+All 32-bit formats have the color and alpha channels in separate bytes and
+every channel uses the same arithmetic in blit.m. So a vector of pixels can
+be handled as a vector of bytes: only the position of the alpha byte (and
+of the colors when a pixel is assembled or converted) differs between the
+formats. Text blitting (gamma tables, mono bitmaps) stays scalar.
+*/
+
+#if defined(__x86_64__) || defined(__i386__)
+
+#include <immintrin.h>
+
+#define V3PRE(r, f, v) v##_##f##_##r
+#define V2PRE(r, f, v) V3PRE(r, f, v)
+#define VPRE(r) V2PRE(r, FORMAT_INSTANCE, VEC_INSTANCE)
+
+/* SSE2: 4 pixels at once */
+#define VEC_INSTANCE sse2
+#define VTARGET __attribute__((target("sse2")))
+#define VEC __m128i
+#define VN 4
+#define VALL 0xffff
+#define VLOAD(p) _mm_loadu_si128((const __m128i *)(p))
+#define VSTORE(p, v) _mm_storeu_si128((__m128i *)(p), v)
+#define VZERO _mm_setzero_si128()
+#define VSET1_16(x) _mm_set1_epi16(x)
+#define VSET1_32(x) _mm_set1_epi32(x)
+#define VSET1_64(x) _mm_set1_epi64x(x)
+#define VAND(a, b) _mm_and_si128(a, b)
+#define VANDNOT(a, b) _mm_andnot_si128(a, b)
+#define VOR(a, b) _mm_or_si128(a, b)
+#define VADD8(a, b) _mm_add_epi8(a, b)
+#define VADDS8U(a, b) _mm_adds_epu8(a, b)
+#define VADD16(a, b) _mm_add_epi16(a, b)
+#define VSUB16(a, b) _mm_sub_epi16(a, b)
+#define VMUL16(a, b) _mm_mullo_epi16(a, b)
+#define VSRL16(a, n) _mm_srli_epi16(a, n)
+#define VSRL32(a, n) _mm_srli_epi32(a, n)
+#define VSLL32(a, n) _mm_slli_epi32(a, n)
+#define VUNPACKLO8(a, b) _mm_unpacklo_epi8(a, b)
+#define VUNPACKHI8(a, b) _mm_unpackhi_epi8(a, b)
+#define VPACKUS16(a, b) _mm_packus_epi16(a, b)
+#define VCMPEQ32(a, b) _mm_cmpeq_epi32(a, b)
+#define VMOVEMASK8(a) _mm_movemask_epi8(a)
+#define VSHUFFLE16(a, i) _mm_shufflehi_epi16(_mm_shufflelo_epi16(a, (i)*0x55), (i)*0x55)
+
+#define FORMAT_INSTANCE rgba
+#define FORMAT_HOW DI_32_RGBA
+#define R_OFS 0
+#define G_OFS 1
+#define B_OFS 2
+#define A_OFS 3
+#include "blit-simd-ops.m"
+
+#define FORMAT_INSTANCE bgra
+#define FORMAT_HOW DI_32_BGRA
+#define R_OFS 2
+#define G_OFS 1
+#define B_OFS 0
+#define A_OFS 3
+#include "blit-simd-ops.m"
+
+#define FORMAT_INSTANCE argb
+#define FORMAT_HOW DI_32_ARGB
+#define R_OFS 1
+#define G_OFS 2
+#define B_OFS 3
+#define A_OFS 0
+#include "blit-simd-ops.m"
+
+#define FORMAT_INSTANCE abgr
+#define FORMAT_HOW DI_32_ABGR
+#define R_OFS 3
+#define G_OFS 2
+#define B_OFS 1
+#define A_OFS 0
+#include "blit-simd-ops.m"
+
+#undef VEC_INSTANCE
+#undef VTARGET
+#undef VEC
+#undef VN
+#undef VALL
+#undef VLOAD
+#undef VSTORE
+#undef VZERO
+#undef VSET1_16
+#undef VSET1_32
+#undef VSET1_64
+#undef VAND
+#undef VANDNOT
+#undef VOR
+#undef VADD8
+#undef VADDS8U
+#undef VADD16
+#undef VSUB16
+#undef VMUL16
+#undef VSRL16
+#undef VSRL32
+#undef VSLL32
+#undef VUNPACKLO8
+#undef VUNPACKHI8
+#undef VPACKUS16
+#undef VCMPEQ32
+#undef VMOVEMASK8
+#undef VSHUFFLE16
+
+/* AVX2: 8 pixels at once. Unpacking, packing and shuffles work inside
+   128-bit lanes, so the code is the same as for SSE2. */
+#define VEC_INSTANCE avx2
+#define VTARGET __attribute__((target("avx2")))
+#define VEC __m256i
+#define VN 8
+#define VALL -1
+#define VLOAD(p) _mm256_loadu_si256((const __m256i *)(p))
+#define VSTORE(p, v) _mm256_storeu_si256((__m256i *)(p), v)
+#define VZERO _mm256_setzero_si256()
+#define VSET1_16(x) _mm256_set1_epi16(x)
+#define VSET1_32(x) _mm256_set1_epi32(x)
+#define VSET1_64(x) _mm256_set1_epi64x(x)
+#define VAND(a, b) _mm256_and_si256(a, b)
+#define VANDNOT(a, b) _mm256_andnot_si256(a, b)
+#define VOR(a, b) _mm256_or_si256(a, b)
+#define VADD8(a, b) _mm256_add_epi8(a, b)
+#define VADDS8U(a, b) _mm256_adds_epu8(a, b)
+#define VADD16(a, b) _mm256_add_epi16(a, b)
+#define VSUB16(a, b) _mm256_sub_epi16(a, b)
+#define VMUL16(a, b) _mm256_mullo_epi16(a, b)
+#define VSRL16(a, n) _mm256_srli_epi16(a, n)
+#define VSRL32(a, n) _mm256_srli_epi32(a, n)
+#define VSLL32(a, n) _mm256_slli_epi32(a, n)
+#define VUNPACKLO8(a, b) _mm256_unpacklo_epi8(a, b)
+#define VUNPACKHI8(a, b) _mm256_unpackhi_epi8(a, b)
+#define VPACKUS16(a, b) _mm256_packus_epi16(a, b)
+#define VCMPEQ32(a, b) _mm256_cmpeq_epi32(a, b)
+#define VMOVEMASK8(a) _mm256_movemask_epi8(a)
+#define VSHUFFLE16(a, i) _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(a, (i)*0x55), (i)*0x55)
+
+#define FORMAT_INSTANCE rgba
+#define FORMAT_HOW DI_32_RGBA
+#define R_OFS 0
+#define G_OFS 1
+#define B_OFS 2
+#define A_OFS 3
+#include "blit-simd-ops.m"
+
+#define FORMAT_INSTANCE bgra
+#define FORMAT_HOW DI_32_BGRA
+#define R_OFS 2
+#define G_OFS 1
+#define B_OFS 0
+#define A_OFS 3
+#include "blit-simd-ops.m"
+
+#define FORMAT_INSTANCE argb
+#define FORMAT_HOW DI_32_ARGB
+#define R_OFS 1
+#define G_OFS 2
+#define B_OFS 3
+#define A_OFS 0
+#include "blit-simd-ops.m"
+
+#define FORMAT_INSTANCE abgr
+#define FORMAT_HOW DI_32_ABGR
+#define R_OFS 3
+#define G_OFS 2
+#define B_OFS 1
+#define A_OFS 0
+#include "blit-simd-ops.m"
+
+int blit_simd_supported(void)
+{
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2"))
+    return BLIT_SIMD_AVX2;
+  if (__builtin_cpu_supports("sse2"))
+    return BLIT_SIMD_SSE2;
+  return BLIT_SIMD_NONE;
+}
+
+#define S(v, f) \
+  di->render_run_opaque = v##_##f##_run_opaque; \
+  di->render_run_opaque_a = v##_##f##_run_opaque_a; \
+  di->render_run_alpha = v##_##f##_run_alpha; \
+  di->render_run_alpha_a = v##_##f##_run_alpha_a; \
+  di->read_pixels_o = v##_##f##_read_pixels_o; \
+  di->read_pixels_a = v##_##f##_read_pixels_a; \
+  di->composite_sover_aa = v##_##f##_sover_aa; \
+  di->composite_sover_ao = v##_##f##_sover_ao; \
+  di->composite_plusl_aa = v##_##f##_plusl_aa; \
+  di->composite_plusl_oa = v##_##f##_plusl_oa; \
+  di->composite_plusl_ao = v##_##f##_plusl_ao_oo; \
+  di->composite_plusl_oo = v##_##f##_plusl_ao_oo; \
+  di->dissolve_aa = v##_##f##_dissolve_aa; \
+  di->dissolve_ao = v##_##f##_dissolve_ao; \
+  di->dissolve_oa = v##_##f##_dissolve_oa; \
+  di->dissolve_oo = v##_##f##_dissolve_oo;
+
+void blit_simd_setup(draw_info_t *di, int level)
+{
+  if (level >= BLIT_SIMD_AVX2) {
+    switch (di->how) {
+      case DI_32_RGBA: S(avx2, rgba) break;
+      case DI_32_BGRA: S(avx2, bgra) break;
+      case DI_32_ARGB: S(avx2, argb) break;
+      case DI_32_ABGR: S(avx2, abgr) break;
+    }
+  } else if (level == BLIT_SIMD_SSE2) {
+    switch (di->how) {
+      case DI_32_RGBA: S(sse2, rgba) break;
+      case DI_32_BGRA: S(sse2, bgra) break;
+      case DI_32_ARGB: S(sse2, argb) break;
+      case DI_32_ABGR: S(sse2, abgr) break;
+    }
+  }
+}
+
+#undef S
+
+#else
+
+int blit_simd_supported(void)
+{
+  return BLIT_SIMD_NONE;
+}
+
+void blit_simd_setup(draw_info_t *di, int level)
+{
+}
+
+#endif
@@ -147,5 +147,20 @@ void artcontext_setup_draw_info(draw_info_t *di, unsigned int red_mask,
                                 unsigned int green_mask, unsigned int blue_mask,
                                 int bpp);
 void artcontext_setup_gamma(float gamma);
+/* Allow or forbid use of blit_simd_setup() in artcontext_setup_draw_info().
+   Must be called before it. */
+void artcontext_setup_simd(int enable);
+
+/** Vector versions of the 32-bit operators (blit-simd.m) **/
+
+#define BLIT_SIMD_NONE 0
+#define BLIT_SIMD_SSE2 1
+#define BLIT_SIMD_AVX2 2
+
+/* Best level the CPU supports. */
+int blit_simd_supported(void);
+/* Replaces operators of di that have a vector version for this level.
+   Results are identical to the scalar ones. */
+void blit_simd_setup(draw_info_t *di, int level);
 
 #endif
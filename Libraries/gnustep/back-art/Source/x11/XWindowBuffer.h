@@ -65,6 +65,8 @@ struct XWindowBuffer_depth_info_s {
   int byte_order;
 };
 
+#define XWB_MAX_DAMAGE 8
+
 /*
   XWindowBuffer maintains an XImage for a window. Each ARTGState that
   renders to that window uses the same XWindowBuffer (and thus the same
@@ -89,16 +91,18 @@ struct XWindowBuffer_depth_info_s {
   struct XWindowBuffer_depth_info_s DI;
 
   /* While a XShmPutImage is in progress we don't try to call it
-     again. The pending updates are stored here, and when we get the
-     ShmCompletion event, we handle them. */
-  int pending_put; /* There are pending updates */
+     again. The updates are collected here, overlapping rectangles are
+     merged, and when we get the ShmCompletion event all of them are put
+     at once. */
+  int num_damage; /* There are pending updates */
   struct {
     int x, y, w, h;
-  } pending_rect; /* in this rectangle. */
+  } damage[XWB_MAX_DAMAGE]; /* in these rectangles. */
 
   int pending_event; /* We're waiting for the ShmCompletion event. */
 
-  /* This is for the ugly shape-hack */
+  /* This is for the ugly shape-hack: the last mask set for the window. Only
+     exposed rows are recomputed. */
   unsigned char *old_shape;
   int old_shape_size;
 
@@ -143,6 +147,11 @@ struct XWindowBuffer_depth_info_s {
 - (void)_exposeRect:(NSRect)r;
 + (void)_gotShmCompletion:(Drawable)d;
 
+/* Image data sent to the X server by all window buffers: in total and
+   during the last second. */
++ (unsigned long long)bytesUploaded;
++ (double)bytesUploadedPerSecond;
+
 @end
 
 #endif
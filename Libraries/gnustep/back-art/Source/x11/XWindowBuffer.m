@@ -24,12 +24,15 @@
 
 #include <config.h>
 
+#include <Foundation/NSDate.h>
+#include <Foundation/NSDebug.h>
 #include <Foundation/NSUserDefaults.h>
 
 #include "x11/XGServer.h"
 #include "x11/XGServerWindow.h"
 #include "x11/XWindowBuffer.h"
 
+#include <limits.h>
 #include <math.h>
 #include <sys/ipc.h>
 #include <sys/shm.h>
@@ -275,7 +278,13 @@ no_xshm:
           wi->alpha = NULL;
         }
 
-      wi->pending_put = wi->pending_event = 0;
+      wi->num_damage = wi->pending_event = 0;
+
+#ifdef HAVE_XSHAPE
+      /* a new image has new size, the whole mask is computed again even
+         if its size in bytes didn't change */
+      wi->old_shape_size = 0;
+#endif
 
       wi->ximage = NULL;
 
@@ -425,45 +434,255 @@ no_xshm:
 
 extern int XShmGetEventBase(Display *d);
 
-- (void) _gotShmCompletion
+static unsigned long long bytes_uploaded;
+static unsigned long long rate_bytes;
+static NSTimeInterval rate_start;
+static double bytes_per_second;
+
+static void count_upload(int bytes)
 {
-#ifdef XSHM
-  if (!use_shm)
-    return;
+  NSTimeInterval now = [NSDate timeIntervalSinceReferenceDate];
 
-  pending_event = 0;
-  if (pending_put)
+  bytes_uploaded += bytes;
+  rate_bytes += bytes;
+  if (now - rate_start >= 1.0)
     {
-      pending_put = 0;
-      if (pending_rect.x + pending_rect.w > window->xframe.size.width)
+      if (rate_start)
         {
-          pending_rect.w = window->xframe.size.width - pending_rect.x;
-          if (pending_rect.w <= 0)
-            return;
+          bytes_per_second = rate_bytes / (now - rate_start);
+          NSDebugLLog(@"XWindowBuffer", @"uploaded %.0f bytes/s",
+                      bytes_per_second);
         }
-      if (pending_rect.y + pending_rect.h > window->xframe.size.height)
+      rate_start = now;
+      rate_bytes = 0;
+    }
+}
+
++ (unsigned long long) bytesUploaded
+{
+  return bytes_uploaded;
+}
+
++ (double) bytesUploadedPerSecond
+{
+  /* nothing was uploaded for a while */
+  if ([NSDate timeIntervalSinceReferenceDate] - rate_start >= 2.0)
+    return 0;
+  return bytes_per_second;
+}
+
+/*
+  Adds the rectangle to the damage list. Rectangles that overlap or touch
+  it are merged with it. If the list is full, it's merged with the
+  rectangle that grows the least.
+*/
+- (void) _addDamage: (int)x : (int)y : (int)w : (int)h
+{
+  int i, x1, y1;
+
+  for (i = 0; i < num_damage; i++)
+    {
+      if (x <= damage[i].x + damage[i].w && damage[i].x <= x + w
+          && y <= damage[i].y + damage[i].h && damage[i].y <= y + h)
+        {
+          x1 = MAX(x + w, damage[i].x + damage[i].w);
+          y1 = MAX(y + h, damage[i].y + damage[i].h);
+          x = MIN(x, damage[i].x);
+          y = MIN(y, damage[i].y);
+          w = x1 - x;
+          h = y1 - y;
+
+          /* the union may touch other rectangles, start over */
+          damage[i] = damage[--num_damage];
+          i = -1;
+        }
+    }
+
+  if (num_damage == XWB_MAX_DAMAGE)
+    {
+      int best = 0, best_growth = INT_MAX;
+
+      for (i = 0; i < num_damage; i++)
         {
-          pending_rect.h = window->xframe.size.height - pending_rect.y;
-          if (pending_rect.h <= 0)
-            return;
+          int growth;
+
+          x1 = MAX(x + w, damage[i].x + damage[i].w) - MIN(x, damage[i].x);
+          y1 = MAX(y + h, damage[i].y + damage[i].h) - MIN(y, damage[i].y);
+          growth = x1 * y1 - damage[i].w * damage[i].h;
+          if (growth < best_growth)
+            {
+              best_growth = growth;
+              best = i;
+            }
         }
+      x1 = MAX(x + w, damage[best].x + damage[best].w);
+      y1 = MAX(y + h, damage[best].y + damage[best].h);
+      x = MIN(x, damage[best].x);
+      y = MIN(y, damage[best].y);
+      damage[best] = damage[--num_damage];
+      /* merging can make it overlap others */
+      [self _addDamage: x : y : x1 - x : y1 - y];
+      return;
+    }
+
+  damage[num_damage].x = x;
+  damage[num_damage].y = y;
+  damage[num_damage].w = w;
+  damage[num_damage].h = h;
+  num_damage++;
+}
+
+#ifdef XSHM
+/*
+  Puts all damaged rectangles in one batch. Only the last XShmPutImage
+  asks for the ShmCompletion event.
+*/
+- (void) _putDamage
+{
+  int i, n, last = -1;
+
+  /* The window might have shrunk since the damage was added. */
+  for (i = n = 0; i < num_damage; i++)
+    {
+      if (damage[i].x + damage[i].w > window->xframe.size.width)
+        damage[i].w = window->xframe.size.width - damage[i].x;
+      if (damage[i].y + damage[i].h > window->xframe.size.height)
+        damage[i].h = window->xframe.size.height - damage[i].y;
+      if (damage[i].w > 0 && damage[i].h > 0)
+        {
+          damage[n++] = damage[i];
+        }
+    }
+  num_damage = 0;
+
+  for (i = 0; i < n; i++)
+    {
       if (!XShmPutImage(display, drawable, gc, ximage,
-                        pending_rect.x, pending_rect.y,
-                        pending_rect.x, pending_rect.y,
-                        pending_rect.w, pending_rect.h,
-                        1))
+                        damage[i].x, damage[i].y,
+                        damage[i].x, damage[i].y,
+                        damage[i].w, damage[i].h,
+                        i == n - 1))
         {
           NSLog(@"XShmPutImage failed?");
         }
       else
         {
-          pending_event = 1;
+          count_upload(damage[i].w * damage[i].h * bytes_per_pixel);
+          last = i;
         }
     }
+  /* wait for the event only if the last put has been done */
+  if (n && last == n - 1)
+    {
+      pending_event = 1;
+    }
+}
+#endif
+
+- (void) _gotShmCompletion
+{
+#ifdef XSHM
+  if (!use_shm)
+    return;
+
+  pending_event = 0;
+  if (num_damage)
+    {
+      [self _putDamage];
+    }
 //        XFlush(window->display);
 #endif
 }
 
+#ifdef HAVE_XSHAPE
+/*
+  Recomputes rows y..y+h-1 of the shape mask from the alpha channel and
+  sets the mask if any of them changed.
+*/
+- (void) _updateShape: (int)y : (int)h
+{
+static int warn = 0;
+  Pixmap p;
+  int row_size = (sx + 7) / 8;
+  int dsize = row_size * sy;
+  unsigned char *dst;
+  unsigned char *a;
+  int as, bofs;
+  unsigned char bits;
+  int changed = 0;
+  int i, iy;
+
+  if (!warn)
+    NSLog(@"Warning: activating shaped windows");
+  warn = 1;
+
+  if (old_shape_size != dsize)
+    {
+      free(old_shape);
+      old_shape = malloc(dsize);
+      if (!old_shape)
+        {
+          old_shape_size = 0;
+          return;
+        }
+      old_shape_size = dsize;
+      memset(old_shape, 0xff, dsize);
+      y = 0;
+      h = sy;
+      changed = 1;
+    }
+
+#define CUTOFF 128
+
+  for (iy = y; iy < y + h; iy++)
+    {
+      if (DI.inline_alpha)
+        {
+          a = data + iy * bytes_per_line + DI.inline_alpha_ofs;
+          as = DI.bytes_per_pixel;
+        }
+      else
+        {
+          a = alpha + iy * sx;
+          as = 1;
+        }
+
+      dst = old_shape + iy * row_size;
+      bits = 0xff;
+      for (i = 0, bofs = 0; i < sx; i++, a += as)
+        {
+          if (*a < CUTOFF)
+            {
+              bits &= ~(1 << bofs);
+            }
+          bofs++;
+          if (bofs == 8 || i == sx - 1)
+            {
+              if (*dst != bits)
+                {
+                  *dst = bits;
+                  changed = 1;
+                }
+              dst++;
+              bits = 0xff;
+              bofs = 0;
+            }
+        }
+    }
+#undef CUTOFF
+
+  if (changed)
+    {
+//      NSLog(@"  updating");
+      p = XCreatePixmapFromBitmapData(display, window->ident,
+                                      (char *)old_shape, sx, sy, 1, 0, 1);
+      XShapeCombineMask(display, window->ident,
+                        ShapeBounding, 0, 0, p, ShapeSet);
+      XFreePixmap(display, p);
+    }
+}
+#endif // HAVE_XSHAPE
+
 - (void) _exposeRect: (NSRect)rect
 {
 /* TODO: Somehow, we can get negative coordinates in the rectangle. So far
@@ -517,124 +736,14 @@ accuracy, we do the test using int: s.
          destination alpha */
       if (has_alpha && use_shape_hack)
         {
-static int warn = 0;
-          Pixmap p;
-          int dsize = ((sx + 7) / 8) * sy;
-          unsigned char *buf = malloc(dsize);
-          unsigned char *dst;
-          int bofs;
-          unsigned char *a;
-          int as;
-          int i, x;
-
-          if (!warn)
-            NSLog(@"Warning: activating shaped windows");
-          warn = 1;
-
-          memset(buf, 0xff, dsize);
-
-#define CUTOFF 128
-
-          if (DI.inline_alpha)
-            {
-              a = data + DI.inline_alpha_ofs;
-              as = DI.bytes_per_pixel;
-            }
-          else
-            {
-              a = alpha;
-              as = 1;
-            }
-
-          for (bofs = 0, i = sx * sy, x = sx, dst = buf; i; i--, a += as)
-            {
-              if (*a < CUTOFF)
-                {
-                  *dst = *dst & ~(1 << bofs);
-                }
-              bofs++;
-              if (bofs == 8)
-                {
-                  dst++;
-                  bofs = 0;
-                }
-              x--;
-              if (!x)
-                {
-                  if (bofs)
-                    {
-                      bofs = 0;
-                      dst++;
-                    }
-                  x = sx;
-                }
-            }
-#undef CUTOFF
-//NSLog(@"check shape");
-          if (old_shape_size == dsize && !memcmp(old_shape, buf, dsize))
-            {
-              free(buf);
-//                NSLog(@"  same shape");
-            }
-          else
-            {
-//                NSLog(@"  updating");
-              p = XCreatePixmapFromBitmapData(display, window->ident,
-                                              (char *)buf, sx, sy, 1, 0, 1);
-              free(old_shape);
-              old_shape = buf;
-              old_shape_size = dsize;
-              XShapeCombineMask(display, window->ident,
-                                ShapeBounding, 0, 0, p, ShapeSet);
-              XFreePixmap(display, p);
-            }
+          [self _updateShape: y : h];
         }
 #endif // HAVE_XSHAPE
 
-      if (pending_event)
-        {
-          if (!pending_put)
-            {
-              pending_put = 1;
-              pending_rect.x = x;
-              pending_rect.y = y;
-              pending_rect.w = w;
-              pending_rect.h = h;
-            }
-          else
-            {
-              if (x < pending_rect.x)
-                {
-                  pending_rect.w += pending_rect.x - x;
-                  pending_rect.x = x;
-                }
-              if (x + w > pending_rect.x + pending_rect.w)
-                {
-                  pending_rect.w = x + w - pending_rect.x;
-                }
-              if (y < pending_rect.y)
-                {
-                  pending_rect.h += pending_rect.y - y;
-                  pending_rect.y = y;
-                }
-              if (y + h > pending_rect.y + pending_rect.h)
-                {
-                  pending_rect.h = y + h - pending_rect.y;
-                }
-            }
-        }
-      else
+      [self _addDamage: x : y : w : h];
+      if (!pending_event)
         {
-          pending_put = 0;
-          if (!XShmPutImage(display, drawable, gc, ximage,
-                            x, y, x, y, w, h, 1))
-            {
-              NSLog(@"XShmPutImage failed?");
-            }
-          else
-            {
-              pending_event = 1;
-            }
+          [self _putDamage];
         }
 
       /* Performance hack. Check right away for ShmCompletion
@@ -654,6 +763,7 @@ static int warn = 0;
     if (ximage)
     {
       XPutImage(display, drawable, gc, ximage, x, y, x, y, w, h);
+      count_upload(w * h * bytes_per_pixel);
     }
 }
 
@@ -727,6 +837,7 @@ static int warn = 0;
     }
   if (alpha)
     free(alpha);
+  free(old_shape);
   [super dealloc];
 }
 
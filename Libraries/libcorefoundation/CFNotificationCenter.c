@@ -45,6 +45,7 @@
 #define CF_DARWIN_CENTER	2
 
 #define CF_OBS_SIZE	32
+#define CF_OBS_BUCKETS	8 // minimum number of name buckets of an observer set
 
 typedef struct __CFObserver {
   //CFStringRef name; // can be NULL
@@ -53,8 +54,27 @@ typedef struct __CFObserver {
   const void *observer; // may be NULL
   CFNotificationCallback callback;
   CFNotificationSuspensionBehavior sb;
+  CFIndex order; // unique, increases in order of registration
+  char removed; // set in published copies when the observer is removed
 } __CFObserver;
 
+/*
+ *	Observers as seen by posting. A set is never changed after it has been published
+ *	(except for the removed flags), adding or removing an observer publishes a new one.
+ *
+ *	Observers are grouped in buckets by name hash: bucket 0 holds observers of any
+ *	name (hash == 0), bucket 1 + (hash & mask) the named ones. obs[starts[i]] to
+ *	obs[starts[i + 1] - 1] is the bucket i, in order of registration.
+ */
+typedef struct __CFObserverSet {
+  CFIndex count;
+  CFIndex mask;
+  CFIndex *starts;
+  __CFObserver *obs;
+  CFIndex readers; // posts running with this set
+  struct __CFObserverSet *retired; // next replaced set waiting to be freed
+} __CFObserverSet;
+
 typedef OSSpinLock CFSpinLock_t;
 
 struct __CFNotificationCenter {
@@ -63,8 +83,12 @@ struct __CFNotificationCenter {
   CFIndex suspended; // <- move into base bits?
   CFIndex observers;
   CFIndex capacity;
-  __CFObserver *obs;
-  CFSpinLock_t lock;
+  __CFObserver *obs; // all observers in order of registration, no empty records
+  CFIndex nextOrder;
+  CFSpinLock_t lock; // serialises changes of observers
+  __CFObserverSet *set; // published observers, read without the lock
+  __CFObserverSet *retired; // replaced sets, each freed when no post uses it
+  CFIndex entering; // posts which have loaded `set' but not yet counted themselves in it
 };
 
 
@@ -309,14 +333,14 @@ void __CFDeliverQueue(void) {
  *	that nothing tries to call them directly.
  */
 Boolean _CFNotificationCenterIsSuspended(CFNotificationCenterRef center) {
-  return center->suspended;
+  return __atomic_load_n(&center->suspended, __ATOMIC_ACQUIRE);
 }
 
 void _CFNotificationCenterSetSuspended(CFNotificationCenterRef center, Boolean suspended) {
   if (center->type == CF_DIST_CENTER) { // only suspendable type
     __CFLock(&center->lock);
     if (center->suspended != suspended) { // changing state?
-      center->suspended = suspended;
+      __atomic_store_n(&center->suspended, suspended, __ATOMIC_RELEASE);
       // have we just un-suspended and are there notifications to deliver?
       if (!suspended && (__CFDistInfo.queueCount != 0)) {
         __CFDeliverQueue();
@@ -663,6 +687,153 @@ void __CFDarwinRemoveNotification(CFHashCode hash, CFHashCode ignored) {
 }
 
 
+/*
+ *	Observer sets. __CFPublishObservers() runs under the center's lock and replaces the
+ *	published set with a copy of center->obs. Posting brackets its use of the set with
+ *	__CFBeginPost() and __CFEndPost(), which count the posts running with each set. A
+ *	replaced set is freed once its own posts have finished, either right away by the
+ *	writer or by the last of them, whatever posts keep running with newer sets.
+ */
+static inline CFIndex __CFObserverBucket(CFIndex mask, CFHashCode hash) {
+  if (hash == 0) {
+    return 0;
+  }
+  return 1 + (CFIndex)((hash ^ (hash >> 16)) & mask);
+}
+
+static __CFObserverSet *__CFCreateObserverSet(const __CFObserver *obs, CFIndex count) {
+  CFIndex buckets = CF_OBS_BUCKETS;
+  CFIndex i, b;
+  __CFObserverSet *set;
+
+  while (buckets < count) {
+    buckets <<= 1;
+  }
+  // buckets + 1 with the wildcard bucket, starts has one more entry for the end
+  set = (__CFObserverSet *)malloc(sizeof(__CFObserverSet) + (buckets + 2) * sizeof(CFIndex)
+                                  + count * sizeof(__CFObserver));
+  if (set == NULL) {
+    return NULL;
+  }
+  set->count = count;
+  set->mask = buckets - 1;
+  set->starts = (CFIndex *)(set + 1);
+  set->obs = (__CFObserver *)(set->starts + buckets + 2);
+  set->readers = 0;
+  set->retired = NULL;
+
+  // count observers of each bucket, then turn counts into bucket starts
+  for (b = 0; b < buckets + 2; b++) {
+    set->starts[b] = 0;
+  }
+  for (i = 0; i < count; i++) {
+    set->starts[__CFObserverBucket(set->mask, obs[i].hash) + 1]++;
+  }
+  for (b = 1; b < buckets + 2; b++) {
+    set->starts[b] += set->starts[b - 1];
+  }
+  // starts[b] is used as the insertion point of bucket b and ends as the start of b + 1
+  for (i = 0; i < count; i++) {
+    b = __CFObserverBucket(set->mask, obs[i].hash);
+    set->obs[set->starts[b]++] = obs[i];
+  }
+  for (b = buckets; b > 0; b--) {
+    set->starts[b] = set->starts[b - 1];
+  }
+  set->starts[0] = 0;
+
+  return set;
+}
+
+/*
+ *	Frees replaced sets no post is running with. Called with the center's lock held.
+ *	A post entering may still be about to count itself in a set it loaded before the
+ *	set was replaced, so nothing is freed while one is.
+ */
+static void __CFReclaimObserverSets(CFNotificationCenterRef center) {
+  __CFObserverSet **link = &center->retired;
+  __CFObserverSet *set;
+
+  if (__atomic_load_n(&center->entering, __ATOMIC_SEQ_CST) != 0) {
+    return;
+  }
+  while ((set = *link) != NULL) {
+    if (__atomic_load_n(&set->readers, __ATOMIC_SEQ_CST) == 0) {
+      __atomic_store_n(link, set->retired, __ATOMIC_SEQ_CST);
+      free(set);
+    }
+    else {
+      link = &set->retired;
+    }
+  }
+}
+
+static void __CFPublishObservers(CFNotificationCenterRef center) {
+  __CFObserverSet *set = NULL;
+  __CFObserverSet *old;
+
+  if (center->observers > 0) {
+    set = __CFCreateObserverSet(center->obs, center->observers);
+    if (set == NULL) {
+      fprintf(stderr, "Couldn't create observer set for notification center type %ld\n", center->type);
+      return;
+    }
+  }
+  old = __atomic_exchange_n(&center->set, set, __ATOMIC_SEQ_CST);
+  if (old != NULL) {
+    old->retired = center->retired;
+    __atomic_store_n(&center->retired, old, __ATOMIC_SEQ_CST);
+  }
+  __CFReclaimObserverSets(center);
+}
+
+static int __CFCompareOrder(const void *a, const void *b) {
+  CFIndex x = *(const CFIndex *)a, y = *(const CFIndex *)b;
+  return (x < y) ? -1 : (x > y);
+}
+
+/*
+ *	Posts which are running (e.g. the one whose callback removes an observer) may still
+ *	see removed observers in the sets they have. Their records get the removed flag, so
+ *	they're not called after removal. `orders' is sorted.
+ */
+static void __CFMarkRemovedObservers(CFNotificationCenterRef center, CFIndex *orders, CFIndex count) {
+  __CFObserverSet *sets[2] = {center->set, center->retired};
+  __CFObserverSet *set;
+  CFIndex i, s;
+
+  for (s = 0; s < 2; s++) {
+    for (set = sets[s]; set != NULL; set = (s == 0) ? NULL : set->retired) {
+      for (i = 0; i < set->count; i++) {
+        if (bsearch(&set->obs[i].order, orders, count, sizeof(CFIndex), __CFCompareOrder)) {
+          __atomic_store_n(&set->obs[i].removed, 1, __ATOMIC_RELEASE);
+        }
+      }
+    }
+  }
+}
+
+static inline __CFObserverSet *__CFBeginPost(CFNotificationCenterRef center) {
+  __CFObserverSet *set;
+
+  __atomic_add_fetch(&center->entering, 1, __ATOMIC_SEQ_CST);
+  set = __atomic_load_n(&center->set, __ATOMIC_SEQ_CST);
+  if (set != NULL) {
+    __atomic_add_fetch(&set->readers, 1, __ATOMIC_SEQ_CST);
+  }
+  __atomic_sub_fetch(&center->entering, 1, __ATOMIC_SEQ_CST);
+  return set;
+}
+
+static inline void __CFEndPost(CFNotificationCenterRef center, __CFObserverSet *set) {
+  if (((set == NULL) || (__atomic_sub_fetch(&set->readers, 1, __ATOMIC_SEQ_CST) == 0))
+      && (__atomic_load_n(&center->retired, __ATOMIC_SEQ_CST) != NULL)) {
+    __CFLock(&center->lock);
+    __CFReclaimObserverSets(center);
+    __CFUnlock(&center->lock);
+  }
+}
+
 /*
  *	Add the observer info into the table of observers for the notification center, growing the
  *	table if need be. Duplicate observers with identical signatures are allowed.
@@ -674,22 +845,16 @@ void __CFAddObserver(CFNotificationCenterRef center, const void *observer, CFNot
 	
   if (center->observers == center->capacity) {
     //fprintf(stderr, "increasing size of observer records for center type %d\n", center->type);
-    center->capacity += CF_OBS_SIZE;
-    center->obs = (__CFObserver*)realloc(center->obs, (center->capacity * sizeof(__CFObserver)));
-    if (center->obs == NULL) {
+    obs = (__CFObserver*)realloc(center->obs, ((center->capacity + CF_OBS_SIZE) * sizeof(__CFObserver)));
+    if (obs == NULL) {
       fprintf(stderr, "Couldn't realloc observer records for notification center type %ld\n", center->type);
       __CFUnlock(&center->lock);
       return; 
     }
-    obs = center->obs + center->observers;
-    // because I'm unsure if realloc zeroes the new memory...
-    for( int i = 0; i < CF_OBS_SIZE; i++ ) (obs++)->callback = NULL;
-    obs = center->obs + center->observers;
-  }
-  else {
-    obs = center->obs;
-    while (obs->callback != NULL) obs++;
+    center->obs = obs;
+    center->capacity += CF_OBS_SIZE;
   }
+  obs = center->obs + center->observers;
 	
   // hash and store the name
   CFHashCode hash = __CFNCHash(name);
@@ -700,80 +865,81 @@ void __CFAddObserver(CFNotificationCenterRef center, const void *observer, CFNot
   obs->observer = observer;
   obs->callback = callBack;
   obs->sb = suspensionBehavior;
+  obs->order = center->nextOrder++;
+  obs->removed = 0;
 	
   center->observers++;
 	
   if( cb != NULL ) cb(name, hash, (CFHashCode)object);
+
+  __CFPublishObservers(center);
 	
   __CFUnlock(&center->lock);
 }
 
 /*
- *	Remove the observer with the given signature from the notification center's table.
+ *	Remove observers from the center's table, keeping the others in order. Observers
+ *	matching `every' (and, unless it's set, the name and object) are removed.
  */
-void __CFRemoveObserver(CFNotificationCenterRef center, const void *observer, CFHashCode name, const void *object, __CFRemoverCallBack cb) {
+static void __CFRemoveObservers(CFNotificationCenterRef center, const void *observer, CFHashCode name, const void *object, Boolean every, __CFRemoverCallBack cb) {
+  __CFObserver *obs;
+  CFIndex *removed = NULL;
+  CFIndex i, count, kept = 0, removedCount = 0;
+
   __CFLock(&center->lock);
-	
-  //CFHashCode hash = (name == NULL) ? 0 : CFHash(name);
-  CFIndex count = center->observers;
-  __CFObserver *obs = center->obs;
-	
-  while (count--) {
-    while (obs->callback == NULL) {
-      obs++;
-    }
-    if ((obs->observer == observer)
-        && /* match name hash */ ((name == 0) || (name == obs->hash))
-        && /* match object */((object == NULL) || (object == obs->object))) {
-      //obs->name = NULL;
-      obs->hash = 0;
-      obs->object = NULL;
-      obs->observer = NULL;
-      obs->callback = NULL;
-      obs->sb = 0;
-      center->observers--;
-			
-      if( cb != NULL ) {
-        cb(name, (CFHashCode)object);
+
+  obs = center->obs;
+  count = center->observers;
+
+  for (i = 0; i < count; i++) {
+    if ((obs[i].observer == observer)
+        && (every
+            || (/* match name hash */ ((name == 0) || (name == obs[i].hash))
+                && /* match object */((object == NULL) || (object == obs[i].object))))) {
+      if (cb != NULL) {
+        if (every) {
+          cb(obs[i].hash, (CFHashCode)obs[i].object);
+        }
+        else {
+          cb(name, (CFHashCode)object);
+        }
+      }
+      if (removed == NULL) {
+        removed = (CFIndex *)malloc((count - i) * sizeof(CFIndex));
       }
+      if (removed != NULL) {
+        removed[removedCount++] = obs[i].order;
+      }
+    }
+    else {
+      obs[kept++] = obs[i];
     }
-    obs++;
   }
 
+  if (kept != count) {
+    center->observers = kept;
+    if (removed != NULL) {
+      __CFMarkRemovedObservers(center, removed, removedCount);
+    }
+    __CFPublishObservers(center);
+  }
+  free(removed);
+
   __CFUnlock(&center->lock);
 }
 
+/*
+ *	Remove the observer with the given signature from the notification center's table.
+ */
+void __CFRemoveObserver(CFNotificationCenterRef center, const void *observer, CFHashCode name, const void *object, __CFRemoverCallBack cb) {
+  __CFRemoveObservers(center, observer, name, object, FALSE, cb);
+}
+
 /*
  *	Remove every instance of the observer from the notification centre's table.
  */
 void __CFRemoveEveryObserver(CFNotificationCenterRef center, const void *observer, __CFRemoverCallBack cb) {
-  __CFLock(&center->lock);
-	
-  CFIndex count = center->observers;	
-  __CFObserver *obs = center->obs;
-	
-  while (count--) {
-    while( obs->callback == NULL ) {
-      obs++;
-    }
-		
-    if (obs->observer == observer) {
-      if (cb != NULL) {
-        cb(obs->hash, (CFHashCode)obs->object);
-      }
-      //obs->name = NULL;
-      obs->hash = 0;
-      obs->object = NULL;
-      obs->observer = NULL;
-      obs->callback = NULL;
-      obs->sb = 0;
-      center->observers--;
-    }
-		
-    obs++;
-  }
-
-  __CFUnlock(&center->lock);	
+  __CFRemoveObservers(center, observer, 0, NULL, TRUE, cb);
 }
 
 /*
@@ -793,43 +959,58 @@ void __CFRemoveEveryObserver(CFNotificationCenterRef center, const void *observe
  *		Local:		object == objectReturn
  *		Distributed:	object == hash, objectReturn == CFStringRef
  *		Darwin:		object == objectReturn == NULL
+ *
+ *	Only the wildcard bucket and the bucket of the name are looked at. They're merged by
+ *	registration order, so observers are called in the order they were added. The lock
+ *	isn't held while callbacks run, they may add and remove observers.
  */
 void __CFInvokeCallBacks(CFNotificationCenterRef center, CFHashCode name, CFStringRef nameReturn, const void *object, const void *objectReturn, CFDictionaryRef userInfo, Boolean deliverNow) {
-  __CFLock(&center->lock);
-		
-  CFIndex count = center->observers;
-  __CFObserver *obs = center->obs;
-	
-  //printf("A\n");
-  //__CFCenterDiag(center);
-	
-  // process each observer in the table
-  while (count--) {
-    //printf("B\n");
-		
-    // find a record with a non-NULL callback field
-    while (obs->callback == NULL) {
-      obs++;
+  __CFObserverSet *set = __CFBeginPost(center);
+  __CFObserver *any, *anyEnd, *named, *namedEnd, *obs;
+
+  if (set == NULL) {
+    __CFEndPost(center, set);
+    return;
+  }
+
+  any = set->obs + set->starts[0];
+  anyEnd = set->obs + set->starts[1];
+  if (name == 0) {
+    named = namedEnd = NULL;
+  }
+  else {
+    CFIndex bucket = __CFObserverBucket(set->mask, name);
+    named = set->obs + set->starts[bucket];
+    namedEnd = set->obs + set->starts[bucket + 1];
+  }
+
+  // process each observer of the two buckets
+  while ((any < anyEnd) || (named < namedEnd)) {
+    if ((named == namedEnd) || ((any < anyEnd) && (any->order < named->order))) {
+      obs = any++;
     }
-		
-    //printf("C\n");
-    //__CFObserverDiag (*obs);
-		
-    //printf("observer: 0x%X\n");
-		
+    else {
+      obs = named++;
+      if (obs->hash != name) { // other name in the same bucket
+        continue;
+      }
+    }
+
     // for an observer to qualify to recieve a notification, it need to match
     // both name and object, taking into account the NULL-case "match any name
     // or object"
-    if (((obs->hash == 0) || (obs->hash == name)) /* match name hash */
-        && ((obs->object == NULL) || (obs->object == object)) /* match object */) {
-      // found a match, now do we deliver the notification?
-      if (deliverNow /* non-dist short-circuit */ || !center->suspended) {
-        // CFMachPort source suggested unlocking before invoking callbacks
-        __CFUnlock(&center->lock);
-        obs->callback((CFNotificationCenterRef)center, (void*)obs->observer, nameReturn, objectReturn, userInfo);
-        __CFLock(&center->lock);
-      }
-      else switch (obs->sb) {
+    if (((obs->object != NULL) && (obs->object != object)) /* match object */
+        || __atomic_load_n(&obs->removed, __ATOMIC_ACQUIRE)) {
+      continue;
+    }
+
+    // found a match, now do we deliver the notification?
+    if (deliverNow /* non-dist short-circuit */ || !__atomic_load_n(&center->suspended, __ATOMIC_ACQUIRE)) {
+      obs->callback((CFNotificationCenterRef)center, (void*)obs->observer, nameReturn, objectReturn, userInfo);
+    }
+    else {
+      __CFLock(&center->lock);
+      switch (obs->sb) {
         case CFNotificationSuspensionBehaviorDrop: break;
         case CFNotificationSuspensionBehaviorCoalesce:
           __CFAddQueue(nameReturn, objectReturn, obs->observer, userInfo, obs->callback, TRUE);
@@ -843,13 +1024,12 @@ void __CFInvokeCallBacks(CFNotificationCenterRef center, CFHashCode name, CFStri
           }
           obs->callback((CFNotificationCenterRef)center, (void*)obs->observer, nameReturn, objectReturn, userInfo);
           break;
-        }
+      }
+      __CFUnlock(&center->lock);
     }
-		
-    obs++;
   }
-	
-  __CFUnlock(&center->lock);
+
+  __CFEndPost(center, set);
 }
 
 
@@ -909,8 +1089,11 @@ CFNotificationCenterRef __CFCreateCenter(CFIndex type) {
   // allocate storage and set counters
   memory->observers = 0;
   memory->capacity = CF_OBS_SIZE;
-  // IMPORTANT: after calloc, we assume memory is zeroed
   memory->obs = (__CFObserver*)calloc(CF_OBS_SIZE, sizeof(__CFObserver));
+  memory->nextOrder = 0;
+  memory->set = NULL;
+  memory->retired = NULL;
+  memory->entering = 0;
 	
   if (memory->obs == NULL) {
     CFAllocatorDeallocate(kCFAllocatorDefault, memory);
@@ -0,0 +1,79 @@
+#include <CoreFoundation/CoreFoundation.h>
+#include <CoreFoundation/CFLogUtilities.h>
+#include <CoreFoundation/CFNotificationCenter.h>
+
+#include <time.h>
+
+#define OBSERVERS 1000
+#define WILDCARD_OBSERVERS 4
+#define POSTS 1000000
+
+static CFIndex deliveries = 0;
+
+void countCallback(CFNotificationCenterRef center,
+                   void *observer,
+                   CFStringRef name,
+                   const void *object,
+                   CFDictionaryRef userInfo) {
+  deliveries++;
+}
+
+double seconds(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int main(int argc, char *argv[])
+{
+  CFNotificationCenterRef nc = CFNotificationCenterGetLocalCenter();
+  CFStringRef names[OBSERVERS];
+  const void *object = &deliveries;
+  double start, elapsed;
+
+  if (nc == NULL) {
+    return (1);
+  }
+
+  // observers of distinct names and a few of any name for one object
+  for (int i = 0; i < OBSERVERS; i++) {
+    names[i] = CFStringCreateWithFormat(kCFAllocatorDefault, NULL, CFSTR("BenchNotification%d"), i);
+    CFNotificationCenterAddObserver(nc, (void *)(intptr_t)(i + 1), countCallback, names[i], NULL,
+                                    CFNotificationSuspensionBehaviorDeliverImmediately);
+  }
+  for (int i = 0; i < WILDCARD_OBSERVERS; i++) {
+    CFNotificationCenterAddObserver(nc, (void *)(intptr_t)(OBSERVERS + i + 1), countCallback, NULL, object,
+                                    CFNotificationSuspensionBehaviorDeliverImmediately);
+  }
+
+  // one name, one observer
+  start = seconds();
+  for (int i = 0; i < POSTS; i++) {
+    CFNotificationCenterPostNotification(nc, names[OBSERVERS / 2], NULL, NULL, TRUE);
+  }
+  elapsed = seconds() - start;
+  CFLog(kCFLogLevelError, CFSTR("%d observers, 1 receiver: %.0f posts/s (%ld deliveries)"),
+        OBSERVERS + WILDCARD_OBSERVERS, POSTS / elapsed, deliveries);
+
+  // one name and the wildcard observers
+  deliveries = 0;
+  start = seconds();
+  for (int i = 0; i < POSTS; i++) {
+    CFNotificationCenterPostNotification(nc, names[i % OBSERVERS], object, NULL, TRUE);
+  }
+  elapsed = seconds() - start;
+  CFLog(kCFLogLevelError, CFSTR("%d observers, %d receivers: %.0f posts/s (%ld deliveries)"),
+        OBSERVERS + WILDCARD_OBSERVERS, 1 + WILDCARD_OBSERVERS, POSTS / elapsed, deliveries);
+
+  for (int i = 0; i < OBSERVERS; i++) {
+    CFNotificationCenterRemoveEveryObserver(nc, (void *)(intptr_t)(i + 1));
+    CFRelease(names[i]);
+  }
+  for (int i = 0; i < WILDCARD_OBSERVERS; i++) {
+    CFNotificationCenterRemoveEveryObserver(nc, (void *)(intptr_t)(OBSERVERS + i + 1));
+  }
+
+  return (0);
+}
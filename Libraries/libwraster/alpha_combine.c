@@ -19,49 +19,261 @@
  */
 #include "config.h"
 
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#define USE_SIMD_COMBINE 1
+#include <emmintrin.h>
+#include <immintrin.h>
+#endif
+
 #include "wraster.h"
 #include "wr_i18n.h"
 
-void RCombineAlpha(unsigned char *d, unsigned char *s, int s_has_alpha,
-		   int width, int height, int dwi, int swi, int opacity) {
-	int x, y;
-	int t, sa;
-	int alpha;
+typedef void (*combineRowFunc)(unsigned char *d, const unsigned char *s,
+			       int width, int opacity);
+
+/*
+ * Blend one RGBA source pixel onto one RGBA destination pixel.
+ *
+ * This is the reference arithmetic: all vectorized variants below must
+ * produce exactly the same bytes, so they mirror the integer rounding of
+ * the alpha channel and the single-precision 'ratio'/'cratio' math.
+ */
+static inline void combinePixel(unsigned char *d, const unsigned char *s, int sa, int opacity)
+{
+	int t, alpha;
 	float ratio, cratio;
 
-	for (y=0; y<height; y++) {
-		for (x=0; x<width; x++) {
-			sa=s_has_alpha?*(s+3):255;
+	if (opacity != 255) {
+		t = sa * opacity + 0x80;
+		sa = ((t>>8)+t)>>8;
+	}
 
-			if (opacity!=255) {
-				t = sa * opacity + 0x80;
-				sa = ((t>>8)+t)>>8;
-			}
+	t = *(d+3) * (255-sa) + 0x80;
+	alpha = sa + (((t>>8)+t)>>8);
 
-			t = *(d+3) * (255-sa) + 0x80;
-			alpha = sa + (((t>>8)+t)>>8);
-
-			if (sa==0 || alpha==0) {
-				ratio = 0;
-				cratio = 1.0;
-			} else if(sa == alpha) {
-				ratio = 1.0;
-				cratio = 0;
-			} else {
-				ratio = (float)sa / alpha;
-				cratio = 1.0F - ratio;
-			}
+	if (sa==0 || alpha==0) {
+		ratio = 0;
+		cratio = 1.0;
+	} else if(sa == alpha) {
+		ratio = 1.0;
+		cratio = 0;
+	} else {
+		ratio = (float)sa / alpha;
+		cratio = 1.0F - ratio;
+	}
+
+	d[0] = (int)d[0] * cratio + (int)s[0] * ratio;
+	d[1] = (int)d[1] * cratio + (int)s[1] * ratio;
+	d[2] = (int)d[2] * cratio + (int)s[2] * ratio;
+	d[3] = alpha;
+}
+
+static void combineRowGeneric(unsigned char *d, const unsigned char *s, int width, int opacity)
+{
+	int x;
+
+	for (x = 0; x < width; x++, d += 4, s += 4)
+		combinePixel(d, s, s[3], opacity);
+}
+
+#ifdef USE_SIMD_COMBINE
+/*
+ * SSE2 variant: 4 pixels per iteration.
+ *
+ * Runs of fully transparent source pixels leave the destination untouched
+ * and runs of fully opaque ones are plain copies, which is what the
+ * reference arithmetic yields for them too. Mixed pixels are blended with
+ * the same float operations as combinePixel() (division, two products, one
+ * sum, truncation) so results stay bit-exact.
+ */
+static void combineRowSSE2(unsigned char *d, const unsigned char *s, int width, int opacity)
+{
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i one = _mm_set1_epi32(1);
+	const __m128i c80 = _mm_set1_epi32(0x80);
+	const __m128i c255 = _mm_set1_epi32(255);
+	const __m128i cff = _mm_set1_epi32(0xff);
+	const __m128i amask = _mm_set1_epi32((int)0xff000000);
+	const __m128i vop = _mm_set1_epi32(opacity);
+	const __m128 fone = _mm_set1_ps(1.0F);
+	int x;
+
+	for (x = 0; x + 4 <= width; x += 4, d += 16, s += 16) {
+		__m128i sv = _mm_loadu_si128((const __m128i *)s);
+		__m128i dv, sa, da, t, alpha, out;
+		__m128 ratio, cratio, r, g, b;
+
+		sa = _mm_srli_epi32(sv, 24);
+		if (opacity != 255) {
+			/* sa * opacity <= 65025, so 16-bit multiplies are enough */
+			t = _mm_add_epi32(_mm_mullo_epi16(sa, vop), c80);
+			sa = _mm_srli_epi32(_mm_add_epi32(_mm_srli_epi32(t, 8), t), 8);
+		}
+
+		t = _mm_cmpeq_epi32(sa, zero);
+		if (_mm_movemask_epi8(t) == 0xffff)
+			continue;
+		t = _mm_cmpeq_epi32(sa, c255);
+		if (_mm_movemask_epi8(t) == 0xffff) {
+			_mm_storeu_si128((__m128i *)d, _mm_or_si128(sv, amask));
+			continue;
+		}
+
+		dv = _mm_loadu_si128((const __m128i *)d);
+		da = _mm_srli_epi32(dv, 24);
+		t = _mm_add_epi32(_mm_mullo_epi16(da, _mm_sub_epi32(c255, sa)), c80);
+		alpha = _mm_add_epi32(sa, _mm_srli_epi32(_mm_add_epi32(_mm_srli_epi32(t, 8), t), 8));
+
+		/* alpha is 0 only when sa is 0: any non-zero divisor gives ratio 0 */
+		t = _mm_and_si128(_mm_cmpeq_epi32(alpha, zero), one);
+		ratio = _mm_div_ps(_mm_cvtepi32_ps(sa), _mm_cvtepi32_ps(_mm_or_si128(alpha, t)));
+		cratio = _mm_sub_ps(fone, ratio);
+
+		r = _mm_add_ps(_mm_mul_ps(_mm_cvtepi32_ps(_mm_and_si128(dv, cff)), cratio),
+			       _mm_mul_ps(_mm_cvtepi32_ps(_mm_and_si128(sv, cff)), ratio));
+		g = _mm_add_ps(_mm_mul_ps(_mm_cvtepi32_ps(_mm_and_si128(_mm_srli_epi32(dv, 8), cff)), cratio),
+			       _mm_mul_ps(_mm_cvtepi32_ps(_mm_and_si128(_mm_srli_epi32(sv, 8), cff)), ratio));
+		b = _mm_add_ps(_mm_mul_ps(_mm_cvtepi32_ps(_mm_and_si128(_mm_srli_epi32(dv, 16), cff)), cratio),
+			       _mm_mul_ps(_mm_cvtepi32_ps(_mm_and_si128(_mm_srli_epi32(sv, 16), cff)), ratio));
+
+		out = _mm_cvttps_epi32(r);
+		out = _mm_or_si128(out, _mm_slli_epi32(_mm_cvttps_epi32(g), 8));
+		out = _mm_or_si128(out, _mm_slli_epi32(_mm_cvttps_epi32(b), 16));
+		out = _mm_or_si128(out, _mm_slli_epi32(alpha, 24));
+		_mm_storeu_si128((__m128i *)d, out);
+	}
+
+	combineRowGeneric(d, s, width - x, opacity);
+}
+
+/*
+ * AVX2 variant of combineRowSSE2(): 8 pixels per iteration.
+ */
+__attribute__((target("avx2")))
+static void combineRowAVX2(unsigned char *d, const unsigned char *s, int width, int opacity)
+{
+	const __m256i zero = _mm256_setzero_si256();
+	const __m256i one = _mm256_set1_epi32(1);
+	const __m256i c80 = _mm256_set1_epi32(0x80);
+	const __m256i c255 = _mm256_set1_epi32(255);
+	const __m256i cff = _mm256_set1_epi32(0xff);
+	const __m256i amask = _mm256_set1_epi32((int)0xff000000);
+	const __m256i vop = _mm256_set1_epi32(opacity);
+	const __m256 fone = _mm256_set1_ps(1.0F);
+	int x;
+
+	for (x = 0; x + 8 <= width; x += 8, d += 32, s += 32) {
+		__m256i sv = _mm256_loadu_si256((const __m256i *)s);
+		__m256i dv, sa, da, t, alpha, out;
+		__m256 ratio, cratio, r, g, b;
+
+		sa = _mm256_srli_epi32(sv, 24);
+		if (opacity != 255) {
+			t = _mm256_add_epi32(_mm256_mullo_epi32(sa, vop), c80);
+			sa = _mm256_srli_epi32(_mm256_add_epi32(_mm256_srli_epi32(t, 8), t), 8);
+		}
+
+		t = _mm256_cmpeq_epi32(sa, zero);
+		if (_mm256_movemask_epi8(t) == -1)
+			continue;
+		t = _mm256_cmpeq_epi32(sa, c255);
+		if (_mm256_movemask_epi8(t) == -1) {
+			_mm256_storeu_si256((__m256i *)d, _mm256_or_si256(sv, amask));
+			continue;
+		}
 
-			*d = (int)*d * cratio + (int)*s * ratio;
-			s++; d++;
-			*d = (int)*d * cratio + (int)*s * ratio;
-			s++; d++;
-			*d = (int)*d * cratio + (int)*s * ratio;
-			s++; d++;
-			*d = alpha;
-			d++;
+		dv = _mm256_loadu_si256((const __m256i *)d);
+		da = _mm256_srli_epi32(dv, 24);
+		t = _mm256_add_epi32(_mm256_mullo_epi32(da, _mm256_sub_epi32(c255, sa)), c80);
+		alpha = _mm256_add_epi32(sa, _mm256_srli_epi32(_mm256_add_epi32(_mm256_srli_epi32(t, 8), t), 8));
 
-			if (s_has_alpha) s++;
+		t = _mm256_and_si256(_mm256_cmpeq_epi32(alpha, zero), one);
+		ratio = _mm256_div_ps(_mm256_cvtepi32_ps(sa), _mm256_cvtepi32_ps(_mm256_or_si256(alpha, t)));
+		cratio = _mm256_sub_ps(fone, ratio);
+
+		r = _mm256_add_ps(_mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_and_si256(dv, cff)), cratio),
+				  _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_and_si256(sv, cff)), ratio));
+		g = _mm256_add_ps(_mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_and_si256(_mm256_srli_epi32(dv, 8), cff)), cratio),
+				  _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_and_si256(_mm256_srli_epi32(sv, 8), cff)), ratio));
+		b = _mm256_add_ps(_mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_and_si256(_mm256_srli_epi32(dv, 16), cff)), cratio),
+				  _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_and_si256(_mm256_srli_epi32(sv, 16), cff)), ratio));
+
+		out = _mm256_cvttps_epi32(r);
+		out = _mm256_or_si256(out, _mm256_slli_epi32(_mm256_cvttps_epi32(g), 8));
+		out = _mm256_or_si256(out, _mm256_slli_epi32(_mm256_cvttps_epi32(b), 16));
+		out = _mm256_or_si256(out, _mm256_slli_epi32(alpha, 24));
+		_mm256_storeu_si256((__m256i *)d, out);
+	}
+
+	combineRowSSE2(d, s, width - x, opacity);
+}
+#endif /* USE_SIMD_COMBINE */
+
+static combineRowFunc combineRow = NULL;
+
+/*
+ * Pick the widest blend kernel the CPU supports. The WRASTER_SIMD
+ * environment variable ("none", "sse2" or "avx2") can force a narrower one,
+ * which is used by the test and benchmark programs.
+ */
+static combineRowFunc selectCombineRow(void)
+{
+	combineRowFunc func = combineRowGeneric;
+#ifdef USE_SIMD_COMBINE
+	const char *forced = getenv("WRASTER_SIMD");
+
+	func = combineRowSSE2;
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2"))
+		func = combineRowAVX2;
+
+	if (forced) {
+		if (strcmp(forced, "none") == 0)
+			func = combineRowGeneric;
+		else if (strcmp(forced, "sse2") == 0)
+			func = combineRowSSE2;
+	}
+#endif
+	return func;
+}
+
+void RCombineAlpha(unsigned char *d, unsigned char *s, int s_has_alpha,
+		   int width, int height, int dwi, int swi, int opacity) {
+	unsigned char buf[4 * 256];
+	int x, y, n;
+
+	if (combineRow == NULL)
+		combineRow = selectCombineRow();
+
+	if (s_has_alpha) {
+		for (y=0; y<height; y++) {
+			combineRow(d, s, width, opacity);
+			d += width * 4 + dwi;
+			s += width * 4 + swi;
+		}
+		return;
+	}
+
+	/* RGB source: widen it in chunks to RGBA with an opaque alpha */
+	for (y=0; y<height; y++) {
+		for (x=0; x<width; x+=n) {
+			unsigned char *p = buf;
+			int i;
+
+			n = width - x;
+			if (n > 256)
+				n = 256;
+			for (i=0; i<n; i++) {
+				*p++ = *s++;
+				*p++ = *s++;
+				*p++ = *s++;
+				*p++ = 255;
+			}
+			combineRow(d, buf, n, opacity);
+			d += n * 4;
 		}
 		d+=dwi;
 		s+=swi;
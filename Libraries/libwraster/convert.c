@@ -30,6 +30,7 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <stdint.h>
 #include <assert.h>
 
 #include "config.h"
@@ -38,6 +39,11 @@
 #include "xutil.h"
 #include "wr_i18n.h"
 
+#if defined(__x86_64__) && defined(__GNUC__)
+#define USE_SIMD_CONVERT 1
+#include <tmmintrin.h>
+#endif
+
 
 #define NFREE(n)  if (n) free(n)
 
@@ -59,8 +65,17 @@ typedef struct RStdConversionTable {
 	struct RStdConversionTable *next;
 } RStdConversionTable;
 
+/* reduced channel value for each 4x4 ordered dither threshold */
+typedef struct ROrderedDitherTable {
+	unsigned short table[16][256];
+	unsigned short mask;
+
+	struct ROrderedDitherTable *next;
+} ROrderedDitherTable;
+
 static RConversionTable *conversionTable = NULL;
 static RStdConversionTable *stdConversionTable = NULL;
+static ROrderedDitherTable *orderedDitherTable = NULL;
 
 static void release_conversion_table(void)
 {
@@ -88,10 +103,24 @@ static void release_std_conversion_table(void)
 	stdConversionTable = NULL;
 }
 
+static void release_ordered_dither_table(void)
+{
+	ROrderedDitherTable *tmp = orderedDitherTable;
+
+	while (tmp) {
+		ROrderedDitherTable *tmp_to_delete = tmp;
+
+		tmp = tmp->next;
+		free(tmp_to_delete);
+	}
+	orderedDitherTable = NULL;
+}
+
 void r_destroy_conversion_tables(void)
 {
 	release_conversion_table();
 	release_std_conversion_table();
+	release_ordered_dither_table();
 }
 
 static unsigned short *computeTable(unsigned short mask)
@@ -151,6 +180,54 @@ static unsigned int *computeStdTable(unsigned int mult, unsigned int max)
 	return tmp->table;
 }
 
+/* 4x4 Bayer matrix */
+static const unsigned char bayer4x4[16] = {
+	 0,  8,  2, 10,
+	12,  4, 14,  6,
+	 3, 11,  1,  9,
+	15,  7, 13,  5
+};
+
+static ROrderedDitherTable *computeOrderedDitherTable(unsigned short mask)
+{
+	ROrderedDitherTable *tmp = orderedDitherTable;
+	int i, t;
+
+	while (tmp) {
+		if (tmp->mask == mask)
+			break;
+		tmp = tmp->next;
+	}
+
+	if (tmp)
+		return tmp;
+
+	tmp = (ROrderedDitherTable *) malloc(sizeof(ROrderedDitherTable));
+	if (tmp == NULL)
+		return NULL;
+
+	/* round up when the fraction lost by reduction exceeds the threshold */
+	for (t = 0; t < 16; t++)
+		for (i = 0; i < 256; i++)
+			tmp->table[t][i] = (i * mask * 32 + (2 * t + 1) * 0xff) / (0xff * 32);
+	tmp->mask = mask;
+
+	tmp->next = orderedDitherTable;
+	orderedDitherTable = tmp;
+
+	return tmp;
+}
+
+static int hostByteOrder(void)
+{
+	const union {
+		uint32_t word;
+		unsigned char byte[4];
+	} probe = { 1 };
+
+	return probe.byte[0] ? LSBFirst : MSBFirst;
+}
+
 /***************************************************************************/
 
 static void
@@ -231,64 +308,108 @@ convertTrueColor_generic(RXImage * ximg, RImage * image,
 		err = nerr;
 		nerr = terr;
 	}
+}
 
-	/* redither the 1st line to distribute error better */
-	ptr = image->data;
-	y = 0;
-	nerr[0] = 0;
-	nerr[1] = 0;
-	nerr[2] = 0;
-	for (x = 0; x < image->width; x++, ptr += channels) {
-
-		/* reduce pixel */
-		pixel = *ptr + err[x];
-		if (pixel < 0)
-			pixel = 0;
-		else if (pixel > 0xff)
-			pixel = 0xff;
-		r = rtable[pixel];
-		/* calc error */
-		rer = pixel - r * dr;
-
-		/* reduce pixel */
-		pixel = *(ptr + 1) + err[x + 1];
-		if (pixel < 0)
-			pixel = 0;
-		else if (pixel > 0xff)
-			pixel = 0xff;
-		g = gtable[pixel];
-		/* calc error */
-		ger = pixel - g * dg;
-
-		/* reduce pixel */
-		pixel = *(ptr + 2) + err[x + 2];
-		if (pixel < 0)
-			pixel = 0;
-		else if (pixel > 0xff)
-			pixel = 0xff;
-		b = btable[pixel];
-		/* calc error */
-		ber = pixel - b * db;
-
-		pixel = (r << roffs) | (g << goffs) | (b << boffs);
-		XPutPixel(ximg->image, x, y, pixel);
-
-		/* distribute error */
-		r = (rer * 3) / 8;
-		g = (ger * 3) / 8;
-		b = (ber * 3) / 8;
-		/* x+1, y */
-		err[x + 3 * 1] += r;
-		err[x + 1 + 3 * 1] += g;
-		err[x + 2 + 3 * 1] += b;
-		/* x, y+1 */
-		nerr[x] += r;
-		nerr[x + 1] += g;
-		nerr[x + 2] += b;
-		/* x+1, y+1 */
-		nerr[x + 3 * 1] = rer - 2 * r;
-		nerr[x + 1 + 3 * 1] = ger - 2 * g;
-		nerr[x + 2 + 3 * 1] = ber - 2 * b;
+#ifdef USE_SIMD_CONVERT
+/*
+ * RGB(A) bytes to 0x00RRGGBB words, 4 pixels per shuffle. Reads up to 4
+ * bytes past the last RGB pixel, which RCreateImage allocates for this.
+ */
+__attribute__((target("ssse3")))
+static void convertRow_888_SSSE3(uint32_t *dst, const unsigned char *src, int width, int channels)
+{
+	const __m128i rgba = _mm_setr_epi8(2, 1, 0, -1, 6, 5, 4, -1, 10, 9, 8, -1, 14, 13, 12, -1);
+	const __m128i rgb = _mm_setr_epi8(2, 1, 0, -1, 5, 4, 3, -1, 8, 7, 6, -1, 11, 10, 9, -1);
+	const __m128i mask = (channels == 4) ? rgba : rgb;
+	int x;
+
+	for (x = 0; x + 4 <= width; x += 4, dst += 4, src += 4 * channels) {
+		__m128i v = _mm_loadu_si128((const __m128i *)src);
+
+		_mm_storeu_si128((__m128i *)dst, _mm_shuffle_epi8(v, mask));
+	}
+	for (; x < width; x++, src += channels)
+		*dst++ = (src[0] << 16) | (src[1] << 8) | src[2];
+}
+#endif
+
+/*
+ * 32 bits per pixel XImage with 8 bits per channel: store the pixels
+ * straight into the image buffer instead of going through XPutPixel.
+ */
+static void convertTrueColor_888(RXImage * ximg, RImage * image,
+				 const unsigned short roffs, const unsigned short goffs, const unsigned short boffs)
+{
+	XImage *xi = ximg->image;
+	unsigned char *ptr = image->data;
+	int channels = (HAS_ALPHA(image) ? 4 : 3);
+	int swap = (xi->byte_order != hostByteOrder());
+	int x, y;
+#ifdef USE_SIMD_CONVERT
+	static int use_ssse3 = -1;
+
+	if (use_ssse3 < 0) {
+		const char *forced = getenv("WRASTER_SIMD");
+
+		__builtin_cpu_init();
+		use_ssse3 = __builtin_cpu_supports("ssse3") && !(forced && strcmp(forced, "none") == 0);
+	}
+#endif
+
+	for (y = 0; y < image->height; y++, ptr += image->width * channels) {
+		uint32_t *dst = (uint32_t *)(xi->data + y * xi->bytes_per_line);
+
+#ifdef USE_SIMD_CONVERT
+		if (use_ssse3 && !swap && roffs == 16 && goffs == 8 && boffs == 0) {
+			convertRow_888_SSSE3(dst, ptr, image->width, channels);
+			continue;
+		}
+#endif
+		for (x = 0; x < image->width; x++) {
+			const unsigned char *p = ptr + x * channels;
+			uint32_t pixel = ((uint32_t)p[0] << roffs) | ((uint32_t)p[1] << goffs) | ((uint32_t)p[2] << boffs);
+
+			dst[x] = swap ? __builtin_bswap32(pixel) : pixel;
+		}
+	}
+}
+
+/*
+ * Ordered (4x4 Bayer) dithering. Every pixel is independent from the
+ * others, unlike with error diffusion, so there is no error buffer to
+ * carry and 16 and 32 bit images are written directly.
+ */
+static void convertTrueColor_ordered(RXImage * ximg, RImage * image,
+				     const ROrderedDitherTable *rtable,
+				     const ROrderedDitherTable *gtable,
+				     const ROrderedDitherTable *btable,
+				     const unsigned short roffs, const unsigned short goffs, const unsigned short boffs)
+{
+	XImage *xi = ximg->image;
+	unsigned char *ptr = image->data;
+	int channels = (HAS_ALPHA(image) ? 4 : 3);
+	int native = (xi->byte_order == hostByteOrder());
+	int x, y;
+
+	for (y = 0; y < image->height; y++) {
+		const unsigned char *threshold = bayer4x4 + (y & 3) * 4;
+		char *line = xi->data + y * xi->bytes_per_line;
+
+		for (x = 0; x < image->width; x++, ptr += channels) {
+			int t = threshold[x & 3];
+			unsigned long pixel;
+
+			pixel = (rtable->table[t][ptr[0]] << roffs)
+			      | (gtable->table[t][ptr[1]] << goffs)
+			      | (btable->table[t][ptr[2]] << boffs);
+
+			if (native && xi->bits_per_pixel == 16)
+				((uint16_t *)line)[x] = pixel;
+			else if (native && xi->bits_per_pixel == 32)
+				((uint32_t *)line)[x] = pixel;
+			else
+				XPutPixel(xi, x, y, pixel);
+		}
 	}
 }
 
@@ -334,7 +455,9 @@ static RXImage *image2TrueColor(RContext * ctx, RImage * image)
 #ifdef WRLIB_DEBUG
 		fputs("true color match\n", stderr);
 #endif
-		if (rmask == 0xff && gmask == 0xff && bmask == 0xff) {
+		if (rmask == 0xff && gmask == 0xff && bmask == 0xff && ximg->image->bits_per_pixel == 32) {
+			convertTrueColor_888(ximg, image, roffs, goffs, boffs);
+		} else if (rmask == 0xff && gmask == 0xff && bmask == 0xff) {
 			for (y = 0; y < image->height; y++) {
 				for (x = 0; x < image->width; x++, ptr += channels) {
 					/* reduce pixel */
@@ -357,6 +480,25 @@ static RXImage *image2TrueColor(RContext * ctx, RImage * image)
 				}
 			}
 		}
+	} else if (rmask == 0xff && gmask == 0xff && bmask == 0xff && ximg->image->bits_per_pixel == 32) {
+		/* nothing to dither with 8 bits per channel */
+		convertTrueColor_888(ximg, image, roffs, goffs, boffs);
+	} else if (ctx->attribs->render_mode == ROrderedRendering) {
+		ROrderedDitherTable *rdither, *gdither, *bdither;
+
+#ifdef WRLIB_DEBUG
+		fputs("true color ordered dither\n", stderr);
+#endif
+		rdither = computeOrderedDitherTable(rmask);
+		gdither = computeOrderedDitherTable(gmask);
+		bdither = computeOrderedDitherTable(bmask);
+		if (rdither == NULL || gdither == NULL || bdither == NULL) {
+			RErrorCode = RERR_NOMEMORY;
+			RDestroyXImage(ctx, ximg);
+			return NULL;
+		}
+
+		convertTrueColor_ordered(ximg, image, rdither, gdither, bdither, roffs, goffs, boffs);
 	} else {
 		/* dither */
 		const int dr = 0xff / rmask;
@@ -33,16 +33,37 @@
 #include <assert.h>
 
 #include "config.h"
+
+#ifdef HAVE_INOTIFY
+#include <sys/inotify.h>
+#endif
+
 #include "wraster.h"
 #include "imgformat.h"
 #include "wr_i18n.h"
 
 
+/*
+ * Image cache
+ *
+ * Loaded images are kept in a hash table keyed by (file, index) whose
+ * entries are also linked in a most-recently-used list. Capacity is
+ * bounded both by number of entries and by the total size of pixel data.
+ * Entries are invalidated through inotify when available, otherwise the
+ * file modification time is checked on every hit.
+ */
 typedef struct RCachedImage {
 	RImage *image;
 	char *file;
+	int index;
+	unsigned hash;
+	size_t size;		/* bytes of pixel data */
 	time_t last_modif;	/* last time file was modified */
-	time_t last_use;	/* last time image was used */
+	int watch;		/* inotify watch descriptor or -1 */
+
+	struct RCachedImage *hnext;	/* hash bucket chain */
+	struct RCachedImage *prev;	/* MRU list */
+	struct RCachedImage *next;
 } RCachedImage;
 
 /*
@@ -51,7 +72,7 @@ typedef struct RCachedImage {
 static int RImageCacheSize = -1;
 
 #define IMAGE_CACHE_DEFAULT_NBENTRIES	  8
-#define IMAGE_CACHE_MAXIMUM_NBENTRIES	256
+#define IMAGE_CACHE_MAXIMUM_NBENTRIES	4096
 
 /*
  * Max. size of image (in pixels) to store in the cache
@@ -61,8 +82,21 @@ static int RImageCacheMaxImage = -1;	/* 0 = any size */
 #define IMAGE_CACHE_DEFAULT_MAXPIXELS	(64 * 64)
 #define IMAGE_CACHE_MAXIMUM_MAXPIXELS	(256 * 256)
 
+/*
+ * Max. total size of cached pixel data (in bytes), 0 = no limit.
+ * Defaults to room for RImageCacheSize images of the largest cached size.
+ */
+static size_t RImageCacheMaxBytes = 0;
+
 
-static RCachedImage *RImageCache;
+static struct {
+	RCachedImage **buckets;
+	unsigned nbuckets;	/* power of 2 */
+	RCachedImage *mru;	/* most recently used */
+	RCachedImage *lru;	/* least recently used */
+	int notify_fd;		/* inotify descriptor or -1 */
+	RImageCacheStats stats;
+} cache = { .notify_fd = -1 };
 
 
 static WRImgFormat identFile(const char *path);
@@ -106,6 +140,7 @@ char **RSupportedFileFormats(void)
 static void init_cache(void)
 {
 	char *tmp;
+	long bytes;
 
 	tmp = getenv("RIMAGE_CACHE");
 	if (!tmp || sscanf(tmp, "%i", &RImageCacheSize) != 1)
@@ -123,37 +158,249 @@ static void init_cache(void)
 	if (RImageCacheMaxImage > IMAGE_CACHE_MAXIMUM_MAXPIXELS)
 		RImageCacheMaxImage = IMAGE_CACHE_MAXIMUM_MAXPIXELS;
 
+	tmp = getenv("RIMAGE_CACHE_BYTES");
+	if (!tmp || sscanf(tmp, "%li", &bytes) != 1)
+		bytes = (long)RImageCacheSize * RImageCacheMaxImage * 4;
+	if (bytes < 0)
+		bytes = 0;
+	RImageCacheMaxBytes = bytes;
+
 	if (RImageCacheSize > 0) {
-		RImageCache = malloc(sizeof(RCachedImage) * RImageCacheSize);
-		if (RImageCache == NULL) {
+		/* keep the load factor at or below 1 */
+		cache.nbuckets = 16;
+		while (cache.nbuckets < (unsigned)RImageCacheSize)
+			cache.nbuckets <<= 1;
+		cache.buckets = calloc(cache.nbuckets, sizeof(RCachedImage *));
+		if (cache.buckets == NULL) {
 			fprintf(stderr, _("wrlib: out of memory for image cache\n"));
+			RImageCacheSize = 0;
 			return;
 		}
-		memset(RImageCache, 0, sizeof(RCachedImage) * RImageCacheSize);
 	}
+
+#ifdef HAVE_INOTIFY
+	tmp = getenv("RIMAGE_CACHE_NOTIFY");
+	if (RImageCacheSize > 0 && (!tmp || strcmp(tmp, "0") != 0))
+		cache.notify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+#endif
 }
 
-void RReleaseCache(void)
+/* FNV-1a over the file name, mixed with the image index */
+static unsigned cache_hash(const char *file, int index)
 {
-	int i;
+	unsigned h = 2166136261U;
 
-	if (RImageCacheSize > 0) {
-		for (i = 0; i < RImageCacheSize; i++) {
-			if (RImageCache[i].file) {
-				RReleaseImage(RImageCache[i].image);
-				free(RImageCache[i].file);
+	while (*file) {
+		h ^= (unsigned char)*file++;
+		h *= 16777619U;
+	}
+	h ^= (unsigned)index;
+	h *= 16777619U;
+
+	return h;
+}
+
+static void cache_unlink_mru(RCachedImage *entry)
+{
+	if (entry->prev)
+		entry->prev->next = entry->next;
+	else
+		cache.mru = entry->next;
+	if (entry->next)
+		entry->next->prev = entry->prev;
+	else
+		cache.lru = entry->prev;
+	entry->prev = entry->next = NULL;
+}
+
+static void cache_push_mru(RCachedImage *entry)
+{
+	entry->prev = NULL;
+	entry->next = cache.mru;
+	if (cache.mru)
+		cache.mru->prev = entry;
+	else
+		cache.lru = entry;
+	cache.mru = entry;
+}
+
+static RCachedImage *cache_find(const char *file, int index, unsigned hash)
+{
+	RCachedImage *entry;
+
+	for (entry = cache.buckets[hash & (cache.nbuckets - 1)]; entry; entry = entry->hnext) {
+		if (entry->hash == hash && entry->index == index && strcmp(entry->file, file) == 0)
+			return entry;
+	}
+	return NULL;
+}
+
+static void cache_remove(RCachedImage *entry)
+{
+	RCachedImage **link = &cache.buckets[entry->hash & (cache.nbuckets - 1)];
+
+	while (*link != entry)
+		link = &(*link)->hnext;
+	*link = entry->hnext;
+
+	cache_unlink_mru(entry);
+
+#ifdef HAVE_INOTIFY
+	/* the watch is shared by all indexes of the same file */
+	if (entry->watch >= 0) {
+		RCachedImage *other;
+
+		for (other = cache.mru; other; other = other->next) {
+			if (other->watch == entry->watch)
+				break;
+		}
+		if (!other)
+			inotify_rm_watch(cache.notify_fd, entry->watch);
+	}
+#endif
+
+	cache.stats.entries--;
+	cache.stats.bytes -= entry->size;
+
+	RReleaseImage(entry->image);
+	free(entry->file);
+	free(entry);
+}
+
+#ifdef HAVE_INOTIFY
+/*
+ * Drop entries for files that changed since the last call. The descriptor
+ * is non-blocking, so with nothing pending this is a single read().
+ */
+static void cache_process_notifications(void)
+{
+	char buffer[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+	ssize_t len;
+
+	for (;;) {
+		char *ptr;
+
+		len = read(cache.notify_fd, buffer, sizeof(buffer));
+		if (len <= 0)
+			break;
+
+		for (ptr = buffer; ptr < buffer + len;) {
+			const struct inotify_event *event = (const struct inotify_event *)ptr;
+			RCachedImage *entry, *next;
+
+			if (event->mask & IN_Q_OVERFLOW) {
+				/* events were lost: nothing can be trusted any more */
+				while (cache.mru) {
+					cache.stats.invalidations++;
+					cache_remove(cache.mru);
+				}
+			} else {
+				for (entry = cache.mru; entry; entry = next) {
+					next = entry->next;
+					if (entry->watch == event->wd) {
+						/* kernel dropped the watch already */
+						if (event->mask & IN_IGNORED)
+							entry->watch = -1;
+						cache.stats.invalidations++;
+						cache_remove(entry);
+						/* removal may have freed 'next' if it shared the watch */
+						next = cache.mru;
+					}
+				}
 			}
+			ptr += sizeof(struct inotify_event) + event->len;
 		}
-		free(RImageCache);
-		RImageCache = NULL;
-		RImageCacheSize = -1;
 	}
 }
+#endif
+
+static void cache_store(const char *file, int index, unsigned hash, RImage *image)
+{
+	RCachedImage *entry;
+	struct stat st;
+	size_t size;
+
+	size = (size_t)image->width * image->height * (image->format == RRGBAFormat ? 4 : 3);
+	if (RImageCacheMaxBytes > 0 && size > RImageCacheMaxBytes)
+		return;
+
+	entry = malloc(sizeof(RCachedImage));
+	if (entry == NULL)
+		return;
+	entry->file = strdup(file);
+	if (entry->file == NULL) {
+		free(entry);
+		return;
+	}
+
+	/* make room: by entry count first, then by byte budget */
+	while (cache.lru && (cache.stats.entries >= (unsigned)RImageCacheSize ||
+			     (RImageCacheMaxBytes > 0 && cache.stats.bytes + size > RImageCacheMaxBytes))) {
+		cache.stats.evictions++;
+		cache_remove(cache.lru);
+	}
+
+	entry->watch = -1;
+#ifdef HAVE_INOTIFY
+	if (cache.notify_fd >= 0)
+		entry->watch = inotify_add_watch(cache.notify_fd, file,
+						 IN_MODIFY | IN_ATTRIB | IN_CLOSE_WRITE |
+						 IN_MOVE_SELF | IN_DELETE_SELF);
+#endif
+
+	if (stat(file, &st) != 0) {
+		/* If we can't get the info, at least use a valid time to reduce risk of problems */
+		st.st_mtime = time(NULL);
+	}
+
+	entry->image = RCloneImage(image);
+	entry->index = index;
+	entry->hash = hash;
+	entry->size = size;
+	entry->last_modif = st.st_mtime;
+
+	entry->hnext = cache.buckets[hash & (cache.nbuckets - 1)];
+	cache.buckets[hash & (cache.nbuckets - 1)] = entry;
+	cache_push_mru(entry);
+
+	cache.stats.entries++;
+	cache.stats.bytes += size;
+}
+
+void RReleaseCache(void)
+{
+	if (RImageCacheSize > 0) {
+		while (cache.mru)
+			cache_remove(cache.mru);
+		free(cache.buckets);
+		cache.buckets = NULL;
+		cache.nbuckets = 0;
+#ifdef HAVE_INOTIFY
+		if (cache.notify_fd >= 0)
+			close(cache.notify_fd);
+#endif
+		cache.notify_fd = -1;
+	}
+	memset(&cache.stats, 0, sizeof(cache.stats));
+	RImageCacheSize = -1;
+}
+
+void RGetImageCacheStats(RImageCacheStats *stats)
+{
+	if (RImageCacheSize < 0)
+		init_cache();
+
+	*stats = cache.stats;
+	stats->max_entries = RImageCacheSize;
+	stats->max_bytes = RImageCacheMaxBytes;
+	stats->notify = (cache.notify_fd >= 0);
+}
 
 RImage *RLoadImage(RContext *context, const char *file, int index)
 {
 	RImage *image = NULL;
-	int i;
+	RCachedImage *entry;
+	unsigned hash = 0;
 	struct stat st;
 
 	assert(file != NULL);
@@ -162,22 +409,27 @@ RImage *RLoadImage(RContext *context, const char *file, int index)
 		init_cache();
 
 	if (RImageCacheSize > 0) {
+		hash = cache_hash(file, index);
 
-		for (i = 0; i < RImageCacheSize; i++) {
-			if (RImageCache[i].file && strcmp(file, RImageCache[i].file) == 0) {
-
-				if (stat(file, &st) == 0 && st.st_mtime == RImageCache[i].last_modif) {
-					RImageCache[i].last_use = time(NULL);
-
-					return RCloneImage(RImageCache[i].image);
-
-				} else {
-					free(RImageCache[i].file);
-					RImageCache[i].file = NULL;
-					RReleaseImage(RImageCache[i].image);
-				}
+#ifdef HAVE_INOTIFY
+		if (cache.notify_fd >= 0)
+			cache_process_notifications();
+#endif
+		entry = cache_find(file, index, hash);
+		if (entry) {
+			/* without inotify fall back to checking the modification time */
+			if (entry->watch >= 0 ||
+			    (stat(file, &st) == 0 && st.st_mtime == entry->last_modif)) {
+				cache_unlink_mru(entry);
+				cache_push_mru(entry);
+				cache.stats.hits++;
+
+				return RCloneImage(entry->image);
 			}
+			cache.stats.invalidations++;
+			cache_remove(entry);
 		}
+		cache.stats.misses++;
 	}
 
 	switch (identFile(file)) {
@@ -241,44 +493,8 @@ RImage *RLoadImage(RContext *context, const char *file, int index)
 
 	/* store image in cache */
 	if (RImageCacheSize > 0 && image &&
-	    (RImageCacheMaxImage == 0 || RImageCacheMaxImage >= image->width * image->height)) {
-		time_t oldest = time(NULL);
-		int oldest_idx = 0;
-		int done = 0;
-
-		if (stat(file, &st) != 0) {
-			/* If we can't get the info, at least use a valid time to reduce risk of problems */
-			st.st_mtime = oldest;
-		}
-
-		for (i = 0; i < RImageCacheSize; i++) {
-			if (!RImageCache[i].file) {
-				RImageCache[i].file = malloc(strlen(file) + 1);
-				strcpy(RImageCache[i].file, file);
-				RImageCache[i].image = RCloneImage(image);
-				RImageCache[i].last_modif = st.st_mtime;
-				RImageCache[i].last_use = time(NULL);
-				done = 1;
-				break;
-			} else {
-				if (oldest > RImageCache[i].last_use) {
-					oldest = RImageCache[i].last_use;
-					oldest_idx = i;
-				}
-			}
-		}
-
-		/* if no slot available, dump least recently used one */
-		if (!done) {
-			free(RImageCache[oldest_idx].file);
-			RReleaseImage(RImageCache[oldest_idx].image);
-			RImageCache[oldest_idx].file = malloc(strlen(file) + 1);
-			strcpy(RImageCache[oldest_idx].file, file);
-			RImageCache[oldest_idx].image = RCloneImage(image);
-			RImageCache[oldest_idx].last_modif = st.st_mtime;
-			RImageCache[oldest_idx].last_use = time(NULL);
-		}
-	}
+	    (RImageCacheMaxImage == 0 || RImageCacheMaxImage >= image->width * image->height))
+		cache_store(file, index, hash, image);
 
 	return image;
 }
@@ -28,6 +28,7 @@
 #include "wraster.h"
 #include "imgformat.h"
 #include "convert.h"
+#include "scale.h"
 #include "wr_i18n.h"
 
 
@@ -276,4 +277,5 @@ void RShutdown(void)
 #endif
 	RReleaseCache();
 	r_destroy_conversion_tables();
+	r_destroy_scale_tables();
 }
@@ -26,6 +26,13 @@
 #include <X11/Xlib.h>
 #include <math.h>
 #include <assert.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#define USE_SIMD_SCALE 1
+#include <emmintrin.h>
+#endif
 
 #include "config.h"
 #include "wraster.h"
@@ -245,6 +252,7 @@ static double Mitchell_filter(double t)
 
 static double (*filterf)(double) = Mitchell_filter;
 static double fwidth = Mitchell_support;
+static RScalingFilter filter_type = RMitchellFilter;
 
 void wraster_change_filter(RScalingFilter type)
 {
@@ -270,229 +278,566 @@ void wraster_change_filter(RScalingFilter type)
 		fwidth = Lanczos3_support;
 		break;
 	default:
+		type = RMitchellFilter;
+		/* fall through */
 	case RMitchellFilter:
 		filterf = Mitchell_filter;
 		fwidth = Mitchell_support;
 		break;
 	}
+	filter_type = type;
 }
 
 /*
  *	image rescaling routine
+ *
+ * The filter is applied separably: every destination pixel of a row (or
+ * column) is a weighted sum of 'ntaps' source pixels. Weights are
+ * normalized and kept in fixed point, and the tables are cached per
+ * (source size, destination size, filter) so repeated scaling of icons
+ * to the same size does not recompute them.
  */
 
-typedef struct {
-	int pixel;
-	double weight;
-} CONTRIB;
+#define WEIGHT_BITS	14
+#define WEIGHT_ONE	(1 << WEIGHT_BITS)
+#define WEIGHT_ROUND	(1 << (WEIGHT_BITS - 1))
 
-typedef struct {
-	int n;			/* number of contributors */
-	CONTRIB *p;		/* pointer to list of contributions */
-} CLIST;
+/* number of filter tables kept around */
+#define FILTER_CACHE_SIZE	16
+
+/* images smaller than this (destination pixels) are scaled on one thread */
+#define PARALLEL_MIN_PIXELS	(256 * 256)
+#define PARALLEL_MIN_ROWS	32
+#define PARALLEL_MAX_THREADS	8
+
+typedef struct RFilterTable {
+	unsigned src_size;
+	unsigned dst_size;
+	RScalingFilter filter;
+
+	int ntaps;		/* taps per destination pixel, always even */
+	int *pixel;		/* [dst_size * ntaps] source pixel index */
+	short *weight;		/* [dst_size * ntaps] weights, sum is WEIGHT_ONE */
+
+	int refcount;		/* users + 1 while it is in the cache */
+
+	struct RFilterTable *next;
+} RFilterTable;
+
+static RFilterTable *filterTables = NULL;
+static pthread_mutex_t filterTablesLock = PTHREAD_MUTEX_INITIALIZER;
 
 /* clamp the input to the specified range */
 #define CLAMP(v,l,h)    ((v)<(l) ? (l) : (v) > (h) ? (h) : v)
 
-/* return of calloc is not checked if NULL in the function below! */
-RImage *RSmoothScaleImage(RImage * src, unsigned new_width, unsigned new_height)
+static RFilterTable *createFilterTable(unsigned src_size, unsigned dst_size)
 {
-	CLIST *contrib;			/* array of contribution lists */
-	RImage *tmp;		/* intermediate image */
-	double xscale, yscale;	/* zoom scale factors */
-	int i, j, k;		/* loop variables */
-	int n;			/* pixel number */
-	double center, left, right;	/* filter calculation variables */
-	double width, fscale;	/* filter calculation variables */
-	double rweight, gweight, bweight;
-	RImage *dst;
-	unsigned char *p;
-	unsigned char *sp;
-	int sch = src->format == RRGBAFormat ? 4 : 3;
-
-	dst = RCreateImage(new_width, new_height, False);
-
-	/* create intermediate image to hold horizontal zoom */
-	tmp = RCreateImage(dst->width, src->height, False);
-	xscale = (double)new_width / (double)src->width;
-	yscale = (double)new_height / (double)src->height;
-
-	/* pre-calculate filter contributions for a row */
-	contrib = (CLIST *) calloc(new_width, sizeof(CLIST));
-	if (xscale < 1.0) {
-		width = fwidth / xscale;
-		fscale = 1.0 / xscale;
-		for (i = 0; i < new_width; ++i) {
-			contrib[i].n = 0;
-			contrib[i].p = (CONTRIB *) calloc((int) ceil(width * 2 + 1), sizeof(CONTRIB));
-			center = (double)i / xscale;
-			left = ceil(center - width);
-			right = floor(center + width);
-			for (j = left; j <= right; ++j) {
-				rweight = center - (double)j;
-				rweight = (*filterf) (rweight / fscale) / fscale;
-				if (j < 0) {
-					n = -j;
-				} else if (j >= src->width) {
-					n = (src->width - j) + src->width - 1;
-				} else {
-					n = j;
-				}
-				k = contrib[i].n++;
-				contrib[i].p[k].pixel = n * sch;
-				contrib[i].p[k].weight = rweight;
-			}
-		}
+	RFilterTable *table;
+	double scale, width, fscale, center, *w;
+	int i, j, k, left, right;
+
+	table = malloc(sizeof(RFilterTable));
+	if (table == NULL)
+		return NULL;
+
+	scale = (double)dst_size / (double)src_size;
+	if (scale < 1.0) {
+		width = fwidth / scale;
+		fscale = 1.0 / scale;
 	} else {
+		width = fwidth;
+		fscale = 1.0;
+	}
 
-		for (i = 0; i < new_width; ++i) {
-			contrib[i].n = 0;
-			contrib[i].p = (CONTRIB *) calloc((int) ceil(fwidth * 2 + 1), sizeof(CONTRIB));
-			center = (double)i / xscale;
-			left = ceil(center - fwidth);
-			right = floor(center + fwidth);
-			for (j = left; j <= right; ++j) {
-				rweight = center - (double)j;
-				rweight = (*filterf) (rweight);
-				if (j < 0) {
-					n = -j;
-				} else if (j >= src->width) {
-					n = (src->width - j) + src->width - 1;
-				} else {
-					n = j;
-				}
-				k = contrib[i].n++;
-				contrib[i].p[k].pixel = n * sch;
-				contrib[i].p[k].weight = rweight;
-			}
+	table->src_size = src_size;
+	table->dst_size = dst_size;
+	table->filter = filter_type;
+	/* taps are processed in pairs, unused ones have a zero weight */
+	table->ntaps = ((int)ceil(width * 2 + 1) + 1) & ~1;
+	table->pixel = calloc((size_t)dst_size * table->ntaps, sizeof(int));
+	table->weight = calloc((size_t)dst_size * table->ntaps, sizeof(short));
+	w = malloc(table->ntaps * sizeof(double));
+	table->refcount = 1;
+	table->next = NULL;
+
+	if (!table->pixel || !table->weight || !w) {
+		free(table->pixel);
+		free(table->weight);
+		free(table);
+		free(w);
+		return NULL;
+	}
+
+	for (i = 0; i < dst_size; i++) {
+		int *pixel = table->pixel + i * table->ntaps;
+		short *weight = table->weight + i * table->ntaps;
+		double sum = 0;
+		int isum = 0, imax = 0;
+
+		center = (double)i / scale;
+		left = ceil(center - width);
+		right = floor(center + width);
+
+		for (j = left, k = 0; j <= right && k < table->ntaps; j++, k++) {
+			int n;
+
+			w[k] = (*filterf) ((center - (double)j) / fscale) / fscale;
+			sum += w[k];
+
+			/* mirror at the edges, clamp for tiny images */
+			if (j < 0)
+				n = -j;
+			else if (j >= src_size)
+				n = (src_size - j) + src_size - 1;
+			else
+				n = j;
+			pixel[k] = CLAMP(n, 0, (int)src_size - 1);
+		}
+
+		/* normalize so that flat areas keep their exact value */
+		for (j = 0; j < k; j++) {
+			weight[j] = (int)lround((fabs(sum) > 1.0E-9 ? w[j] / sum : w[j]) * WEIGHT_ONE);
+			isum += weight[j];
+			if (weight[j] > weight[imax])
+				imax = j;
 		}
+		if (k > 0)
+			weight[imax] += WEIGHT_ONE - isum;
 	}
+	free(w);
 
-	/* apply filter to zoom horizontally from src to tmp */
-	p = tmp->data;
+	return table;
+}
 
-	for (k = 0; k < tmp->height; ++k) {
-		CONTRIB *pp;
+static void releaseFilterTable(RFilterTable *table)
+{
+	if (--table->refcount > 0)
+		return;
 
-		sp = src->data + src->width * k * sch;
+	free(table->pixel);
+	free(table->weight);
+	free(table);
+}
 
-		for (i = 0; i < tmp->width; ++i) {
-			rweight = gweight = bweight = 0.0;
+/*
+ * Returns the table for scaling 'src_size' pixels to 'dst_size' pixels
+ * with the current filter, building it if needed. Release it with
+ * putFilterTable().
+ */
+static RFilterTable *getFilterTable(unsigned src_size, unsigned dst_size)
+{
+	RFilterTable *table, *prev = NULL;
+	int count = 0;
 
-			pp = contrib[i].p;
+	pthread_mutex_lock(&filterTablesLock);
 
-			for (j = 0; j < contrib[i].n; ++j) {
-				rweight += sp[pp[j].pixel] * pp[j].weight;
-				gweight += sp[pp[j].pixel + 1] * pp[j].weight;
-				bweight += sp[pp[j].pixel + 2] * pp[j].weight;
+	for (table = filterTables; table; prev = table, table = table->next, count++) {
+		if (table->src_size == src_size && table->dst_size == dst_size &&
+		    table->filter == filter_type)
+			break;
+	}
+
+	if (table) {
+		/* move to front */
+		if (prev) {
+			prev->next = table->next;
+			table->next = filterTables;
+			filterTables = table;
+		}
+	} else {
+		table = createFilterTable(src_size, dst_size);
+		if (table) {
+			table->next = filterTables;
+			filterTables = table;
+
+			/* drop the least recently used one */
+			if (count >= FILTER_CACHE_SIZE) {
+				for (prev = table; prev->next->next; prev = prev->next)
+					;
+				releaseFilterTable(prev->next);
+				prev->next = NULL;
 			}
-			*p++ = CLAMP(rweight, 0, 255);
-			*p++ = CLAMP(gweight, 0, 255);
-			*p++ = CLAMP(bweight, 0, 255);
 		}
 	}
 
-	/* free the memory allocated for horizontal filter weights */
-	for (i = 0; i < new_width; ++i) {
-		free(contrib[i].p);
+	if (table)
+		table->refcount++;
+
+	pthread_mutex_unlock(&filterTablesLock);
+
+	return table;
+}
+
+static void putFilterTable(RFilterTable *table)
+{
+	pthread_mutex_lock(&filterTablesLock);
+	releaseFilterTable(table);
+	pthread_mutex_unlock(&filterTablesLock);
+}
+
+void r_destroy_scale_tables(void)
+{
+	RFilterTable *table;
+
+	pthread_mutex_lock(&filterTablesLock);
+	while (filterTables) {
+		table = filterTables;
+		filterTables = table->next;
+		releaseFilterTable(table);
 	}
-	free(contrib);
-
-	/* pre-calculate filter contributions for a column */
-	contrib = (CLIST *) calloc(dst->height, sizeof(CLIST));
-	if (yscale < 1.0) {
-		width = fwidth / yscale;
-		fscale = 1.0 / yscale;
-		for (i = 0; i < dst->height; ++i) {
-			contrib[i].n = 0;
-			contrib[i].p = (CONTRIB *) calloc((int) ceil(width * 2 + 1), sizeof(CONTRIB));
-			center = (double)i / yscale;
-			left = ceil(center - width);
-			right = floor(center + width);
-			for (j = left; j <= right; ++j) {
-				rweight = center - (double)j;
-				rweight = (*filterf) (rweight / fscale) / fscale;
-				if (j < 0) {
-					n = -j;
-				} else if (j >= tmp->height) {
-					n = (tmp->height - j) + tmp->height - 1;
-				} else {
-					n = j;
-				}
-				k = contrib[i].n++;
-				contrib[i].p[k].pixel = n * 3;
-				contrib[i].p[k].weight = rweight;
+	pthread_mutex_unlock(&filterTablesLock);
+}
+
+/*
+ * Pixels go through the filter as 4 x 16 bit premultiplied values with 7
+ * fractional bits (0 .. 255 << 7), so one code path handles RGB and RGBA,
+ * transparent pixels do not bleed their color into visible ones, and two
+ * taps can be accumulated at once with a 16x16->32 bit multiply-add.
+ * Sums stay in an int: values are below 1 << 15, weights are at most
+ * WEIGHT_ONE and positive weights of a normalized filter add up to less
+ * than 2.
+ */
+#define PIXEL_BITS	7
+#define PIXEL_MAX	(255 << PIXEL_BITS)
+
+typedef struct {
+	RImage *src;
+	RImage *dst;
+	short *tmp;		/* horizontally scaled image */
+	RFilterTable *xtable;
+	RFilterTable *ytable;
+	int first;
+	int last;
+	Bool failed;		/* out of memory */
+} ScaleBand;
+
+static void loadRow(const RImage *src, int y, short *row)
+{
+	int x;
+
+	if (src->format == RRGBAFormat) {
+		const unsigned char *sp = src->data + (size_t)y * src->width * 4;
+
+		for (x = 0; x < src->width; x++, sp += 4, row += 4) {
+			unsigned a = sp[3];
+
+			if (a == 255) {
+				row[0] = sp[0] << PIXEL_BITS;
+				row[1] = sp[1] << PIXEL_BITS;
+				row[2] = sp[2] << PIXEL_BITS;
+			} else {
+				row[0] = (sp[0] * a * (1 << PIXEL_BITS) + 127) / 255;
+				row[1] = (sp[1] * a * (1 << PIXEL_BITS) + 127) / 255;
+				row[2] = (sp[2] * a * (1 << PIXEL_BITS) + 127) / 255;
 			}
+			row[3] = a << PIXEL_BITS;
 		}
 	} else {
-		for (i = 0; i < dst->height; ++i) {
-			contrib[i].n = 0;
-			contrib[i].p = (CONTRIB *) calloc((int) ceil(fwidth * 2 + 1), sizeof(CONTRIB));
-			center = (double)i / yscale;
-			left = ceil(center - fwidth);
-			right = floor(center + fwidth);
-			for (j = left; j <= right; ++j) {
-				rweight = center - (double)j;
-				rweight = (*filterf) (rweight);
-				if (j < 0) {
-					n = -j;
-				} else if (j >= tmp->height) {
-					n = (tmp->height - j) + tmp->height - 1;
-				} else {
-					n = j;
-				}
-				k = contrib[i].n++;
-				contrib[i].p[k].pixel = n * 3;
-				contrib[i].p[k].weight = rweight;
-			}
+		const unsigned char *sp = src->data + (size_t)y * src->width * 3;
+
+		for (x = 0; x < src->width; x++, sp += 3, row += 4) {
+			row[0] = sp[0] << PIXEL_BITS;
+			row[1] = sp[1] << PIXEL_BITS;
+			row[2] = sp[2] << PIXEL_BITS;
+			row[3] = PIXEL_MAX;
 		}
 	}
+}
 
-	/* apply filter to zoom vertically from tmp to dst */
-	sp = malloc(tmp->height * 3);
+#ifdef USE_SIMD_SCALE
+static void filterRow(const short *row, short *out, const RFilterTable *t)
+{
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i max = _mm_set1_epi16(PIXEL_MAX);
+	int x, j;
+
+	for (x = 0; x < t->dst_size; x++, out += 4) {
+		const int *pixel = t->pixel + x * t->ntaps;
+		const short *weight = t->weight + x * t->ntaps;
+		__m128i acc = _mm_set1_epi32(WEIGHT_ROUND), v, a;
+
+		for (j = 0; j < t->ntaps; j += 2) {
+			__m128i p0 = _mm_loadl_epi64((const __m128i *)(row + pixel[j] * 4));
+			__m128i p1 = _mm_loadl_epi64((const __m128i *)(row + pixel[j + 1] * 4));
+			int w;
+
+			memcpy(&w, weight + j, sizeof(w));
+			acc = _mm_add_epi32(acc, _mm_madd_epi16(_mm_unpacklo_epi16(p0, p1), _mm_set1_epi32(w)));
+		}
 
-	for (k = 0; k < new_width; ++k) {
-		CONTRIB *pp;
+		/* clamp alpha to [0, PIXEL_MAX] and colors to [0, alpha] */
+		v = _mm_packs_epi32(_mm_srai_epi32(acc, WEIGHT_BITS), zero);
+		v = _mm_max_epi16(v, zero);
+		a = _mm_min_epi16(_mm_shufflelo_epi16(v, 0xff), max);
+		_mm_storel_epi64((__m128i *)out, _mm_min_epi16(v, a));
+	}
+}
 
-		p = dst->data + k * 3;
+/* acc[i] += r0[i] * w0 + r1[i] * w1 */
+static void accumulateRows(int *acc, const short *r0, const short *r1, const short *w, int n)
+{
+	__m128i wp;
+	int i, pair;
+
+	memcpy(&pair, w, sizeof(pair));
+	wp = _mm_set1_epi32(pair);
+
+	for (i = 0; i + 8 <= n; i += 8) {
+		__m128i a = _mm_loadu_si128((const __m128i *)(r0 + i));
+		__m128i b = _mm_loadu_si128((const __m128i *)(r1 + i));
+		__m128i lo = _mm_loadu_si128((const __m128i *)(acc + i));
+		__m128i hi = _mm_loadu_si128((const __m128i *)(acc + i + 4));
+
+		lo = _mm_add_epi32(lo, _mm_madd_epi16(_mm_unpacklo_epi16(a, b), wp));
+		hi = _mm_add_epi32(hi, _mm_madd_epi16(_mm_unpackhi_epi16(a, b), wp));
+		_mm_storeu_si128((__m128i *)(acc + i), lo);
+		_mm_storeu_si128((__m128i *)(acc + i + 4), hi);
+	}
+	for (; i < n; i++)
+		acc[i] += r0[i] * w[0] + r1[i] * w[1];
+}
+#else
+static void filterRow(const short *row, short *out, const RFilterTable *t)
+{
+	int x, j;
 
-		/* copy a column into a row */
-		{
-			int i;
-			unsigned char *p, *d;
+	for (x = 0; x < t->dst_size; x++, out += 4) {
+		const int *pixel = t->pixel + x * t->ntaps;
+		const short *weight = t->weight + x * t->ntaps;
+		int r = WEIGHT_ROUND, g = WEIGHT_ROUND, b = WEIGHT_ROUND, a = WEIGHT_ROUND;
 
-			d = sp;
-			for (i = tmp->height, p = tmp->data + k * 3; i-- > 0; p += tmp->width * 3) {
-				*d++ = *p;
-				*d++ = *(p + 1);
-				*d++ = *(p + 2);
-			}
+		for (j = 0; j < t->ntaps; j++) {
+			const short *s = row + pixel[j] * 4;
+
+			r += s[0] * weight[j];
+			g += s[1] * weight[j];
+			b += s[2] * weight[j];
+			a += s[3] * weight[j];
 		}
-		for (i = 0; i < new_height; ++i) {
-			rweight = gweight = bweight = 0.0;
+		a >>= WEIGHT_BITS;
+		a = CLAMP(a, 0, PIXEL_MAX);
+		r >>= WEIGHT_BITS;
+		g >>= WEIGHT_BITS;
+		b >>= WEIGHT_BITS;
+		out[0] = CLAMP(r, 0, a);
+		out[1] = CLAMP(g, 0, a);
+		out[2] = CLAMP(b, 0, a);
+		out[3] = a;
+	}
+}
+
+static void accumulateRows(int *acc, const short *r0, const short *r1, const short *w, int n)
+{
+	int i;
+
+	for (i = 0; i < n; i++)
+		acc[i] += r0[i] * w[0] + r1[i] * w[1];
+}
+#endif
+
+static void *scaleRowsHorizontal(void *arg)
+{
+	ScaleBand *band = arg;
+	RFilterTable *t = band->xtable;
+	short *row;
+	int y;
+
+	row = malloc(band->src->width * 4 * sizeof(short));
+	if (row == NULL) {
+		band->failed = True;
+		return NULL;
+	}
+
+	for (y = band->first; y < band->last; y++) {
+		loadRow(band->src, y, row);
+		filterRow(row, band->tmp + (size_t)y * t->dst_size * 4, t);
+	}
+	free(row);
 
-			pp = contrib[i].p;
+	return NULL;
+}
+
+static void *scaleRowsVertical(void *arg)
+{
+	ScaleBand *band = arg;
+	RFilterTable *t = band->ytable;
+	int width = band->dst->width;
+	int has_alpha = (band->dst->format == RRGBAFormat);
+	int *acc;
+	int x, y, j;
+
+	acc = malloc(width * 4 * sizeof(int));
+	if (acc == NULL) {
+		band->failed = True;
+		return NULL;
+	}
+
+	for (y = band->first; y < band->last; y++) {
+		const int *pixel = t->pixel + y * t->ntaps;
+		const short *weight = t->weight + y * t->ntaps;
+		unsigned char *p = band->dst->data + (size_t)y * width * (has_alpha ? 4 : 3);
+
+		/* accumulate whole rows: sequential memory access */
+		for (x = 0; x < width * 4; x++)
+			acc[x] = WEIGHT_ROUND;
+		for (j = 0; j < t->ntaps; j += 2) {
+			if (weight[j] == 0 && weight[j + 1] == 0)
+				continue;
+			accumulateRows(acc,
+				       band->tmp + (size_t)pixel[j] * width * 4,
+				       band->tmp + (size_t)pixel[j + 1] * width * 4,
+				       weight + j, width * 4);
+		}
 
-			for (j = 0; j < contrib[i].n; ++j) {
-				rweight += sp[pp[j].pixel] * pp[j].weight;
-				gweight += sp[pp[j].pixel + 1] * pp[j].weight;
-				bweight += sp[pp[j].pixel + 2] * pp[j].weight;
+		for (x = 0; x < width; x++) {
+			const int *v = acc + x * 4;
+			int a, r, g, b;
+
+			a = v[3] >> WEIGHT_BITS;
+			a = CLAMP(a, 0, PIXEL_MAX);
+			r = v[0] >> WEIGHT_BITS;
+			r = CLAMP(r, 0, a);
+			g = v[1] >> WEIGHT_BITS;
+			g = CLAMP(g, 0, a);
+			b = v[2] >> WEIGHT_BITS;
+			b = CLAMP(b, 0, a);
+
+			if (!has_alpha) {
+				*p++ = (r + (1 << (PIXEL_BITS - 1))) >> PIXEL_BITS;
+				*p++ = (g + (1 << (PIXEL_BITS - 1))) >> PIXEL_BITS;
+				*p++ = (b + (1 << (PIXEL_BITS - 1))) >> PIXEL_BITS;
+			} else if (a == 0) {
+				*p++ = 0;
+				*p++ = 0;
+				*p++ = 0;
+				*p++ = 0;
+			} else {
+				/* un-premultiply with one division per pixel */
+				unsigned inv = ((255U << 16) + a / 2) / a;
+
+				*p++ = (r * inv + 0x8000) >> 16;
+				*p++ = (g * inv + 0x8000) >> 16;
+				*p++ = (b * inv + 0x8000) >> 16;
+				*p++ = (a + (1 << (PIXEL_BITS - 1))) >> PIXEL_BITS;
 			}
-			*p = CLAMP(rweight, 0, 255);
-			*(p + 1) = CLAMP(gweight, 0, 255);
-			*(p + 2) = CLAMP(bweight, 0, 255);
-			p += new_width * 3;
 		}
 	}
-	free(sp);
+	free(acc);
+
+	return NULL;
+}
+
+static int scaleThreadCount(unsigned rows, unsigned pixels)
+{
+	static int ncpu = -1;
+	int n;
+
+	if (ncpu < 0) {
+		char *tmp = getenv("WRASTER_SCALE_THREADS");
+
+		if (!tmp || sscanf(tmp, "%i", &ncpu) != 1)
+			ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+		ncpu = CLAMP(ncpu, 1, PARALLEL_MAX_THREADS);
+	}
+
+	if (pixels < PARALLEL_MIN_PIXELS)
+		return 1;
+
+	n = rows / PARALLEL_MIN_ROWS;
+	return CLAMP(n, 1, ncpu);
+}
+
+/*
+ * Run 'func' over 'rows' rows split into bands, on the calling thread plus
+ * up to PARALLEL_MAX_THREADS - 1 helpers. Returns False if a band failed.
+ */
+static Bool runBands(void *(*func)(void *), ScaleBand *proto, unsigned rows, int nthreads)
+{
+	Bool ok = True;
+	ScaleBand band[PARALLEL_MAX_THREADS];
+	pthread_t thread[PARALLEL_MAX_THREADS];
+	int started[PARALLEL_MAX_THREADS];
+	int i;
+
+	for (i = 0; i < nthreads; i++) {
+		band[i] = *proto;
+		band[i].first = rows * i / nthreads;
+		band[i].last = rows * (i + 1) / nthreads;
+		band[i].failed = False;
+		started[i] = 0;
+	}
+
+	for (i = 1; i < nthreads; i++)
+		started[i] = (pthread_create(&thread[i], NULL, func, &band[i]) == 0);
+
+	func(&band[0]);
+
+	for (i = 1; i < nthreads; i++) {
+		if (started[i])
+			pthread_join(thread[i], NULL);
+		else
+			func(&band[i]);
+	}
+
+	for (i = 0; i < nthreads; i++) {
+		if (band[i].failed)
+			ok = False;
+	}
+	return ok;
+}
+
+RImage *RSmoothScaleImage(RImage * src, unsigned new_width, unsigned new_height)
+{
+	RFilterTable *xtable, *ytable;
+	RImage *dst;
+	ScaleBand job;
+	int has_alpha = (src->format == RRGBAFormat);
+	int nthreads;
+	Bool ok;
+
+	dst = RCreateImage(new_width, new_height, has_alpha);
+	if (dst == NULL)
+		return NULL;
+
+	xtable = getFilterTable(src->width, new_width);
+	ytable = getFilterTable(src->height, new_height);
+
+	/* intermediate image holds the horizontal zoom */
+	job.tmp = malloc((size_t)new_width * src->height * 4 * sizeof(short));
+
+	if (!xtable || !ytable || !job.tmp) {
+		if (xtable)
+			putFilterTable(xtable);
+		if (ytable)
+			putFilterTable(ytable);
+		free(job.tmp);
+		RReleaseImage(dst);
+		RErrorCode = RERR_NOMEMORY;
+		return NULL;
+	}
+
+	job.src = src;
+	job.dst = dst;
+	job.xtable = xtable;
+	job.ytable = ytable;
+
+	nthreads = scaleThreadCount(src->height, new_width * src->height);
+	ok = runBands(scaleRowsHorizontal, &job, src->height, nthreads);
 
-	/* free the memory allocated for vertical filter weights */
-	for (i = 0; i < dst->height; ++i) {
-		free(contrib[i].p);
+	if (ok) {
+		nthreads = scaleThreadCount(new_height, new_width * new_height);
+		ok = runBands(scaleRowsVertical, &job, new_height, nthreads);
 	}
-	free(contrib);
 
-	RReleaseImage(tmp);
+	free(job.tmp);
+	putFilterTable(xtable);
+	putFilterTable(ytable);
+
+	if (!ok) {
+		RReleaseImage(dst);
+		RErrorCode = RERR_NOMEMORY;
+		return NULL;
+	}
 
 	return dst;
 }
@@ -26,5 +26,10 @@
  */
 void wraster_change_filter(RScalingFilter type);
 
+/*
+ * Function to release the cached filter tables
+ */
+void r_destroy_scale_tables(void);
+
 
 #endif
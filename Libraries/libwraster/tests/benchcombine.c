@@ -0,0 +1,109 @@
+/*
+ * Micro-benchmark for alpha compositing (RCombineArea and
+ * RCombineAreaWithOpaqueness) with every blend kernel available on
+ * this machine (selected through WRASTER_SIMD).
+ */
+#include "wraster.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* Icon-like image: transparent border, opaque body, soft edge in between */
+static RImage *makeIcon(unsigned size)
+{
+	RImage *img = RCreateImage(size, size, True);
+	unsigned char *p = img->data;
+	unsigned x, y;
+	int c = size / 2;
+
+	for (y = 0; y < size; y++) {
+		for (x = 0; x < size; x++) {
+			int dx = (int)x - c, dy = (int)y - c;
+			int r2 = dx * dx + dy * dy, inner = (c - 4) * (c - 4);
+
+			*p++ = x * 255 / size;
+			*p++ = y * 255 / size;
+			*p++ = 128;
+			*p++ = r2 < inner ? 255 : r2 < c * c ? 255 * (c * c - r2) / (c * c - inner) : 0;
+		}
+	}
+	return img;
+}
+
+static RImage *makeNoise(unsigned width, unsigned height)
+{
+	RImage *img = RCreateImage(width, height, True);
+	unsigned i;
+
+	for (i = 0; i < width * height * 4; i++)
+		img->data[i] = rand();
+	return img;
+}
+
+static void bench(const char *name, RImage *dst, RImage *src, int opacity, int iterations)
+{
+	double start, elapsed;
+	int i;
+
+	start = now();
+	for (i = 0; i < iterations; i++) {
+		if (opacity == 255)
+			RCombineArea(dst, src, 0, 0, src->width, src->height, 0, 0);
+		else
+			RCombineAreaWithOpaqueness(dst, src, 0, 0, src->width, src->height, 0, 0, opacity);
+	}
+	elapsed = now() - start;
+
+	printf("  %-28s %8.2f Mpixel/s\n", name,
+	       (double)src->width * src->height * iterations / elapsed / 1e6);
+}
+
+static void runBenchmarks(void)
+{
+	RImage *icon = makeIcon(64), *tile = makeNoise(64, 64);
+	RImage *big = makeNoise(1920, 1080), *bigdst = makeNoise(1920, 1080);
+
+	bench("64x64 icon on tile", tile, icon, 255, 50000);
+	bench("64x64 icon on tile, 50%", tile, icon, 128, 50000);
+	bench("1920x1080 noise", bigdst, big, 255, 50);
+	bench("1920x1080 noise, 80%", bigdst, big, 200, 50);
+
+	RReleaseImage(icon);
+	RReleaseImage(tile);
+	RReleaseImage(big);
+	RReleaseImage(bigdst);
+}
+
+int main(void)
+{
+	static const char *modes[] = { "none", "sse2", "avx2" };
+	unsigned i;
+
+	for (i = 0; i < sizeof(modes) / sizeof(modes[0]); i++) {
+		pid_t pid;
+
+		fflush(stdout);
+		pid = fork();
+
+		if (pid == 0) {
+			setenv("WRASTER_SIMD", modes[i], 1);
+			printf("%s:\n", modes[i]);
+			runBenchmarks();
+			exit(0);
+		}
+		waitpid(pid, NULL, 0);
+	}
+
+	return 0;
+}
@@ -0,0 +1,123 @@
+/*
+ * Benchmark for RConvertImage: cost per megapixel of converting an RImage
+ * to a Pixmap on the default visual, for every rendering mode, next to the
+ * per-pixel XPutPixel loop RConvertImage used to run on 24/32 bit visuals.
+ */
+#include <X11/Xlib.h>
+#include <X11/Xutil.h>
+#include "wraster.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <time.h>
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static RImage *makeImage(unsigned width, unsigned height, int alpha)
+{
+	RImage *img = RCreateImage(width, height, alpha);
+	unsigned i;
+
+	for (i = 0; i < width * height * (alpha ? 4 : 3); i++)
+		img->data[i] = rand();
+	return img;
+}
+
+static void benchConvert(Display *dpy, const char *name, RRenderingMode mode, RImage *img, int iterations)
+{
+	RContextAttributes attr;
+	RContext *ctx;
+	Pixmap pix;
+	double start;
+	int i;
+
+	attr.flags = RC_RenderMode;
+	attr.render_mode = mode;
+	ctx = RCreateContext(dpy, DefaultScreen(dpy), &attr);
+	if (!ctx) {
+		printf("  %-24s %s\n", name, RMessageForError(RErrorCode));
+		return;
+	}
+
+	start = now();
+	for (i = 0; i < iterations; i++) {
+		RConvertImage(ctx, img, &pix);
+		XFreePixmap(dpy, pix);
+	}
+	XSync(dpy, False);
+	printf("  %-24s %8.3f ms/Mpixel\n", name,
+	       (now() - start) * 1000 / iterations / (img->width * img->height / 1e6));
+
+	RDestroyContext(ctx);
+}
+
+/* what RConvertImage did before the direct 32 bpp path */
+static void benchPutPixel(Display *dpy, RImage *img, int iterations)
+{
+	int screen = DefaultScreen(dpy);
+	Visual *visual = DefaultVisual(dpy, screen);
+	int depth = DefaultDepth(dpy, screen);
+	int channels = img->format == RRGBAFormat ? 4 : 3;
+	XImage *ximg;
+	Pixmap pix;
+	GC gc = DefaultGC(dpy, screen);
+	double start;
+	int i, x, y;
+
+	ximg = XCreateImage(dpy, visual, depth, ZPixmap, 0, NULL, img->width, img->height, 8, 0);
+	ximg->data = malloc(ximg->bytes_per_line * img->height);
+
+	start = now();
+	for (i = 0; i < iterations; i++) {
+		unsigned char *ptr = img->data;
+
+		for (y = 0; y < img->height; y++) {
+			for (x = 0; x < img->width; x++, ptr += channels)
+				XPutPixel(ximg, x, y, (ptr[0] << 16) | (ptr[1] << 8) | ptr[2]);
+		}
+		pix = XCreatePixmap(dpy, RootWindow(dpy, screen), img->width, img->height, depth);
+		XPutImage(dpy, pix, gc, ximg, 0, 0, 0, 0, img->width, img->height);
+		XFreePixmap(dpy, pix);
+	}
+	XSync(dpy, False);
+	printf("  %-24s %8.3f ms/Mpixel\n", "XPutPixel loop",
+	       (now() - start) * 1000 / iterations / (img->width * img->height / 1e6));
+
+	XDestroyImage(ximg);
+}
+
+int main(void)
+{
+	Display *dpy;
+	RImage *img[2];
+	int i;
+
+	dpy = XOpenDisplay("");
+	if (!dpy) {
+		puts("cant open display");
+		exit(1);
+	}
+
+	img[0] = makeImage(1920, 1080, False);
+	img[1] = makeImage(1920, 1080, True);
+
+	for (i = 0; i < 2; i++) {
+		printf("1920x1080 %s, depth %i:\n", i ? "RGBA" : "RGB", DefaultDepth(dpy, DefaultScreen(dpy)));
+		if (DefaultDepth(dpy, DefaultScreen(dpy)) >= 24)
+			benchPutPixel(dpy, img[i], 20);
+		benchConvert(dpy, "best match", RBestMatchRendering, img[i], 20);
+		benchConvert(dpy, "Floyd-Steinberg dither", RDitheredRendering, img[i], 20);
+		benchConvert(dpy, "ordered dither", ROrderedRendering, img[i], 20);
+	}
+
+	RReleaseImage(img[0]);
+	RReleaseImage(img[1]);
+	XCloseDisplay(dpy);
+
+	return 0;
+}
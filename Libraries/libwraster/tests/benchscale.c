@@ -0,0 +1,127 @@
+/*
+ * Benchmark for RSmoothScaleImage with every filter that can be selected
+ * through wraster_change_filter, on a single thread and on the default
+ * number of threads (WRASTER_SCALE_THREADS), next to the previous
+ * implementation (see refscale.c). RScaleImage is given as the unfiltered
+ * baseline.
+ */
+#include "wraster.h"
+#include "scale.h"
+#include "refscale.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static RImage *makeImage(unsigned width, unsigned height, int alpha)
+{
+	RImage *img = RCreateImage(width, height, alpha);
+	unsigned char *p = img->data;
+	unsigned x, y;
+
+	for (y = 0; y < height; y++) {
+		for (x = 0; x < width; x++) {
+			*p++ = x * 255 / width;
+			*p++ = y * 255 / height;
+			*p++ = (x ^ y) & 0xff;
+			if (alpha)
+				*p++ = (x + y) & 0x80 ? 255 : x & 0xff;
+		}
+	}
+	return img;
+}
+
+static const struct {
+	const char *name;
+	RScalingFilter filter;
+} filters[] = {
+	{ "box", RBoxFilter },
+	{ "triangle", RTriangleFilter },
+	{ "bell", RBellFilter },
+	{ "bspline", RBSplineFilter },
+	{ "lanczos3", RLanczos3Filter },
+	{ "mitchell", RMitchellFilter }
+};
+
+static const struct {
+	const char *name;
+	unsigned sw, sh, dw, dh;
+	int alpha;
+	int iterations;
+} cases[] = {
+	{ "icon 128->64 RGBA", 128, 128, 64, 64, 1, 2000 },
+	{ "icon 48->64 RGBA", 48, 48, 64, 64, 1, 2000 },
+	{ "miniwindow 1280x1024->64 RGB", 1280, 1024, 64, 64, 0, 20 },
+	{ "wallpaper 2560x1600->1920x1080", 2560, 1600, 1920, 1080, 0, 3 }
+};
+
+static void runBenchmarks(void)
+{
+	unsigned c, f;
+	int i;
+
+	for (c = 0; c < sizeof(cases) / sizeof(cases[0]); c++) {
+		RImage *src = makeImage(cases[c].sw, cases[c].sh, cases[c].alpha);
+		double start;
+
+		printf("  %s\n", cases[c].name);
+
+		start = now();
+		for (i = 0; i < cases[c].iterations; i++)
+			RReleaseImage(RScaleImage(src, cases[c].dw, cases[c].dh));
+		printf("    %-10s %10.3f ms\n", "(nearest)", (now() - start) * 1000 / cases[c].iterations);
+
+		for (f = 0; f < sizeof(filters) / sizeof(filters[0]); f++) {
+			double current, previous;
+
+			wraster_change_filter(filters[f].filter);
+			start = now();
+			for (i = 0; i < cases[c].iterations; i++)
+				RReleaseImage(RSmoothScaleImage(src, cases[c].dw, cases[c].dh));
+			current = (now() - start) * 1000 / cases[c].iterations;
+
+			refChangeFilter(filters[f].filter);
+			start = now();
+			for (i = 0; i < cases[c].iterations; i++)
+				RReleaseImage(refSmoothScaleImage(src, cases[c].dw, cases[c].dh));
+			previous = (now() - start) * 1000 / cases[c].iterations;
+
+			printf("    %-10s %10.3f ms  (previous %10.3f ms, x%.1f)\n", filters[f].name,
+			       current, previous, previous / current);
+		}
+		RReleaseImage(src);
+	}
+}
+
+int main(void)
+{
+	static const char *threads[] = { "1", NULL };
+	unsigned i;
+
+	for (i = 0; i < sizeof(threads) / sizeof(threads[0]); i++) {
+		pid_t pid;
+
+		fflush(stdout);
+		pid = fork();
+		if (pid == 0) {
+			if (threads[i])
+				setenv("WRASTER_SCALE_THREADS", threads[i], 1);
+			printf("%s thread(s):\n", threads[i] ? threads[i] : "default");
+			runBenchmarks();
+			exit(0);
+		}
+		waitpid(pid, NULL, 0);
+	}
+
+	return 0;
+}
@@ -0,0 +1,10 @@
+/*
+ * Previous RSmoothScaleImage, see refscale.c
+ */
+#ifndef REFSCALE_H_
+#define REFSCALE_H_
+
+void refChangeFilter(RScalingFilter type);
+RImage *refSmoothScaleImage(RImage *src, unsigned new_width, unsigned new_height);
+
+#endif
@@ -0,0 +1,95 @@
+/*
+ * Exercises the RLoadImage cache: hits, LRU eviction under the byte
+ * budget and invalidation of entries whose file changed.
+ */
+#include "wraster.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+static int failures = 0;
+
+/* PPM loading does not need a display */
+static RContext ctx;
+
+#define CHECK(cond) do { \
+	if (!(cond)) { printf("  failed: %s (line %i)\n", #cond, __LINE__); failures++; } \
+} while (0)
+
+static void writePPM(const char *path, int size, int value)
+{
+	FILE *f = fopen(path, "wb");
+	int i;
+
+	fprintf(f, "P6\n%i %i\n255\n", size, size);
+	for (i = 0; i < size * size * 3; i++)
+		fputc(value, f);
+	fclose(f);
+}
+
+static int firstPixel(RImage *img)
+{
+	int value = img ? img->data[0] : -1;
+
+	if (img)
+		RReleaseImage(img);
+	return value;
+}
+
+int main(void)
+{
+	RImageCacheStats st;
+	char path[4][64];
+	int i;
+
+	/* 3 images of 32x32 RGB fit, the 4th one does not */
+	setenv("RIMAGE_CACHE", "16", 1);
+	setenv("RIMAGE_CACHE_BYTES", "9216", 1);
+
+	for (i = 0; i < 4; i++) {
+		snprintf(path[i], sizeof(path[i]), "/tmp/wraster-testcache-%i-%i.ppm", (int)getpid(), i);
+		writePPM(path[i], 32, 10 + i);
+	}
+
+	CHECK(firstPixel(RLoadImage(&ctx, path[0], 0)) == 10);
+	CHECK(firstPixel(RLoadImage(&ctx, path[0], 0)) == 10);
+	RGetImageCacheStats(&st);
+	CHECK(st.hits == 1 && st.misses == 1 && st.entries == 1);
+	CHECK(st.bytes == 32 * 32 * 3);
+
+	/* same file, another index is another entry */
+	CHECK(firstPixel(RLoadImage(&ctx, path[0], 1)) == 10);
+	RGetImageCacheStats(&st);
+	CHECK(st.misses == 2 && st.entries == 2);
+
+	/* touch path[0] so path[1] becomes least recently used, then overflow */
+	CHECK(firstPixel(RLoadImage(&ctx, path[1], 0)) == 11);
+	RGetImageCacheStats(&st);
+	CHECK(st.evictions == 0 && st.entries == 3);
+	CHECK(firstPixel(RLoadImage(&ctx, path[0], 0)) == 10);
+	CHECK(firstPixel(RLoadImage(&ctx, path[0], 1)) == 10);
+	CHECK(firstPixel(RLoadImage(&ctx, path[2], 0)) == 12);
+	RGetImageCacheStats(&st);
+	CHECK(st.evictions == 1 && st.entries == 3 && st.bytes <= st.max_bytes);
+	CHECK(firstPixel(RLoadImage(&ctx, path[0], 0)) == 10);
+	RGetImageCacheStats(&st);
+	CHECK(st.evictions == 1);
+
+	/* rewriting the file must not return the stale image */
+	sleep(st.notify ? 0 : 1);
+	writePPM(path[0], 32, 99);
+	CHECK(firstPixel(RLoadImage(&ctx, path[0], 0)) == 99);
+	RGetImageCacheStats(&st);
+	CHECK(st.invalidations >= 1);
+
+	printf("image cache (%s): hits=%lu misses=%lu evictions=%lu invalidations=%lu\n",
+	       st.notify ? "inotify" : "stat", st.hits, st.misses, st.evictions, st.invalidations);
+
+	RShutdown();
+	for (i = 0; i < 4; i++)
+		unlink(path[i]);
+
+	printf("%s\n", failures ? "FAILED" : "ok");
+	return failures ? 1 : 0;
+}
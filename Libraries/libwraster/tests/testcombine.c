@@ -0,0 +1,167 @@
+/*
+ * Checks that RCombineAlpha() produces exactly the same bytes as the
+ * original one-pixel-at-a-time implementation, for every blend kernel
+ * available on this machine (selected through WRASTER_SIMD).
+ */
+#include "wraster.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+static void refCombineAlpha(unsigned char *d, unsigned char *s, int s_has_alpha,
+			    int width, int height, int dwi, int swi, int opacity)
+{
+	int x, y;
+	int t, sa;
+	int alpha;
+	float ratio, cratio;
+
+	for (y=0; y<height; y++) {
+		for (x=0; x<width; x++) {
+			sa=s_has_alpha?*(s+3):255;
+
+			if (opacity!=255) {
+				t = sa * opacity + 0x80;
+				sa = ((t>>8)+t)>>8;
+			}
+
+			t = *(d+3) * (255-sa) + 0x80;
+			alpha = sa + (((t>>8)+t)>>8);
+
+			if (sa==0 || alpha==0) {
+				ratio = 0;
+				cratio = 1.0;
+			} else if(sa == alpha) {
+				ratio = 1.0;
+				cratio = 0;
+			} else {
+				ratio = (float)sa / alpha;
+				cratio = 1.0F - ratio;
+			}
+
+			*d = (int)*d * cratio + (int)*s * ratio;
+			s++; d++;
+			*d = (int)*d * cratio + (int)*s * ratio;
+			s++; d++;
+			*d = (int)*d * cratio + (int)*s * ratio;
+			s++; d++;
+			*d = alpha;
+			d++;
+
+			if (s_has_alpha) s++;
+		}
+		d+=dwi;
+		s+=swi;
+	}
+}
+
+/* Source alpha pattern: 0 = random, 1 = mostly clear/opaque like icons */
+static void fill(unsigned char *p, int size, int pattern)
+{
+	int i;
+
+	for (i = 0; i < size; i++)
+		p[i] = rand() & 0xff;
+
+	if (pattern == 1) {
+		for (i = 3; i < size; i += 4) {
+			int r = rand() % 16;
+
+			p[i] = (r < 7) ? 0 : (r < 14) ? 255 : p[i];
+		}
+	}
+}
+
+static int runChecks(void)
+{
+	static const int widths[] = { 1, 3, 4, 7, 8, 15, 16, 17, 64, 333 };
+	static const int opacities[] = { 255, 0, 1, 128, 200, 254 };
+	int failures = 0;
+	unsigned w, o, pattern, has_alpha;
+
+	srand(1);
+	for (w = 0; w < sizeof(widths) / sizeof(widths[0]); w++)
+	for (o = 0; o < sizeof(opacities) / sizeof(opacities[0]); o++)
+	for (pattern = 0; pattern < 2; pattern++)
+	for (has_alpha = 0; has_alpha < 2; has_alpha++) {
+		int width = widths[w], height = 5;
+		int dwi = 4 * 3, swi = (has_alpha ? 4 : 3) * 2;
+		int dsize = (width * 4 + dwi) * height;
+		int ssize = (width * (has_alpha ? 4 : 3) + swi) * height;
+		unsigned char *s = malloc(ssize);
+		unsigned char *d1 = malloc(dsize);
+		unsigned char *d2 = malloc(dsize);
+
+		fill(s, ssize, pattern);
+		fill(d1, dsize, pattern);
+		memcpy(d2, d1, dsize);
+
+		refCombineAlpha(d1, s, has_alpha, width, height, dwi, swi, opacities[o]);
+		RCombineAlpha(d2, s, has_alpha, width, height, dwi, swi, opacities[o]);
+
+		if (memcmp(d1, d2, dsize) != 0) {
+			printf("  mismatch: width=%i opacity=%i pattern=%u alpha=%u\n",
+			       width, opacities[o], pattern, has_alpha);
+			failures++;
+		}
+		free(s);
+		free(d1);
+		free(d2);
+	}
+
+	/* Exhaustive over (source alpha, destination alpha, opacity) */
+	{
+		unsigned char s[256 * 4], d1[256 * 4], d2[256 * 4];
+		int sa, op, i;
+
+		for (op = 0; op < 256; op++) {
+			for (sa = 0; sa < 256; sa++) {
+				for (i = 0; i < 256; i++) {
+					s[i * 4] = rand(); s[i * 4 + 1] = rand(); s[i * 4 + 2] = rand();
+					s[i * 4 + 3] = sa;
+					d1[i * 4] = rand(); d1[i * 4 + 1] = rand(); d1[i * 4 + 2] = rand();
+					d1[i * 4 + 3] = i;
+				}
+				memcpy(d2, d1, sizeof(d1));
+				refCombineAlpha(d1, s, 1, 256, 1, 0, 0, op);
+				RCombineAlpha(d2, s, 1, 256, 1, 0, 0, op);
+				if (memcmp(d1, d2, sizeof(d1)) != 0) {
+					printf("  mismatch: source alpha=%i opacity=%i\n", sa, op);
+					failures++;
+				}
+			}
+		}
+	}
+
+	return failures;
+}
+
+int main(void)
+{
+	static const char *modes[] = { "none", "sse2", "avx2" };
+	int status = 0;
+	unsigned i;
+
+	for (i = 0; i < sizeof(modes) / sizeof(modes[0]); i++) {
+		pid_t pid;
+
+		fflush(stdout);
+		pid = fork();
+		int result;
+
+		if (pid == 0) {
+			/* blend kernel is selected on first use, so pick it per child */
+			setenv("WRASTER_SIMD", modes[i], 1);
+			exit(runChecks() ? 1 : 0);
+		}
+		waitpid(pid, &result, 0);
+		printf("RCombineAlpha [%s]: %s\n", modes[i],
+		       (WIFEXITED(result) && WEXITSTATUS(result) == 0) ? "ok" : "FAILED");
+		if (!WIFEXITED(result) || WEXITSTATUS(result) != 0)
+			status = 1;
+	}
+
+	return status;
+}
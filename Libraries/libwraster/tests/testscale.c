@@ -0,0 +1,178 @@
+/*
+ * Checks RSmoothScaleImage against the previous implementation (see
+ * refscale.c) on opaque images, for every filter, scaling up and down, on
+ * a single thread and on the default number of threads
+ * (WRASTER_SCALE_THREADS). Also checks that flat images, alpha included,
+ * keep their exact value.
+ */
+#include "wraster.h"
+#include "scale.h"
+#include "refscale.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+/*
+ * Largest difference allowed for a channel, and on average: the previous
+ * implementation truncates twice (8-bit intermediate image and result),
+ * the new one rounds once.
+ */
+#define MAX_DIFFERENCE	2
+#define MEAN_DIFFERENCE	1.25
+
+static const struct {
+	const char *name;
+	RScalingFilter filter;
+} filters[] = {
+	{ "box", RBoxFilter },
+	{ "triangle", RTriangleFilter },
+	{ "bell", RBellFilter },
+	{ "bspline", RBSplineFilter },
+	{ "lanczos3", RLanczos3Filter },
+	{ "mitchell", RMitchellFilter }
+};
+
+static const struct {
+	unsigned sw, sh, dw, dh;
+} sizes[] = {
+	{ 128, 128, 64, 64 },
+	{ 48, 48, 64, 64 },
+	{ 100, 37, 33, 90 },
+	{ 640, 480, 61, 47 },
+	{ 64, 64, 64, 64 },
+	{ 33, 17, 131, 67 }
+};
+
+/* Smooth gradients with some detail, alpha is opaque */
+static RImage *makeImage(unsigned width, unsigned height, int alpha)
+{
+	RImage *img = RCreateImage(width, height, alpha);
+	unsigned char *p = img->data;
+	unsigned x, y;
+
+	for (y = 0; y < height; y++) {
+		for (x = 0; x < width; x++) {
+			*p++ = x * 255 / width;
+			*p++ = y * 255 / height;
+			*p++ = ((x / 4 + y / 4) & 1) ? 200 : 60;
+			if (alpha)
+				*p++ = 255;
+		}
+	}
+	return img;
+}
+
+static int compare(RImage *img, RImage *ref, const char *what)
+{
+	int ch = img->format == RRGBAFormat ? 4 : 3;
+	unsigned i, count = img->width * img->height;
+	int d, max = 0;
+	double total = 0;
+
+	for (i = 0; i < count; i++) {
+		int c;
+
+		for (c = 0; c < 3; c++) {
+			d = abs(img->data[i * ch + c] - ref->data[i * 3 + c]);
+			total += d;
+			if (d > max)
+				max = d;
+		}
+		if (ch == 4 && img->data[i * 4 + 3] != 255) {
+			printf("FAILED: %s: alpha %d at %u\n", what, img->data[i * 4 + 3], i);
+			return 1;
+		}
+	}
+	if (max > MAX_DIFFERENCE || total / (count * 3) > MEAN_DIFFERENCE) {
+		printf("FAILED: %s: largest difference %d, mean %.3f\n", what, max,
+		       total / (count * 3));
+		return 1;
+	}
+	return 0;
+}
+
+static int checkFlat(unsigned sw, unsigned sh, unsigned dw, unsigned dh, const char *what)
+{
+	static const unsigned char color[4] = { 17, 128, 250, 77 };
+	RImage *src = RCreateImage(sw, sh, True);
+	RImage *dst;
+	unsigned i;
+	int errors = 0;
+
+	for (i = 0; i < sw * sh * 4; i++)
+		src->data[i] = color[i % 4];
+	dst = RSmoothScaleImage(src, dw, dh);
+	for (i = 0; i < dw * dh * 4; i++) {
+		if (dst->data[i] != color[i % 4]) {
+			printf("FAILED: %s: flat image changed to %d at %u\n", what, dst->data[i], i);
+			errors++;
+			break;
+		}
+	}
+	RReleaseImage(dst);
+	RReleaseImage(src);
+	return errors;
+}
+
+static int runChecks(void)
+{
+	unsigned f, s;
+	int alpha, errors = 0;
+	char what[128];
+
+	for (f = 0; f < sizeof(filters) / sizeof(filters[0]); f++) {
+		wraster_change_filter(filters[f].filter);
+		refChangeFilter(filters[f].filter);
+
+		for (s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+			for (alpha = 0; alpha <= 1; alpha++) {
+				RImage *src = makeImage(sizes[s].sw, sizes[s].sh, alpha);
+				RImage *img = RSmoothScaleImage(src, sizes[s].dw, sizes[s].dh);
+				RImage *ref = refSmoothScaleImage(src, sizes[s].dw, sizes[s].dh);
+
+				snprintf(what, sizeof(what), "%s %ux%u->%ux%u %s", filters[f].name,
+					 sizes[s].sw, sizes[s].sh, sizes[s].dw, sizes[s].dh,
+					 alpha ? "RGBA" : "RGB");
+				errors += compare(img, ref, what);
+
+				RReleaseImage(ref);
+				RReleaseImage(img);
+				RReleaseImage(src);
+			}
+			snprintf(what, sizeof(what), "%s %ux%u->%ux%u flat", filters[f].name,
+				 sizes[s].sw, sizes[s].sh, sizes[s].dw, sizes[s].dh);
+			errors += checkFlat(sizes[s].sw, sizes[s].sh, sizes[s].dw, sizes[s].dh, what);
+		}
+	}
+	return errors;
+}
+
+int main(void)
+{
+	static const char *threads[] = { "1", NULL };
+	int status = 0;
+	unsigned i;
+
+	for (i = 0; i < sizeof(threads) / sizeof(threads[0]); i++) {
+		pid_t pid;
+		int result;
+
+		fflush(stdout);
+		pid = fork();
+		if (pid == 0) {
+			/* thread count is read on first use, so set it per child */
+			if (threads[i])
+				setenv("WRASTER_SCALE_THREADS", threads[i], 1);
+			exit(runChecks() ? 1 : 0);
+		}
+		waitpid(pid, &result, 0);
+		printf("RSmoothScaleImage [%s thread(s)]: %s\n", threads[i] ? threads[i] : "default",
+		       (WIFEXITED(result) && WEXITSTATUS(result) == 0) ? "ok" : "FAILED");
+		if (!WIFEXITED(result) || WEXITSTATUS(result) != 0)
+			status = 1;
+	}
+
+	return status;
+}
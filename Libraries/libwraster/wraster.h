@@ -97,7 +97,7 @@
 extern "C" {
 #endif /* __cplusplus */
 
-/* RBestMatchRendering or RDitheredRendering */
+/* RBestMatchRendering, RDitheredRendering or ROrderedRendering */
 #define RC_RenderMode 		(1<<0)
 
 /* number of colors per channel for colormap in PseudoColor mode */
@@ -125,8 +125,9 @@ extern "C" {
 
 /* image display modes */
 typedef enum {
-	RDitheredRendering = 0,
-	RBestMatchRendering = 1
+	RDitheredRendering = 0,	/* Floyd-Steinberg error diffusion */
+	RBestMatchRendering = 1,	/* no dithering */
+	ROrderedRendering = 2		/* ordered dithering, TrueColor only */
 } RRenderingMode;
 
 
@@ -268,6 +269,22 @@ typedef struct RXImage {
 } RXImage;
 
 
+/*
+ * counters of the RLoadImage cache, see RGetImageCacheStats()
+ */
+typedef struct RImageCacheStats {
+    unsigned long hits;		       /* lookups answered from the cache */
+    unsigned long misses;	       /* lookups that loaded the file */
+    unsigned long evictions;	       /* entries dropped to make room */
+    unsigned long invalidations;       /* entries dropped because file changed */
+    unsigned entries;		       /* images currently cached */
+    int max_entries;
+    size_t bytes;		       /* pixel data currently cached */
+    size_t max_bytes;		       /* 0 = no limit */
+    int notify;			       /* True if inotify tracks changes */
+} RImageCacheStats;
+
+
 /* note that not all operations are supported in all functions */
 typedef enum {
     RClearOperation,	       /* clear with 0 */
@@ -380,6 +397,9 @@ RImage *RCreateImageFromDrawable(RContext *context, Drawable drawable,
 RImage *RLoadImage(RContext *context, const char *file, int index)
         __wrlib_useresult __wrlib_nonalias __wrlib_nonnull(1, 2);
 
+void RGetImageCacheStats(RImageCacheStats *stats)
+        __wrlib_nonnull(1);
+
 RImage* RRetainImage(RImage *image);
 
 void RReleaseImage(RImage *image)